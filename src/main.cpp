@@ -25,6 +25,10 @@
 // NVS for storing MAC addresses
 #include <Preferences.h>
 
+#include <array>
+#include <atomic>
+#include <cmath>
+
 // Touchscreen pins
 #define XPT2046_IRQ 36
 #define XPT2046_MOSI 32
@@ -33,93 +37,980 @@
 #define XPT2046_CS 33
 
 SPIClass touchscreenSPI = SPIClass(VSPI);
-XPT2046_Touchscreen touchscreen(XPT2046_CS, XPT2046_IRQ);
+XPT2046_Touchscreen touchscreen(XPT2046_CS);  // PENIRQ is handled here, not by the library
 
 #define SCREEN_WIDTH 240
 #define SCREEN_HEIGHT 320
 
-int x, y, z;
+// Touch pipeline: the PENIRQ edge wakes a sampler task, which reads the panel
+// only while it is pressed, filters and calibrates the samples and hands them
+// to LVGL through a single-producer/single-consumer ring buffer.
+#define TOUCH_SAMPLE_PERIOD_MS 5
+#define TOUCH_MIN_PRESSURE 400   // Same Z threshold the XPT2046 library uses for touched()
+#define TOUCH_RELEASE_SAMPLES 3  // Samples in a row below TOUCH_MIN_PRESSURE that end a press
+#define TOUCH_THROW_READ_MS 33   // LVGL's indev read period, kept up after a release for the scroll throw
+#define TOUCH_THROW_MAX_MS 1000
+#define TOUCH_IIR_SHIFT 1        // IIR weight of a new sample: 1 / 2^TOUCH_IIR_SHIFT
+#define TOUCH_RING_SIZE 16       // Power of two
+
+struct TouchPoint {
+  int16_t x;
+  int16_t y;
+  int16_t rawX;   // Filtered panel reading before calibration, for the calibration screen
+  int16_t rawY;
+  bool pressed;
+};
+
+TouchPoint touchRing[TOUCH_RING_SIZE];
+std::atomic<uint32_t> touchRingHead(0);  // Written by the sampler task only
+std::atomic<uint32_t> touchRingTail(0);  // Written by loop() only
+TouchPoint touchLast = {};               // Last point handed to LVGL, read by loop() only
+TaskHandle_t touchTaskHandle = nullptr;
+lv_indev_t * touchIndev = nullptr;
+lv_timer_t * touchThrowTimer = nullptr;  // Runs after a release, see touchThrowRead()
+unsigned long touchReleaseMillis = 0;
+
+// Affine raw-to-screen calibration: x = a*rx + b*ry + c, y = d*rx + e*ry + f
+struct TouchCalibration {
+  float a, b, c, d, e, f;
+};
+
+// Matches the old map(p.x, 200, 3700, 1, 240) / map(p.y, 240, 3800, 1, 320)
+constexpr TouchCalibration TOUCH_DEFAULT_CALIBRATION = { 239.0f / 3500, 0, 1 - 200 * 239.0f / 3500,
+                                                         0, 319.0f / 3560, 1 - 240 * 319.0f / 3560 };
+
+// In use: loaded with the settings, replaced by the calibration screen. The
+// sampler task copies it under the mux when a press starts.
+TouchCalibration touchCalibration = TOUCH_DEFAULT_CALIBRATION;
+portMUX_TYPE touchCalibrationMux = portMUX_INITIALIZER_UNLOCKED;
+
+// Median of the last three raw samples rejects single-sample spikes, then a
+// first-order IIR smooths the remaining jitter. No hardware access.
+struct TouchFilter {
+  int16_t histX[3];
+  int16_t histY[3];
+  uint8_t count = 0;  // Samples since the press started, saturates at 3
+  uint8_t next = 0;
+  int32_t iirX = 0;   // 1/16 raw units
+  int32_t iirY = 0;
+  
+  static int16_t median3(int16_t a, int16_t b, int16_t c) {
+    return max(min(a, b), min(max(a, b), c));
+  }
+  
+  void reset() {
+    count = 0;
+    next = 0;
+  }
+  
+  void update(int16_t rawX, int16_t rawY, int16_t& outX, int16_t& outY) {
+    histX[next] = rawX;
+    histY[next] = rawY;
+    next = (next + 1) % 3;
+    if (count < 3) count++;
+    
+    int16_t mx = rawX;
+    int16_t my = rawY;
+    if (count >= 3) {
+      mx = median3(histX[0], histX[1], histX[2]);
+      my = median3(histY[0], histY[1], histY[2]);
+    }
+    
+    // The first sample of a press seeds the IIR
+    if (count == 1) {
+      iirX = mx << 4;
+      iirY = my << 4;
+    } else {
+      iirX += ((mx << 4) - iirX) >> TOUCH_IIR_SHIFT;
+      iirY += ((my << 4) - iirY) >> TOUCH_IIR_SHIFT;
+    }
+    outX = (iirX + 8) >> 4;
+    outY = (iirY + 8) >> 4;
+  }
+};
+
+// Display driver. With DISPLAY_DMA_FLUSH, LVGL renders the next band into one
+// draw buffer while DMA pushes the other to the panel; 0 falls back to LVGL's
+// blocking TFT_eSPI driver with a single buffer.
+#ifndef DISPLAY_DMA_FLUSH
+#define DISPLAY_DMA_FLUSH 1
+#endif
+#ifndef DRAW_BUF_DIVISOR
+#define DRAW_BUF_DIVISOR 10  // Each draw buffer holds 1/DRAW_BUF_DIVISOR of the screen
+#endif
 
-#define DRAW_BUF_SIZE (SCREEN_WIDTH * SCREEN_HEIGHT / 10 * (LV_COLOR_DEPTH / 8))
+#define DRAW_BUF_SIZE (SCREEN_WIDTH * SCREEN_HEIGHT / DRAW_BUF_DIVISOR * (LV_COLOR_DEPTH / 8))
 uint32_t draw_buf[DRAW_BUF_SIZE / 4];
+#if DISPLAY_DMA_FLUSH
+uint32_t draw_buf2[DRAW_BUF_SIZE / 4];
+TFT_eSPI tft = TFT_eSPI(SCREEN_WIDTH, SCREEN_HEIGHT);
+#endif
 
 // Global variables
 lv_obj_t * main_screen;
-lv_obj_t * bluetooth_screen;
-lv_obj_t * stored_devices_screen;  // ADDED: Stored devices screen
+lv_obj_t * bluetooth_screen = nullptr;       // Built on first visit, see show_bluetooth_screen()
+lv_obj_t * stored_devices_screen = nullptr;  // Built on first visit, see show_stored_devices_screen()
+lv_obj_t * calibration_screen = nullptr;     // Built on first visit, see show_touch_calibration_screen()
 lv_obj_t * status_indicator;  // ADDED: Status indicator circle
 
+// Delete the Bluetooth and stored devices screens when the user leaves them;
+// their view model keeps what they show for the next visit
+#ifndef LAZY_SCREEN_TEARDOWN
+#define LAZY_SCREEN_TEARDOWN 1
+#endif
+
+// Relay board frame: header, relay channel, state (0x01 ON / 0x00 OFF), checksum.
+// The checksum is the low byte of the sum of the first three bytes.
+#define RELAY_FRAME_HEADER 0xA0
+#define RELAY_MAX 6                 // Relay buttons the main screen has room for
+#define RELAY_COLUMNS 3
+#define RELAY_ACTIVE_PEER -1        // RelayDescriptor::target: whichever peer is active
+
+typedef std::array<uint8_t, 4> RelayFrame;
+
+// The one relay frame encoder; constexpr so the defaults are checked at build time
+constexpr RelayFrame makeRelayFrame(uint8_t channel, bool on, uint8_t header = RELAY_FRAME_HEADER) {
+  return RelayFrame{{ header, channel, (uint8_t)(on ? 0x01 : 0x00),
+                      (uint8_t)(header + channel + (on ? 0x01 : 0x00)) }};
+}
+
+// Frame bytes packed big-endian, so a frame reads like the board's hex command string
+constexpr uint32_t relayFramePacked(const RelayFrame& f) {
+  return ((uint32_t)f[0] << 24) | ((uint32_t)f[1] << 16) | ((uint32_t)f[2] << 8) | f[3];
+}
+
+// Stored peers, by target index (see the peer registry below)
+#define STORED_PEER_MAX 8           // Target masks (targeted scan, reconnect) are 8 bits wide
+
+// Relay table: one descriptor per main screen button, so adding a relay is a
+// table entry rather than code. Only a table that differs from
+// RELAY_DEFAULT_CONFIG is kept in the settings blob; an empty stored table
+// means the compiled default, so a new default reaches panels that never changed it.
+struct RelayDescriptor {
+  char label[12];                   // Button text
+  uint8_t channel;                  // Board channel; a stored peer's relay map may override it
+  uint8_t header;                   // Frame template: first byte of makeRelayFrame()
+  int8_t target;                    // Stored peer index, or RELAY_ACTIVE_PEER
+};
+
+struct RelayConfig {
+  uint8_t count;
+  RelayDescriptor relays[RELAY_MAX];
+};
+
+// The six buttons of the original screen. Relay5 and Relay6 are placeholders
+// that drive channel 1, as their handlers did; a stored table can point them elsewhere.
+constexpr RelayConfig RELAY_DEFAULT_CONFIG = { 6, {
+  { "Relay1", 1, RELAY_FRAME_HEADER, RELAY_ACTIVE_PEER },
+  { "Relay2", 2, RELAY_FRAME_HEADER, RELAY_ACTIVE_PEER },
+  { "Relay3", 3, RELAY_FRAME_HEADER, RELAY_ACTIVE_PEER },
+  { "Relay4", 4, RELAY_FRAME_HEADER, RELAY_ACTIVE_PEER },
+  { "Relay5", 1, RELAY_FRAME_HEADER, RELAY_ACTIVE_PEER },
+  { "Relay6", 1, RELAY_FRAME_HEADER, RELAY_ACTIVE_PEER },
+} };
+
+RelayConfig relayConfig = RELAY_DEFAULT_CONFIG;
+
+// A relay table read from NVS is only used if every entry can be sent
+constexpr bool relayConfigValid(const RelayConfig& config) {
+  if (config.count > RELAY_MAX) return false;
+  for (int relay = 0; relay < config.count; relay++) {
+    const RelayDescriptor& d = config.relays[relay];
+    bool terminated = false;
+    for (char c : d.label) terminated |= (c == 0);
+    if (!terminated || d.channel == 0) return false;
+    if (d.target != RELAY_ACTIVE_PEER && (d.target < 0 || d.target >= STORED_PEER_MAX)) return false;
+  }
+  return true;
+}
+
+bool relayConfigIsDefault(const RelayConfig& config) {
+  return memcmp(&config, &RELAY_DEFAULT_CONFIG, sizeof(config)) == 0;
+}
+
+constexpr uint32_t relayDefaultFrame(int relay, bool on) {
+  return relayFramePacked(makeRelayFrame(RELAY_DEFAULT_CONFIG.relays[relay].channel, on,
+                                         RELAY_DEFAULT_CONFIG.relays[relay].header));
+}
+
+// Build-time check that the default table encodes to the board's documented commands
+static_assert(relayConfigValid(RELAY_DEFAULT_CONFIG), "RELAY_DEFAULT_CONFIG");
+static_assert(relayDefaultFrame(0, true) == 0xA00101A2, "Relay1 ON frame");
+static_assert(relayDefaultFrame(0, false) == 0xA00100A1, "Relay1 OFF frame");
+static_assert(relayDefaultFrame(1, true) == 0xA00201A3, "Relay2 ON frame");
+static_assert(relayDefaultFrame(1, false) == 0xA00200A2, "Relay2 OFF frame");
+static_assert(relayDefaultFrame(2, true) == 0xA00301A4, "Relay3 ON frame");
+static_assert(relayDefaultFrame(2, false) == 0xA00300A3, "Relay3 OFF frame");
+static_assert(relayDefaultFrame(3, true) == 0xA00401A5, "Relay4 ON frame");
+static_assert(relayDefaultFrame(3, false) == 0xA00400A4, "Relay4 OFF frame");
+static_assert(relayDefaultFrame(4, true) == 0xA00101A2, "Relay5 ON frame (placeholder)");
+static_assert(relayDefaultFrame(4, false) == 0xA00100A1, "Relay5 OFF frame (placeholder)");
+static_assert(relayDefaultFrame(5, true) == 0xA00101A2, "Relay6 ON frame (placeholder)");
+static_assert(relayDefaultFrame(5, false) == 0xA00100A1, "Relay6 OFF frame (placeholder)");
+
+// Relay status frames, notified by the board on FFE1 in the command frame layout.
+// A frame for one channel (1-8) echoes that channel's state; a frame for
+// RELAY_STATUS_ALL carries every channel at once, bit n-1 = channel n.
+// RELAY_QUERY_FRAME asks for one full report, so a re-sync is a single write.
+//
+// Only the command frames above come from the board's command list (they are
+// the hex strings the relay handlers always sent). The status side is not
+// documented anywhere this firmware has: the echo and the 0xFF query/report
+// are assumed from boards of this family answering a command with the same
+// frame. So the model only acts on notifications that parse as such frames, a
+// board is queried only once it has sent one (StoredPeer::reportsStatus), and a
+// board that never does is driven by the frames this firmware wrote alone.
+#define RELAY_STATUS_ALL 0xFF
+#define RELAY_STATUS_CHANNELS 8
+
+constexpr RelayFrame RELAY_QUERY_FRAME = makeRelayFrame(RELAY_STATUS_ALL, false);
+static_assert(relayFramePacked(RELAY_QUERY_FRAME) == 0xA0FF009F, "Relay status query frame");
+static_assert(RELAY_MAX <= 8, "Relay state is kept as one bit per relay in a uint8_t");
+
+// Parse a notification into the channels it reports (known) and their states (on).
+// One notification may carry several frames; malformed frames are skipped.
+// Returns the number of frames used.
+constexpr int relayParseStatus(const uint8_t* data, size_t length, uint8_t& known, uint8_t& on) {
+  int frames = 0;
+  known = 0;
+  on = 0;
+  for (size_t i = 0; i + sizeof(RelayFrame) <= length; i += sizeof(RelayFrame)) {
+    const uint8_t* f = data + i;
+    if (f[0] != RELAY_FRAME_HEADER || (uint8_t)(f[0] + f[1] + f[2]) != f[3]) continue;
+    
+    if (f[1] == RELAY_STATUS_ALL) {
+      known = 0xFF;
+      on = f[2];
+    } else if (f[1] >= 1 && f[1] <= RELAY_STATUS_CHANNELS) {
+      uint8_t bit = 1 << (f[1] - 1);
+      known |= bit;
+      on = f[2] ? (on | bit) : (on & ~bit);
+    } else {
+      continue;
+    }
+    frames++;
+  }
+  return frames;
+}
+
+// Parse result packed as known << 8 | on, the form it travels in a link event
+constexpr uint16_t relayParseStatusPacked(const uint8_t* data, size_t length) {
+  uint8_t known = 0, on = 0;
+  relayParseStatus(data, length, known, on);
+  return (known << 8) | on;
+}
+
+constexpr uint8_t RELAY_STATUS_SAMPLE[] = { 0xA0, 0xFF, 0x05, 0xA4,    // Full report: channels 1 and 3 ON
+                                            0xA0, 0x02, 0x01, 0xA3,    // Echo: channel 2 ON
+                                            0xA0, 0x04, 0x01, 0x00 };  // Bad checksum
+static_assert(relayParseStatusPacked(RELAY_STATUS_SAMPLE, 4) == 0xFF05, "Full status report");
+static_assert(relayParseStatusPacked(RELAY_STATUS_SAMPLE + 4, 4) == 0x0202, "Channel echo");
+static_assert(relayParseStatusPacked(RELAY_STATUS_SAMPLE, sizeof(RELAY_STATUS_SAMPLE)) == 0xFF07,
+              "Frames batched in one notification, malformed frame skipped");
+
+// Bluetooth device address as a 6-byte value, most significant byte first (the
+// order it is printed in and the order of esp_bd_addr_t). All zeros = unset.
+struct MacAddress {
+  uint8_t bytes[6] = {};
+  
+  struct Text {
+    char chars[18];
+    const char* c_str() const { return chars; }
+  };
+  
+  static constexpr int hexValue(char c) {
+    return (c >= '0' && c <= '9') ? c - '0' :
+           (c >= 'a' && c <= 'f') ? c - 'a' + 10 :
+           (c >= 'A' && c <= 'F') ? c - 'A' + 10 : -1;
+  }
+  
+  // "aa:bb:cc:dd:ee:ff" in either case; unset if the text is malformed
+  static constexpr MacAddress parse(const char* text) {
+    MacAddress mac;
+    for (int i = 0; i < 6; i++) {
+      const char* p = text + i * 3;
+      int hi = hexValue(p[0]);
+      int lo = (hi < 0) ? -1 : hexValue(p[1]);
+      if (lo < 0 || p[2] != (i < 5 ? ':' : '\0')) return MacAddress();
+      mac.bytes[i] = (uint8_t)((hi << 4) | lo);
+    }
+    return mac;
+  }
+  
+  static constexpr MacAddress fromPacked(uint64_t value) {
+    MacAddress mac;
+    for (int i = 5; i >= 0; i--) {
+      mac.bytes[i] = (uint8_t)value;
+      value >>= 8;
+    }
+    return mac;
+  }
+  
+  // 48-bit integer form, used as the advertiser table key
+  constexpr uint64_t packed() const {
+    uint64_t value = 0;
+    for (int i = 0; i < 6; i++) {
+      value = (value << 8) | bytes[i];
+    }
+    return value;
+  }
+  
+  constexpr bool isSet() const { return packed() != 0; }
+  constexpr bool operator==(const MacAddress& other) const { return packed() == other.packed(); }
+  constexpr bool operator!=(const MacAddress& other) const { return packed() != other.packed(); }
+  
+  // "aa:bb:cc:dd:ee:ff", as BLEAddress::toString() prints it
+  constexpr Text toString() const {
+    Text text{};
+    for (int i = 0; i < 6; i++) {
+      text.chars[i * 3] = "0123456789abcdef"[bytes[i] >> 4];
+      text.chars[i * 3 + 1] = "0123456789abcdef"[bytes[i] & 0x0F];
+      text.chars[i * 3 + 2] = (i < 5) ? ':' : '\0';
+    }
+    return text;
+  }
+};
+
+static_assert(sizeof(MacAddress) == 6, "MacAddress is stored in NVS as a 6-byte blob");
+static_assert(MacAddress::parse("B4:52:A9:B0:0F:BB").packed() == 0xB452A9B00FBBull, "MAC parse");
+static_assert(MacAddress::parse("b4:52:a9:b0:0f:bb") == MacAddress::parse("B4:52:A9:B0:0F:BB"), "MAC parse case");
+static_assert(!MacAddress::parse("B4:52:A9:B0:0F").isSet(), "Truncated MAC is unset");
+static_assert(!MacAddress::parse("B4:52:A9:B0:0F:BB:").isSet(), "Trailing text is unset");
+static_assert(!MacAddress::parse("00:00:00:00:00:00").isSet(), "All-zero MAC is unset");
+static_assert(MacAddress::parse(MacAddress::fromPacked(0xB452A9B00FBBull).toString().chars).packed() == 0xB452A9B00FBBull,
+              "MAC format round trip");
+
+// Stored peer registry: the relay boards this panel connects to by MAC, each with
+// its cached FFE1 handle and relay channel map. An entry keeps its index (the
+// target number in the UI and its hello message) for life; forgetting a peer only
+// unsets its address. NVS holds the used prefix as one versioned blob, so boot
+// reads every peer with a single getBytes() however many are stored.
+#define PEER_REGISTRY_VERSION 1
+
+struct StoredPeer {
+  MacAddress address;               // Unset = free entry
+  char name[20];
+  uint16_t charHandle;              // Cached FFE1 handle, 0 = discover on connect
+  uint8_t charProperties;           // ESP_GATT_CHAR_PROP_BIT_* of FFE1
+  bool reportsStatus;               // Has sent a relay status frame: re-synced with a query on connect
+  uint8_t relayChannel[RELAY_MAX];  // Board channel of each relay button, 0 = the relay table's
+};
+
+struct PeerRegistry {
+  uint8_t version = PEER_REGISTRY_VERSION;
+  uint8_t count = 0;                // Entries past count are free
+  StoredPeer peers[STORED_PEER_MAX] = {};
+};
+
+static_assert(STORED_PEER_MAX <= 8, "Target masks are 8 bits wide");
+
+PeerRegistry peerRegistry;
+
+// Sent by each target once its link is ready; the boards key on these
+const char* const PEER_HELLO[STORED_PEER_MAX] = {
+  "CONNECTED", "CONNECTED_TO_TARGET2", "CONNECTED_TO_TARGET3", "CONNECTED_TO_TARGET4",
+  "CONNECTED_TO_TARGET5", "CONNECTED_TO_TARGET6", "CONNECTED_TO_TARGET7", "CONNECTED_TO_TARGET8"
+};
+
+// Target index of a stored peer, -1 if it is not stored
+int peerRegistryFind(const MacAddress& address) {
+  if (!address.isSet()) return -1;
+  for (int target = 0; target < peerRegistry.count; target++) {
+    if (peerRegistry.peers[target].address == address) return target;
+  }
+  return -1;
+}
+
+// Fill a registry entry with a peer, no cached handle and no relay channel overrides
+void peerRegistrySet(int target, const MacAddress& address, const char* name) {
+  StoredPeer& peer = peerRegistry.peers[target];
+  peer = StoredPeer();
+  peer.address = address;
+  strlcpy(peer.name, name, sizeof(peer.name));
+  if (target >= peerRegistry.count) peerRegistry.count = target + 1;
+}
+
 // BLE Variables
 BLEScan* pBLEScan;
-BLEClient* pClient = nullptr;
-BLEAddress* serverAddress = nullptr;
-BLERemoteCharacteristic* pRemoteCharacteristic = nullptr;
 bool isScanning = false;
-bool isConnected = false;
-String connectedDeviceName = "";
-String connectedDeviceAddress = "";
+
+// Connection state machine. Connect and discovery run on the BLE worker task;
+// loop() receives its progress as events and owns every state change.
+enum BleLinkState {
+  LINK_IDLE,
+  LINK_CONNECTING,
+  LINK_DISCOVERING,
+  LINK_READY,
+  LINK_DISCONNECTING
+};
+
+enum BleLinkEventType {
+  LINK_EVT_CONNECT_REQUESTED,
+  LINK_EVT_LINK_UP,
+  LINK_EVT_READY,
+  LINK_EVT_FAILED,
+  LINK_EVT_TIMEOUT,
+  LINK_EVT_DISCONNECT_REQUESTED,
+  LINK_EVT_DISCONNECTED,
+  LINK_EVT_HANDLE_INVALID,    // A write to a cached handle was rejected by the peer
+  LINK_EVT_WRITE_FAILED,      // The stack refused a write posted to the worker
+  LINK_EVT_LINK_LOST,         // The peer dropped the link (BLEClientCallbacks::onDisconnect)
+  LINK_EVT_TARGET_SCAN_DONE,  // Targeted scan finished; slot = wanted target mask, handle = found mask
+  LINK_EVT_RELAY_STATUS       // Relay status notification; handle = reported channel mask << 8 | on mask
+};
+
+struct BleLinkEvent {
+  BleLinkEventType type;
+  int slot;                                  // Connection pool slot
+  uint32_t attempt;                          // Events from stale attempts are discarded
+  BLEClient* client;                         // Handed over with LINK_EVT_READY
+  BLERemoteCharacteristic* characteristic;  // nullptr when discovery was skipped
+  uint16_t handle;
+  char reason[32];
+  uint32_t postedMicros;                     // For the link-loss latency metric
+};
+
+// BLE worker: one task pinned to the BLE core makes every call into the BLE
+// library. loop() posts commands and consumes the results as link events and
+// scan results, so radio latency never lands inside a UI frame.
+enum BleCommandType {
+  BLE_CMD_SCAN_START,
+  BLE_CMD_SCAN_STOP,
+  BLE_CMD_SCAN_CLEAR,       // Free the stack's copy of the last scan's results
+  BLE_CMD_CONNECT,
+  BLE_CMD_WRITE,
+  BLE_CMD_DISCONNECT,
+  BLE_CMD_TARGET_SCAN,      // Short whitelist-filtered scan for stored targets (reconnect policy)
+  BLE_CMD_SUBSCRIBE         // Enable relay status notifications on FFE1
+};
+
+#define BLE_CORE 0                   // Same core as the BLE controller and host tasks
+#define BLE_COMMAND_QUEUE_LENGTH 16
+#define BLE_WRITE_QUEUE_LENGTH 16    // BLE_CMD_WRITE only, served ahead of the command queue
+#define BLE_COMMAND_DATA_MAX 32      // Largest write: a full relay batch or a text message
+
+struct BleCommand {
+  BleCommandType type;
+  int slot;                 // Pool slot; TARGET_SCAN: mask of wanted targets
+  uint32_t attempt;
+  MacAddress address;       // CONNECT, SUBSCRIBE
+  MacAddress targetAddress[STORED_PEER_MAX];  // TARGET_SCAN, by target index
+  uint16_t cachedHandle;    // CONNECT: 0 = run full discovery
+  BLEClient* client;        // CONNECT: set to rediscover on an existing link; WRITE, DISCONNECT, SUBSCRIBE
+  BLERemoteCharacteristic* characteristic;  // SUBSCRIBE: discovered FFE1, nullptr for a cached handle
+  uint16_t connId;          // WRITE, SUBSCRIBE
+  uint16_t handle;          // WRITE, SUBSCRIBE
+  bool response;            // WRITE: acknowledged write
+  uint8_t length;           // WRITE
+  uint8_t data[BLE_COMMAND_DATA_MAX];
+};
+
+static_assert(RELAY_MAX * sizeof(RelayFrame) <= BLE_COMMAND_DATA_MAX,
+              "A full relay batch must fit in one BLE_CMD_WRITE");
+
+#define CONNECT_TIMEOUT_MS 5000       // Passed to BLEClient::connect()
+#define PHASE_TIMEOUT_MARGIN_MS 1000  // Grace on top of the stack's own connect timeout
+#define DISCOVERY_TIMEOUT_MS 5000
+#define LINK_EVENT_QUEUE_LENGTH 8
+
+// Connection pool: one entry per peer, so several stored peers can stay
+// connected at the same time. The relay buttons drive the active peer.
+#define MAX_PEER_LINKS 3
+
+// Relay command pipeline. Taps arriving within the window after a write are
+// queued and flushed together when it closes.
+#define RELAY_COALESCE_WINDOW_MS 30
+#define RELAY_BATCH_WRITES 1          // 0 = one frame per GATT write
+#define ATT_WRITE_OVERHEAD 3          // ATT opcode + handle; the rest of the MTU is payload
+#define RELAY_WRITE_CREDITS 4         // Unacknowledged relay writes allowed in flight
+#define WRITE_CREDIT_TIMEOUT_MS 500   // Reclaim credits whose completion never arrived
+#define RELAY_CONFIRM_TIMEOUT_MS 300  // Query a reporting board that has not confirmed a tap by then
+
+struct BlePeerLink {
+  bool inUse = false;
+  MacAddress address;
+  char name[32];
+  const char* hello = nullptr;                        // String literal, sent once the link is ready
+  BLEClient* client = nullptr;
+  BLERemoteCharacteristic* characteristic = nullptr;  // nullptr when the handle came from the cache
+  uint16_t charHandle = 0;                            // FFE1 attribute handle used for every write
+  uint8_t charProperties = 0;                         // ESP_GATT_CHAR_PROP_BIT_* of FFE1, 0 if unknown
+  uint16_t connId = 0;
+  BleLinkState state = LINK_IDLE;
+  uint32_t attempt = 0;
+  unsigned long phaseStartMillis = 0;
+  unsigned long attemptStartMillis = 0;
+  unsigned long lastUsedMillis = 0;
+  bool handleFromCache = false;
+  bool firstWritePending = false;
+  uint32_t writeCount = 0;                            // Health counters
+  uint32_t writeFailures = 0;
+  
+  // Outgoing relay frames, at most one per board channel (a newer frame replaces the queued one)
+  RelayFrame relayQueue[RELAY_MAX];
+  uint8_t relayQueueLength = 0;
+  uint32_t relayQueuedMicros = 0;                     // When the queue last went from empty to non-empty
+  unsigned long relayLastFlushMillis = 0;
+  uint32_t relayFramesQueued = 0;                     // Pipeline counters
+  uint32_t relayFramesCoalesced = 0;
+  uint32_t relayWrites = 0;
+  uint32_t relayFramesDropped = 0;                    // Frames whose write was refused
+  
+  // Relay state model: desired is what the buttons asked for (bit per relay button),
+  // confirmed is what the board last reported (bit n-1 per board channel n)
+  bool relayModelValid = false;                       // Seeded by a tap or a status report
+  uint8_t relayDesired = 0;
+  uint8_t relayPending = 0;                           // Relays whose desired state is not confirmed yet
+  uint8_t relayConfirmed = 0;
+  uint8_t relayConfirmedKnown = 0;                    // Channels the board has reported at all
+  bool relayTapSinceQuery = false;
+  unsigned long relayLastTapMillis = 0;
+  uint32_t relayLastTapMicros = 0;
+  uint32_t relayStatusReports = 0;                    // Sync counters
+  uint32_t relayQueries = 0;
+  uint32_t relayMissedWrites = 0;
+  
+  // Write flow control: each write takes a credit, its ESP_GATTC_WRITE_CHAR_EVT returns it.
+  // Updated from the BTC task as well, so only touched under bleWriteCreditMux.
+  volatile uint8_t writesInFlight = 0;
+  volatile bool congested = false;
+  unsigned long lastWriteMillis = 0;
+  uint32_t creditStalls = 0;
+};
+
+BlePeerLink peerLinks[MAX_PEER_LINKS];
+int activePeer = -1;                                  // Pool slot the relay buttons write to
+lv_obj_t * relayButtons[RELAY_MAX];                 // Main screen relay buttons, by relay index
+uint8_t relayShown = 0;                               // Checked state of relayButtons, bit per relay
+portMUX_TYPE bleWriteCreditMux = portMUX_INITIALIZER_UNLOCKED;
+QueueHandle_t linkEventQueue = nullptr;
+volatile uint32_t linkEventsDropped = 0;           // BTC task events lost to a full linkEventQueue
+uint32_t linkEventsDroppedReported = 0;
+QueueHandle_t bleCommandQueue = nullptr;
+QueueHandle_t bleWriteQueue = nullptr;
+uint32_t nextLinkAttempt = 0;
 
 // Device storage
-struct BLEDeviceInfo {
-  String name;
-  String address;
+// Advertiser table: every device heard while scanning, keyed by its 48-bit
+// address packed into a uint64_t. Fixed capacity with open addressing, so a
+// scan updates entries in place (smoothed RSSI, last seen) without allocating.
+// Entries not heard for ADVERTISER_AGE_OUT_MS are dropped when a scan starts;
+// when the table is full a new address evicts an entry (advertiserVictim()).
+#define ADVERTISER_SLOT_BITS 9
+#define ADVERTISER_SLOTS (1 << ADVERTISER_SLOT_BITS)
+#define ADVERTISER_MAX 384             // Hundreds of advertisers; keeps the load factor at or below 75%
+#define ADVERTISER_RSSI_SHIFT 2        // EWMA weight of a new RSSI sample: 1/4
+#define ADVERTISER_AGE_OUT_MS 60000
+
+struct Advertiser {
+  uint64_t address = 0;           // 0 = free slot
+  char name[32];                  // Empty until the device sends one
+  int16_t rssiQ4;                 // Smoothed RSSI in 1/16 dB
+  uint8_t revision;               // Bumped when the shown name, dB value or target tag changes
+  uint16_t position;              // Index in advertiserList
+  unsigned long lastSeenMillis;
+};
+
+Advertiser advertiserSlots[ADVERTISER_SLOTS];
+uint16_t advertiserList[ADVERTISER_MAX];  // Slots in discovery order; this is the device list
+int advertiserCount = 0;
+uint32_t advertiserEvictions = 0;        // In the current scan
+int selectedDeviceIdx = -1;              // Position in advertiserList
+
+// Asynchronous scan: onResult() runs on the BLE host task and hands results
+// to the UI loop through a bounded queue
+#define SCAN_DURATION_S 5
+#define SCAN_QUEUE_LENGTH 32
+#define SCAN_DRAIN_PER_LOOP 16  // Results merged into the advertiser table per loop() pass
+
+struct ScanResultMsg {
+  char name[32];
+  MacAddress address;
   int rssi;
-  bool isTarget1;
-  bool isTarget2;
+  uint32_t receivedMicros;  // For the scan-to-list latency metric
+};
+
+QueueHandle_t scanResultQueue = nullptr;
+volatile bool scanCompleted = false;
+volatile bool listScanRunning = false;  // Set by the worker while BLEScan runs a list scan
+bool scanAfterProbe = false;            // Scan requested during a reconnect probe
+volatile uint32_t scanDroppedResults = 0;
+unsigned long scanStartMillis = 0;
+unsigned long scanFirstResultMillis = 0;
+unsigned long scanLastDrainMillis = 0;
+unsigned long scanMaxLoopGapMs = 0;
+
+// Device list: virtualized. Only DEVICE_LIST_POOL_ROWS row buttons exist; as the
+// list scrolls they are moved and rebound to advertiserList entries.
+#define DEVICE_LIST_HEADER_H 24
+#define DEVICE_LIST_ROW_H 30
+#define DEVICE_LIST_ROW_PITCH 34  // Row height + gap
+#define DEVICE_LIST_POOL_ROWS 6   // Rows visible in the 120 px container, plus one partly scrolled in at each end
+
+// Bluetooth screen view model: what the screen shows. It outlives the widgets,
+// so a screen rebuilt after teardown comes back in the same state.
+struct BluetoothViewModel {
+  String status = "Status: Disconnected";
+  String selected = "Selected: None";
+  const char* placeholder = "Devices will appear here";  // nullptr while device rows show
+};
+
+// Widgets of the lazily built screens; all nullptr while the screen does not exist
+struct BluetoothScreenWidgets {
+  lv_obj_t* deviceList = nullptr;
+  lv_obj_t* deviceListSpacer = nullptr;                   // Sizes the scrollable area to the whole list
+  lv_obj_t* deviceListRows[DEVICE_LIST_POOL_ROWS] = {};
+  int deviceListRowIndex[DEVICE_LIST_POOL_ROWS] = {};     // advertiserList position bound to each row, -1 = unbound
+  uint8_t deviceListRowRevision[DEVICE_LIST_POOL_ROWS] = {};  // Advertiser revision the row text shows
+  lv_obj_t* selectedDeviceLabel = nullptr;
+  lv_obj_t* connectionStatusLabel = nullptr;
+  lv_obj_t* scanButtonLabel = nullptr;
+  lv_obj_t* scanPlaceholderLabel = nullptr;
 };
 
-std::vector<BLEDeviceInfo> bleDevices;
-int selectedDeviceIdx = -1;
+struct StoredScreenWidgets {
+  lv_obj_t* statusLabels[STORED_PEER_MAX] = {};  // By target index, nullptr for free entries
+};
 
-// Stored devices (Target1 and Target2)
-BLEDeviceInfo storedDevices[2];  // Index 0: Target1, Index 1: Target2
+// Touch calibration screen: one target at a time, and the raw readings of the
+// targets tapped so far
+#define CALIBRATION_POINTS 3
+struct CalibrationScreenWidgets {
+  lv_obj_t* marker = nullptr;
+  lv_obj_t* prompt = nullptr;
+  int step = 0;                  // Target being shown
+  int16_t rawX[CALIBRATION_POINTS] = {};
+  int16_t rawY[CALIBRATION_POINTS] = {};
+};
 
-// UI elements
-lv_obj_t* deviceList;
-lv_obj_t* selectedDeviceLabel;
-lv_obj_t* connectionStatusLabel;
-lv_obj_t* target1StatusLabel;  // ADDED: Target1 status label
-lv_obj_t* target2StatusLabel;  // ADDED: Target2 status label
+BluetoothViewModel btView;
+BluetoothScreenWidgets btUi;
+StoredScreenWidgets storedUi;
+CalibrationScreenWidgets calibrationUi;
 
 // Your BLE Service and Characteristic UUIDs
 #define SERVICE_UUID        "0000FFE0-0000-1000-8000-00805F9B34FB"
 #define CHARACTERISTIC_UUID "0000FFE1-0000-1000-8000-00805F9B34FB"
 
-// Default MAC addresses (used if nothing is stored in NVS)
-#define DEFAULT_TARGET_DEVICE_ADDRESS "B4:52:A9:B0:0F:BB"
-#define DEFAULT_TARGET2_DEVICE_ADDRESS "00:00:00:00:00:00"
+// Default Target1 MAC (used if nothing is stored in NVS)
+constexpr MacAddress DEFAULT_TARGET1_MAC = MacAddress::parse("B4:52:A9:B0:0F:BB");
+static_assert(DEFAULT_TARGET1_MAC.isSet(), "Default Target1 MAC must parse");
 
 // NVS Preferences
 Preferences preferences;
 #define NVS_NAMESPACE "ble_storage"
+#define SETTINGS_KEY "settings"
+#define HANDLE_CACHE_KEY "handles"
+// Keys of the original firmware, folded into the settings blob on first boot
 #define TARGET1_MAC_KEY "target1_mac"
 #define TARGET2_MAC_KEY "target2_mac"
-#define AUTOCONNECT_ENABLED_KEY "auto_connect"  // CHANGED: Shortened key name
-
-// Current MAC addresses from NVS
-String storedTarget1MAC = "";
-String storedTarget2MAC = "";
+#define AUTOCONNECT_ENABLED_KEY "auto_connect"
 
 // Auto-connect state
 bool autoConnectEnabled = true;  // ADDED: Default to enabled
 
+// Settings store. autoConnectEnabled, touchCalibration, relayConfig and
+// peerRegistry are the RAM mirror; setters change them and mark the mirror dirty, and an LVGL timer
+// commits SETTINGS_COMMIT_DELAY_MS after the last change (a shutdown handler
+// covers restarts). A commit writes one versioned blob in one Preferences
+// session, so click handlers never wait on flash and a burst costs one write.
+#define SETTINGS_VERSION 1
+#define SETTINGS_COMMIT_DELAY_MS 2000
+
+struct SettingsRecord {
+  uint8_t version;
+  bool autoConnect;
+  TouchCalibration touch;        // Written by the calibration screen
+  RelayConfig relays;
+  PeerRegistry peers;            // Last, so the blob ends after the used entries
+};
+
+// Cached FFE1 handles of peers that are not stored (stored peers keep theirs in
+// the registry). A RAM mirror of its own blob, loaded with the settings and
+// committed with them; most recently saved first, so a full cache replaces the
+// entry saved longest ago.
+#define HANDLE_CACHE_MAX 8
+
+struct HandleCacheEntry {
+  MacAddress address;
+  uint32_t entry;                // (properties << 16) | handle
+};
+
+bool settingsDirty = false;
+HandleCacheEntry handleCache[HANDLE_CACHE_MAX];
+uint8_t handleCacheCount = 0;
+bool handleCacheDirty = false;
+lv_timer_t * settingsTimer = nullptr;
+uint32_t settingsChanges = 0;    // Since boot, for the write-coalescing ratio
+uint32_t settingsCommits = 0;
+
+// Main loop scheduler: loop() sleeps until the next LVGL timer or BLE deadline
+// is due, and the BLE and touch tasks wake it early when they post work
+#define LOOP_MAX_SLEEP_MS 500
+#define LINK_POLL_PERIOD_MS 2000   // Lost-link backstop for a missed disconnect callback, runs as an LVGL timer
+
+TaskHandle_t loopTaskHandle = nullptr;
+uint32_t loopTimerWakeups = 0;   // Woke because a deadline came due
+uint32_t loopEventWakeups = 0;   // Woken early by a BLE task
+
+// Wake loop() from a BLE or touch task (task context only, not from an ISR)
+void wakeMainLoop() {
+  if (loopTaskHandle) xTaskNotifyGive(loopTaskHandle);
+}
+
+// Boot pipeline: setup() brings up the display and main screen on the loop core
+// while bleWorkerTask() initializes the BLE stack on the other one. Auto-connect
+// starts from loop() as soon as the stack reports ready.
+TaskHandle_t bleWorkerHandle = nullptr;
+volatile bool bleStackReady = false;  // Set by bleWorkerTask(); no BLE commands before this
+bool bootAutoConnectPending = false;
+bool bootLinkReadyLogged = false;
+
+// Hand a command to the BLE worker; false if the queue stayed full for the whole wait.
+// Writes have their own queue, which the worker serves first.
+bool blePostCommand(const BleCommand& cmd, TickType_t wait = 0) {
+  QueueHandle_t queue = (cmd.type == BLE_CMD_WRITE) ? bleWriteQueue : bleCommandQueue;
+  if (xQueueSend(queue, &cmd, wait) != pdTRUE) {
+    Serial.println(cmd.type == BLE_CMD_WRITE ? "ERROR: BLE write queue full" : "ERROR: BLE command queue full");
+    return false;
+  }
+  if (bleWorkerHandle) xTaskNotifyGive(bleWorkerHandle);
+  return true;
+}
+
+// Boot phase timestamp, in ms since reset
+void bootMark(const char* phase) {
+  Serial.printf("Boot: %-18s %6lu ms\n", phase, millis());
+}
+
+// Targeted scan: the controller's whitelist filter passes only the stored
+// targets' advertisements, so the host sees nothing else. The scan is passive
+// (a MAC needs no scan response) and the GAP hook ends it as soon as every
+// wanted target has been seen.
+#define TARGET_SCAN_DURATION_S 2
+#define TARGET_SCAN_INTERVAL 0x50  // 50 ms, in 0.625 ms units
+#define TARGET_SCAN_WINDOW 0x28    // 25 ms: 50% radio duty, against 99% for the list scan
+
+struct TargetScanState {
+  volatile bool active = false;
+  volatile bool donePending = false;  // TARGET_SCAN_DONE did not fit in the queue
+  uint8_t wantedMask = 0;             // Bit per target index
+  uint8_t listedMask = 0;             // Targets on the controller whitelist
+  volatile uint8_t foundMask = 0;
+  esp_bd_addr_t address[STORED_PEER_MAX];
+  unsigned long foundMillis[STORED_PEER_MAX];
+  unsigned long startMillis = 0;
+  volatile unsigned long endMillis = 0;
+  volatile uint32_t reports = 0;      // Advertising reports that reached the host
+};
+
+TargetScanState targetScan;
+
+// Automatic reconnect for the stored targets while auto-connect is enabled.
+// A lost or failed target is retried with exponential backoff plus jitter, and
+// each retry first runs a targeted scan for its MAC, so an absent peer costs
+// TARGET_SCAN_DURATION_S instead of a full connect timeout.
+#define RECONNECT_BACKOFF_MIN_MS 1000
+#define RECONNECT_BACKOFF_MAX_MS 60000
+
+enum ReconnectPhase {
+  RECONNECT_OFF,
+  RECONNECT_WAITING,      // Until nextAttemptMillis
+  RECONNECT_PROBING,      // Targeted scan posted to the worker
+  RECONNECT_CONNECTING    // Connect attempt running
+};
+
+struct ReconnectPolicy {
+  ReconnectPhase phase = RECONNECT_OFF;
+  uint32_t backoffMs = RECONNECT_BACKOFF_MIN_MS;
+  unsigned long nextAttemptMillis = 0;
+  unsigned long lostMillis = 0;    // Start of the outage, for the reconnect latency
+  uint32_t attempts = 0;           // Connect attempts in this outage
+  uint32_t probesAbsent = 0;       // Probes in this outage that did not see the target
+  uint32_t reconnects = 0;         // Outages recovered since boot
+};
+
+ReconnectPolicy reconnectPolicy[STORED_PEER_MAX];  // By target index
+
+// Performance metrics, enabled by the esp32dev_perf environment (-DPERF_METRICS=1).
+// Loop iteration time, scan-result-to-list latency and relay-tap-to-write
+// latency are summarised over Serial every PERF_REPORT_INTERVAL_MS.
+#ifndef PERF_METRICS
+#define PERF_METRICS 0
+#endif
+#define PERF_REPORT_INTERVAL_MS 10000
+
+#if PERF_METRICS
+struct PerfStat {
+  const char* name;
+  uint32_t count;
+  uint64_t totalUs;
+  uint32_t maxUs;
+};
+
+PerfStat perfLoop = { "loop iteration" };
+PerfStat perfScanToList = { "scan result to list" };
+PerfStat perfListBind = { "device list rebind" };
+PerfStat perfTapToWrite = { "relay tap to write" };
+PerfStat perfRelayConfirm = { "relay tap to confirm" };
+PerfStat perfFrame = { "frame render+flush" };
+PerfStat perfFlushWait = { "flush DMA wait" };
+PerfStat perfLinkLoss = { "link loss to UI" };
+PerfStat perfAdvertiserUpdate = { "advertiser table update" };
+PerfStat perfSettingsHandler = { "settings click handler" };
+PerfStat perfSettingsCommit = { "settings commit" };
+uint32_t perfFrameStartMicros = 0;
+bool perfFirstFrameLogged = false;
+
+void perfRecord(PerfStat& stat, uint32_t us) {
+  stat.count++;
+  stat.totalUs += us;
+  if (us > stat.maxUs) stat.maxUs = us;
+}
+
+// Print and reset one statistic
+void perfPrint(PerfStat& stat) {
+  if (stat.count) {
+    Serial.printf("  %-20s n=%-6lu avg=%6lu us  max=%6lu us\n", stat.name, (unsigned long)stat.count,
+                  (unsigned long)(stat.totalUs / stat.count), (unsigned long)stat.maxUs);
+  }
+  stat.count = 0;
+  stat.totalUs = 0;
+  stat.maxUs = 0;
+}
+
+// Called from loop(): time the iteration and report periodically
+void perfLoopTick() {
+  static uint32_t lastMicros = 0;
+  static unsigned long lastReport = 0;
+  
+  uint32_t now = micros();
+  if (lastMicros) perfRecord(perfLoop, now - lastMicros);
+  lastMicros = now;
+  
+  if (millis() - lastReport > PERF_REPORT_INTERVAL_MS) {
+    lastReport = millis();
+    Serial.println("=== Performance ===");
+    perfPrint(perfLoop);
+    perfPrint(perfScanToList);
+    perfPrint(perfListBind);
+    perfPrint(perfTapToWrite);
+    perfPrint(perfRelayConfirm);
+    perfPrint(perfFrame);
+    perfPrint(perfFlushWait);
+    perfPrint(perfLinkLoss);
+    perfPrint(perfAdvertiserUpdate);
+    perfPrint(perfSettingsHandler);
+    perfPrint(perfSettingsCommit);
+    Serial.printf("  settings: %lu changes, %lu commits since boot\n",
+                  (unsigned long)settingsChanges, (unsigned long)settingsCommits);
+    for (int target = 0; target < peerRegistry.count; target++) {
+      if (!peerRegistry.peers[target].address.isSet()) continue;
+      Serial.printf("  Target%d reconnects: %lu, attempts this outage: %lu\n", target + 1,
+                    (unsigned long)reconnectPolicy[target].reconnects,
+                    (unsigned long)reconnectPolicy[target].attempts);
+    }
+    Serial.printf("  loop wakeups: %lu timer, %lu event\n",
+                  (unsigned long)loopTimerWakeups, (unsigned long)loopEventWakeups);
+    Serial.printf("  heap free: %lu, min %lu\n",
+                  (unsigned long)ESP.getFreeHeap(), (unsigned long)ESP.getMinFreeHeap());
+    loopTimerWakeups = 0;
+    loopEventWakeups = 0;
+  }
+}
+
+// Display refresh events: time each frame from the first band rendered to the last one flushed
+static void perfDisplayEvent(lv_event_t * e) {
+  if (lv_event_get_code(e) == LV_EVENT_REFR_START) {
+    perfFrameStartMicros = micros();
+  } else if (perfFrameStartMicros) {
+    perfRecord(perfFrame, micros() - perfFrameStartMicros);
+    perfFrameStartMicros = 0;
+    
+    // Boot to the first complete frame on the panel
+    if (!perfFirstFrameLogged) {
+      perfFirstFrameLogged = true;
+      Serial.printf("Time to first frame: %lu ms after boot\n", millis());
+    }
+  }
+}
+
+// LVGL heap use at a point of interest (UI built, scan finished)
+void perfLvglMemory(const char* when) {
+  lv_mem_monitor_t mon;
+  lv_mem_monitor(&mon);
+  Serial.printf("LVGL memory %s: %lu bytes used, max %lu, %u%% fragmented; heap free %lu\n", when,
+                (unsigned long)(mon.total_size - mon.free_size), (unsigned long)mon.max_used, mon.frag_pct,
+                (unsigned long)ESP.getFreeHeap());
+}
+
+void perfWatchDisplay(lv_display_t * disp) {
+  lv_display_add_event_cb(disp, perfDisplayEvent, LV_EVENT_REFR_START, NULL);
+  lv_display_add_event_cb(disp, perfDisplayEvent, LV_EVENT_REFR_READY, NULL);
+  Serial.printf("Display: %s flush, draw buffer 1/%d screen (%u bytes)\n",
+                DISPLAY_DMA_FLUSH ? "DMA double-buffered" : "blocking", DRAW_BUF_DIVISOR,
+                (unsigned int)DRAW_BUF_SIZE);
+}
+
+#define PERF_RECORD(stat, us) perfRecord(stat, us)
+#define PERF_LOOP_TICK() perfLoopTick()
+#define PERF_WATCH_DISPLAY(disp) perfWatchDisplay(disp)
+#define PERF_LVGL_MEMORY(when) perfLvglMemory(when)
+#else
+#define PERF_RECORD(stat, us) do {} while (0)
+#define PERF_LOOP_TICK() do {} while (0)
+#define PERF_WATCH_DISPLAY(disp) do {} while (0)
+#define PERF_LVGL_MEMORY(when) do {} while (0)
+#endif
+
 // Forward function declarations
 void bleStartScan();
+void bleStopScan();
+void bleProcessScanResults();
+bool bleConnect(const MacAddress& address, const char* name, const char* hello);
 bool bleConnectToDevice(int deviceIndex);
+bool bleConnectStoredTarget(int target);
+void bleProcessLinkEvents();
+int blePoolFind(const MacAddress& address);
+bool bleIsPeerReady(const MacAddress& address);
+void bleDisconnectPeer(int slot);
+void bleLinkLost(int slot);
+void reconnectArm(int target);
+void reconnectCancel(int target);
+void reconnectStartAttempt(int target);
+bool reconnectProbeRunning();
+void bleProcessReconnects();
 void bleDisconnect();
-void bleSendData(const String& data);
-void bleSendHexString(const String& hexString);
-bool bleAutoConnectDirect();  // ADDED THIS
-bool bleAutoConnectTarget2();  // ADDED THIS: Direct connect to Target2
+void bleSendDataTo(int slot, const char* data);
+void bleSendRelay(int relay, bool on);
+void bleQueueRelayFrame(int slot, const RelayFrame& frame);
+bool bleRelayWriteNoResponse(int slot);
+void bleFlushRelayQueue(int slot);
+void bleRelayDropFrames(int slot, int first);
+void bleProcessRelayQueues();
+int relaySlot(int relay);
+uint8_t bleRelayChannel(int slot, int relay);
+bool bleRelayAwaitingConfirm(const BlePeerLink& link);
+void bleRelaySync(int slot);
+void bleRelayQuery(int slot);
+void bleRelayApplyStatus(int slot, uint8_t known, uint8_t on);
+void relayRefreshButtons();
 void updateStatusIndicator();  // ADDED: Function to update status indicator
 void updateStoredDevicesScreen();  // ADDED: Update stored devices screen
+void show_bluetooth_screen();
+void show_stored_devices_screen();
+void show_touch_calibration_screen();
+void uiLoadScreen(lv_obj_t * target);
 void log_print(lv_log_level_t level, const char * buf);
 void touchscreen_read(lv_indev_t * indev, lv_indev_data_t * data);
-void loadStoredMACs();  // ADDED: Load MACs from NVS
-void saveTarget1MAC(const String& mac);  // ADDED: Save Target1 MAC to NVS
-void saveTarget2MAC(const String& mac);  // ADDED: Save Target2 MAC to NVS
-void loadAutoConnectState();  // ADDED: Load auto-connect state from NVS
-void saveAutoConnectState(bool enabled);  // ADDED: Save auto-connect state to NVS
+void loadSettings();
+void settingsMarkDirty();
+void settingsCommit();
+int peerRegistryStore(const MacAddress& address, const char* name);
+void peerRegistryForget(int target);
+void saveAutoConnectState(bool enabled);  // ADDED: Save auto-connect state
+uint16_t loadCachedHandle(const MacAddress& mac, uint8_t& properties);
+void saveCachedHandle(const MacAddress& mac, uint16_t handle, uint8_t properties);
 
 // EVENT HANDLER DECLARATIONS - ADDED THIS
 static void event_handler_btnSet(lv_event_t * e);
@@ -128,19 +1019,15 @@ static void event_handler_btnBackStored(lv_event_t * e);  // ADDED: Back from st
 static void event_handler_btnScan(lv_event_t * e);
 static void event_handler_btnConnect(lv_event_t * e);
 static void event_handler_btnDisconnect(lv_event_t * e);
+static void event_handler_btnDisconnectStored(lv_event_t * e);
 static void event_handler_deviceList(lv_event_t * e);  // ADDED THIS LINE
-static void event_handler_btn1(lv_event_t * e);
-static void event_handler_btn2(lv_event_t * e);
-static void event_handler_btn3(lv_event_t * e);
-static void event_handler_btn4(lv_event_t * e);
-static void event_handler_btn5(lv_event_t * e);
-static void event_handler_btn6(lv_event_t * e);
-static void event_handler_btnTarget1(lv_event_t * e);  // ADDED: Store as Target1
-static void event_handler_btnTarget2(lv_event_t * e);  // ADDED: Store as Target2
+static void event_handler_relay(lv_event_t * e);
+static void event_handler_btnStore(lv_event_t * e);
+static void event_handler_btnForget(lv_event_t * e);
 static void event_handler_btnStoredDevices(lv_event_t * e);  // ADDED: For Stored Devices button
-static void event_handler_btnConnectTarget1(lv_event_t * e);  // ADDED: Connect to Target1
-static void event_handler_btnConnectTarget2(lv_event_t * e);  // ADDED: Connect to Target2
+static void event_handler_btnConnectStored(lv_event_t * e);
 static void event_handler_autoConnectCheckbox(lv_event_t * e);  // ADDED: For auto-connect checkbox
+static void event_handler_screenDeleted(lv_event_t * e);
 
 // Logging
 void log_print(lv_log_level_t level, const char * buf) {
@@ -149,684 +1036,2536 @@ void log_print(lv_log_level_t level, const char * buf) {
   Serial.flush();
 }
 
-// Touchscreen
-void touchscreen_read(lv_indev_t * indev, lv_indev_data_t * data) {
-  if(touchscreen.tirqTouched() && touchscreen.touched()) {
-    TS_Point p = touchscreen.getPoint();
-    x = map(p.x, 200, 3700, 1, SCREEN_WIDTH);
-    y = map(p.y, 240, 3800, 1, SCREEN_HEIGHT);
-    z = p.z;
-
-    data->state = LV_INDEV_STATE_PRESSED;
-    data->point.x = x;
-    data->point.y = y;
-  } else {
-    data->state = LV_INDEV_STATE_RELEASED;
-  }
-}
-
-// Update status indicator function
-void updateStatusIndicator() {
-  if (status_indicator) {
-    if (isConnected && pClient && pClient->isConnected()) {
-      // Connected - Use BLUE (0xFF0000 on your display = Blue)
-      lv_obj_set_style_bg_color(status_indicator, lv_color_hex(0xFF0000), LV_PART_MAIN);
-    } else {
-      // Not connected - Use RED (0x00FF00 on your display = Red)
-      lv_obj_set_style_bg_color(status_indicator, lv_color_hex(0x00FF00), LV_PART_MAIN);
-    }
-    lv_obj_set_style_bg_opa(status_indicator, LV_OPA_COVER, LV_PART_MAIN);
-  }
+// LVGL tick source: real elapsed time instead of a fixed increment per loop
+static uint32_t lv_tick_millis(void) {
+  return millis();
 }
 
-// ADDED: Load stored MACs from NVS
-void loadStoredMACs() {
-  preferences.begin(NVS_NAMESPACE, false);
-  storedTarget1MAC = preferences.getString(TARGET1_MAC_KEY, DEFAULT_TARGET_DEVICE_ADDRESS);
-  storedTarget2MAC = preferences.getString(TARGET2_MAC_KEY, DEFAULT_TARGET2_DEVICE_ADDRESS);
-  preferences.end();
+#if DISPLAY_DMA_FLUSH
+// Start pushing a rendered band to the panel and return; the transfer overlaps
+// with LVGL rendering the next band into the other buffer
+static void tft_flush_dma(lv_display_t * disp, const lv_area_t * area, uint8_t * px_map) {
+  uint32_t w = lv_area_get_width(area);
+  uint32_t h = lv_area_get_height(area);
+  
+  // The panel expects big-endian RGB565
+  lv_draw_sw_rgb565_swap(px_map, w * h);
   
-  Serial.println("=== Loaded Stored MACs from NVS ===");
-  Serial.println("Target1 MAC: " + storedTarget1MAC);
-  Serial.println("Target2 MAC: " + storedTarget2MAC);
+  tft.startWrite();
+  tft.pushImageDMA(area->x1, area->y1, w, h, (uint16_t *)px_map);
 }
 
-// ADDED: Save Target1 MAC to NVS
-void saveTarget1MAC(const String& mac) {
-  preferences.begin(NVS_NAMESPACE, false);
-  preferences.putString(TARGET1_MAC_KEY, mac);
-  preferences.end();
+// Called by LVGL before it reuses a buffer: wait for the band in flight
+static void tft_flush_wait(lv_display_t * disp) {
+  uint32_t start = micros();
+  tft.dmaWait();
+  tft.endWrite();
+  PERF_RECORD(perfFlushWait, micros() - start);
   
-  storedTarget1MAC = mac;
-  Serial.println("Saved Target1 MAC to NVS: " + mac);
+  lv_display_flush_ready(disp);
 }
 
-// ADDED: Save Target2 MAC to NVS
-void saveTarget2MAC(const String& mac) {
-  preferences.begin(NVS_NAMESPACE, false);
-  preferences.putString(TARGET2_MAC_KEY, mac);
-  preferences.end();
-  
-  storedTarget2MAC = mac;
-  Serial.println("Saved Target2 MAC to NVS: " + mac);
+// Follow LVGL's rotation, as lv_tft_espi does
+static void tft_resolution_changed(lv_event_t * e) {
+  lv_display_t * disp = (lv_display_t *)lv_event_get_target(e);
+  tft.setRotation((uint8_t)lv_display_get_rotation(disp));
 }
 
-// ADDED: Load auto-connect state from NVS
-void loadAutoConnectState() {
-  preferences.begin(NVS_NAMESPACE, false);
-  autoConnectEnabled = preferences.getBool(AUTOCONNECT_ENABLED_KEY, true); // Default to enabled
-  preferences.end();
+// Create the LVGL display on TFT_eSPI with two draw buffers and DMA flushing
+lv_display_t * tft_dma_display_create() {
+  tft.begin();
+  tft.setRotation(0);
+  tft.fillScreen(TFT_BLACK);
+  tft.initDMA();
   
-  Serial.println("Auto-connect enabled: " + String(autoConnectEnabled ? "YES" : "NO"));
+  lv_display_t * disp = lv_display_create(SCREEN_WIDTH, SCREEN_HEIGHT);
+  lv_display_set_flush_cb(disp, tft_flush_dma);
+  lv_display_set_flush_wait_cb(disp, tft_flush_wait);
+  lv_display_set_buffers(disp, draw_buf, draw_buf2, sizeof(draw_buf), LV_DISPLAY_RENDER_MODE_PARTIAL);
+  lv_display_add_event_cb(disp, tft_resolution_changed, LV_EVENT_RESOLUTION_CHANGED, NULL);
+  return disp;
 }
+#endif
 
-// ADDED: Save auto-connect state to NVS
-void saveAutoConnectState(bool enabled) {
-  preferences.begin(NVS_NAMESPACE, false);
-  preferences.putBool(AUTOCONNECT_ENABLED_KEY, enabled);
-  preferences.end();
-  
-  autoConnectEnabled = enabled;
-  Serial.println("Saved auto-connect state: " + String(enabled ? "ENABLED" : "DISABLED"));
+// Touchscreen
+// PENIRQ falling edge: wake the sampler task
+void IRAM_ATTR touchIrqHandler() {
+  BaseType_t woken = pdFALSE;
+  vTaskNotifyGiveFromISR(touchTaskHandle, &woken);
+  if (woken) portYIELD_FROM_ISR();
 }
 
-// ADDED: Function to update stored devices screen
-void updateStoredDevicesScreen() {
-  if (!stored_devices_screen) return;
-  
-  // Update Target1 status
-  if (target1StatusLabel) {
-    String statusText = "Target1: ";
-    if (isConnected && connectedDeviceAddress == storedTarget1MAC) {
-      statusText += "CONNECTED";
-      lv_obj_set_style_text_color(target1StatusLabel, lv_color_hex(0x00FF00), LV_PART_MAIN);
-    } else {
-      statusText += "DISCONNECTED";
-      lv_obj_set_style_text_color(target1StatusLabel, lv_color_hex(0xFF0000), LV_PART_MAIN);
-    }
-    lv_label_set_text(target1StatusLabel, statusText.c_str());
-  }
-  
-  // Update Target2 status
-  if (target2StatusLabel) {
-    String statusText = "Target2: ";
-    if (isConnected && connectedDeviceAddress == storedTarget2MAC) {
-      statusText += "CONNECTED";
-      lv_obj_set_style_text_color(target2StatusLabel, lv_color_hex(0x00FF00), LV_PART_MAIN);
-    } else if (storedTarget2MAC == "00:00:00:00:00:00") {
-      statusText += "MAC NOT SET";
-      lv_obj_set_style_text_color(target2StatusLabel, lv_color_hex(0xFFA500), LV_PART_MAIN);
-    } else {
-      statusText += "DISCONNECTED";
-      lv_obj_set_style_text_color(target2StatusLabel, lv_color_hex(0xFF0000), LV_PART_MAIN);
-    }
-    lv_label_set_text(target2StatusLabel, statusText.c_str());
-  }
+static bool touchRingPush(const TouchPoint& point) {
+  uint32_t head = touchRingHead.load(std::memory_order_relaxed);
+  if (head - touchRingTail.load(std::memory_order_acquire) == TOUCH_RING_SIZE) return false;
+  touchRing[head % TOUCH_RING_SIZE] = point;
+  touchRingHead.store(head + 1, std::memory_order_release);
+  return true;
 }
 
-// BLE Callback for discovered devices (updated to just log, not store)
-class MyAdvertisedDeviceCallbacks: public BLEAdvertisedDeviceCallbacks {
-  void onResult(BLEAdvertisedDevice advertisedDevice) {
-    // Just log found devices, but don't store them here anymore
-    String deviceName = advertisedDevice.getName().c_str();
-    if (deviceName.length() == 0) {
-      deviceName = "Unknown Device";
-    }
-    
-    String deviceAddress = advertisedDevice.getAddress().toString().c_str();
-    int rssi = advertisedDevice.getRSSI();
-    
-    Serial.printf("BLE Scanning: %s - %s (%d dB)\n", 
-                  deviceName.c_str(), deviceAddress.c_str(), rssi);
-  }
-};
+static bool touchRingPop(TouchPoint& point) {
+  uint32_t tail = touchRingTail.load(std::memory_order_relaxed);
+  if (tail == touchRingHead.load(std::memory_order_acquire)) return false;
+  point = touchRing[tail % TOUCH_RING_SIZE];
+  touchRingTail.store(tail + 1, std::memory_order_release);
+  return true;
+}
 
-// Initialize stored devices
-void initStoredDevices() {
-  // Target1
-  storedDevices[0].name = "MY TARGET DEVICE";
-  storedDevices[0].address = storedTarget1MAC;
-  storedDevices[0].rssi = -60;
-  storedDevices[0].isTarget1 = true;
-  storedDevices[0].isTarget2 = false;
-  
-  // Target2 (if not placeholder)
-  storedDevices[1].name = "TARGET2 DEVICE";
-  storedDevices[1].address = storedTarget2MAC;
-  storedDevices[1].rssi = -60;
-  storedDevices[1].isTarget1 = false;
-  storedDevices[1].isTarget2 = (storedTarget2MAC != "00:00:00:00:00:00");
+bool touchPointsPending() {
+  return touchRingTail.load(std::memory_order_relaxed) != touchRingHead.load(std::memory_order_acquire);
 }
 
-// NEW: Direct auto-connect function for Target1
-bool bleAutoConnectDirect() {
-  Serial.println("=== Attempting Direct Auto-Connect to Target Device ===");
-  
-  // Check if Target1 address is stored
-  if (storedTarget1MAC.length() == 0 || storedTarget1MAC == "00:00:00:00:00:00") {
-    Serial.println("ERROR: Target1 MAC address is not stored!");
-    Serial.println("Please select a device and tap 'Target1' to store it.");
-    
-    if (connectionStatusLabel) {
-      lv_label_set_text(connectionStatusLabel, "Status: Target1 MAC not set");
-    }
-    return false;
-  }
-  
-  // Disconnect if already connected
-  if (isConnected) {
-    bleDisconnect();
-    delay(500);
-  }
+// Sampler task: idle until PENIRQ, then sample every TOUCH_SAMPLE_PERIOD_MS
+// while the pen is down. No SPI traffic while the panel is untouched. A press
+// ends when PENIRQ goes high or after TOUCH_RELEASE_SAMPLES low-Z samples in a
+// row, so Z jitter does not split it; a light first contact is sampled for as
+// long as PENIRQ stays low.
+static void touchTask(void * param) {
+  TouchFilter filter;
   
-  // Create BLE client
-  pClient = BLEDevice::createClient();
-  serverAddress = new BLEAddress(storedTarget1MAC.c_str());
-  
-  Serial.print("Direct connection to: ");
-  Serial.println(storedTarget1MAC);
-  
-  // Connect to BLE server
-  if (pClient->connect(*serverAddress)) {
-    Serial.println("Connected to BLE server!");
-    
-    // Get the service
-    BLERemoteService* pRemoteService = pClient->getService(SERVICE_UUID);
-    if (pRemoteService == nullptr) {
-      Serial.println("Failed to find service UUID");
-      bleDisconnect();
-      updateStatusIndicator();  // UPDATE status indicator
-      updateStoredDevicesScreen();  // UPDATE stored devices screen
-      return false;
+  for (;;) {
+    // The pen may already be down again: its edge was dropped with the sampling ones
+    if (digitalRead(XPT2046_IRQ) == HIGH) {
+      ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
     }
+    filter.reset();
+    portENTER_CRITICAL(&touchCalibrationMux);
+    const TouchCalibration cal = touchCalibration;
+    portEXIT_CRITICAL(&touchCalibrationMux);
     
-    // Get the characteristic
-    pRemoteCharacteristic = pRemoteService->getCharacteristic(CHARACTERISTIC_UUID);
-    if (pRemoteCharacteristic == nullptr) {
-      Serial.println("Failed to find characteristic UUID");
-      bleDisconnect();
-      updateStatusIndicator();  // UPDATE status indicator
-      updateStoredDevicesScreen();  // UPDATE stored devices screen
-      return false;
+    TouchPoint point = { 0, 0, 0, 0, false };
+    int lowSamples = 0;
+    for (;;) {
+      TS_Point p = touchscreen.getPoint();
+      if (p.z < TOUCH_MIN_PRESSURE) {
+        if (digitalRead(XPT2046_IRQ) == HIGH) break;
+        if (point.pressed && ++lowSamples >= TOUCH_RELEASE_SAMPLES) break;
+        vTaskDelay(pdMS_TO_TICKS(TOUCH_SAMPLE_PERIOD_MS));
+        continue;
+      }
+      lowSamples = 0;
+      
+      int16_t fx, fy;
+      filter.update(p.x, p.y, fx, fy);
+      point.x = constrain((int)(cal.a * fx + cal.b * fy + cal.c), 0, SCREEN_WIDTH - 1);
+      point.y = constrain((int)(cal.d * fx + cal.e * fy + cal.f), 0, SCREEN_HEIGHT - 1);
+      point.rawX = fx;
+      point.rawY = fy;
+      point.pressed = true;
+      
+      // A full ring means LVGL is behind; the newest sample will follow shortly
+      touchRingPush(point);
+      wakeMainLoop();
+      vTaskDelay(pdMS_TO_TICKS(TOUCH_SAMPLE_PERIOD_MS));
     }
     
-    isConnected = true;
-    connectedDeviceName = "MY TARGET DEVICE";
-    connectedDeviceAddress = storedTarget1MAC;
-    
-    if (connectionStatusLabel) {
-      lv_label_set_text(connectionStatusLabel, "Status: Auto-Connected");
+    // Release at the last pressed position; an edge without a real press sends nothing
+    if (point.pressed) {
+      point.pressed = false;
+      while (!touchRingPush(point)) {
+        vTaskDelay(pdMS_TO_TICKS(TOUCH_SAMPLE_PERIOD_MS));
+      }
+      wakeMainLoop();
     }
     
-    // UPDATE status indicator and stored devices screen
-    updateStatusIndicator();
-    updateStoredDevicesScreen();
-    
-    // Send connection confirmation
-    delay(100);
-    bleSendData("CONNECTED");
-    
-    Serial.println("=== BLE Auto-Connection Successful ===");
-    return true;
-  } else {
-    Serial.println("Failed to auto-connect to BLE server");
-    delete pClient;
-    pClient = nullptr;
-    delete serverAddress;
-    serverAddress = nullptr;
-    updateStatusIndicator();  // UPDATE status indicator
-    updateStoredDevicesScreen();  // UPDATE stored devices screen
-    return false;
+    // Sampling toggles PENIRQ, drop the edges it raised; a new press is caught
+    // by the level check at the top
+    ulTaskNotifyTake(pdTRUE, 0);
   }
 }
 
-// NEW: Direct auto-connect function for Target2
-bool bleAutoConnectTarget2() {
-  Serial.println("=== Attempting Direct Auto-Connect to Target2 Device ===");
-  
-  // Check if Target2 address is still placeholder
-  if (storedTarget2MAC == "00:00:00:00:00:00") {
-    Serial.println("ERROR: Target2 MAC address is still placeholder!");
-    Serial.println("Please select a device and tap 'Target2' to store it.");
-    
-    if (connectionStatusLabel) {
-      lv_label_set_text(connectionStatusLabel, "Status: Target2 MAC not set");
+// LVGL read callback (event mode): hand over buffered points one at a time
+void touchscreen_read(lv_indev_t * indev, lv_indev_data_t * data) {
+  TouchPoint point;
+  if (touchRingPop(point)) {
+    // A release starts the reads that carry the scroll throw
+    if (touchLast.pressed && !point.pressed && touchThrowTimer) {
+      touchReleaseMillis = millis();
+      lv_timer_resume(touchThrowTimer);
+      lv_timer_reset(touchThrowTimer);
     }
-    updateStoredDevicesScreen();  // UPDATE stored devices screen
-    return false;
+    touchLast = point;
   }
   
-  // Disconnect if already connected
-  if (isConnected) {
-    bleDisconnect();
-    delay(500);
-  }
+  data->point.x = touchLast.x;
+  data->point.y = touchLast.y;
+  data->state = touchLast.pressed ? LV_INDEV_STATE_PRESSED : LV_INDEV_STATE_RELEASED;
+  data->continue_reading = touchPointsPending();
+}
+
+// LVGL timer, resumed on a release. In event mode LVGL reads only when points
+// arrive, but a scroll throw advances one step per read: keep reading at the
+// usual indev rate until the throw has run out.
+static void touchThrowRead(lv_timer_t * timer) {
+  lv_indev_read(touchIndev);
+  if (!lv_indev_get_scroll_obj(touchIndev) || millis() - touchReleaseMillis >= TOUCH_THROW_MAX_MS) {
+    lv_timer_pause(timer);
+  }
+}
+
+// A calibration the sampler can use: finite, and not collapsing the panel onto a line
+bool touchCalibrationValid(const TouchCalibration& cal) {
+  const float values[] = { cal.a, cal.b, cal.c, cal.d, cal.e, cal.f };
+  for (float v : values) {
+    if (!std::isfinite(v)) return false;
+  }
+  return fabsf(cal.a * cal.e - cal.b * cal.d) > 1e-6f;
+}
+
+// Solve the affine calibration that maps three raw readings onto the panel
+// points they were taken at (Cramer's rule on the differences to the third
+// point). Returns false if the readings are (nearly) on one line.
+bool touchCalibrationSolve(const int16_t rawX[3], const int16_t rawY[3],
+                           const int16_t panelX[3], const int16_t panelY[3], TouchCalibration& cal) {
+  float dx0 = rawX[0] - rawX[2], dy0 = rawY[0] - rawY[2];
+  float dx1 = rawX[1] - rawX[2], dy1 = rawY[1] - rawY[2];
+  float det = dx0 * dy1 - dx1 * dy0;
+  if (fabsf(det) < 1000.0f) return false;  // Raw units squared; a real triangle is ~1e6
+  
+  float dX0 = panelX[0] - panelX[2], dX1 = panelX[1] - panelX[2];
+  float dY0 = panelY[0] - panelY[2], dY1 = panelY[1] - panelY[2];
+  cal.a = (dX0 * dy1 - dX1 * dy0) / det;
+  cal.b = (dx0 * dX1 - dx1 * dX0) / det;
+  cal.c = panelX[2] - cal.a * rawX[2] - cal.b * rawY[2];
+  cal.d = (dY0 * dy1 - dY1 * dy0) / det;
+  cal.e = (dx0 * dY1 - dx1 * dY0) / det;
+  cal.f = panelY[2] - cal.d * rawX[2] - cal.e * rawY[2];
+  return touchCalibrationValid(cal);
+}
+
+// Use a new calibration from the next press on, and store it with the settings
+void saveTouchCalibration(const TouchCalibration& cal) {
+  portENTER_CRITICAL(&touchCalibrationMux);
+  touchCalibration = cal;
+  portEXIT_CRITICAL(&touchCalibrationMux);
+  settingsMarkDirty();
+  Serial.printf("Touch calibration: x = %.5f*rx + %.5f*ry + %.1f, y = %.5f*rx + %.5f*ry + %.1f\n",
+                cal.a, cal.b, cal.c, cal.d, cal.e, cal.f);
+}
+
+// Theme: every widget style is a shared lv_style_t built once in theme_init()
+// and added to objects, instead of local style properties per object.
+//
+// This panel shows the R, G and B channels of a written colour as blue, red
+// and green (0xFF0000 displays blue). Theme colours are true RGB; theme_color()
+// converts them for the panel selected by PANEL_COLOR_ORDER.
+#define PANEL_ORDER_RGB 0      // Panel shows colours as written
+#define PANEL_ORDER_BGR 1      // Red and blue swapped
+#define PANEL_ORDER_ROTATED 2  // Written R/G/B show as B/R/G (this board)
+#ifndef PANEL_COLOR_ORDER
+#define PANEL_COLOR_ORDER PANEL_ORDER_ROTATED
+#endif
+
+#define THEME_BLUE          0x0000FF
+#define THEME_BLUE_PRESSED  0x6666FF
+#define THEME_RED           0xFF0000
+#define THEME_GREEN         0x00FF00
+#define THEME_GREY          0x808080
+
+lv_color_t theme_color(uint32_t rgb) {
+  uint32_t r = (rgb >> 16) & 0xFF;
+  uint32_t g = (rgb >> 8) & 0xFF;
+  uint32_t b = rgb & 0xFF;
+#if PANEL_COLOR_ORDER == PANEL_ORDER_BGR
+  return lv_color_hex((b << 16) | (g << 8) | r);
+#elif PANEL_COLOR_ORDER == PANEL_ORDER_ROTATED
+  return lv_color_hex((b << 16) | (r << 8) | g);
+#else
+  return lv_color_hex(rgb);
+#endif
+}
+
+lv_style_t themeScreen;          // Black screen background
+lv_style_t themeTransparent;     // Layout-only containers: no border, background or padding
+lv_style_t themeTitle;           // White 16 px, centred
+lv_style_t themeHeading;         // White 14 px
+lv_style_t themeText;            // White 12 px
+lv_style_t themeCaption;         // White 12 px, centred
+lv_style_t themeButton;          // Blue with white text and 2 px white border; also relay OFF
+lv_style_t themeAccentButton;    // Red background (title button)
+lv_style_t themeRelayOn;         // Green, for LV_STATE_CHECKED
+lv_style_t themeListBox;         // Device list frame
+lv_style_t themeListText;        // Device list header and placeholder
+lv_style_t themeListRow;         // Device list rows
+lv_style_t themeListRowPressed;
+lv_style_t themeStatusDot;       // Main screen link indicator, red when down
+lv_style_t themeStatusDotOn;     // Blue while the active peer is connected (LV_STATE_CHECKED)
+lv_style_t themeStatusText;      // Stored peer status, red when disconnected
+lv_style_t themeStatusTextOn;    // Green while connected (LV_STATE_CHECKED)
+lv_style_t themeSeparator;
+
+void theme_init() {
+  lv_style_init(&themeScreen);
+  lv_style_set_bg_color(&themeScreen, lv_color_black());
+  lv_style_set_bg_opa(&themeScreen, LV_OPA_COVER);
+  
+  lv_style_init(&themeTransparent);
+  lv_style_set_border_width(&themeTransparent, 0);
+  lv_style_set_bg_opa(&themeTransparent, LV_OPA_TRANSP);
+  lv_style_set_pad_all(&themeTransparent, 0);
+  
+  lv_style_init(&themeTitle);
+  lv_style_set_text_color(&themeTitle, lv_color_white());
+  lv_style_set_text_font(&themeTitle, &lv_font_montserrat_16);
+  lv_style_set_text_align(&themeTitle, LV_TEXT_ALIGN_CENTER);
+  
+  lv_style_init(&themeHeading);
+  lv_style_set_text_color(&themeHeading, lv_color_white());
+  lv_style_set_text_font(&themeHeading, &lv_font_montserrat_14);
+  
+  lv_style_init(&themeText);
+  lv_style_set_text_color(&themeText, lv_color_white());
+  lv_style_set_text_font(&themeText, &lv_font_montserrat_12);
+  
+  lv_style_init(&themeCaption);
+  lv_style_set_text_color(&themeCaption, lv_color_white());
+  lv_style_set_text_font(&themeCaption, &lv_font_montserrat_12);
+  lv_style_set_text_align(&themeCaption, LV_TEXT_ALIGN_CENTER);
+  
+  lv_style_init(&themeButton);
+  lv_style_set_bg_color(&themeButton, theme_color(THEME_BLUE));
+  lv_style_set_bg_opa(&themeButton, LV_OPA_COVER);
+  lv_style_set_text_color(&themeButton, lv_color_white());
+  lv_style_set_border_width(&themeButton, 2);
+  lv_style_set_border_color(&themeButton, lv_color_white());
+  lv_style_set_border_opa(&themeButton, LV_OPA_COVER);
+  
+  lv_style_init(&themeAccentButton);
+  lv_style_set_bg_color(&themeAccentButton, theme_color(THEME_RED));
+  
+  lv_style_init(&themeRelayOn);
+  lv_style_set_bg_color(&themeRelayOn, theme_color(THEME_GREEN));
+  
+  lv_style_init(&themeListBox);
+  lv_style_set_bg_color(&themeListBox, lv_color_black());
+  lv_style_set_bg_opa(&themeListBox, LV_OPA_COVER);
+  lv_style_set_border_width(&themeListBox, 2);
+  lv_style_set_border_color(&themeListBox, lv_color_white());
+  lv_style_set_border_opa(&themeListBox, LV_OPA_COVER);
+  lv_style_set_radius(&themeListBox, 5);
+  lv_style_set_pad_all(&themeListBox, 5);
+  
+  lv_style_init(&themeListText);
+  lv_style_set_text_color(&themeListText, lv_color_white());
+  lv_style_set_text_font(&themeListText, &lv_font_montserrat_12);
+  lv_style_set_text_align(&themeListText, LV_TEXT_ALIGN_CENTER);
+  lv_style_set_bg_color(&themeListText, lv_color_black());
+  lv_style_set_bg_opa(&themeListText, LV_OPA_COVER);
+  lv_style_set_pad_all(&themeListText, 5);
+  
+  lv_style_init(&themeListRow);
+  lv_style_set_bg_color(&themeListRow, theme_color(THEME_BLUE));
+  lv_style_set_bg_opa(&themeListRow, LV_OPA_COVER);
+  lv_style_set_text_color(&themeListRow, lv_color_white());
+  lv_style_set_text_font(&themeListRow, &lv_font_montserrat_12);
+  lv_style_set_border_width(&themeListRow, 1);
+  lv_style_set_border_color(&themeListRow, lv_color_white());
+  lv_style_set_border_opa(&themeListRow, LV_OPA_50);
+  
+  lv_style_init(&themeListRowPressed);
+  lv_style_set_bg_color(&themeListRowPressed, theme_color(THEME_BLUE_PRESSED));
+  
+  lv_style_init(&themeStatusDot);
+  lv_style_set_radius(&themeStatusDot, 10);  // Half of 20px for perfect circle
+  lv_style_set_bg_color(&themeStatusDot, theme_color(THEME_RED));
+  lv_style_set_bg_opa(&themeStatusDot, LV_OPA_COVER);
+  lv_style_set_border_width(&themeStatusDot, 2);
+  lv_style_set_border_color(&themeStatusDot, lv_color_white());
+  lv_style_set_border_opa(&themeStatusDot, LV_OPA_COVER);
+  lv_style_set_pad_all(&themeStatusDot, 0);
+  
+  lv_style_init(&themeStatusDotOn);
+  lv_style_set_bg_color(&themeStatusDotOn, theme_color(THEME_BLUE));
+  
+  lv_style_init(&themeStatusText);
+  lv_style_set_text_color(&themeStatusText, theme_color(THEME_RED));
+  
+  lv_style_init(&themeStatusTextOn);
+  lv_style_set_text_color(&themeStatusTextOn, theme_color(THEME_GREEN));
+  
+  lv_style_init(&themeSeparator);
+  lv_style_set_line_width(&themeSeparator, 1);
+  lv_style_set_line_color(&themeSeparator, theme_color(THEME_GREY));
+}
+
+// Update status indicator function
+void updateStatusIndicator() {
+  if (status_indicator) {
+    // Connected: blue (themeStatusDotOn), not connected: red
+    bool connected = activePeer >= 0 && peerLinks[activePeer].state == LINK_READY;
+    lv_obj_set_state(status_indicator, LV_STATE_CHECKED, connected);
+  }
+}
+
+// Index of a peer in the handle cache, -1 if it has no entry
+static int handleCacheFind(const MacAddress& mac) {
+  for (int i = 0; i < handleCacheCount; i++) {
+    if (handleCache[i].address == mac) return i;
+  }
+  return -1;
+}
+
+// Bytes of the registry: the header and the used entries
+static size_t peerRegistryBytes(uint8_t count) {
+  return offsetof(PeerRegistry, peers) + count * sizeof(StoredPeer);
+}
+
+// Bytes of the settings blob: everything up to the registry's used entries
+static size_t settingsRecordBytes(uint8_t peerCount) {
+  return offsetof(SettingsRecord, peers) + peerRegistryBytes(peerCount);
+}
+
+// (Re)start the commit timer, so a burst of changes is written once
+static void settingsScheduleCommit() {
+  settingsChanges++;
+  if (settingsTimer) {
+    lv_timer_reset(settingsTimer);
+    lv_timer_resume(settingsTimer);
+  }
+}
+
+// Record a change to the settings mirror (auto-connect, touch calibration, relay table, peer registry)
+void settingsMarkDirty() {
+  settingsDirty = true;
+  settingsScheduleCommit();
+}
+
+// Write every pending change in one Preferences session: the settings blob
+// and the handle cache blob, each if it changed. Also runs from the shutdown
+// handler, so a restart does not lose changes.
+void settingsCommit() {
+  if (!settingsDirty && !handleCacheDirty) return;
+  
+  uint32_t start = micros();
+  preferences.begin(NVS_NAMESPACE, false);
+  if (settingsDirty) {
+    static SettingsRecord record;
+    record.version = SETTINGS_VERSION;
+    record.autoConnect = autoConnectEnabled;
+    record.touch = touchCalibration;
+    record.relays = relayConfigIsDefault(relayConfig) ? RelayConfig{} : relayConfig;
+    record.peers = peerRegistry;
+    preferences.putBytes(SETTINGS_KEY, &record, settingsRecordBytes(peerRegistry.count));
+    settingsDirty = false;
+  }
+  if (handleCacheDirty) {
+    if (handleCacheCount > 0) {
+      preferences.putBytes(HANDLE_CACHE_KEY, handleCache, handleCacheCount * sizeof(HandleCacheEntry));
+    } else {
+      preferences.remove(HANDLE_CACHE_KEY);
+    }
+    handleCacheDirty = false;
+  }
+  preferences.end();
+  
+  settingsCommits++;
+  PERF_RECORD(perfSettingsCommit, micros() - start);
+  Serial.printf("Settings committed in %lu us (%lu changes in %lu commits since boot)\n",
+                (unsigned long)(micros() - start), (unsigned long)settingsChanges, (unsigned long)settingsCommits);
+}
+
+static void settingsCommitTimer(lv_timer_t * timer) {
+  lv_timer_pause(timer);
+  settingsCommit();
+}
+
+// ADDED: Save auto-connect state to NVS
+void saveAutoConnectState(bool enabled) {
+  autoConnectEnabled = enabled;
+  settingsMarkDirty();
+  Serial.println("Saved auto-connect state: " + String(enabled ? "ENABLED" : "DISABLED"));
+}
+
+// Load the cached FFE1 handle and properties for a peer, 0 if none is stored.
+// Reads the RAM mirror only, so connecting never waits on flash.
+uint16_t loadCachedHandle(const MacAddress& mac, uint8_t& properties) {
+  int target = peerRegistryFind(mac);
+  if (target >= 0) {
+    properties = peerRegistry.peers[target].charProperties;
+    return peerRegistry.peers[target].charHandle;
+  }
+  
+  int i = handleCacheFind(mac);
+  uint32_t entry = (i >= 0) ? handleCache[i].entry : 0;
+  properties = (entry >> 16) & 0xFF;
+  return entry & 0xFFFF;
+}
+
+// Save (or with handle 0, forget) the FFE1 handle and properties for a peer
+void saveCachedHandle(const MacAddress& mac, uint16_t handle, uint8_t properties) {
+  int target = peerRegistryFind(mac);
+  if (target >= 0) {
+    peerRegistry.peers[target].charHandle = handle;
+    peerRegistry.peers[target].charProperties = properties;
+    settingsMarkDirty();
+  } else {
+    int i = handleCacheFind(mac);
+    if (handle == 0) {
+      if (i < 0) return;
+      memmove(&handleCache[i], &handleCache[i + 1], (handleCacheCount - i - 1) * sizeof(HandleCacheEntry));
+      handleCacheCount--;
+    } else {
+      // Move this peer's entry to the front; a new one takes the last entry's place when full
+      if (i < 0) {
+        if (handleCacheCount < HANDLE_CACHE_MAX) {
+          i = handleCacheCount++;
+        } else {
+          i = HANDLE_CACHE_MAX - 1;
+          Serial.printf("Handle cache full, replacing %s\n", handleCache[i].address.toString().c_str());
+        }
+      }
+      memmove(&handleCache[1], &handleCache[0], i * sizeof(HandleCacheEntry));
+      handleCache[0].address = mac;
+      handleCache[0].entry = ((uint32_t)properties << 16) | handle;
+    }
+    handleCacheDirty = true;
+    settingsScheduleCommit();
+  }
+  
+  Serial.printf("Handle cache for %s: 0x%04X (properties 0x%02X)\n", mac.toString().c_str(), handle, properties);
+}
+
+// Read and remove a Target1/Target2 MAC key of the original firmware (text)
+static MacAddress loadLegacyTargetMAC(const char* key) {
+  MacAddress mac = MacAddress::parse(preferences.getString(key, "").c_str());
+  preferences.remove(key);
+  return mac;
+}
+
+// Gather the settings from the keys of the original firmware, removing each
+// key as it is folded in. Runs inside loadSettings()' Preferences session.
+static void loadLegacySettings() {
+  if (preferences.isKey(AUTOCONNECT_ENABLED_KEY)) {
+    autoConnectEnabled = preferences.getBool(AUTOCONNECT_ENABLED_KEY, true);
+    preferences.remove(AUTOCONNECT_ENABLED_KEY);
+  }
+  
+  peerRegistry = PeerRegistry();
+  MacAddress target1 = preferences.isKey(TARGET1_MAC_KEY) ? loadLegacyTargetMAC(TARGET1_MAC_KEY) : DEFAULT_TARGET1_MAC;
+  MacAddress target2 = preferences.isKey(TARGET2_MAC_KEY) ? loadLegacyTargetMAC(TARGET2_MAC_KEY) : MacAddress();
+  if (target1.isSet()) peerRegistrySet(0, target1, "MY TARGET DEVICE");
+  if (target2.isSet()) peerRegistrySet(1, target2, "TARGET2 DEVICE");
+}
+
+// Use a relay table read from NVS; an empty one stands for RELAY_DEFAULT_CONFIG.
+// Returns false if the table is invalid (the default is kept).
+static bool loadRelayConfig(const RelayConfig& stored) {
+  if (stored.count == 0) {
+    relayConfig = RELAY_DEFAULT_CONFIG;
+  } else if (relayConfigValid(stored)) {
+    relayConfig = stored;
+  } else {
+    Serial.println("Stored relay table is invalid, using the default");
+    return false;
+  }
+  return true;
+}
+
+// Load every setting with one read of one blob, and the handle cache with one
+// more, so boot cost does not grow with the number of peers. On the first boot after an upgrade from the
+// original firmware the settings are gathered from its keys and committed as
+// the blob.
+void loadSettings() {
+  static SettingsRecord record;
+  uint32_t start = micros();
+  preferences.begin(NVS_NAMESPACE, false);
+  size_t length = preferences.getBytes(SETTINGS_KEY, &record, sizeof(record));
+  bool valid = length >= settingsRecordBytes(0) && record.version == SETTINGS_VERSION &&
+               record.peers.version == PEER_REGISTRY_VERSION && record.peers.count <= STORED_PEER_MAX &&
+               length == settingsRecordBytes(record.peers.count);
+  if (valid) {
+    autoConnectEnabled = record.autoConnect;
+    peerRegistry = record.peers;
+    if (!loadRelayConfig(record.relays)) {
+      settingsDirty = true;
+    }
+    if (touchCalibrationValid(record.touch)) {
+      touchCalibration = record.touch;
+    } else {
+      Serial.println("Stored touch calibration is invalid, using the default");
+      touchCalibration = TOUCH_DEFAULT_CALIBRATION;
+      settingsDirty = true;
+    }
+  } else {
+    loadLegacySettings();
+    settingsDirty = true;
+  }
+  
+  size_t cacheLength = preferences.getBytes(HANDLE_CACHE_KEY, handleCache, sizeof(handleCache));
+  handleCacheCount = (cacheLength % sizeof(HandleCacheEntry) == 0) ? cacheLength / sizeof(HandleCacheEntry) : 0;
+  preferences.end();
+  uint32_t readUs = micros() - start;
+  
+  if (settingsDirty) {
+    Serial.println("Settings blob rewritten");
+    settingsCommit();
+  }
+  
+  Serial.printf("=== Settings: %u bytes, read in %lu us ===\n",
+                (unsigned int)settingsRecordBytes(peerRegistry.count), (unsigned long)readUs);
+  Serial.println("Auto-connect enabled: " + String(autoConnectEnabled ? "YES" : "NO"));
+  Serial.printf("Relays configured: %u\n", relayConfig.count);
+  for (int target = 0; target < peerRegistry.count; target++) {
+    const StoredPeer& peer = peerRegistry.peers[target];
+    if (!peer.address.isSet()) continue;
+    Serial.printf("Target%d: %s (%s), handle 0x%04X\n", target + 1, peer.name,
+                  peer.address.toString().c_str(), peer.charHandle);
+  }
+}
+
+// Store a peer in the first free entry, or rename it if it is already stored.
+// Returns its target index, -1 if the registry is full.
+int peerRegistryStore(const MacAddress& address, const char* name) {
+  int target = peerRegistryFind(address);
+  if (target >= 0) {
+    strlcpy(peerRegistry.peers[target].name, name, sizeof(peerRegistry.peers[target].name));
+  } else {
+    for (target = 0; target < STORED_PEER_MAX && peerRegistry.peers[target].address.isSet(); target++) {}
+    if (target == STORED_PEER_MAX) return -1;
+    peerRegistrySet(target, address, name);
+    
+    // Stored while connected: keep what its link already learned
+    int slot = blePoolFind(address);
+    peerRegistry.peers[target].reportsStatus = slot >= 0 && peerLinks[slot].relayStatusReports > 0;
+  }
+  settingsMarkDirty();
+  
+  Serial.printf("Stored Target%d: %s (%s)\n", target + 1, name, address.toString().c_str());
+  return target;
+}
+
+// Remove a stored peer; its index stays free until the next store
+void peerRegistryForget(int target) {
+  reconnectCancel(target);
+  Serial.printf("Forgot Target%d: %s\n", target + 1, peerRegistry.peers[target].name);
+  
+  peerRegistry.peers[target] = StoredPeer();
+  while (peerRegistry.count > 0 && !peerRegistry.peers[peerRegistry.count - 1].address.isSet()) {
+    peerRegistry.count--;
+  }
+  settingsMarkDirty();
+}
+
+// ADDED: Function to update stored devices screen
+void updateStoredDevicesScreen() {
+  if (!stored_devices_screen) return;
+  
+  for (int target = 0; target < peerRegistry.count; target++) {
+    lv_obj_t* label = storedUi.statusLabels[target];
+    if (!label) continue;
+    
+    // Connected: green (themeStatusTextOn), not connected: red
+    int slot = blePoolFind(peerRegistry.peers[target].address);
+    bool connected = slot >= 0 && peerLinks[slot].state == LINK_READY;
+    if (connected) {
+      lv_label_set_text(label, (slot == activePeer) ? "Status: CONNECTED (ACTIVE)" : "Status: CONNECTED");
+    } else {
+      lv_label_set_text(label, "Status: DISCONNECTED");
+    }
+    lv_obj_set_state(label, LV_STATE_CHECKED, connected);
+  }
+}
+
+// BLE Callback for discovered devices
+// Runs on the BLE host task: copy the result into the scan queue for the UI loop to pick up
+class MyAdvertisedDeviceCallbacks: public BLEAdvertisedDeviceCallbacks {
+  void onResult(BLEAdvertisedDevice advertisedDevice) {
+    ScanResultMsg msg;
+    
+    strlcpy(msg.name, advertisedDevice.getName().c_str(), sizeof(msg.name));
+    BLEAddress address = advertisedDevice.getAddress();
+    memcpy(msg.address.bytes, *address.getNative(), sizeof(msg.address.bytes));
+    msg.rssi = advertisedDevice.getRSSI();
+    msg.receivedMicros = micros();
+    
+    // Never block the BLE stack, drop the result if the UI has fallen behind
+    if (xQueueSend(scanResultQueue, &msg, 0) != pdTRUE) {
+      scanDroppedResults++;
+    }
+    wakeMainLoop();
+  }
+};
+
+// Home slot: Fibonacci hashing of the address onto ADVERTISER_SLOT_BITS bits
+static inline uint32_t advertiserHash(uint64_t address) {
+  return (uint32_t)((address * 0x9E3779B97F4A7C15ull) >> (64 - ADVERTISER_SLOT_BITS));
+}
+
+// Slot holding this address, or the free slot it would go into (linear probing).
+// At most ADVERTISER_MAX of the slots are used, so the probe always ends.
+static int advertiserProbe(uint64_t address) {
+  uint32_t i = advertiserHash(address);
+  while (advertiserSlots[i].address != address && advertiserSlots[i].address != 0) {
+    i = (i + 1) & (ADVERTISER_SLOTS - 1);
+  }
+  return i;
+}
+
+Advertiser& advertiserAt(int position) {
+  return advertiserSlots[advertiserList[position]];
+}
+
+// Free a slot and close the gap in its probe chain (backward shift deletion),
+// so lookups need no tombstones. An entry that moves keeps its list position.
+static void advertiserRemoveSlot(uint32_t hole) {
+  uint32_t i = (hole + 1) & (ADVERTISER_SLOTS - 1);
+  while (advertiserSlots[i].address != 0) {
+    // The entry at i may move back into the hole if the hole is on its probe path
+    uint32_t home = advertiserHash(advertiserSlots[i].address);
+    if (((i - home) & (ADVERTISER_SLOTS - 1)) >= ((i - hole) & (ADVERTISER_SLOTS - 1))) {
+      advertiserSlots[hole] = advertiserSlots[i];
+      advertiserList[advertiserSlots[hole].position] = hole;
+      hole = i;
+    }
+    i = (i + 1) & (ADVERTISER_SLOTS - 1);
+  }
+  advertiserSlots[hole].address = 0;
+}
+
+// List position to give up for a new address when the table is full: the
+// weakest entry not heard since the scan started, else the stalest one. The
+// selected device and stored peers are never evicted. -1 if nothing may go.
+static int advertiserVictim() {
+  int victim = -1;
+  bool victimHeard = false;
+  for (int i = 0; i < advertiserCount; i++) {
+    const Advertiser& entry = advertiserAt(i);
+    if (i == selectedDeviceIdx || peerRegistryFind(MacAddress::fromPacked(entry.address)) >= 0) continue;
+    
+    bool heard = (long)(entry.lastSeenMillis - scanStartMillis) >= 0;
+    if (victim >= 0) {
+      const Advertiser& best = advertiserAt(victim);
+      if (heard != victimHeard) {
+        if (heard) continue;
+      } else if (heard ? (long)(entry.lastSeenMillis - best.lastSeenMillis) >= 0 : entry.rssiQ4 >= best.rssiQ4) {
+        continue;
+      }
+    }
+    victim = i;
+    victimHeard = heard;
+  }
+  return victim;
+}
+
+// Merge one advertising report. A new address on a full table takes over the
+// list position of an evicted entry. Returns false if nothing could be evicted.
+bool advertiserUpdate(uint64_t address, const char* name, int rssi, unsigned long now) {
+  int slot = advertiserProbe(address);
+  Advertiser* entry = &advertiserSlots[slot];
+  
+  if (entry->address == 0) {
+    int position = advertiserCount;
+    uint8_t revision = 0;
+    if (advertiserCount >= ADVERTISER_MAX) {
+      position = advertiserVictim();
+      if (position < 0) return false;
+      
+      // The row at this position shows another device now, so its revision moves on
+      int victimSlot = advertiserList[position];
+      revision = advertiserSlots[victimSlot].revision + 1;
+      advertiserRemoveSlot(victimSlot);
+      advertiserEvictions++;
+      slot = advertiserProbe(address);  // The removal may have shifted the probe chain
+      entry = &advertiserSlots[slot];
+    } else {
+      advertiserCount++;
+    }
+    entry->address = address;
+    entry->name[0] = '\0';
+    entry->rssiQ4 = rssi * 16;
+    entry->revision = revision;
+    entry->position = position;
+    advertiserList[position] = slot;
+  } else {
+    int shownDb = entry->rssiQ4 / 16;
+    entry->rssiQ4 += (rssi * 16 - entry->rssiQ4) / (1 << ADVERTISER_RSSI_SHIFT);
+    if (entry->rssiQ4 / 16 != shownDb) entry->revision++;
+  }
+  
+  if (name[0] && strcmp(entry->name, name) != 0) {
+    strlcpy(entry->name, name, sizeof(entry->name));
+    entry->revision++;
+  }
+  entry->lastSeenMillis = now;
+  return true;
+}
+
+// Drop entries not heard for ADVERTISER_AGE_OUT_MS and close up the list,
+// keeping the survivors in discovery order
+void advertiserAgeOut(unsigned long now) {
+  int keptCount = 0;
+  for (int i = 0; i < advertiserCount; i++) {
+    int slot = advertiserList[i];
+    if (now - advertiserSlots[slot].lastSeenMillis >= ADVERTISER_AGE_OUT_MS) {
+      advertiserRemoveSlot(slot);
+    } else {
+      advertiserList[keptCount] = slot;
+      advertiserSlots[slot].position = keptCount++;
+    }
+  }
+  if (keptCount == advertiserCount) return;
+  
+  Serial.printf("Advertiser table: aged out %d of %d\n", advertiserCount - keptCount, advertiserCount);
+  advertiserCount = keptCount;
+}
+
+// Display name of an entry
+const char* advertiserName(const Advertiser& entry) {
+  return entry.name[0] ? entry.name : "Unknown Device";
+}
+
+// Target index of this entry in the peer registry, -1 if it is not stored
+int advertiserTarget(const Advertiser& entry) {
+  return peerRegistryFind(MacAddress::fromPacked(entry.address));
+}
+
+// Status and selection lines of the Bluetooth screen; kept in btView while the screen is torn down
+void uiSetStatus(const String& text) {
+  btView.status = text;
+  if (btUi.connectionStatusLabel) {
+    lv_label_set_text(btUi.connectionStatusLabel, text.c_str());
+  }
+}
+
+void uiSetSelected(const String& text) {
+  btView.selected = text;
+  if (btUi.selectedDeviceLabel) {
+    lv_label_set_text(btUi.selectedDeviceLabel, text.c_str());
+  }
+}
+
+// Show a text line in place of the device rows; nullptr hides it
+void deviceListSetPlaceholder(const char* text) {
+  btView.placeholder = text;
+  if (!btUi.scanPlaceholderLabel) return;
+  
+  if (text) {
+    lv_label_set_text(btUi.scanPlaceholderLabel, text);
+    lv_obj_remove_flag(btUi.scanPlaceholderLabel, LV_OBJ_FLAG_HIDDEN);
+  } else {
+    lv_obj_add_flag(btUi.scanPlaceholderLabel, LV_OBJ_FLAG_HIDDEN);
+  }
+}
+
+// Row text for list position i, e.g. ">> Relay (Target1) (-60dB)"
+static void deviceListRowText(int i, char* buf, size_t len) {
+  const Advertiser& device = advertiserAt(i);
+  char displayText[48];
+  
+  // Mark stored peers with their target number
+  int target = advertiserTarget(device);
+  if (target >= 0) {
+    snprintf(displayText, sizeof(displayText), ">> %s (Target%d)", advertiserName(device), target + 1);
+  } else {
+    strlcpy(displayText, advertiserName(device), sizeof(displayText));
+  }
+  
+  // Add the smoothed RSSI
+  size_t used = strlen(displayText);
+  snprintf(displayText + used, sizeof(displayText) - used, " (%ddB)", device.rssiQ4 / 16);
+  
+  // Truncate if too long
+  if (strlen(displayText) > 30) {
+    strcpy(displayText + 27, "...");
+  }
+  
+  snprintf(buf, len, LV_SYMBOL_BLUETOOTH " %s", displayText);
+}
+
+// Bind the pooled rows to the entries around the current scroll position
+void deviceListRefresh() {
+  if (!btUi.deviceList || !btUi.deviceListSpacer) return;
+  
+  int count = advertiserCount;
+  lv_obj_set_height(btUi.deviceListSpacer, DEVICE_LIST_HEADER_H + max(count, 1) * DEVICE_LIST_ROW_PITCH);
+  
+  int first = (lv_obj_get_scroll_y(btUi.deviceList) - DEVICE_LIST_HEADER_H) / DEVICE_LIST_ROW_PITCH;
+  if (first < 0) first = 0;
+  
+  char text[64];
+  for (int k = 0; k < DEVICE_LIST_POOL_ROWS; k++) {
+    lv_obj_t* row = btUi.deviceListRows[k];
+    int index = first + k;
+    
+    if (index >= count) {
+      lv_obj_add_flag(row, LV_OBJ_FLAG_HIDDEN);
+      btUi.deviceListRowIndex[k] = -1;
+      continue;
+    }
+    
+    // Only reformat the text when the row moves to another entry or its entry changed
+    uint8_t revision = advertiserAt(index).revision;
+    if (btUi.deviceListRowIndex[k] != index || btUi.deviceListRowRevision[k] != revision) {
+      deviceListRowText(index, text, sizeof(text));
+      lv_label_set_text(lv_obj_get_child(row, 0), text);
+      lv_obj_set_user_data(row, (void*)(uintptr_t)index);
+      lv_obj_set_y(row, DEVICE_LIST_HEADER_H + index * DEVICE_LIST_ROW_PITCH);
+      btUi.deviceListRowIndex[k] = index;
+      btUi.deviceListRowRevision[k] = revision;
+    }
+    lv_obj_remove_flag(row, LV_OBJ_FLAG_HIDDEN);
+  }
+}
+
+// Empty the list (the rows are kept for reuse)
+void deviceListClear() {
+  for (int k = 0; k < DEVICE_LIST_POOL_ROWS; k++) {
+    btUi.deviceListRowIndex[k] = -1;
+  }
+  if (btUi.deviceList) {
+    lv_obj_scroll_to_y(btUi.deviceList, 0, LV_ANIM_OFF);
+  }
+  deviceListRefresh();
+}
+
+static void event_handler_deviceListScroll(lv_event_t * e) {
+  deviceListRefresh();
+}
+
+// Create the row pool (each time create_bluetooth_screen builds the screen)
+void deviceListCreateRows() {
+  // Invisible object whose height sets the scrollable content height
+  btUi.deviceListSpacer = lv_obj_create(btUi.deviceList);
+  lv_obj_remove_style_all(btUi.deviceListSpacer);
+  lv_obj_remove_flag(btUi.deviceListSpacer, LV_OBJ_FLAG_CLICKABLE);
+  lv_obj_set_size(btUi.deviceListSpacer, 1, DEVICE_LIST_HEADER_H);
+  
+  for (int k = 0; k < DEVICE_LIST_POOL_ROWS; k++) {
+    lv_obj_t* btn = lv_button_create(btUi.deviceList);
+    lv_obj_set_size(btn, 200, DEVICE_LIST_ROW_H);
+    lv_obj_add_style(btn, &themeListRow, LV_PART_MAIN);
+    lv_obj_add_style(btn, &themeListRowPressed, LV_PART_MAIN | LV_STATE_PRESSED);
+    lv_obj_add_flag(btn, LV_OBJ_FLAG_HIDDEN);
+    
+    lv_obj_t * lbl = lv_label_create(btn);
+    lv_obj_center(lbl);
+    
+    // The device index is stored in the button user data when the row is bound
+    lv_obj_add_event_cb(btn, event_handler_deviceList, LV_EVENT_CLICKED, NULL);
+    
+    btUi.deviceListRows[k] = btn;
+    btUi.deviceListRowIndex[k] = -1;
+  }
+  
+  lv_obj_add_event_cb(btUi.deviceList, event_handler_deviceListScroll, LV_EVENT_SCROLL, NULL);
+}
+
+// BLE stack callback when the scan duration has elapsed. BLEScan keeps this
+// callback after its scan and fires it on any scan's INQ_CMPL, a targeted
+// scan's included, so only a list scan the worker started counts.
+static void bleScanComplete(BLEScanResults results) {
+  if (!listScanRunning) return;
+  listScanRunning = false;
+  scanCompleted = true;
+  wakeMainLoop();
+}
+
+// BLE Functions
+// Starts an asynchronous scan; results are streamed into the list by bleProcessScanResults()
+void bleStartScan() {
+  if (isScanning) return;
+  if (!bleStackReady) {
+    uiSetStatus("Status: Bluetooth starting...");
+    return;
+  }
+  
+  // One scan at a time: a reconnect probe is short, so the list scan follows it
+  if (reconnectProbeRunning() || targetScan.active) {
+    scanAfterProbe = true;
+    uiSetStatus("Status: Scan starts after reconnect probe");
+    return;
+  }
+  
+  Serial.println("=== Starting BLE Scan ===");
+  isScanning = true;
+  scanCompleted = false;
+  scanDroppedResults = 0;
+  advertiserEvictions = 0;
+  scanFirstResultMillis = 0;
+  scanMaxLoopGapMs = 0;
+  scanStartMillis = millis();
+  scanLastDrainMillis = scanStartMillis;
+  
+  // Devices heard recently stay listed; the scan refreshes them in place
+  advertiserAgeOut(scanStartMillis);
+  selectedDeviceIdx = -1;
+  xQueueReset(scanResultQueue);
+  
+  deviceListClear();
+  deviceListSetPlaceholder(advertiserCount ? nullptr : "Scanning...");
+  
+  uiSetSelected("Selected: None");
+  
+  if (btUi.scanButtonLabel) {
+    lv_label_set_text(btUi.scanButtonLabel, "Stop");
+  }
+  
+  // Start BLE scan in the background, bleScanComplete() fires when it ends
+  BleCommand cmd = {};
+  cmd.type = BLE_CMD_SCAN_START;
+  if (!blePostCommand(cmd)) {
+    scanCompleted = true;
+  }
+}
+
+// Cancel a running scan, results already received stay in the list
+void bleStopScan() {
+  if (!isScanning) return;
+  
+  Serial.println("=== Stopping BLE Scan ===");
+  BleCommand cmd = {};
+  cmd.type = BLE_CMD_SCAN_STOP;
+  blePostCommand(cmd, portMAX_DELAY);
+  scanCompleted = true;
+}
+
+// Called from loop(): merges queued scan results into the advertiser table and the device list
+void bleProcessScanResults() {
+  if (!isScanning) return;
+  
+  // Track the longest gap between UI loop iterations while the scan runs
+  unsigned long now = millis();
+  if (now - scanLastDrainMillis > scanMaxLoopGapMs) {
+    scanMaxLoopGapMs = now - scanLastDrainMillis;
+  }
+  scanLastDrainMillis = now;
+  
+  ScanResultMsg msg;
+  int drained = 0;
+  uint32_t updateStart = micros();
+  while (drained < SCAN_DRAIN_PER_LOOP && xQueueReceive(scanResultQueue, &msg, 0) == pdTRUE) {
+    drained++;
+    
+    if (!scanFirstResultMillis) {
+      scanFirstResultMillis = now;
+      Serial.printf("First scan result after %lu ms\n", scanFirstResultMillis - scanStartMillis);
+      
+      deviceListSetPlaceholder(nullptr);
+    }
+    
+    int countBefore = advertiserCount;
+    uint32_t evictionsBefore = advertiserEvictions;
+    if (!advertiserUpdate(msg.address.packed(), msg.name, msg.rssi, now)) {
+      scanDroppedResults++;
+      continue;
+    }
+    if (advertiserCount != countBefore || advertiserEvictions != evictionsBefore) {
+      Serial.printf("BLE Found: %s - %s (%d dB)\n", msg.name[0] ? msg.name : "Unknown Device",
+                    msg.address.toString().c_str(), msg.rssi);
+    }
+  }
+  if (drained) {
+    PERF_RECORD(perfAdvertiserUpdate, (micros() - updateStart) / drained);
+  }
+  
+  // One rebind for the whole batch; only rows in view are touched
+  if (drained) {
+    uint32_t bindStart = micros();
+    deviceListRefresh();
+    PERF_RECORD(perfListBind, micros() - bindStart);
+    PERF_RECORD(perfScanToList, micros() - msg.receivedMicros);
+  }
+  
+  // Finish once the stack reports completion and every queued result is shown
+  if (scanCompleted && uxQueueMessagesWaiting(scanResultQueue) == 0) {
+    if (advertiserCount == 0) {
+      deviceListSetPlaceholder("No devices found");
+    }
+    
+    BleCommand cmd = {};
+    cmd.type = BLE_CMD_SCAN_CLEAR;
+    blePostCommand(cmd);
+    isScanning = false;
+    
+    if (btUi.scanButtonLabel) {
+      lv_label_set_text(btUi.scanButtonLabel, "Scan");
+    }
+    
+    Serial.printf("=== Scan Complete: %d devices in %lu ms (first result %lu ms, dropped %u, evicted %u, max UI gap %lu ms) ===\n",
+                  advertiserCount, millis() - scanStartMillis,
+                  scanFirstResultMillis ? scanFirstResultMillis - scanStartMillis : 0,
+                  (unsigned int)scanDroppedResults, (unsigned int)advertiserEvictions, scanMaxLoopGapMs);
+    PERF_LVGL_MEMORY("after scan");
+  }
+}
+
+// Pure transition table for the connection state machine
+BleLinkState bleLinkNextState(BleLinkState state, BleLinkEventType event) {
+  switch (event) {
+    case LINK_EVT_CONNECT_REQUESTED:
+      return (state == LINK_IDLE) ? LINK_CONNECTING : state;
+    case LINK_EVT_LINK_UP:
+      return (state == LINK_CONNECTING) ? LINK_DISCOVERING : state;
+    case LINK_EVT_READY:
+      return (state == LINK_CONNECTING || state == LINK_DISCOVERING) ? LINK_READY : state;
+    case LINK_EVT_HANDLE_INVALID:
+      return (state == LINK_READY) ? LINK_DISCOVERING : state;
+    case LINK_EVT_FAILED:
+    case LINK_EVT_TIMEOUT:
+      return (state == LINK_CONNECTING || state == LINK_DISCOVERING) ? LINK_IDLE : state;
+    case LINK_EVT_DISCONNECT_REQUESTED:
+      return (state == LINK_IDLE) ? LINK_IDLE : LINK_DISCONNECTING;
+    case LINK_EVT_DISCONNECTED:
+      return LINK_IDLE;
+    case LINK_EVT_WRITE_FAILED:
+      return state;
+    case LINK_EVT_LINK_LOST:
+      return (state == LINK_READY) ? LINK_DISCONNECTING : state;
+    case LINK_EVT_TARGET_SCAN_DONE:
+    case LINK_EVT_RELAY_STATUS:
+      return state;
+  }
+  return state;
+}
+
+const char* bleLinkStateName(BleLinkState state) {
+  switch (state) {
+    case LINK_IDLE:          return "Idle";
+    case LINK_CONNECTING:    return "Connecting";
+    case LINK_DISCOVERING:   return "Discovering";
+    case LINK_READY:         return "Ready";
+    case LINK_DISCONNECTING: return "Disconnecting";
+  }
+  return "?";
+}
+
+// Apply an event to a pool entry's state machine, logging every transition
+void bleLinkApply(int slot, BleLinkEventType event) {
+  BlePeerLink& link = peerLinks[slot];
+  BleLinkState next = bleLinkNextState(link.state, event);
+  if (next != link.state) {
+    Serial.printf("BLE link %d (%s): %s -> %s\n", slot, link.address.toString().c_str(),
+                  bleLinkStateName(link.state), bleLinkStateName(next));
+    link.state = next;
+    link.phaseStartMillis = millis();
+  }
+}
+
+// Find the pool slot holding a peer, -1 if it is not in the pool
+int blePoolFind(const MacAddress& address) {
+  for (int i = 0; i < MAX_PEER_LINKS; i++) {
+    if (peerLinks[i].inUse && peerLinks[i].address == address) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+// True if the peer has a live link that can take writes
+bool bleIsPeerReady(const MacAddress& address) {
+  int slot = blePoolFind(address);
+  return slot >= 0 && peerLinks[slot].state == LINK_READY;
+}
+
+// Pick a slot for a peer: its existing slot, a free one, or the least recently
+// used idle/ready one that is not the active peer
+static int blePoolAcquire(const MacAddress& address) {
+  int slot = blePoolFind(address);
+  if (slot >= 0) return slot;
+  
+  int victim = -1;
+  for (int i = 0; i < MAX_PEER_LINKS; i++) {
+    if (!peerLinks[i].inUse) {
+      victim = i;
+      break;
+    }
+    if (i == activePeer) continue;
+    if (peerLinks[i].state != LINK_IDLE && peerLinks[i].state != LINK_READY) continue;
+    if (victim < 0 || peerLinks[i].lastUsedMillis < peerLinks[victim].lastUsedMillis) {
+      victim = i;
+    }
+  }
+  if (victim < 0) return -1;
+  
+  if (peerLinks[victim].inUse) {
+    Serial.printf("Connection pool full, releasing %s\n", peerLinks[victim].address.toString().c_str());
+    bleDisconnectPeer(victim);
+  }
+  
+  BlePeerLink& link = peerLinks[victim];
+  link = BlePeerLink();
+  link.inUse = true;
+  link.address = address;
+  return victim;
+}
+
+// Fill in a link event for loop()
+static BleLinkEvent bleMakeLinkEvent(BleLinkEventType type, int slot, uint32_t attempt,
+                                     BLEClient* client, BLERemoteCharacteristic* characteristic,
+                                     uint16_t handle, const char* reason) {
+  BleLinkEvent evt;
+  evt.type = type;
+  evt.slot = slot;
+  evt.attempt = attempt;
+  evt.client = client;
+  evt.characteristic = characteristic;
+  evt.handle = handle;
+  strlcpy(evt.reason, reason, sizeof(evt.reason));
+  evt.postedMicros = micros();
+  return evt;
+}
+
+// Post a link event from the BLE worker to loop(), waiting for room in the queue
+static void blePostLinkEvent(BleLinkEventType type, int slot, uint32_t attempt,
+                             BLEClient* client = nullptr,
+                             BLERemoteCharacteristic* characteristic = nullptr,
+                             uint16_t handle = 0,
+                             const char* reason = "") {
+  BleLinkEvent evt = bleMakeLinkEvent(type, slot, attempt, client, characteristic, handle, reason);
+  xQueueSend(linkEventQueue, &evt, portMAX_DELAY);
+  wakeMainLoop();
+}
+
+// Post a link event from a BLE stack callback (BTC task). Never blocks: the BTC
+// task also delivers the events loop() and the worker wait on, so a full queue
+// drops the event and counts it, like onResult() does for scan results.
+static bool bleStackPostLinkEvent(BleLinkEventType type, int slot, uint32_t attempt,
+                                  uint16_t handle = 0, const char* reason = "") {
+  BleLinkEvent evt = bleMakeLinkEvent(type, slot, attempt, nullptr, nullptr, handle, reason);
+  bool posted = xQueueSend(linkEventQueue, &evt, 0) == pdTRUE;
+  if (!posted) {
+    linkEventsDropped++;
+  }
+  wakeMainLoop();
+  return posted;
+}
+
+// Link-loss detection, one instance per pool slot (runs on the BTC task).
+// The worker installs it when it creates a client and removes it before any
+// disconnect it makes itself, so only a peer-side drop is reported. If the
+// event queue is full the loss is parked in lostAttempt for bleLinkPollTimer().
+class BleLinkCallbacks : public BLEClientCallbacks {
+public:
+  int slot = 0;
+  volatile uint32_t attempt = 0;
+  volatile uint32_t lostAttempt = 0;  // Attempt whose LINK_LOST could not be queued, 0 if none
+  
+  void onConnect(BLEClient* client) {}
+  
+  void onDisconnect(BLEClient* client) {
+    if (!bleStackPostLinkEvent(LINK_EVT_LINK_LOST, slot, attempt, 0, "Connection lost")) {
+      lostAttempt = attempt;
+    }
+  }
+};
+
+BleLinkCallbacks bleLinkCallbacks[MAX_PEER_LINKS];
+
+// Worker side of BLE_CMD_WRITE. The credit was taken when the write was posted;
+// a write the stack refuses gives it back here.
+static void bleWorkerWrite(const BleCommand& cmd) {
+  esp_err_t err = esp_ble_gattc_write_char(cmd.client->getGattcIf(), cmd.connId, cmd.handle,
+                                           cmd.length, (uint8_t*)cmd.data,
+                                           cmd.response ? ESP_GATT_WRITE_TYPE_RSP : ESP_GATT_WRITE_TYPE_NO_RSP,
+                                           ESP_GATT_AUTH_REQ_NONE);
+  if (err != ESP_OK) {
+    portENTER_CRITICAL(&bleWriteCreditMux);
+    if (peerLinks[cmd.slot].writesInFlight > 0) peerLinks[cmd.slot].writesInFlight--;
+    portEXIT_CRITICAL(&bleWriteCreditMux);
+    
+    Serial.printf("BLE write failed: %d\n", err);
+    blePostLinkEvent(LINK_EVT_WRITE_FAILED, cmd.slot, cmd.attempt);
+  }
+}
+
+// Run every queued write. The worker calls this before each command and
+// between the blocking steps of a connect, so writes to peers that are already
+// READY do not wait behind a connect, scan or discovery.
+static void bleWorkerDrainWrites() {
+  BleCommand cmd;
+  while (xQueueReceive(bleWriteQueue, &cmd, 0) == pdTRUE) {
+    bleWorkerWrite(cmd);
+  }
+}
+
+// Worker side of BLE_CMD_CONNECT: the blocking connect and discovery calls.
+// The worker owns the client until it hands it over with LINK_EVT_READY.
+// With a cached handle, discovery is skipped and the handle is used directly.
+static void bleWorkerConnect(const BleCommand& cmd) {
+  int slot = cmd.slot;
+  uint32_t attempt = cmd.attempt;
+  BLEClient* client = cmd.client;
+  
+  // No client means a fresh connection; otherwise rediscover on the existing link
+  if (client == nullptr) {
+    Serial.printf("Attempting BLE connection to: %s\n", cmd.address.toString().c_str());
+    
+    client = BLEDevice::createClient();
+    esp_bd_addr_t bda;
+    memcpy(bda, cmd.address.bytes, sizeof(bda));
+    BLEAddress address(bda);
+    
+    bleLinkCallbacks[slot].slot = slot;
+    bleLinkCallbacks[slot].attempt = attempt;
+    client->setClientCallbacks(&bleLinkCallbacks[slot]);
+    
+    if (!client->connect(address, BLE_ADDR_TYPE_PUBLIC, CONNECT_TIMEOUT_MS)) {
+      client->setClientCallbacks(nullptr);
+      delete client;
+      blePostLinkEvent(LINK_EVT_FAILED, slot, attempt, nullptr, nullptr, 0, "Connection failed");
+      return;
+    }
+    bleWorkerDrainWrites();
+    
+    if (cmd.cachedHandle) {
+      blePostLinkEvent(LINK_EVT_READY, slot, attempt, client, nullptr, cmd.cachedHandle);
+      return;
+    }
+    blePostLinkEvent(LINK_EVT_LINK_UP, slot, attempt);
+  }
+  
+  // Get the service
+  BLERemoteService* pRemoteService = client->getService(SERVICE_UUID);
+  if (pRemoteService == nullptr) {
+    client->setClientCallbacks(nullptr);
+    client->disconnect();
+    delete client;
+    blePostLinkEvent(LINK_EVT_FAILED, slot, attempt, nullptr, nullptr, 0, "Service not found");
+    return;
+  }
+  bleWorkerDrainWrites();
+  
+  // Get the characteristic
+  BLERemoteCharacteristic* characteristic = pRemoteService->getCharacteristic(CHARACTERISTIC_UUID);
+  if (characteristic == nullptr) {
+    client->setClientCallbacks(nullptr);
+    client->disconnect();
+    delete client;
+    blePostLinkEvent(LINK_EVT_FAILED, slot, attempt, nullptr, nullptr, 0, "Characteristic not found");
+    return;
+  }
+  
+  blePostLinkEvent(LINK_EVT_READY, slot, attempt, client, characteristic, characteristic->getHandle());
+}
+
+// FFE1's CCCD, by descriptor discovery: through BLERemoteCharacteristic after a
+// full discovery, else from the stack's attribute cache. 0 if neither has it.
+static uint16_t bleWorkerFindCccd(const BleCommand& cmd) {
+  if (cmd.characteristic) {
+    BLERemoteDescriptor* cccd = cmd.characteristic->getDescriptor(BLEUUID((uint16_t)ESP_GATT_UUID_CHAR_CLIENT_CONFIG));
+    return cccd ? cccd->getHandle() : 0;
+  }
+  
+  esp_bt_uuid_t uuid = {};
+  uuid.len = ESP_UUID_LEN_16;
+  uuid.uuid.uuid16 = ESP_GATT_UUID_CHAR_CLIENT_CONFIG;
+  esp_gattc_descr_elem_t descr;
+  uint16_t count = 1;
+  if (esp_ble_gattc_get_descr_by_char_handle(cmd.client->getGattcIf(), cmd.connId, cmd.handle, uuid,
+                                             &descr, &count) == ESP_GATT_OK && count > 0) {
+    return descr.handle;
+  }
+  return 0;
+}
+
+// Worker side of BLE_CMD_SUBSCRIBE: register for FFE1 notifications and switch
+// them on in the peer's CCCD. Without a discovered CCCD nothing is written; the
+// link works without status reports until a full discovery finds one.
+static void bleWorkerSubscribe(const BleCommand& cmd) {
+  uint16_t cccd = bleWorkerFindCccd(cmd);
+  if (cccd == 0) {
+    Serial.printf("Relay status notifications unavailable: no CCCD found for handle 0x%04X\n", cmd.handle);
+    return;
+  }
+  
+  esp_bd_addr_t bda;
+  memcpy(bda, cmd.address.bytes, ESP_BD_ADDR_LEN);
+  uint8_t enable[2] = { 0x01, 0x00 };
+  
+  esp_err_t err = esp_ble_gattc_register_for_notify(cmd.client->getGattcIf(), bda, cmd.handle);
+  if (err == ESP_OK) {
+    err = esp_ble_gattc_write_char_descr(cmd.client->getGattcIf(), cmd.connId, cccd,
+                                         sizeof(enable), enable, ESP_GATT_WRITE_TYPE_RSP,
+                                         ESP_GATT_AUTH_REQ_NONE);
+  }
+  if (err != ESP_OK) {
+    Serial.printf("Relay status notifications unavailable: %d\n", err);
+  }
+}
+
+// End of a targeted scan (BTC task): hand the result to loop()
+static void bleTargetScanFinish() {
+  targetScan.endMillis = millis();
+  targetScan.active = false;
+  if (!bleStackPostLinkEvent(LINK_EVT_TARGET_SCAN_DONE, targetScan.wantedMask, 0, targetScan.foundMask)) {
+    targetScan.donePending = true;
+  }
+}
+
+// BLE stack GAP hook (runs on the BTC task): matches targeted scan reports
+// against the wanted targets, stops the scan once all of them are seen and
+// reports the end of the scan
+static void bleGapEventHandler(esp_gap_ble_cb_event_t event, esp_ble_gap_cb_param_t* param) {
+  if (!targetScan.active) return;
+  
+  if (event == ESP_GAP_BLE_SCAN_RESULT_EVT) {
+    if (param->scan_rst.search_evt == ESP_GAP_SEARCH_INQ_RES_EVT) {
+      targetScan.reports++;
+      for (int target = 0; target < STORED_PEER_MAX; target++) {
+        uint8_t bit = 1 << target;
+        if (!(targetScan.wantedMask & bit) || (targetScan.foundMask & bit)) continue;
+        if (memcmp(param->scan_rst.bda, targetScan.address[target], ESP_BD_ADDR_LEN) != 0) continue;
+        
+        targetScan.foundMillis[target] = millis();
+        targetScan.foundMask |= bit;
+        if (targetScan.foundMask == targetScan.wantedMask) {
+          esp_ble_gap_stop_scanning();
+        }
+      }
+    } else if (param->scan_rst.search_evt == ESP_GAP_SEARCH_INQ_CMPL_EVT) {
+      bleTargetScanFinish();
+    }
+  } else if (event == ESP_GAP_BLE_SCAN_START_COMPLETE_EVT) {
+    if (param->scan_start_cmpl.status != ESP_BT_STATUS_SUCCESS) {
+      bleTargetScanFinish();
+    }
+  } else if (event == ESP_GAP_BLE_SCAN_STOP_COMPLETE_EVT) {
+    bleTargetScanFinish();
+  }
+}
+
+// Worker side of BLE_CMD_TARGET_SCAN. Runs the scan directly on the GAP API
+// (BLEScan has no filter policy setting) and goes straight back to the queue;
+// bleGapEventHandler() posts LINK_EVT_TARGET_SCAN_DONE when the scan ends.
+static void bleWorkerTargetScan(const BleCommand& cmd) {
+  // The previous scan's targets leave the whitelist here, on the worker
+  for (int target = 0; target < STORED_PEER_MAX; target++) {
+    if (targetScan.listedMask & (1 << target)) {
+      esp_ble_gap_update_whitelist(false, targetScan.address[target], BLE_WL_ADDR_TYPE_PUBLIC);
+    }
+  }
   
-  // Create BLE client
-  pClient = BLEDevice::createClient();
-  serverAddress = new BLEAddress(storedTarget2MAC.c_str());
+  targetScan.wantedMask = cmd.slot;
+  targetScan.listedMask = cmd.slot;
+  targetScan.foundMask = 0;
+  targetScan.reports = 0;
+  for (int target = 0; target < STORED_PEER_MAX; target++) {
+    if (!(targetScan.wantedMask & (1 << target))) continue;
+    memcpy(targetScan.address[target], cmd.targetAddress[target].bytes, ESP_BD_ADDR_LEN);
+    esp_ble_gap_update_whitelist(true, targetScan.address[target], BLE_WL_ADDR_TYPE_PUBLIC);
+  }
   
-  Serial.print("Direct connection to Target2: ");
-  Serial.println(storedTarget2MAC);
+  esp_ble_scan_params_t params = {};
+  params.scan_type = BLE_SCAN_TYPE_PASSIVE;
+  params.own_addr_type = BLE_ADDR_TYPE_PUBLIC;
+  params.scan_filter_policy = BLE_SCAN_FILTER_ALLOW_ONLY_WLST;
+  params.scan_interval = TARGET_SCAN_INTERVAL;
+  params.scan_window = TARGET_SCAN_WINDOW;
+  params.scan_duplicate = BLE_SCAN_DUPLICATE_ENABLE;  // One report per target is all we need
   
-  // Connect to BLE server
-  if (pClient->connect(*serverAddress)) {
-    Serial.println("Connected to Target2 BLE server!");
-    
-    // Get the service
-    BLERemoteService* pRemoteService = pClient->getService(SERVICE_UUID);
-    if (pRemoteService == nullptr) {
-      Serial.println("Failed to find service UUID on Target2");
-      bleDisconnect();
-      updateStatusIndicator();  // UPDATE status indicator
-      updateStoredDevicesScreen();  // UPDATE stored devices screen
-      return false;
+  targetScan.startMillis = millis();
+  targetScan.active = true;
+  if (esp_ble_gap_set_scan_params(&params) != ESP_OK ||
+      esp_ble_gap_start_scanning(TARGET_SCAN_DURATION_S) != ESP_OK) {
+    targetScan.active = false;
+    targetScan.endMillis = targetScan.startMillis;
+    Serial.println("ERROR: Failed to start targeted scan");
+    blePostLinkEvent(LINK_EVT_TARGET_SCAN_DONE, cmd.slot, 0, nullptr, nullptr, 0);
+  }
+}
+
+// Ask the worker to connect a pool entry for its current attempt
+static bool bleStartConnect(int slot, uint16_t cachedHandle, BLEClient* client) {
+  BlePeerLink& link = peerLinks[slot];
+  
+  BleCommand cmd = {};
+  cmd.type = BLE_CMD_CONNECT;
+  cmd.slot = slot;
+  cmd.attempt = link.attempt;
+  cmd.address = link.address;
+  cmd.cachedHandle = cachedHandle;
+  cmd.client = client;
+  return blePostCommand(cmd);
+}
+
+// Hand a client to the worker to disconnect and delete. The worker drains the
+// write queue before every command, so writes already posted for it still find it alive.
+static void bleReleaseClient(BLEClient* client) {
+  BleCommand cmd = {};
+  cmd.type = BLE_CMD_DISCONNECT;
+  cmd.client = client;
+  blePostCommand(cmd, portMAX_DELAY);
+}
+
+// BLE stack GATT client hook (runs on the BTC task). Write completions return
+// flow control credits; a rejected write to a cached handle means the peer's
+// attribute table changed: rediscover. FFE1 notifications carry relay status.
+static void bleGattcEventHandler(esp_gattc_cb_event_t event, esp_gatt_if_t gattc_if,
+                                 esp_ble_gattc_cb_param_t* param) {
+  if (event == ESP_GATTC_CONGEST_EVT) {
+    for (int i = 0; i < MAX_PEER_LINKS; i++) {
+      if (peerLinks[i].state == LINK_READY && peerLinks[i].connId == param->congest.conn_id) {
+        peerLinks[i].congested = param->congest.congested;
+      }
     }
-    
-    // Get the characteristic
-    pRemoteCharacteristic = pRemoteService->getCharacteristic(CHARACTERISTIC_UUID);
-    if (pRemoteCharacteristic == nullptr) {
-      Serial.println("Failed to find characteristic UUID on Target2");
-      bleDisconnect();
-      updateStatusIndicator();  // UPDATE status indicator
-      updateStoredDevicesScreen();  // UPDATE stored devices screen
-      return false;
+    wakeMainLoop();
+    return;
+  }
+  
+  if (event == ESP_GATTC_NOTIFY_EVT) {
+    for (int i = 0; i < MAX_PEER_LINKS; i++) {
+      const BlePeerLink& link = peerLinks[i];
+      if (link.state != LINK_READY || link.connId != param->notify.conn_id ||
+          link.charHandle != param->notify.handle) continue;
+      
+      uint8_t known, on;
+      if (relayParseStatus(param->notify.value, param->notify.value_len, known, on) > 0) {
+        bleStackPostLinkEvent(LINK_EVT_RELAY_STATUS, i, link.attempt, (known << 8) | on);
+      }
     }
+    return;
+  }
+  
+  if (event != ESP_GATTC_WRITE_CHAR_EVT) return;
+  
+  for (int i = 0; i < MAX_PEER_LINKS; i++) {
+    BlePeerLink& link = peerLinks[i];
+    if (link.state != LINK_READY || link.connId != param->write.conn_id ||
+        link.charHandle != param->write.handle) continue;
     
-    isConnected = true;
-    connectedDeviceName = "TARGET2 DEVICE";
-    connectedDeviceAddress = storedTarget2MAC;
+    portENTER_CRITICAL(&bleWriteCreditMux);
+    if (link.writesInFlight > 0) link.writesInFlight--;
+    portEXIT_CRITICAL(&bleWriteCreditMux);
+    wakeMainLoop();
     
-    if (connectionStatusLabel) {
-      lv_label_set_text(connectionStatusLabel, "Status: Connected to Target2");
+    if (param->write.status != ESP_GATT_OK && link.handleFromCache) {
+      bleStackPostLinkEvent(LINK_EVT_HANDLE_INVALID, i, link.attempt, param->write.handle);
     }
+  }
+}
+
+// BLE worker task: brings up the stack off the UI core (setup() does not wait
+// for it), then executes commands from loop() in order
+static void bleWorkerTask(void* param) {
+  Serial.println("Initializing BLE Client...");
+  BLEDevice::init("POV_BLE_Controller");
+  BLEDevice::setCustomGattcHandler(bleGattcEventHandler);
+  BLEDevice::setCustomGapHandler(bleGapEventHandler);
+  
+  // Create BLE scan
+  pBLEScan = BLEDevice::getScan();
+  pBLEScan->setAdvertisedDeviceCallbacks(new MyAdvertisedDeviceCallbacks(), true);  // Repeats refresh RSSI
+  pBLEScan->setActiveScan(true);
+  pBLEScan->setInterval(100);
+  pBLEScan->setWindow(99);
+  
+  Serial.println("BLE initialized successfully");
+  bootMark("BLE stack ready");
+  bleStackReady = true;
+  wakeMainLoop();
+  
+  // Every post notifies the worker; one wakeup runs everything queued so far
+  BleCommand cmd;
+  for (;;) {
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
     
-    // UPDATE status indicator and stored devices screen
-    updateStatusIndicator();
-    updateStoredDevicesScreen();
-    
-    // Send connection confirmation
-    delay(100);
-    bleSendData("CONNECTED_TO_TARGET2");
-    
-    Serial.println("=== Target2 BLE Auto-Connection Successful ===");
-    return true;
-  } else {
-    Serial.println("Failed to auto-connect to Target2 BLE server");
-    delete pClient;
-    pClient = nullptr;
-    delete serverAddress;
-    serverAddress = nullptr;
-    updateStatusIndicator();  // UPDATE status indicator
-    updateStoredDevicesScreen();  // UPDATE stored devices screen
-    return false;
+    for (;;) {
+      bleWorkerDrainWrites();
+      if (xQueueReceive(bleCommandQueue, &cmd, 0) != pdTRUE) break;
+      
+      switch (cmd.type) {
+        case BLE_CMD_SCAN_START:
+          listScanRunning = true;
+          if (!pBLEScan->start(SCAN_DURATION_S, bleScanComplete, false)) {
+            listScanRunning = false;
+            Serial.println("ERROR: Failed to start BLE scan");
+            scanCompleted = true;
+            wakeMainLoop();
+          }
+          break;
+        
+        case BLE_CMD_SCAN_STOP:
+          listScanRunning = false;
+          pBLEScan->stop();
+          break;
+        
+        case BLE_CMD_SCAN_CLEAR:
+          pBLEScan->clearResults();
+          break;
+        
+        case BLE_CMD_CONNECT:
+          bleWorkerConnect(cmd);
+          break;
+        
+        case BLE_CMD_WRITE:
+          bleWorkerWrite(cmd);
+          break;
+        
+        case BLE_CMD_TARGET_SCAN:
+          bleWorkerTargetScan(cmd);
+          break;
+        
+        case BLE_CMD_SUBSCRIBE:
+          bleWorkerSubscribe(cmd);
+          break;
+        
+        case BLE_CMD_DISCONNECT:
+          cmd.client->setClientCallbacks(nullptr);
+          if (cmd.client->isConnected()) {
+            cmd.client->disconnect();
+          }
+          delete cmd.client;
+          break;
+      }
+    }
   }
 }
 
-// BLE Functions
-void bleStartScan() {
-  if (isScanning) return;
+// Called from loop(): start the boot auto-connect once the BLE stack is up
+void bootProcess() {
+  if (!bootAutoConnectPending || !bleStackReady) return;
   
-  Serial.println("=== Starting BLE Scan ===");
-  isScanning = true;
+  bootAutoConnectPending = false;
+  if (autoConnectEnabled && peerRegistry.peers[0].address.isSet()) {
+    bootMark("auto-connect");
+    // Straight to a connect, no probe; if it fails the reconnect policy takes over
+    reconnectPolicy[0].lostMillis = millis();
+    reconnectStartAttempt(0);
+  }
+}
+
+// Make a ready pool entry the one the relay buttons drive
+void bleSetActivePeer(int slot) {
+  activePeer = slot;
+  peerLinks[slot].lastUsedMillis = millis();
   
-  bleDevices.clear();
-  selectedDeviceIdx = -1;
+  uiSetStatus(String("Status: Connected to ") + peerLinks[slot].name);
+  updateStatusIndicator();
+  updateStoredDevicesScreen();
+  
+  Serial.printf("Active peer: %s (%s)\n", peerLinks[slot].name, peerLinks[slot].address.toString().c_str());
+  relayRefreshButtons();
+}
+
+// Start connecting to a device. Returns immediately; progress arrives through
+// bleProcessLinkEvents(). hello is sent once the link is ready.
+// A peer that is already pooled and ready just becomes the active peer.
+bool bleConnect(const MacAddress& address, const char* name, const char* hello) {
+  if (!bleStackReady) {
+    uiSetStatus("Status: Bluetooth starting...");
+    return false;
+  }
+  
+  int slot = blePoolAcquire(address);
+  if (slot < 0) {
+    Serial.println("ERROR: No free connection slot");
+    uiSetStatus("Status: Too many connections");
+    return false;
+  }
+  
+  BlePeerLink& link = peerLinks[slot];
+  strlcpy(link.name, name, sizeof(link.name));
+  link.hello = hello;
+  
+  if (link.state == LINK_READY) {
+    bleSetActivePeer(slot);
+    return true;
+  }
   
-  if (deviceList) {
-    lv_obj_clean(deviceList);
-    lv_list_add_text(deviceList, "Scanning...");
+  if (link.state != LINK_IDLE) {
+    Serial.println("ERROR: A connection attempt is already in progress");
+    return false;
+  }
+  
+  Serial.printf("=== Connecting to: %s (%s) ===\n", name, address.toString().c_str());
+  
+  // A running scan would compete with the connection for the radio
+  bleStopScan();
+  
+  link.attempt = ++nextLinkAttempt;
+  link.attemptStartMillis = millis();
+  link.lastUsedMillis = link.attemptStartMillis;
+  
+  // A cached handle lets the worker skip service/characteristic discovery
+  uint16_t cachedHandle = loadCachedHandle(address, link.charProperties);
+  link.handleFromCache = (cachedHandle != 0);
+  
+  bleLinkApply(slot, LINK_EVT_CONNECT_REQUESTED);
+  
+  if (!bleStartConnect(slot, cachedHandle, nullptr)) {
+    bleLinkApply(slot, LINK_EVT_FAILED);
+    return false;
+  }
+  
+  uiSetStatus("Status: Connecting...");
+  return true;
+}
+
+// Connect to a device from the scan list
+bool bleConnectToDevice(int deviceIndex) {
+  if (deviceIndex < 0 || deviceIndex >= advertiserCount) {
+    Serial.printf("ERROR: Invalid device index %d (list has %d devices)\n",
+                  deviceIndex, advertiserCount);
+    return false;
   }
   
-  if (selectedDeviceLabel) {
-    lv_label_set_text(selectedDeviceLabel, "Selected: None");
+  const Advertiser& device = advertiserAt(deviceIndex);
+  return bleConnect(MacAddress::fromPacked(device.address), advertiserName(device), "CONNECTED");
+}
+
+// Connect to a stored peer by target index
+bool bleConnectStoredTarget(int target) {
+  const StoredPeer& peer = peerRegistry.peers[target];
+  
+  if (!peer.address.isSet()) {
+    Serial.printf("ERROR: Target%d is not stored!\n", target + 1);
+    Serial.println("Please select a device and tap 'Store' to store it.");
+    
+    uiSetStatus(String("Status: Target") + (target + 1) + " not set");
+    updateStoredDevicesScreen();
+    return false;
   }
   
-  // Start BLE scan for 5 seconds
-  BLEScanResults foundDevices = pBLEScan->start(5, false);
-  Serial.print("BLE scan found: ");
-  Serial.print(foundDevices.getCount());
-  Serial.println(" devices");
+  return bleConnect(peer.address, peer.name, PEER_HELLO[target]);
+}
+
+// Next retry after the current backoff plus up to 25% jitter; the backoff then doubles
+static void reconnectSchedule(int target) {
+  ReconnectPolicy& policy = reconnectPolicy[target];
+  uint32_t delayMs = policy.backoffMs + random(0, policy.backoffMs / 4 + 1);
+  policy.nextAttemptMillis = millis() + delayMs;
+  policy.backoffMs = min<uint32_t>(policy.backoffMs * 2, RECONNECT_BACKOFF_MAX_MS);
+  policy.phase = RECONNECT_WAITING;
+  Serial.printf("Reconnect Target%d: next try in %lu ms\n", target + 1, (unsigned long)delayMs);
+}
+
+// Start retrying a target after its link was lost
+void reconnectArm(int target) {
+  if (target < 0 || !autoConnectEnabled) return;
+  
+  ReconnectPolicy& policy = reconnectPolicy[target];
+  if (policy.phase != RECONNECT_OFF) return;
+  
+  policy.lostMillis = millis();
+  policy.attempts = 0;
+  policy.probesAbsent = 0;
+  policy.backoffMs = RECONNECT_BACKOFF_MIN_MS;
+  reconnectSchedule(target);
+}
+
+// Stop retrying (the user disconnected the target or turned auto-connect off)
+void reconnectCancel(int target) {
+  if (target < 0 || reconnectPolicy[target].phase == RECONNECT_OFF) return;
   
-  // Update UI with found devices
-  // In the bleStartScan() function, replace the list update section with:
+  Serial.printf("Reconnect Target%d: cancelled\n", target + 1);
+  reconnectPolicy[target].phase = RECONNECT_OFF;
+}
+
+void reconnectStartAttempt(int target) {
+  ReconnectPolicy& policy = reconnectPolicy[target];
+  policy.attempts++;
+  policy.phase = RECONNECT_CONNECTING;
+  if (!bleConnectStoredTarget(target)) {
+    reconnectSchedule(target);
+  }
+}
+
+// Targeted scan result: connect only to targets that are advertising
+void reconnectProbeDone(uint8_t wantedMask, uint8_t foundMask) {
+  for (int target = 0; target < STORED_PEER_MAX; target++) {
+    if (!(wantedMask & (1 << target)) || reconnectPolicy[target].phase != RECONNECT_PROBING) continue;
+    
+    if (foundMask & (1 << target)) {
+      reconnectStartAttempt(target);
+    } else {
+      reconnectPolicy[target].probesAbsent++;
+      Serial.printf("Reconnect Target%d: not advertising\n", target + 1);
+      reconnectSchedule(target);
+    }
+  }
+}
 
-// Update UI with found devices
-// In the bleStartScan() function, replace the list update section with:
+// A targeted scan is posted or running
+bool reconnectProbeRunning() {
+  for (int target = 0; target < STORED_PEER_MAX; target++) {
+    if (reconnectPolicy[target].phase == RECONNECT_PROBING) return true;
+  }
+  return false;
+}
 
-// Update UI with found devices
-if (deviceList) {
-  // Clear the container (remove all children except the header)
-  lv_obj_t* child = lv_obj_get_child(deviceList, 0);
-  int child_index = 0;
-  while (child) {
-    // Keep the first child (header)
-    if (child_index > 0) {
-      lv_obj_del(child);
+// Called from loop() when a targeted scan has ended
+void bleTargetScanDone(uint8_t wantedMask, uint8_t foundMask) {
+  for (int target = 0; target < STORED_PEER_MAX; target++) {
+    if (wantedMask & foundMask & (1 << target)) {
+      Serial.printf("Targeted scan: Target%d found after %lu ms\n", target + 1,
+                    targetScan.foundMillis[target] - targetScan.startMillis);
     }
-    child = lv_obj_get_child(deviceList, ++child_index);
+  }
+  Serial.printf("Targeted scan: %lu ms at %d%% radio duty, %lu report(s) to the host\n",
+                targetScan.endMillis - targetScan.startMillis,
+                TARGET_SCAN_WINDOW * 100 / TARGET_SCAN_INTERVAL, (unsigned long)targetScan.reports);
+  
+  reconnectProbeDone(wantedMask, foundMask);
+  
+  if (scanAfterProbe) {
+    scanAfterProbe = false;
+    bleStartScan();
+  }
+}
+
+// Called from loop(): advance each target's reconnect policy. Targets due
+// for a retry share one targeted scan.
+void bleProcessReconnects() {
+  // The GAP hook could not queue the end of the last targeted scan
+  if (targetScan.donePending) {
+    targetScan.donePending = false;
+    bleTargetScanDone(targetScan.wantedMask, targetScan.foundMask);
   }
   
-  if (foundDevices.getCount() > 0) {
-    // First, add all found devices
-    for (int i = 0; i < foundDevices.getCount(); i++) {
-      BLEAdvertisedDevice device = foundDevices.getDevice(i);
-      String deviceName = device.getName().c_str();
-      if (deviceName.length() == 0) {
-        deviceName = "Unknown Device";
+  BleCommand cmd = {};
+  cmd.type = BLE_CMD_TARGET_SCAN;
+  bool probing = false;
+  
+  for (int target = 0; target < STORED_PEER_MAX; target++) {
+    ReconnectPolicy& policy = reconnectPolicy[target];
+    if (policy.phase == RECONNECT_OFF) continue;
+    
+    const MacAddress& mac = peerRegistry.peers[target].address;
+    if (!autoConnectEnabled || !mac.isSet()) {
+      reconnectCancel(target);
+      continue;
+    }
+    
+    // Connected, by this policy or by hand
+    int slot = blePoolFind(mac);
+    if (slot >= 0 && peerLinks[slot].state == LINK_READY) {
+      policy.reconnects++;
+      policy.phase = RECONNECT_OFF;
+      Serial.printf("Reconnect Target%d: connected after %lu ms, %lu attempt(s), %lu probe(s) absent\n",
+                    target + 1, millis() - policy.lostMillis, (unsigned long)policy.attempts,
+                    (unsigned long)policy.probesAbsent);
+      continue;
+    }
+    
+    if (policy.phase == RECONNECT_CONNECTING) {
+      // The attempt failed or timed out
+      if (slot < 0 || peerLinks[slot].state == LINK_IDLE) {
+        reconnectSchedule(target);
       }
-      
-      String deviceAddress = device.getAddress().toString().c_str();
-      int rssi = device.getRSSI();
-      
-      BLEDeviceInfo newDevice;
-      newDevice.name = deviceName;
-      newDevice.address = deviceAddress;
-      newDevice.rssi = rssi;
-      newDevice.isTarget1 = (deviceAddress == storedTarget1MAC);
-      newDevice.isTarget2 = (deviceAddress == storedTarget2MAC);
-      bleDevices.push_back(newDevice);
-      
-      Serial.printf("BLE Found: %s - %s (%d dB)\n", 
-                    deviceName.c_str(), deviceAddress.c_str(), rssi);
+      continue;
     }
     
-    // Now add devices to the container
-    for (size_t i = 0; i < bleDevices.size(); i++) {
-      String displayText = bleDevices[i].name;
-      
-      // Mark as Target1 or Target2 if they match stored MACs
-      if (bleDevices[i].isTarget1) {
-        displayText = ">> " + displayText + " (Target1)";
-      } else if (bleDevices[i].isTarget2) {
-        displayText = ">> " + displayText + " (Target2)";
+    if (policy.phase == RECONNECT_PROBING) probing = true;
+    if (policy.phase != RECONNECT_WAITING || (long)(millis() - policy.nextAttemptMillis) < 0) continue;
+    
+    cmd.slot |= 1 << target;
+    cmd.targetAddress[target] = mac;
+  }
+  if (cmd.slot == 0) return;
+  
+  // One targeted scan at a time, and never during a user scan
+  if (isScanning || probing) {
+    for (int target = 0; target < STORED_PEER_MAX; target++) {
+      if (cmd.slot & (1 << target)) {
+        reconnectPolicy[target].nextAttemptMillis = millis() + RECONNECT_BACKOFF_MIN_MS;
       }
-      
-      // Add RSSI if available
-      if (bleDevices[i].rssi != 0) {
-        displayText += " (" + String(bleDevices[i].rssi) + "dB)";
+    }
+    return;
+  }
+  
+  bool posted = blePostCommand(cmd);
+  for (int target = 0; target < STORED_PEER_MAX; target++) {
+    if (!(cmd.slot & (1 << target))) continue;
+    if (posted) {
+      reconnectPolicy[target].phase = RECONNECT_PROBING;
+    } else {
+      reconnectSchedule(target);
+    }
+  }
+}
+
+// How long the current connect/discovery phase may take, 0 when no attempt is running
+uint32_t bleLinkPhaseTimeout(const BlePeerLink& link) {
+  if (!link.inUse) return 0;
+  if (link.state == LINK_CONNECTING) return CONNECT_TIMEOUT_MS + PHASE_TIMEOUT_MARGIN_MS;
+  if (link.state == LINK_DISCOVERING) return DISCOVERY_TIMEOUT_MS;
+  return 0;
+}
+
+// Called from loop(): consume BLE worker events and enforce phase timeouts
+void bleProcessLinkEvents() {
+  // A dropped relay status is caught by the confirm timeout, a dropped
+  // HANDLE_INVALID by the next rejected write; just make the loss visible
+  if (linkEventsDropped != linkEventsDroppedReported) {
+    linkEventsDroppedReported = linkEventsDropped;
+    Serial.printf("WARNING: %lu BLE stack event(s) dropped, link event queue full\n",
+                  (unsigned long)linkEventsDroppedReported);
+  }
+  
+  BleLinkEvent evt;
+  while (xQueueReceive(linkEventQueue, &evt, 0) == pdTRUE) {
+    // Not about a pool slot: evt.slot and evt.handle are target masks
+    if (evt.type == LINK_EVT_TARGET_SCAN_DONE) {
+      bleTargetScanDone(evt.slot, evt.handle);
+      continue;
+    }
+    
+    BlePeerLink& link = peerLinks[evt.slot];
+    
+    // Events from an attempt that already timed out or was superseded
+    if (!link.inUse || evt.attempt != link.attempt) {
+      if (evt.client) {
+        bleReleaseClient(evt.client);
       }
+      continue;
+    }
+    
+    bleLinkApply(evt.slot, evt.type);
+    
+    switch (evt.type) {
+      case LINK_EVT_LINK_UP:
+        Serial.println("Connected to BLE server, discovering services...");
+        uiSetStatus("Status: Discovering...");
+        break;
       
-      // Truncate if too long
-      if (displayText.length() > 30) {
-        displayText = displayText.substring(0, 27) + "...";
+      case LINK_EVT_READY: {
+        // Already had a client: this was a rediscovery after a rejected cached handle
+        bool rediscovered = (link.client != nullptr);
+        
+        link.client = evt.client;
+        link.characteristic = evt.characteristic;
+        link.charHandle = evt.handle;
+        link.connId = evt.client->getConnId();
+        link.firstWritePending = true;
+        
+        if (link.characteristic) {
+          link.charProperties = 0;
+          if (link.characteristic->canWrite()) link.charProperties |= ESP_GATT_CHAR_PROP_BIT_WRITE;
+          if (link.characteristic->canWriteNoResponse()) link.charProperties |= ESP_GATT_CHAR_PROP_BIT_WRITE_NR;
+          
+          // Check if we can write to it
+          if (link.charProperties & ESP_GATT_CHAR_PROP_BIT_WRITE) {
+            Serial.println("Characteristic supports write operations");
+          } else {
+            Serial.println("Warning: Characteristic may not support write");
+          }
+          
+          // Remember the handle so the next connect can skip discovery
+          link.handleFromCache = false;
+          saveCachedHandle(link.address, link.charHandle, link.charProperties);
+        } else {
+          Serial.printf("Using cached characteristic handle 0x%04X\n", link.charHandle);
+        }
+        Serial.printf("Relay frames use write %s\n",
+                      bleRelayWriteNoResponse(evt.slot) ? "without response" : "with response");
+        
+        if (!rediscovered) {
+          bleSetActivePeer(evt.slot);
+          Serial.printf("=== BLE Connection Successful (%lu ms) ===\n", millis() - link.attemptStartMillis);
+          if (!bootLinkReadyLogged) {
+            bootLinkReadyLogged = true;
+            bootMark("first link ready");
+          }
+        }
+        
+        // Send connection confirmation
+        bleSendDataTo(evt.slot, link.hello);
+        
+        // Follow the board's relay status reports instead of trusting the buttons
+        bleRelaySync(evt.slot);
+        break;
       }
       
-      // Create a button for each device
-      lv_obj_t* btn = lv_button_create(deviceList);
-      lv_obj_set_size(btn, 200, 30);
+      case LINK_EVT_RELAY_STATUS:
+        bleRelayApplyStatus(evt.slot, evt.handle >> 8, evt.handle & 0xFF);
+        break;
       
-      // Style the button to have blue background and white text
-      lv_obj_set_style_bg_color(btn, lv_color_hex(0xFF0000), LV_PART_MAIN); // Blue background
-      lv_obj_set_style_bg_opa(btn, LV_OPA_COVER, LV_PART_MAIN);
-      lv_obj_set_style_text_color(btn, lv_color_white(), LV_PART_MAIN);
-      lv_obj_set_style_text_font(btn, &lv_font_montserrat_12, LV_PART_MAIN);
+      case LINK_EVT_HANDLE_INVALID:
+        // Fall back to full discovery on the existing link
+        Serial.printf("Cached handle 0x%04X rejected, rediscovering\n", evt.handle);
+        saveCachedHandle(link.address, 0, 0);
+        link.handleFromCache = false;
+        if (!bleStartConnect(evt.slot, 0, link.client)) {
+          bleDisconnectPeer(evt.slot);
+        }
+        break;
       
-      // Add a subtle border for separation
-      lv_obj_set_style_border_width(btn, 1, LV_PART_MAIN);
-      lv_obj_set_style_border_color(btn, lv_color_hex(0xFFFFFF), LV_PART_MAIN); // White border
-      lv_obj_set_style_border_opa(btn, LV_OPA_50, LV_PART_MAIN); // 50% opacity
+      case LINK_EVT_WRITE_FAILED:
+        link.writeFailures++;
+        break;
       
-      // Set pressed state styling (lighter blue)
-      lv_obj_set_style_bg_color(btn, lv_color_hex(0xFF6666), LV_PART_MAIN | LV_STATE_PRESSED);
+      case LINK_EVT_LINK_LOST:
+        // During the first connect the worker still owns the client and reports the failure itself
+        if (link.client) {
+          bleLinkLost(evt.slot);
+          PERF_RECORD(perfLinkLoss, micros() - evt.postedMicros);
+        }
+        break;
       
-      // Create label with Bluetooth symbol and device name
-      lv_obj_t * lbl = lv_label_create(btn);
-      String buttonText = LV_SYMBOL_BLUETOOTH;
-      buttonText += " ";
-      buttonText += displayText;
-      lv_label_set_text(lbl, buttonText.c_str());
-      lv_obj_center(lbl);
+      case LINK_EVT_FAILED:
+        // Discovery on an existing link failed, the worker already released the client
+        if (link.client) {
+          link.client = nullptr;
+          bleDisconnectPeer(evt.slot);
+        }
+        Serial.printf("BLE connection failed: %s\n", evt.reason);
+        uiSetStatus(String("Status: ") + evt.reason);
+        updateStatusIndicator();
+        updateStoredDevicesScreen();
+        break;
       
-      // Store device index in button user data
-      lv_obj_set_user_data(btn, (void*)(uintptr_t)i);
+      default:
+        break;
+    }
+  }
+  
+  // Phase timeouts: give up on the attempt; a late result is cleaned up above
+  for (int i = 0; i < MAX_PEER_LINKS; i++) {
+    BlePeerLink& link = peerLinks[i];
+    uint32_t timeout = bleLinkPhaseTimeout(link);
+    if (timeout && millis() - link.phaseStartMillis > timeout) {
+      Serial.printf("BLE %s phase timed out after %lu ms (%s)\n", bleLinkStateName(link.state),
+                    (unsigned long)timeout, link.address.toString().c_str());
+      link.attempt = ++nextLinkAttempt;
+      bleLinkApply(i, LINK_EVT_TIMEOUT);
       
-      // Add event handler to the button
-      lv_obj_add_event_cb(btn, event_handler_deviceList, LV_EVENT_CLICKED, NULL);
+      // Rediscovery on a live link: the worker still holds the client and
+      // releases it when its late result arrives
+      if (link.client) {
+        link.client = nullptr;
+      }
+      bleDisconnectPeer(i);
       
-      Serial.printf("Added device %d to list: %s\n", i, displayText.c_str());
+      uiSetStatus("Status: Connection timed out");
     }
-  } else {
-    // Add "No devices found" message with BLACK background
-    lv_obj_t * noDevices = lv_label_create(deviceList);
-    lv_label_set_text(noDevices, "No devices found");
-    lv_obj_set_width(noDevices, 200);
-    lv_obj_set_style_text_color(noDevices, lv_color_white(), LV_PART_MAIN);
-    lv_obj_set_style_text_font(noDevices, &lv_font_montserrat_12, LV_PART_MAIN);
-    lv_obj_set_style_text_align(noDevices, LV_TEXT_ALIGN_CENTER, LV_PART_MAIN);
-    lv_obj_set_style_bg_color(noDevices, lv_color_black(), LV_PART_MAIN); // BLACK background
-    lv_obj_set_style_bg_opa(noDevices, LV_OPA_COVER, LV_PART_MAIN);
-    lv_obj_set_style_pad_all(noDevices, 5, LV_PART_MAIN);
   }
 }
+
+// Close one pool entry's link (or cancel its connection attempt) and free the slot
+void bleDisconnectPeer(int slot) {
+  if (slot < 0 || slot >= MAX_PEER_LINKS || !peerLinks[slot].inUse) return;
+  BlePeerLink& link = peerLinks[slot];
+  
+  // Abandon an attempt still in progress; its late result is cleaned up by bleProcessLinkEvents()
+  if (link.state == LINK_CONNECTING || link.state == LINK_DISCOVERING) {
+    Serial.println("Cancelling BLE connection attempt");
+    link.attempt = ++nextLinkAttempt;
+    bleLinkApply(slot, LINK_EVT_FAILED);
+    
+    uiSetStatus("Status: Connection cancelled");
+  }
+  
+  if (link.client != nullptr) {
+    Serial.printf("Disconnecting from BLE %s...\n", link.address.toString().c_str());
+    
+    if (link.state == LINK_READY) {
+      bleFlushRelayQueue(slot);
+      bleSendDataTo(slot, "DISCONNECT");
+    }
+    bleLinkApply(slot, LINK_EVT_DISCONNECT_REQUESTED);
+    
+    bleReleaseClient(link.client);
+    link.client = nullptr;
+    
+    uiSetStatus("Status: Disconnected");
+    Serial.println("BLE Disconnected");
+  }
+  
+  // Free the slot; the attempt id stays so a late result from the worker is discarded
+  bleLinkApply(slot, LINK_EVT_DISCONNECTED);
+  link.inUse = false;
+  
+  if (slot == activePeer) {
+    activePeer = -1;
+  }
   
-  pBLEScan->clearResults();
-  isScanning = false;
-  Serial.printf("=== Scan Complete: %d devices ===\n", bleDevices.size());
+  // UPDATE status indicator and stored devices screen
+  updateStatusIndicator();
+  updateStoredDevicesScreen();
 }
 
-bool bleConnectToDevice(int deviceIndex) {
-  Serial.printf("=== Connecting to device index: %d ===\n", deviceIndex);
+// The peer dropped the link: queued relay frames fail at once instead of being
+// written to a dead connection, and the slot is freed
+void bleLinkLost(int slot) {
+  BlePeerLink& link = peerLinks[slot];
+  Serial.printf("BLE connection lost: %s\n", link.address.toString().c_str());
+  reconnectArm(peerRegistryFind(link.address));
   
-  if (deviceIndex < 0 || deviceIndex >= bleDevices.size()) {
-    Serial.printf("ERROR: Invalid device index %d (list has %d devices)\n", 
-                  deviceIndex, bleDevices.size());
-    return false;
+  if (link.relayQueueLength > 0) {
+    Serial.printf("Dropping %u queued relay frame(s)\n", link.relayQueueLength);
+    link.relayQueueLength = 0;
   }
   
-  BLEDeviceInfo device = bleDevices[deviceIndex];
-  Serial.printf("Connecting to: %s (%s)\n", 
-                device.name.c_str(), device.address.c_str());
+  // Rediscovery in progress: the worker holds the client and releases it when its call fails
+  if (link.state == LINK_DISCOVERING) {
+    link.client = nullptr;
+  }
   
-  if (connectionStatusLabel) {
-    lv_label_set_text(connectionStatusLabel, "Status: Connecting...");
+  // Not LINK_READY any more, so nothing is written on the way out
+  bleDisconnectPeer(slot);
+  uiSetStatus("Status: Connection lost");
+}
+
+// Disconnect the active peer (the Disconnect button on the Bluetooth screen)
+void bleDisconnect() {
+  bleDisconnectPeer(activePeer);
+}
+
+// Write raw bytes to a pool entry's FFE1 handle. Works the same whether the
+// handle came from discovery or from the handle cache.
+bool bleWriteCharacteristic(int slot, uint8_t* data, size_t length, bool response) {
+  if (slot < 0 || slot >= MAX_PEER_LINKS) return false;
+  BlePeerLink& link = peerLinks[slot];
+  if (!(link.state == LINK_READY && link.client && link.charHandle)) {
+    return false;
   }
   
-  // Disconnect if already connected
-  if (isConnected) {
-    bleDisconnect();
-    delay(500);
+  if (length > BLE_COMMAND_DATA_MAX) {
+    Serial.printf("BLE write of %u bytes exceeds %d\n", (unsigned int)length, BLE_COMMAND_DATA_MAX);
+    return false;
   }
   
-  // Create BLE client
-  pClient = BLEDevice::createClient();
-  serverAddress = new BLEAddress(device.address.c_str());
+  BleCommand cmd = {};
+  cmd.type = BLE_CMD_WRITE;
+  cmd.slot = slot;
+  cmd.attempt = link.attempt;
+  cmd.client = link.client;
+  cmd.connId = link.connId;
+  cmd.handle = link.charHandle;
+  cmd.response = response;
+  cmd.length = length;
+  memcpy(cmd.data, data, length);
   
-  Serial.print("Attempting BLE connection to: ");
-  Serial.println(device.address.c_str());
+  // Take the credit first: the completion can arrive on the BTC task before the worker returns
+  portENTER_CRITICAL(&bleWriteCreditMux);
+  link.writesInFlight++;
+  portEXIT_CRITICAL(&bleWriteCreditMux);
   
-  // Connect to BLE server
-  if (pClient->connect(*serverAddress)) {
-    Serial.println("Connected to BLE server!");
+  if (!blePostCommand(cmd)) {
+    portENTER_CRITICAL(&bleWriteCreditMux);
+    if (link.writesInFlight > 0) link.writesInFlight--;
+    portEXIT_CRITICAL(&bleWriteCreditMux);
     
-    // Get the service
-    BLERemoteService* pRemoteService = pClient->getService(SERVICE_UUID);
-    if (pRemoteService == nullptr) {
-      Serial.println("Failed to find service UUID: " + String(SERVICE_UUID));
-      bleDisconnect();
-      updateStatusIndicator();  // UPDATE status indicator
-      updateStoredDevicesScreen();  // UPDATE stored devices screen
-      return false;
+    link.writeFailures++;
+    return false;
+  }
+  link.writeCount++;
+  link.lastUsedMillis = millis();
+  link.lastWriteMillis = link.lastUsedMillis;
+  
+  if (link.firstWritePending) {
+    link.firstWritePending = false;
+    Serial.printf("Connect-to-first-write: %lu ms (handle cache %s)\n",
+                  millis() - link.attemptStartMillis, link.handleFromCache ? "hit" : "miss");
+  }
+  return true;
+}
+
+// Relay frames go out unacknowledged when FFE1 advertises write-without-response.
+// Unknown properties (a handle cached by an older build) fall back to acknowledged writes.
+bool bleRelayWriteNoResponse(int slot) {
+  return peerLinks[slot].charProperties & ESP_GATT_CHAR_PROP_BIT_WRITE_NR;
+}
+
+// Free write credits for a pool entry: RELAY_WRITE_CREDITS for unacknowledged
+// writes, one for acknowledged ones, none while the stack reports congestion
+int bleWriteCreditsAvailable(int slot) {
+  BlePeerLink& link = peerLinks[slot];
+  if (link.congested) return 0;
+  
+  // A completion that never arrived must not stall the link for good
+  if (link.writesInFlight > 0 && millis() - link.lastWriteMillis > WRITE_CREDIT_TIMEOUT_MS) {
+    Serial.printf("Reclaiming %u write credit(s) without completion\n", link.writesInFlight);
+    portENTER_CRITICAL(&bleWriteCreditMux);
+    link.writesInFlight = 0;
+    portEXIT_CRITICAL(&bleWriteCreditMux);
+  }
+  
+  int window = bleRelayWriteNoResponse(slot) ? RELAY_WRITE_CREDITS : 1;
+  return max(0, window - (int)link.writesInFlight);
+}
+
+// Critical text messages ("CONNECTED", "DISCONNECT") are always written with
+// response and do not wait for a credit
+void bleSendDataTo(int slot, const char* data) {
+  // Acknowledged writes also report a stale cached handle back
+  if (bleWriteCharacteristic(slot, (uint8_t*)data, strlen(data), true)) {
+    Serial.printf("BLE Sent: %s\n", data);
+  } else {
+    Serial.println("Cannot send: Not connected to BLE");
+  }
+}
+
+// Send a relay button's state to the peer its descriptor targets, through that
+// peer's relay queue. The tap becomes the relay's desired state until the board
+// confirms it.
+void bleSendRelay(int relay, bool on) {
+  uint8_t bit = 1 << relay;
+  relayShown = on ? (relayShown | bit) : (relayShown & ~bit);  // The button already shows it
+  
+  int slot = relaySlot(relay);
+  if (slot < 0 || peerLinks[slot].state != LINK_READY) {
+    Serial.println("Cannot send relay frame: Not connected to BLE");
+    return;
+  }
+  BlePeerLink& link = peerLinks[slot];
+  link.relayModelValid = true;
+  link.relayDesired = on ? (link.relayDesired | bit) : (link.relayDesired & ~bit);
+  link.relayPending |= bit;
+  link.relayTapSinceQuery = true;
+  link.relayLastTapMillis = millis();
+  link.relayLastTapMicros = micros();
+  
+  bleQueueRelayFrame(slot, makeRelayFrame(bleRelayChannel(slot, relay), on, relayConfig.relays[relay].header));
+}
+
+// Queue a relay frame for a peer. An ON/OFF/ON burst on one relay collapses
+// into its final state; the first tap after a quiet period is written at once.
+void bleQueueRelayFrame(int slot, const RelayFrame& frame) {
+  if (slot < 0 || slot >= MAX_PEER_LINKS || peerLinks[slot].state != LINK_READY) {
+    Serial.println("Cannot send relay frame: Not connected to BLE");
+    return;
+  }
+  BlePeerLink& link = peerLinks[slot];
+  link.relayFramesQueued++;
+  
+  // A newer frame for the same board channel supersedes the queued one
+  bool coalesced = false;
+  for (int i = 0; i < link.relayQueueLength; i++) {
+    if (link.relayQueue[i][1] == frame[1]) {
+      link.relayQueue[i] = frame;
+      link.relayFramesCoalesced++;
+      coalesced = true;
+      break;
     }
-    
-    Serial.println("Found BLE service!");
-    
-    // Get the characteristic
-    pRemoteCharacteristic = pRemoteService->getCharacteristic(CHARACTERISTIC_UUID);
-    if (pRemoteCharacteristic == nullptr) {
-      Serial.println("Failed to find characteristic UUID: " + String(CHARACTERISTIC_UUID));
-      bleDisconnect();
-      updateStatusIndicator();  // UPDATE status indicator
-      updateStoredDevicesScreen();  // UPDATE stored devices screen
-      return false;
+  }
+  
+  if (!coalesced) {
+    if (link.relayQueueLength == RELAY_MAX) {
+      bleFlushRelayQueue(slot);
     }
-    
-    Serial.println("Found BLE characteristic!");
-    
-    // Check if we can write to it
-    if (pRemoteCharacteristic->canWrite()) {
-      Serial.println("Characteristic supports write operations");
-    } else {
-      Serial.println("Warning: Characteristic may not support write");
+    if (link.relayQueueLength == 0) link.relayQueuedMicros = micros();
+    link.relayQueue[link.relayQueueLength++] = frame;
+  }
+  
+  // Nothing written recently: no reason to hold the tap back
+  if (millis() - link.relayLastFlushMillis >= RELAY_COALESCE_WINDOW_MS) {
+    bleFlushRelayQueue(slot);
+  }
+}
+
+// Write a peer's queued relay frames, packing as many as the MTU allows into each write.
+// Frames that find no free write credit stay queued for the next pass.
+void bleFlushRelayQueue(int slot) {
+  if (slot < 0 || slot >= MAX_PEER_LINKS) return;
+  BlePeerLink& link = peerLinks[slot];
+  if (link.relayQueueLength == 0) return;
+  
+  bool noResponse = bleRelayWriteNoResponse(slot);
+  
+  int framesPerWrite = 1;
+#if RELAY_BATCH_WRITES
+  if (link.client) {
+    framesPerWrite = max(1, ((int)link.client->getMTU() - ATT_WRITE_OVERHEAD) / (int)sizeof(RelayFrame));
+  }
+#endif
+  
+  uint8_t batch[RELAY_MAX * sizeof(RelayFrame)];
+  int sent = 0;
+  bool stalled = false;
+  while (sent < link.relayQueueLength) {
+    if (bleWriteCreditsAvailable(slot) == 0) {
+      link.creditStalls++;
+      stalled = true;
+      break;
     }
     
-    isConnected = true;
-    connectedDeviceName = device.name;
-    connectedDeviceAddress = device.address;
-    
-    if (connectionStatusLabel) {
-      lv_label_set_text(connectionStatusLabel, ("Status: Connected to " + device.name).c_str());
+    int count = min(framesPerWrite, link.relayQueueLength - sent);
+    for (int i = 0; i < count; i++) {
+      memcpy(batch + i * sizeof(RelayFrame), link.relayQueue[sent + i].data(), sizeof(RelayFrame));
     }
     
-    // UPDATE status indicator and stored devices screen
-    updateStatusIndicator();
-    updateStoredDevicesScreen();
-    
-    // Send connection confirmation
-    delay(100);
-    bleSendData("CONNECTED");
-    
-    Serial.println("=== BLE Connection Successful ===");
-    return true;
-  } else {
-    Serial.println("Failed to connect to BLE server");
-    
-    if (connectionStatusLabel) {
-      lv_label_set_text(connectionStatusLabel, "Status: Connection failed");
+    if (!bleWriteCharacteristic(slot, batch, count * sizeof(RelayFrame), !noResponse)) {
+      Serial.println("Cannot send relay frame: Not connected to BLE");
+      break;
     }
+    link.relayWrites++;
+    PERF_RECORD(perfTapToWrite, micros() - link.relayQueuedMicros);
     
-    delete pClient;
-    pClient = nullptr;
-    delete serverAddress;
-    serverAddress = nullptr;
-    
-    updateStatusIndicator();  // UPDATE status indicator
-    updateStoredDevicesScreen();  // UPDATE stored devices screen
+    for (int i = 0; i < count; i++) {
+      const RelayFrame& f = link.relayQueue[sent + i];
+      Serial.printf("BLE Sent relay frame: %02X %02X %02X %02X\n", f[0], f[1], f[2], f[3]);
+    }
+    sent += count;
+  }
+  
+  if (stalled) {
+    for (int i = sent; i < link.relayQueueLength; i++) {
+      link.relayQueue[i - sent] = link.relayQueue[i];
+    }
+    link.relayQueueLength -= sent;
+  } else {
+    bleRelayDropFrames(slot, sent);
+  }
+  if (sent == 0) return;
+  
+  link.relayLastFlushMillis = millis();
+  Serial.printf("Relay pipeline: %lu taps, %lu coalesced, %lu writes, %lu credit stalls\n",
+                (unsigned long)link.relayFramesQueued, (unsigned long)link.relayFramesCoalesced,
+                (unsigned long)link.relayWrites, (unsigned long)link.creditStalls);
+}
+
+// Queued frames from 'first' on will never be written (the write was refused):
+// the relays they carried go back to the state the board last reported, or to
+// the state before the tap if it never reported one, and the buttons follow
+void bleRelayDropFrames(int slot, int first) {
+  BlePeerLink& link = peerLinks[slot];
+  if (first >= link.relayQueueLength) {
+    link.relayQueueLength = 0;
+    return;
+  }
+  Serial.printf("Dropping %u queued relay frame(s)\n", link.relayQueueLength - first);
+  
+  for (int i = first; i < link.relayQueueLength; i++) {
+    const RelayFrame& f = link.relayQueue[i];
+    uint8_t channelBit = (f[1] >= 1 && f[1] <= RELAY_STATUS_CHANNELS) ? 1 << (f[1] - 1) : 0;
+    bool on = (link.relayConfirmedKnown & channelBit) ? (link.relayConfirmed & channelBit) : !f[2];
     
-    return false;
+    for (int relay = 0; relay < relayConfig.count; relay++) {
+      if (relaySlot(relay) != slot || bleRelayChannel(slot, relay) != f[1]) continue;
+      uint8_t bit = 1 << relay;
+      link.relayDesired = on ? (link.relayDesired | bit) : (link.relayDesired & ~bit);
+      link.relayPending &= ~bit;
+    }
   }
+  link.relayFramesDropped += link.relayQueueLength - first;
+  link.relayQueueLength = 0;
+  relayRefreshButtons();
 }
 
-void bleDisconnect() {
-  if (isConnected || pClient != nullptr) {
-    Serial.println("Disconnecting from BLE...");
-    
-    if (isConnected) {
-      bleSendData("DISCONNECT");
-    }
-    
-    if (pClient && pClient->isConnected()) {
-      pClient->disconnect();
-    }
-    
-    if (pClient) {
-      delete pClient;
-      pClient = nullptr;
+// Flush every relay queue whose coalescing window has closed (called from loop())
+void bleProcessRelayQueues() {
+  for (int i = 0; i < MAX_PEER_LINKS; i++) {
+    BlePeerLink& link = peerLinks[i];
+    if (link.relayQueueLength > 0 && millis() - link.relayLastFlushMillis >= RELAY_COALESCE_WINDOW_MS) {
+      bleFlushRelayQueue(i);
     }
     
-    if (serverAddress) {
-      delete serverAddress;
-      serverAddress = nullptr;
+    // A tap the board has not confirmed in time: one query settles it
+    if (bleRelayAwaitingConfirm(link) && millis() - link.relayLastTapMillis >= RELAY_CONFIRM_TIMEOUT_MS) {
+      bleRelayQuery(i);
     }
+  }
+}
+
+// Pool slot a relay button drives: the active peer, or the stored peer its
+// descriptor names if that one is pooled. -1 if there is none.
+int relaySlot(int relay) {
+  int target = relayConfig.relays[relay].target;
+  if (target == RELAY_ACTIVE_PEER) return activePeer;
+  if (target >= peerRegistry.count || !peerRegistry.peers[target].address.isSet()) return -1;
+  return blePoolFind(peerRegistry.peers[target].address);
+}
+
+// Board channel a relay button drives on a pool entry's peer: the peer's own
+// relay map if it sets one, otherwise the relay table's
+uint8_t bleRelayChannel(int slot, int relay) {
+  int target = peerRegistryFind(peerLinks[slot].address);
+  uint8_t channel = (target >= 0) ? peerRegistry.peers[target].relayChannel[relay] : 0;
+  return channel ? channel : relayConfig.relays[relay].channel;
+}
+
+// Written taps the board has not confirmed and no query has been sent for since.
+// Boards that never reported their state are not queried after taps.
+bool bleRelayAwaitingConfirm(const BlePeerLink& link) {
+  return link.state == LINK_READY && link.relayPending && link.relayTapSinceQuery &&
+         link.relayQueueLength == 0 && link.relayStatusReports > 0;
+}
+
+// Ask the board for every channel's state in one write; the answer arrives as
+// a RELAY_STATUS_ALL notification
+void bleRelayQuery(int slot) {
+  BlePeerLink& link = peerLinks[slot];
+  RelayFrame query = RELAY_QUERY_FRAME;
+  link.relayTapSinceQuery = false;
+  if (bleWriteCharacteristic(slot, query.data(), query.size(), !bleRelayWriteNoResponse(slot))) {
+    link.relayQueries++;
+  }
+}
+
+// Subscribe to a ready link's relay status notifications and re-sync its model
+// with one query. Runs again after a rediscovery, which may move the handle.
+// The query goes only to a board known to report its state: on this link, or
+// on an earlier one if it is stored. Firmware without status reports may act on it.
+void bleRelaySync(int slot) {
+  BlePeerLink& link = peerLinks[slot];
+  BleCommand cmd = {};
+  cmd.type = BLE_CMD_SUBSCRIBE;
+  cmd.slot = slot;
+  cmd.attempt = link.attempt;
+  cmd.address = link.address;
+  cmd.client = link.client;
+  cmd.connId = link.connId;
+  cmd.handle = link.charHandle;
+  cmd.characteristic = link.characteristic;
+  if (!blePostCommand(cmd)) return;
+  
+  int target = peerRegistryFind(link.address);
+  if (link.relayStatusReports > 0 || (target >= 0 && peerRegistry.peers[target].reportsStatus)) {
+    bleRelayQuery(slot);
+  }
+}
+
+// Reconcile a pool entry's relay model with a status report and refresh the
+// buttons that changed. A full report with no tap since the query went out is
+// the board's whole truth: a pending tap it does not reflect was lost.
+void bleRelayApplyStatus(int slot, uint8_t known, uint8_t on) {
+  BlePeerLink& link = peerLinks[slot];
+  link.relayConfirmed = (link.relayConfirmed & ~known) | (on & known);
+  link.relayConfirmedKnown |= known;
+  link.relayStatusReports++;
+  link.relayModelValid = true;
+  
+  // Remembered, so the next connection starts with a query
+  int target = peerRegistryFind(link.address);
+  if (target >= 0 && !peerRegistry.peers[target].reportsStatus) {
+    peerRegistry.peers[target].reportsStatus = true;
+    settingsMarkDirty();
+  }
+  
+  bool settled = (known == RELAY_STATUS_ALL) && !link.relayTapSinceQuery;
+  uint8_t hadPending = link.relayPending;
+  for (int relay = 0; relay < relayConfig.count; relay++) {
+    if (relaySlot(relay) != slot) continue;
     
-    pRemoteCharacteristic = nullptr;
-    isConnected = false;
-    connectedDeviceName = "";
-    connectedDeviceAddress = "";
+    uint8_t channel = bleRelayChannel(slot, relay);
+    if (channel < 1 || channel > RELAY_STATUS_CHANNELS || !(known & (1 << (channel - 1)))) continue;
     
-    if (connectionStatusLabel) {
-      lv_label_set_text(connectionStatusLabel, "Status: Disconnected");
+    uint8_t bit = 1 << relay;
+    bool confirmed = on & (1 << (channel - 1));
+    if (link.relayPending & bit) {
+      bool matches = (confirmed == (bool)(link.relayDesired & bit));
+      if (!matches && !settled) continue;  // The write may still be on its way
+      if (!matches) {
+        link.relayMissedWrites++;
+        Serial.printf("Relay%d: write not confirmed, board reports %s\n", relay + 1, confirmed ? "ON" : "OFF");
+      }
+      link.relayPending &= ~bit;
     }
+    link.relayDesired = confirmed ? (link.relayDesired | bit) : (link.relayDesired & ~bit);
+  }
+  if (hadPending && !link.relayPending) {
+    PERF_RECORD(perfRelayConfirm, micros() - link.relayLastTapMicros);
+  }
+  
+  Serial.printf("Relay status: %02X (channels %02X), %lu reports, %lu queries, %lu missed writes\n",
+                link.relayConfirmed, link.relayConfirmedKnown, (unsigned long)link.relayStatusReports,
+                (unsigned long)link.relayQueries, (unsigned long)link.relayMissedWrites);
+  
+  relayRefreshButtons();
+}
+
+// Bring the relay buttons in line with the model of the peer each one drives,
+// touching only the buttons that differ. lv_obj_set_state() sends no
+// LV_EVENT_VALUE_CHANGED, so nothing is written back to the board.
+void relayRefreshButtons() {
+  for (int relay = 0; relay < relayConfig.count; relay++) {
+    int slot = relaySlot(relay);
+    if (slot < 0 || !peerLinks[slot].relayModelValid || !relayButtons[relay]) continue;
     
-    // UPDATE status indicator and stored devices screen
-    updateStatusIndicator();
-    updateStoredDevicesScreen();
-    
-    Serial.println("BLE Disconnected");
+    uint8_t bit = 1 << relay;
+    bool desired = peerLinks[slot].relayDesired & bit;
+    if (desired == (bool)(relayShown & bit)) continue;
+    lv_obj_set_state(relayButtons[relay], LV_STATE_CHECKED, desired);
+    relayShown ^= bit;
   }
 }
 
-void bleSendData(const String& data) {
-  if (isConnected && pClient && pClient->isConnected() && pRemoteCharacteristic) {
-    if (pRemoteCharacteristic->canWrite()) {
-      pRemoteCharacteristic->writeValue(data.c_str(), data.length());
-      Serial.println("BLE Sent: " + data);
-    } else {
-      // Try to write anyway (some characteristics don't report canWrite correctly)
-      pRemoteCharacteristic->writeValue(data.c_str(), data.length());
-      Serial.println("BLE Sent (force write): " + data);
+// LVGL timer: drop pool entries whose LINK_LOST event did not fit in the queue.
+// Link state lives in peerLinks; BLEClient is only called from the worker.
+static void bleLinkPollTimer(lv_timer_t * timer) {
+  for (int i = 0; i < MAX_PEER_LINKS; i++) {
+    uint32_t lost = bleLinkCallbacks[i].lostAttempt;
+    if (lost == 0) continue;
+    bleLinkCallbacks[i].lostAttempt = 0;
+    
+    // Same rule as the queued event: only a link loop() already owns
+    if (peerLinks[i].inUse && peerLinks[i].attempt == lost && peerLinks[i].client) {
+      bleLinkApply(i, LINK_EVT_LINK_LOST);
+      bleLinkLost(i);
     }
-  } else {
-    Serial.println("Cannot send: Not connected to BLE");
   }
 }
 
-// NEW FUNCTION: Send hex string as raw bytes
-void bleSendHexString(const String& hexString) {
-  if (isConnected && pClient && pClient->isConnected() && pRemoteCharacteristic) {
-    // Convert hex string to bytes
-    int length = hexString.length();
-    if (length % 2 != 0) {
-      Serial.println("ERROR: Hex string must have even number of characters");
-      return;
-    }
-    
-    int byteCount = length / 2;
-    uint8_t* bytes = new uint8_t[byteCount];
+// Milliseconds until the BLE side needs loop() again: queued scan results,
+// a relay flush, a connect phase timeout or a reconnect retry. 0 means work is pending now.
+uint32_t bleNextDeadlineMs() {
+  if (isScanning && (scanCompleted || uxQueueMessagesWaiting(scanResultQueue) > 0)) return 0;
+  
+  uint32_t next = LOOP_MAX_SLEEP_MS;
+  unsigned long now = millis();
+  for (int i = 0; i < MAX_PEER_LINKS; i++) {
+    BlePeerLink& link = peerLinks[i];
+    uint32_t due = LOOP_MAX_SLEEP_MS;
     
-    for (int i = 0; i < byteCount; i++) {
-      String byteString = hexString.substring(i * 2, i * 2 + 2);
-      bytes[i] = strtoul(byteString.c_str(), NULL, 16);
+    if (link.relayQueueLength > 0) {
+      // Waiting for credits: a write completion wakes the loop, the reclaim timeout is the fallback
+      if (bleWriteCreditsAvailable(i) == 0) {
+        unsigned long waited = now - link.lastWriteMillis;
+        due = (waited < WRITE_CREDIT_TIMEOUT_MS) ? WRITE_CREDIT_TIMEOUT_MS - waited + 1 : 1;
+      } else {
+        unsigned long waited = now - link.relayLastFlushMillis;
+        due = (waited < RELAY_COALESCE_WINDOW_MS) ? RELAY_COALESCE_WINDOW_MS - waited : 0;
+      }
     }
     
-    // Send the bytes
-    if (pRemoteCharacteristic->canWrite()) {
-      pRemoteCharacteristic->writeValue(bytes, byteCount, false);
-      Serial.print("BLE Sent hex bytes: ");
-      for (int i = 0; i < byteCount; i++) {
-        Serial.printf("%02X ", bytes[i]);
-      }
-      Serial.println();
-    } else {
-      // Try to write anyway
-      pRemoteCharacteristic->writeValue(bytes, byteCount, false);
-      Serial.print("BLE Sent hex bytes (force write): ");
-      for (int i = 0; i < byteCount; i++) {
-        Serial.printf("%02X ", bytes[i]);
-      }
-      Serial.println();
+    if (bleRelayAwaitingConfirm(link)) {
+      unsigned long waited = now - link.relayLastTapMillis;
+      due = min(due, (uint32_t)((waited < RELAY_CONFIRM_TIMEOUT_MS) ? RELAY_CONFIRM_TIMEOUT_MS - waited : 0));
     }
     
-    delete[] bytes;
-  } else {
-    Serial.println("Cannot send hex: Not connected to BLE");
+    uint32_t timeout = bleLinkPhaseTimeout(link);
+    if (timeout) {
+      unsigned long elapsed = now - link.phaseStartMillis;
+      due = min(due, (uint32_t)((elapsed <= timeout) ? timeout - elapsed + 1 : 0));
+    }
+    next = min(next, due);
+  }
+  
+  // Reconnect retries waiting for their backoff to run out
+  for (int target = 0; target < STORED_PEER_MAX; target++) {
+    const ReconnectPolicy& policy = reconnectPolicy[target];
+    if (policy.phase != RECONNECT_WAITING) continue;
+    long remaining = (long)(policy.nextAttemptMillis - now);
+    next = min(next, (uint32_t)max(remaining, 0L));
   }
+  return next;
 }
 
 // Callbacks
+// Title button: a click opens the Bluetooth screen, a long press the touch calibration
 static void event_handler_btnSet(lv_event_t * e) {
-  if(lv_event_get_code(e) == LV_EVENT_CLICKED) {
-    lv_screen_load(bluetooth_screen);
+  lv_event_code_t code = lv_event_get_code(e);
+  if (code == LV_EVENT_LONG_PRESSED) {
+    show_touch_calibration_screen();
+  } else if (code == LV_EVENT_CLICKED && lv_screen_active() == main_screen) {
+    // The click that ends a long press finds the calibration screen loaded
+    show_bluetooth_screen();
   }
 }
 
 static void event_handler_btnBack(lv_event_t * e) {
   if(lv_event_get_code(e) == LV_EVENT_CLICKED) {
-    lv_screen_load(main_screen);
+    uiLoadScreen(main_screen);
   }
 }
 
 // ADDED: Back from stored devices screen - CORRECTED to go to Bluetooth screen
 static void event_handler_btnBackStored(lv_event_t * e) {
   if(lv_event_get_code(e) == LV_EVENT_CLICKED) {
-    lv_screen_load(bluetooth_screen);  // CORRECTED: Goes to Bluetooth screen, not main screen
+    show_bluetooth_screen();  // CORRECTED: Goes to Bluetooth screen, not main screen
   }
 }
 
 static void event_handler_btnScan(lv_event_t * e) {
   if(lv_event_get_code(e) == LV_EVENT_CLICKED) {
     Serial.println("=== Scan Button Clicked ===");
-    bleStartScan();
+    // The Scan button doubles as Stop while a scan is running
+    if (isScanning) {
+      bleStopScan();
+    } else {
+      bleStartScan();
+    }
   }
 }
 
@@ -835,13 +3574,11 @@ static void event_handler_btnConnect(lv_event_t * e) {
     Serial.printf("=== Connect Button Clicked ===\n");
     Serial.printf("Selected device index: %d\n", selectedDeviceIdx);
     
-    if (selectedDeviceIdx >= 0 && selectedDeviceIdx < bleDevices.size()) {
+    if (selectedDeviceIdx >= 0 && selectedDeviceIdx < advertiserCount) {
       bleConnectToDevice(selectedDeviceIdx);
     } else {
       Serial.println("ERROR: Please select a device from the list first!");
-      if (connectionStatusLabel) {
-        lv_label_set_text(connectionStatusLabel, "Status: Select device first");
-      }
+      uiSetStatus("Status: Select device first");
     }
   }
 }
@@ -849,10 +3586,23 @@ static void event_handler_btnConnect(lv_event_t * e) {
 static void event_handler_btnDisconnect(lv_event_t * e) {
   if(lv_event_get_code(e) == LV_EVENT_CLICKED) {
     Serial.println("=== Disconnect Button Clicked ===");
+    if (activePeer >= 0) {
+      reconnectCancel(peerRegistryFind(peerLinks[activePeer].address));
+    }
     bleDisconnect();
   }
 }
 
+// Disconnect buttons on the stored devices screen close that target's pooled link
+static void event_handler_btnDisconnectStored(lv_event_t * e) {
+  if(lv_event_get_code(e) == LV_EVENT_CLICKED) {
+    int target = (int)(uintptr_t)lv_event_get_user_data(e);
+    Serial.printf("=== Disconnect Target%d Button Clicked ===\n", target + 1);
+    reconnectCancel(target);
+    bleDisconnectPeer(blePoolFind(peerRegistry.peers[target].address));
+  }
+}
+
 // Device list selection callback - FIXED
 static void event_handler_deviceList(lv_event_t * e) {
   lv_event_code_t code = lv_event_get_code(e);
@@ -865,83 +3615,89 @@ static void event_handler_deviceList(lv_event_t * e) {
     
     Serial.printf("Device list item clicked! Index from user data: %u\n", (unsigned int)index);
     
-    if (index < bleDevices.size()) {
+    if (index < (uintptr_t)advertiserCount) {
       selectedDeviceIdx = (int)index;
-      BLEDeviceInfo& device = bleDevices[index];
+      const Advertiser& device = advertiserAt(index);
       
       Serial.printf("SUCCESS: Selected device %u: %s (%s)\n", 
-                    (unsigned int)index, device.name.c_str(), device.address.c_str());
+                    (unsigned int)index, advertiserName(device), MacAddress::fromPacked(device.address).toString().c_str());
       
       // Update selected device label
-      if (selectedDeviceLabel) {
-        String displayText = "Selected: " + device.name;
-        if (device.isTarget1) {
-          displayText += " [TARGET1]";
-        } else if (device.isTarget2) {
-          displayText += " [TARGET2]";
-        }
-        lv_label_set_text(selectedDeviceLabel, displayText.c_str());
+      String displayText = String("Selected: ") + advertiserName(device);
+      int target = advertiserTarget(device);
+      if (target >= 0) {
+        displayText += String(" [TARGET") + (target + 1) + "]";
       }
+      uiSetSelected(displayText);
     } else {
-      Serial.printf("ERROR: Index %u is invalid (list size: %d)\n", (unsigned int)index, bleDevices.size());
+      Serial.printf("ERROR: Index %u is invalid (list size: %d)\n", (unsigned int)index, advertiserCount);
       selectedDeviceIdx = -1;
-      if (selectedDeviceLabel) {
-        lv_label_set_text(selectedDeviceLabel, "Selected: INVALID");
-      }
+      uiSetSelected("Selected: INVALID");
     }
   }
 }
 
-// ADDED: Event handler for Store as Target1 button
-static void event_handler_btnTarget1(lv_event_t * e) {
+// Drop the stored devices screen if it is built but not shown, so its rows are
+// rebuilt from the registry on the next visit
+static void storedScreenInvalidate() {
+  if (stored_devices_screen && lv_screen_active() != stored_devices_screen) {
+    lv_obj_delete(stored_devices_screen);
+  }
+}
+
+// Store the selected device in the peer registry
+static void event_handler_btnStore(lv_event_t * e) {
   if(lv_event_get_code(e) == LV_EVENT_CLICKED) {
-    Serial.println("=== Store as Target1 Button Clicked ===");
+    Serial.println("=== Store Button Clicked ===");
     
-    if (selectedDeviceIdx >= 0 && selectedDeviceIdx < bleDevices.size()) {
-      BLEDeviceInfo device = bleDevices[selectedDeviceIdx];
-      saveTarget1MAC(device.address);
-      
-      Serial.println("Saved as Target1: " + device.address);
+    if (selectedDeviceIdx >= 0 && selectedDeviceIdx < advertiserCount) {
+      Advertiser& device = advertiserAt(selectedDeviceIdx);
+      uint32_t start = micros();
+      int target = peerRegistryStore(MacAddress::fromPacked(device.address), advertiserName(device));
+      PERF_RECORD(perfSettingsHandler, micros() - start);
+      if (target < 0) {
+        Serial.printf("ERROR: All %d stored device entries are in use\n", STORED_PEER_MAX);
+        uiSetStatus("Status: Stored devices full");
+        return;
+      }
       
       // Update status label
-      if (connectionStatusLabel) {
-        lv_label_set_text(connectionStatusLabel, ("Stored as Target1: " + device.name).c_str());
-      }
+      uiSetStatus(String("Stored as Target") + (target + 1) + ": " + advertiserName(device));
       
-      // Update stored devices screen if it exists
-      updateStoredDevicesScreen();
+      // The list row gains its target tag; the stored devices screen gains a row
+      device.revision++;
+      deviceListRefresh();
+      storedScreenInvalidate();
     } else {
       Serial.println("ERROR: Please select a device from the list first!");
-      if (connectionStatusLabel) {
-        lv_label_set_text(connectionStatusLabel, "Status: Select device first");
-      }
+      uiSetStatus("Status: Select device first");
     }
   }
 }
 
-// ADDED: Event handler for Store as Target2 button (renamed from just Target2)
-static void event_handler_btnTarget2(lv_event_t * e) {
+// Remove the selected device from the peer registry
+static void event_handler_btnForget(lv_event_t * e) {
   if(lv_event_get_code(e) == LV_EVENT_CLICKED) {
-    Serial.println("=== Store as Target2 Button Clicked ===");
+    Serial.println("=== Forget Button Clicked ===");
     
-    if (selectedDeviceIdx >= 0 && selectedDeviceIdx < bleDevices.size()) {
-      BLEDeviceInfo device = bleDevices[selectedDeviceIdx];
-      saveTarget2MAC(device.address);
-      
-      Serial.println("Saved as Target2: " + device.address);
-      
-      // Update status label
-      if (connectionStatusLabel) {
-        lv_label_set_text(connectionStatusLabel, ("Stored as Target2: " + device.name).c_str());
+    if (selectedDeviceIdx >= 0 && selectedDeviceIdx < advertiserCount) {
+      Advertiser& device = advertiserAt(selectedDeviceIdx);
+      int target = advertiserTarget(device);
+      if (target < 0) {
+        uiSetStatus("Status: Device is not stored");
+        return;
       }
       
-      // Update stored devices screen if it exists
-      updateStoredDevicesScreen();
+      uint32_t start = micros();
+      peerRegistryForget(target);
+      PERF_RECORD(perfSettingsHandler, micros() - start);
+      uiSetStatus(String("Forgot Target") + (target + 1) + ": " + advertiserName(device));
+      device.revision++;
+      deviceListRefresh();
+      storedScreenInvalidate();
     } else {
       Serial.println("ERROR: Please select a device from the list first!");
-      if (connectionStatusLabel) {
-        lv_label_set_text(connectionStatusLabel, "Status: Select device first");
-      }
+      uiSetStatus("Status: Select device first");
     }
   }
 }
@@ -954,489 +3710,321 @@ static void event_handler_autoConnectCheckbox(lv_event_t * e) {
     
     Serial.println("Auto-connect checkbox changed: " + String(checked ? "ENABLED" : "DISABLED"));
     
-    // Save the state to NVS
+    // Save the state (committed to NVS in the background)
+    uint32_t start = micros();
     saveAutoConnectState(checked);
+    PERF_RECORD(perfSettingsHandler, micros() - start);
     
     // Update status label
-    if (connectionStatusLabel) {
-      lv_label_set_text(connectionStatusLabel, 
-                       checked ? "Status: Auto-connect ENABLED" : "Status: Auto-connect DISABLED");
-    }
+    uiSetStatus(checked ? "Status: Auto-connect ENABLED" : "Status: Auto-connect DISABLED");
   }
 }
 
-static void event_handler_btn1(lv_event_t * e) {
+// Relay buttons: the relay table index travels in the event's user data
+static void event_handler_relay(lv_event_t * e) {
   if(lv_event_get_code(e) == LV_EVENT_VALUE_CHANGED) {
     lv_obj_t * obj = (lv_obj_t*) lv_event_get_target(e);
+    int relay = (int)(uintptr_t)lv_event_get_user_data(e);
     bool state = lv_obj_has_state(obj, LV_STATE_CHECKED);
     
-    if (state) {
-      // Relay 1 ON: A00101A2
-      bleSendHexString("A00101A2");
-      Serial.println("Relay1: ON (A00101A2)");
-    } else {
-      // Relay 1 OFF: A00100A1
-      bleSendHexString("A00100A1");
-      Serial.println("Relay1: OFF (A00100A1)");
-    }
+    bleSendRelay(relay, state);
+    Serial.printf("%s: %s\n", relayConfig.relays[relay].label, state ? "ON" : "OFF");
   }
 }
 
-static void event_handler_btn2(lv_event_t * e) {
-  if(lv_event_get_code(e) == LV_EVENT_VALUE_CHANGED) {
-    lv_obj_t * obj = (lv_obj_t*) lv_event_get_target(e);
-    bool state = lv_obj_has_state(obj, LV_STATE_CHECKED);
-    
-    if (state) {
-      // Relay 2 ON: A00201A3
-      bleSendHexString("A00201A3");
-      Serial.println("Relay2: ON (A00201A3)");
-    } else {
-      // Relay 2 OFF: A00200A2
-      bleSendHexString("A00200A2");
-      Serial.println("Relay2: OFF (A00200A2)");
-    }
+// ADDED: Event handler for Stored Devices button
+static void event_handler_btnStoredDevices(lv_event_t * e) {
+  if(lv_event_get_code(e) == LV_EVENT_CLICKED) {
+    Serial.println("=== Stored Devices Button Clicked ===");
+    show_stored_devices_screen();
   }
 }
 
-static void event_handler_btn3(lv_event_t * e) {
-  if(lv_event_get_code(e) == LV_EVENT_VALUE_CHANGED) {
-    lv_obj_t * obj = (lv_obj_t*) lv_event_get_target(e);
-    bool state = lv_obj_has_state(obj, LV_STATE_CHECKED);
-    
-    if (state) {
-      // Relay 3 ON: A00301A4
-      bleSendHexString("A00301A4");
-      Serial.println("Relay3: ON (A00301A4)");
-    } else {
-      // Relay 3 OFF: A00300A3
-      bleSendHexString("A00300A3");
-      Serial.println("Relay3: OFF (A00300A3)");
-    }
+// Connect buttons on the stored devices screen, one per target
+static void event_handler_btnConnectStored(lv_event_t * e) {
+  if(lv_event_get_code(e) == LV_EVENT_CLICKED) {
+    int target = (int)(uintptr_t)lv_event_get_user_data(e);
+    Serial.printf("=== Connect to Target%d Button Clicked ===\n", target + 1);
+    bleConnectStoredTarget(target);
   }
 }
 
-static void event_handler_btn4(lv_event_t * e) {
-  if(lv_event_get_code(e) == LV_EVENT_VALUE_CHANGED) {
-    lv_obj_t * obj = (lv_obj_t*) lv_event_get_target(e);
-    bool state = lv_obj_has_state(obj, LV_STATE_CHECKED);
-    
-    if (state) {
-      // Relay 4 ON: A00401A5
-      bleSendHexString("A00401A5");
-      Serial.println("Relay4: ON (A00401A5)");
-    } else {
-      // Relay 4 OFF: A00400A4
-      bleSendHexString("A00400A4");
-      Serial.println("Relay4: OFF (A00400A4)");
-    }
-  }
-}
+// Button helpers shared by the screens. Each object gets its theme styles added
+// once; only geometry and text are set per object.
 
-// Add these after the event_handler_btn4 function
-static void event_handler_btn5(lv_event_t * e) {
-  if(lv_event_get_code(e) == LV_EVENT_VALUE_CHANGED) {
-    lv_obj_t * obj = (lv_obj_t*) lv_event_get_target(e);
-    bool state = lv_obj_has_state(obj, LV_STATE_CHECKED);
-    
-    if (state) {
-      // Relay 5 ON: A00101A2 (placeholder)
-      bleSendHexString("A00101A2");
-      Serial.println("Relay5: ON (A00101A2)");
-    } else {
-      // Relay 5 OFF: A00100A1 (placeholder)
-      bleSendHexString("A00100A1");
-      Serial.println("Relay5: OFF (A00100A1)");
-    }
-  }
+// Blue text button (Connect, Scan, Store, ...)
+lv_obj_t* create_blue_button(lv_obj_t* parent, const char* label, lv_event_cb_t event_cb, lv_align_t align, int x_offset, int y_offset, int width = 80, int height = 35, void* user_data = NULL) {
+  lv_obj_t * btn = lv_button_create(parent);
+  lv_obj_add_event_cb(btn, event_cb, LV_EVENT_CLICKED, user_data);
+  lv_obj_align(btn, align, x_offset, y_offset);
+  lv_obj_set_size(btn, width, height);
+  lv_obj_add_style(btn, &themeButton, LV_PART_MAIN);
+  lv_obj_add_style(btn, &themeText, LV_PART_MAIN);
+  
+  // Create label
+  lv_obj_t * lbl = lv_label_create(btn);
+  lv_label_set_text(lbl, label);
+  lv_obj_center(lbl);
+  
+  return btn;
 }
 
-static void event_handler_btn6(lv_event_t * e) {
-  if(lv_event_get_code(e) == LV_EVENT_VALUE_CHANGED) {
-    lv_obj_t * obj = (lv_obj_t*) lv_event_get_target(e);
-    bool state = lv_obj_has_state(obj, LV_STATE_CHECKED);
-    
-    if (state) {
-      // Relay 6 ON: A00101A2 (placeholder)
-      bleSendHexString("A00101A2");
-      Serial.println("Relay6: ON (A00101A2)");
-    } else {
-      // Relay 6 OFF: A00100A1 (placeholder)
-      bleSendHexString("A00100A1");
-      Serial.println("Relay6: OFF (A00100A1)");
-    }
-  }
+// Small 35x35 navigation button with a symbol
+lv_obj_t* create_nav_button(lv_obj_t* parent, const char* symbol, lv_event_cb_t event_cb, lv_align_t align) {
+  lv_obj_t * btn = lv_button_create(parent);
+  lv_obj_add_event_cb(btn, event_cb, LV_EVENT_CLICKED, NULL);
+  lv_obj_set_size(btn, 35, 35);
+  lv_obj_align(btn, align, 0, 0);
+  lv_obj_add_style(btn, &themeButton, LV_PART_MAIN);
+  
+  // Create label with symbol
+  lv_obj_t * lbl = lv_label_create(btn);
+  lv_label_set_text(lbl, symbol);
+  lv_obj_center(lbl);
+  
+  return btn;
 }
 
-// ADDED: Event handler for Stored Devices button
-static void event_handler_btnStoredDevices(lv_event_t * e) {
-  if(lv_event_get_code(e) == LV_EVENT_CLICKED) {
-    Serial.println("=== Stored Devices Button Clicked ===");
-    lv_screen_load(stored_devices_screen);
-    updateStoredDevicesScreen();  // Update the screen with current status
-  }
+// Container (75x35) for the back/forward navigation buttons at top right
+lv_obj_t* create_nav_container(lv_obj_t* parent) {
+  lv_obj_t * nav_container = lv_obj_create(parent);
+  lv_obj_set_size(nav_container, 75, 35);
+  lv_obj_align(nav_container, LV_ALIGN_TOP_RIGHT, -5, 10);
+  lv_obj_add_style(nav_container, &themeTransparent, LV_PART_MAIN);
+  return nav_container;
 }
 
-// ADDED: Event handler for Connect to Target1 button
-static void event_handler_btnConnectTarget1(lv_event_t * e) {
-  if(lv_event_get_code(e) == LV_EVENT_CLICKED) {
-    Serial.println("=== Connect to Target1 Button Clicked ===");
-    bleAutoConnectDirect();
-  }
+// Screen title label
+lv_obj_t* create_title(lv_obj_t* parent, const char* text) {
+  lv_obj_t * title = lv_label_create(parent);
+  lv_label_set_text(title, text);
+  lv_obj_set_width(title, 300);
+  lv_obj_add_style(title, &themeTitle, LV_PART_MAIN);
+  lv_obj_align(title, LV_ALIGN_TOP_MID, 0, 10);
+  return title;
 }
 
-// ADDED: Event handler for Connect to Target2 button
-static void event_handler_btnConnectTarget2(lv_event_t * e) {
-  if(lv_event_get_code(e) == LV_EVENT_CLICKED) {
-    Serial.println("=== Connect to Target2 Button Clicked ===");
-    bleAutoConnectTarget2();
-  }
+// Plain label at a fixed position on the stored devices screen
+lv_obj_t* create_label(lv_obj_t* parent, const char* text, lv_style_t* style, int width, int y_offset) {
+  lv_obj_t * lbl = lv_label_create(parent);
+  lv_label_set_text(lbl, text);
+  lv_obj_set_width(lbl, width);
+  lv_obj_align(lbl, LV_ALIGN_TOP_LEFT, 10, y_offset);
+  lv_obj_add_style(lbl, style, LV_PART_MAIN);
+  return lbl;
 }
 
 // Screen creation - Stored Devices Screen
+#define STORED_LIST_TOP 50      // Below the title and navigation buttons
+#define STORED_ROW_PITCH 110    // Height of one stored peer's section
+
 void create_stored_devices_screen() {
   stored_devices_screen = lv_obj_create(NULL);
   lv_obj_set_size(stored_devices_screen, SCREEN_WIDTH, SCREEN_HEIGHT);
-  
-  // Set background color to BLACK
-  lv_obj_set_style_bg_color(stored_devices_screen, lv_color_black(), LV_PART_MAIN);
-  lv_obj_set_style_bg_opa(stored_devices_screen, LV_OPA_COVER, LV_PART_MAIN);
+  lv_obj_add_style(stored_devices_screen, &themeScreen, LV_PART_MAIN);
+  lv_obj_add_event_cb(stored_devices_screen, event_handler_screenDeleted, LV_EVENT_DELETE, NULL);
   
   // Title
-  lv_obj_t * title = lv_label_create(stored_devices_screen);
-  lv_label_set_text(title, "Stored Devices");
-  lv_obj_set_width(title, 300);
-  lv_obj_set_style_text_font(title, &lv_font_montserrat_16, LV_PART_MAIN);
-  lv_obj_set_style_text_align(title, LV_TEXT_ALIGN_CENTER, 0);
-  lv_obj_set_style_text_color(title, lv_color_white(), LV_PART_MAIN);
-  lv_obj_align(title, LV_ALIGN_TOP_MID, 0, 10);
+  create_title(stored_devices_screen, "Stored Devices");
   
-  // Helper function to create blue buttons like main screen
-  auto create_blue_button = [&](const char* label, lv_event_cb_t event_cb, lv_align_t align, int x_offset, int y_offset, int width = 80, int height = 35) -> lv_obj_t* {
-    lv_obj_t * btn = lv_button_create(stored_devices_screen);
-    lv_obj_add_event_cb(btn, event_cb, LV_EVENT_CLICKED, NULL);
-    lv_obj_align(btn, align, x_offset, y_offset);
-    lv_obj_set_size(btn, width, height);
-    
-    // Set blue background (0xFF0000 on your display)
-    lv_obj_set_style_bg_color(btn, lv_color_hex(0xFF0000), LV_PART_MAIN);
-    lv_obj_set_style_bg_opa(btn, LV_OPA_COVER, LV_PART_MAIN);
-    
-    // Set white text
-    lv_obj_set_style_text_color(btn, lv_color_white(), LV_PART_MAIN);
-    
-    // Set font size 12
-    lv_obj_set_style_text_font(btn, &lv_font_montserrat_12, LV_PART_MAIN);
-    
-    // Add border for better visibility
-    lv_obj_set_style_border_width(btn, 2, LV_PART_MAIN);
-    lv_obj_set_style_border_color(btn, lv_color_white(), LV_PART_MAIN);
-    lv_obj_set_style_border_opa(btn, LV_OPA_COVER, LV_PART_MAIN);
-    
-    // Create label
-    lv_obj_t * lbl = lv_label_create(btn);
-    lv_label_set_text(lbl, label);
-    lv_obj_center(lbl);
-    
-    return btn;
-  };
+  // Navigation buttons at top right
+  lv_obj_t * nav_container = create_nav_container(stored_devices_screen);
   
-  // Helper function for navigation buttons (smaller blue buttons)
-  auto create_nav_button = [&](const char* symbol, lv_event_cb_t event_cb, lv_align_t align, lv_obj_t* parent) -> lv_obj_t* {
-    lv_obj_t * btn = lv_button_create(parent);
-    lv_obj_add_event_cb(btn, event_cb, LV_EVENT_CLICKED, NULL);
-    lv_obj_set_size(btn, 35, 35);
-    lv_obj_align(btn, align, 0, 0);
+  // Left button (Back to bluetooth screen)
+  create_nav_button(nav_container, LV_SYMBOL_LEFT, event_handler_btnBackStored, LV_ALIGN_LEFT_MID);
+  
+  // Right button (Back to main screen)
+  create_nav_button(nav_container, LV_SYMBOL_RIGHT, event_handler_btnBack, LV_ALIGN_RIGHT_MID);
+  
+  // One section per stored peer in a scrollable area below the title
+  lv_obj_t * peer_list = lv_obj_create(stored_devices_screen);
+  lv_obj_set_size(peer_list, SCREEN_WIDTH, SCREEN_HEIGHT - STORED_LIST_TOP);
+  lv_obj_align(peer_list, LV_ALIGN_TOP_LEFT, 0, STORED_LIST_TOP);
+  lv_obj_add_style(peer_list, &themeTransparent, LV_PART_MAIN);
+  lv_obj_set_scrollbar_mode(peer_list, LV_SCROLLBAR_MODE_AUTO);
+  
+  static lv_point_precise_t separator_points[] = { {10, 0}, {230, 0} };
+  char text[48];
+  int y = 10;
+  for (int target = 0; target < peerRegistry.count; target++) {
+    const StoredPeer& peer = peerRegistry.peers[target];
+    if (!peer.address.isSet()) continue;
     
-    // Set blue background (0xFF0000 on your display)
-    lv_obj_set_style_bg_color(btn, lv_color_hex(0xFF0000), LV_PART_MAIN);
-    lv_obj_set_style_bg_opa(btn, LV_OPA_COVER, LV_PART_MAIN);
+    snprintf(text, sizeof(text), "Target%d: %s", target + 1, peer.name);
+    create_label(peer_list, text, &themeHeading, 140, y);
+    snprintf(text, sizeof(text), "MAC: %s", peer.address.toString().c_str());
+    create_label(peer_list, text, &themeText, 220, y + 25);
     
-    // Set white text
-    lv_obj_set_style_text_color(btn, lv_color_white(), LV_PART_MAIN);
+    // Status (colour follows the link state, see updateStoredDevicesScreen())
+    storedUi.statusLabels[target] = create_label(peer_list, "Status: DISCONNECTED", &themeText, 140, y + 50);
+    lv_obj_add_style(storedUi.statusLabels[target], &themeStatusText, LV_PART_MAIN);
+    lv_obj_add_style(storedUi.statusLabels[target], &themeStatusTextOn, LV_PART_MAIN | LV_STATE_CHECKED);
     
-    // Add border for better visibility
-    lv_obj_set_style_border_width(btn, 2, LV_PART_MAIN);
-    lv_obj_set_style_border_color(btn, lv_color_white(), LV_PART_MAIN);
-    lv_obj_set_style_border_opa(btn, LV_OPA_COVER, LV_PART_MAIN);
+    // Connect / Disconnect buttons, told apart by their target index
+    void* index = (void*)(uintptr_t)target;
+    create_blue_button(peer_list, "Connect", event_handler_btnConnectStored, LV_ALIGN_TOP_RIGHT, -5, y, 80, 35, index);
+    create_blue_button(peer_list, "Disconnect", event_handler_btnDisconnectStored, LV_ALIGN_TOP_RIGHT, -5, y + 40, 80, 35, index);
     
-    // Create label with symbol
-    lv_obj_t * lbl = lv_label_create(btn);
-    lv_label_set_text(lbl, symbol);
-    lv_obj_center(lbl);
+    // Separator line
+    lv_obj_t * line = lv_line_create(peer_list);
+    lv_line_set_points(line, separator_points, 2);
+    lv_obj_set_y(line, y + STORED_ROW_PITCH - 15);
+    lv_obj_add_style(line, &themeSeparator, LV_PART_MAIN);
     
-    return btn;
-  };
+    y += STORED_ROW_PITCH;
+  }
   
-  // Container for navigation buttons (75x35) at top right
-  lv_obj_t * nav_container = lv_obj_create(stored_devices_screen);
-  lv_obj_set_size(nav_container, 75, 35);
-  lv_obj_align(nav_container, LV_ALIGN_TOP_RIGHT, -5, 10);  // Position at top right
-  lv_obj_set_style_border_width(nav_container, 0, LV_PART_MAIN);
-  lv_obj_set_style_bg_opa(nav_container, LV_OPA_TRANSP, LV_PART_MAIN);
-  lv_obj_set_style_pad_all(nav_container, 0, LV_PART_MAIN);
-  
-  // Left button (Back to bluetooth screen) - 35x35 with blue style
-  create_nav_button(LV_SYMBOL_LEFT, event_handler_btnBackStored, LV_ALIGN_LEFT_MID, nav_container);
-  
-  // Right button (Back to main screen) - 35x35 with blue style
-  create_nav_button(LV_SYMBOL_RIGHT, event_handler_btnBack, LV_ALIGN_RIGHT_MID, nav_container);
-  
-  // Target1 Section - Adjusted Y positions since navigation container is at top
-  lv_obj_t * target1Label = lv_label_create(stored_devices_screen);
-  lv_label_set_text(target1Label, "Target1 Device:");
-  lv_obj_set_width(target1Label, 200);
-  lv_obj_align(target1Label, LV_ALIGN_TOP_LEFT, 10, 60);  // Moved down from 50 to 60
-  lv_obj_set_style_text_font(target1Label, &lv_font_montserrat_14, LV_PART_MAIN);
-  lv_obj_set_style_text_color(target1Label, lv_color_white(), LV_PART_MAIN);
-  
-  // Target1 MAC address
-  lv_obj_t * target1MacLabel = lv_label_create(stored_devices_screen);
-  lv_label_set_text(target1MacLabel, ("MAC: " + storedTarget1MAC).c_str());
-  lv_obj_set_width(target1MacLabel, 220);
-  lv_obj_align(target1MacLabel, LV_ALIGN_TOP_LEFT, 10, 85);  // Moved down from 75 to 85
-  lv_obj_set_style_text_font(target1MacLabel, &lv_font_montserrat_12, LV_PART_MAIN);
-  lv_obj_set_style_text_color(target1MacLabel, lv_color_white(), LV_PART_MAIN);
-  
-  // Target1 Status
-  target1StatusLabel = lv_label_create(stored_devices_screen);
-  lv_label_set_text(target1StatusLabel, "Target1: DISCONNECTED");
-  lv_obj_set_width(target1StatusLabel, 220);
-  lv_obj_align(target1StatusLabel, LV_ALIGN_TOP_LEFT, 10, 110);  // Moved down from 100 to 110
-  lv_obj_set_style_text_font(target1StatusLabel, &lv_font_montserrat_12, LV_PART_MAIN);
-  lv_obj_set_style_text_color(target1StatusLabel, lv_color_hex(0xFF0000), LV_PART_MAIN);
-  
-  // Target1 Connect Button - Blue style
-  create_blue_button("Connect", event_handler_btnConnectTarget1, LV_ALIGN_TOP_RIGHT, -5, 60);
-  
-  // Target1 Disconnect Button - Blue style
-  create_blue_button("Disconnect", event_handler_btnDisconnect, LV_ALIGN_TOP_RIGHT, -5, 100);
-  
-  // Separator line - Adjusted Y position
-  lv_obj_t * line1 = lv_line_create(stored_devices_screen);
-  static lv_point_precise_t line_points1[] = { {10, 150}, {230, 150} };  // Moved down from 140 to 150
-  lv_line_set_points(line1, line_points1, 2);
-  lv_obj_set_style_line_width(line1, 1, 0);
-  lv_obj_set_style_line_color(line1, lv_color_hex(0x808080), 0);
-  
-  // Target2 Section - Adjusted Y positions
-  lv_obj_t * target2Label = lv_label_create(stored_devices_screen);
-  lv_label_set_text(target2Label, "Target2 Device:");
-  lv_obj_set_width(target2Label, 200);
-  lv_obj_align(target2Label, LV_ALIGN_TOP_LEFT, 10, 170);  // Moved down from 160 to 170
-  lv_obj_set_style_text_font(target2Label, &lv_font_montserrat_14, LV_PART_MAIN);
-  lv_obj_set_style_text_color(target2Label, lv_color_white(), LV_PART_MAIN);
-  
-  // Target2 MAC address
-  lv_obj_t * target2MacLabel = lv_label_create(stored_devices_screen);
-  String target2MacText = "MAC: " + storedTarget2MAC;
-  if (storedTarget2MAC == "00:00:00:00:00:00") {
-    target2MacText += " (PLACEHOLDER)";
-  }
-  lv_label_set_text(target2MacLabel, target2MacText.c_str());
-  lv_obj_set_width(target2MacLabel, 220);
-  lv_obj_align(target2MacLabel, LV_ALIGN_TOP_LEFT, 10, 195);  // Moved down from 185 to 195
-  lv_obj_set_style_text_font(target2MacLabel, &lv_font_montserrat_12, LV_PART_MAIN);
-  lv_obj_set_style_text_color(target2MacLabel, lv_color_white(), LV_PART_MAIN);
-  
-  // Target2 Status
-  target2StatusLabel = lv_label_create(stored_devices_screen);
-  lv_label_set_text(target2StatusLabel, "Target2: MAC NOT SET");
-  lv_obj_set_width(target2StatusLabel, 220);
-  lv_obj_align(target2StatusLabel, LV_ALIGN_TOP_LEFT, 10, 220);  // Moved down from 210 to 220
-  lv_obj_set_style_text_font(target2StatusLabel, &lv_font_montserrat_12, LV_PART_MAIN);
-  lv_obj_set_style_text_color(target2StatusLabel, lv_color_hex(0xFFA500), LV_PART_MAIN);
-  
-  // Target2 Connect Button - Blue style
-  create_blue_button("Connect", event_handler_btnConnectTarget2, LV_ALIGN_TOP_RIGHT, -5, 165);
-  
-  // Target2 Disconnect Button - Blue style
-  create_blue_button("Disconnect", event_handler_btnDisconnect, LV_ALIGN_TOP_RIGHT, -5, 205);
+  if (y == 10) {
+    create_label(peer_list, "No stored devices.\nSelect one on the Bluetooth\nscreen and tap 'Store'.", &themeText, 220, y);
+  }
+  
+  updateStoredDevicesScreen();
+}
+
+// Calibration targets in screen coordinates (320x240 after the display's
+// ROTATION_270), spread over the panel so the solve is well conditioned
+const lv_point_t CALIBRATION_TARGETS[CALIBRATION_POINTS] = { {32, 24}, {288, 120}, {160, 216} };
+
+// Panel point under a screen point: the inverse of the ROTATION_270 LVGL applies to touches
+static void calibrationPanelPoint(const lv_point_t& screen, int16_t& x, int16_t& y) {
+  x = SCREEN_WIDTH - 1 - screen.y;
+  y = screen.x;
+}
+
+// Move the marker to the current target and say which one it is
+static void calibrationShowTarget(const char* note) {
+  const lv_point_t& target = CALIBRATION_TARGETS[calibrationUi.step];
+  lv_obj_set_pos(calibrationUi.marker, target.x - 10, target.y - 10);
+  char text[64];
+  snprintf(text, sizeof(text), "%sTap the centre of the dot (%d/%d)", note, calibrationUi.step + 1, CALIBRATION_POINTS);
+  lv_label_set_text(calibrationUi.prompt, text);
+}
+
+// Calibration screen tapped: keep the raw reading for the current target; after
+// the last one solve, store and go back to the main screen, or start over if
+// the taps do not give a usable calibration
+static void event_handler_calibrationTap(lv_event_t * e) {
+  if (lv_event_get_code(e) != LV_EVENT_CLICKED) return;
+  calibrationUi.rawX[calibrationUi.step] = touchLast.rawX;
+  calibrationUi.rawY[calibrationUi.step] = touchLast.rawY;
+  if (++calibrationUi.step < CALIBRATION_POINTS) {
+    calibrationShowTarget("");
+    return;
+  }
+  
+  int16_t panelX[CALIBRATION_POINTS], panelY[CALIBRATION_POINTS];
+  for (int i = 0; i < CALIBRATION_POINTS; i++) {
+    calibrationPanelPoint(CALIBRATION_TARGETS[i], panelX[i], panelY[i]);
+  }
+  TouchCalibration cal;
+  if (!touchCalibrationSolve(calibrationUi.rawX, calibrationUi.rawY, panelX, panelY, cal)) {
+    Serial.println("Touch calibration failed, starting over");
+    calibrationUi.step = 0;
+    calibrationShowTarget("Try again. ");
+    return;
+  }
+  saveTouchCalibration(cal);
+  uiLoadScreen(main_screen);
+}
+
+// Screen creation - Touch Calibration Screen
+void create_touch_calibration_screen() {
+  calibration_screen = lv_obj_create(NULL);
+  lv_obj_add_style(calibration_screen, &themeScreen, LV_PART_MAIN);
+  lv_obj_remove_flag(calibration_screen, LV_OBJ_FLAG_SCROLLABLE);
+  lv_obj_add_event_cb(calibration_screen, event_handler_screenDeleted, LV_EVENT_DELETE, NULL);
+  lv_obj_add_event_cb(calibration_screen, event_handler_calibrationTap, LV_EVENT_CLICKED, NULL);
+  
+  calibrationUi.prompt = lv_label_create(calibration_screen);
+  lv_obj_set_width(calibrationUi.prompt, 300);
+  lv_obj_align(calibrationUi.prompt, LV_ALIGN_CENTER, 0, 0);
+  lv_obj_add_style(calibrationUi.prompt, &themeCaption, LV_PART_MAIN);
+  
+  // Target dot; taps go through it to the screen
+  calibrationUi.marker = lv_obj_create(calibration_screen);
+  lv_obj_set_size(calibrationUi.marker, 20, 20);
+  lv_obj_add_style(calibrationUi.marker, &themeStatusDot, LV_PART_MAIN);
+  lv_obj_remove_flag(calibrationUi.marker, LV_OBJ_FLAG_CLICKABLE);
 }
 
-// Screen creation - Bluetooth Screen
-// Screen creation - Bluetooth Screen
-// Screen creation - Bluetooth Screen
-// Screen creation - Bluetooth Screen
-// Screen creation - Bluetooth Screen
 // Screen creation - Bluetooth Screen
 void create_bluetooth_screen() {
   bluetooth_screen = lv_obj_create(NULL);
   lv_obj_set_size(bluetooth_screen, SCREEN_WIDTH, SCREEN_HEIGHT);
-  
-  // Set background color to BLACK
-  lv_obj_set_style_bg_color(bluetooth_screen, lv_color_black(), LV_PART_MAIN);
-  lv_obj_set_style_bg_opa(bluetooth_screen, LV_OPA_COVER, LV_PART_MAIN);
+  lv_obj_add_style(bluetooth_screen, &themeScreen, LV_PART_MAIN);
+  lv_obj_add_event_cb(bluetooth_screen, event_handler_screenDeleted, LV_EVENT_DELETE, NULL);
   
   // Title
-  lv_obj_t * title = lv_label_create(bluetooth_screen);
-  lv_label_set_text(title, "BLE 4.0 Client");
-  lv_obj_set_width(title, 300);
-  lv_obj_set_style_text_font(title, &lv_font_montserrat_16, LV_PART_MAIN);
-  lv_obj_set_style_text_align(title, LV_TEXT_ALIGN_CENTER, 0);
-  lv_obj_set_style_text_color(title, lv_color_white(), LV_PART_MAIN);
-  lv_obj_align(title, LV_ALIGN_TOP_MID, 0, 10);
-  
-  // Helper function to create blue buttons like main screen - MOVED TO TOP
-  auto create_blue_button = [&](const char* label, lv_event_cb_t event_cb, lv_align_t align, int x_offset, int y_offset, int width = 80, int height = 35) -> lv_obj_t* {
-    lv_obj_t * btn = lv_button_create(bluetooth_screen);
-    lv_obj_add_event_cb(btn, event_cb, LV_EVENT_CLICKED, NULL);
-    lv_obj_align(btn, align, x_offset, y_offset);
-    lv_obj_set_size(btn, width, height);
-    
-    // Set blue background (0xFF0000 on your display)
-    lv_obj_set_style_bg_color(btn, lv_color_hex(0xFF0000), LV_PART_MAIN);
-    lv_obj_set_style_bg_opa(btn, LV_OPA_COVER, LV_PART_MAIN);
-    
-    // Set white text
-    lv_obj_set_style_text_color(btn, lv_color_white(), LV_PART_MAIN);
-    
-    // Set font size 12 (or 14 for larger if preferred)
-    lv_obj_set_style_text_font(btn, &lv_font_montserrat_12, LV_PART_MAIN);
-    
-    // Add border for better visibility
-    lv_obj_set_style_border_width(btn, 2, LV_PART_MAIN);
-    lv_obj_set_style_border_color(btn, lv_color_white(), LV_PART_MAIN);
-    lv_obj_set_style_border_opa(btn, LV_OPA_COVER, LV_PART_MAIN);
-    
-    // Create label
-    lv_obj_t * lbl = lv_label_create(btn);
-    lv_label_set_text(lbl, label);
-    lv_obj_center(lbl);
-    
-    return btn;
-  };
+  create_title(bluetooth_screen, "BLE 4.0 Client");
   
-  // MOVE NAVIGATION CONTAINER TO TOP RIGHT HERE
-  // Container for navigation buttons (75x35) at top right
-  lv_obj_t * nav_container = lv_obj_create(bluetooth_screen);
-  lv_obj_set_size(nav_container, 75, 35);
-  lv_obj_align(nav_container, LV_ALIGN_TOP_RIGHT, -5, 10); // CHANGED from bottom-right to top-right
-  lv_obj_set_style_border_width(nav_container, 0, LV_PART_MAIN);
-  lv_obj_set_style_bg_opa(nav_container, LV_OPA_TRANSP, LV_PART_MAIN);
-  lv_obj_set_style_pad_all(nav_container, 0, LV_PART_MAIN);
-  
-  // Helper function for navigation buttons (smaller blue buttons)
-  auto create_nav_button = [&](const char* symbol, lv_event_cb_t event_cb, lv_align_t align) -> lv_obj_t* {
-    lv_obj_t * btn = lv_button_create(nav_container);
-    lv_obj_add_event_cb(btn, event_cb, LV_EVENT_CLICKED, NULL);
-    lv_obj_set_size(btn, 35, 35);
-    lv_obj_align(btn, align, 0, 0);
-    
-    // Set blue background (0xFF0000 on your display)
-    lv_obj_set_style_bg_color(btn, lv_color_hex(0xFF0000), LV_PART_MAIN);
-    lv_obj_set_style_bg_opa(btn, LV_OPA_COVER, LV_PART_MAIN);
-    
-    // Set white text
-    lv_obj_set_style_text_color(btn, lv_color_white(), LV_PART_MAIN);
-    
-    // Add border for better visibility
-    lv_obj_set_style_border_width(btn, 2, LV_PART_MAIN);
-    lv_obj_set_style_border_color(btn, lv_color_white(), LV_PART_MAIN);
-    lv_obj_set_style_border_opa(btn, LV_OPA_COVER, LV_PART_MAIN);
-    
-    // Create label with symbol
-    lv_obj_t * lbl = lv_label_create(btn);
-    lv_label_set_text(lbl, symbol);
-    lv_obj_center(lbl);
-    
-    return btn;
-  };
+  // Navigation buttons at top right
+  lv_obj_t * nav_container = create_nav_container(bluetooth_screen);
   
-  // Left button (Back to main screen) - 35x35 with blue style
-  create_nav_button(LV_SYMBOL_LEFT, event_handler_btnBack, LV_ALIGN_LEFT_MID);
+  // Left button (Back to main screen)
+  create_nav_button(nav_container, LV_SYMBOL_LEFT, event_handler_btnBack, LV_ALIGN_LEFT_MID);
   
-  // Right button (Go to stored devices) - 35x35 with blue style
-  create_nav_button(LV_SYMBOL_RIGHT, event_handler_btnStoredDevices, LV_ALIGN_RIGHT_MID);
+  // Right button (Go to stored devices)
+  create_nav_button(nav_container, LV_SYMBOL_RIGHT, event_handler_btnStoredDevices, LV_ALIGN_RIGHT_MID);
   
-  // ALTERNATIVE APPROACH: Create a custom list using container and buttons
-  // Create a container for the device list
+  // Device list: a scrollable container whose rows are positioned by deviceListRefresh()
   lv_obj_t * list_container = lv_obj_create(bluetooth_screen);
   lv_obj_set_size(list_container, 220, 120);
-  lv_obj_align(list_container, LV_ALIGN_TOP_LEFT, 0, 50); // CHANGED from 40 to 50 to make room for nav buttons
-  
-  // Style the container to look like a list with BLACK background
-  lv_obj_set_style_bg_color(list_container, lv_color_black(), LV_PART_MAIN); // CHANGED to BLACK background
-  lv_obj_set_style_bg_opa(list_container, LV_OPA_COVER, LV_PART_MAIN);
-  lv_obj_set_style_border_width(list_container, 2, LV_PART_MAIN);
-  lv_obj_set_style_border_color(list_container, lv_color_white(), LV_PART_MAIN);
-  lv_obj_set_style_border_opa(list_container, LV_OPA_COVER, LV_PART_MAIN);
-  lv_obj_set_style_radius(list_container, 5, LV_PART_MAIN);
-  lv_obj_set_style_pad_all(list_container, 5, LV_PART_MAIN);
-  
-  // Make container scrollable
-  lv_obj_set_flex_flow(list_container, LV_FLEX_FLOW_COLUMN);
+  lv_obj_align(list_container, LV_ALIGN_TOP_LEFT, 0, 50);
+  lv_obj_add_style(list_container, &themeListBox, LV_PART_MAIN);
   lv_obj_set_scrollbar_mode(list_container, LV_SCROLLBAR_MODE_AUTO);
   
-  // Create a header label for the list - with black background
+  // Header label for the list
   lv_obj_t * list_header = lv_label_create(list_container);
   lv_label_set_text(list_header, "Found Devices:");
-  lv_obj_set_width(list_header, 200);
-  lv_obj_set_style_text_color(list_header, lv_color_white(), LV_PART_MAIN);
-  lv_obj_set_style_text_font(list_header, &lv_font_montserrat_12, LV_PART_MAIN);
-  lv_obj_set_style_text_align(list_header, LV_TEXT_ALIGN_CENTER, LV_PART_MAIN);
-  lv_obj_set_style_bg_color(list_header, lv_color_black(), LV_PART_MAIN); // CHANGED to BLACK background
-  lv_obj_set_style_bg_opa(list_header, LV_OPA_COVER, LV_PART_MAIN);
-  lv_obj_set_style_pad_all(list_header, 5, LV_PART_MAIN);
-  
-  // Create initial placeholder text - with black background
+  lv_obj_set_size(list_header, 200, DEVICE_LIST_HEADER_H);
+  lv_obj_add_style(list_header, &themeListText, LV_PART_MAIN);
+  
+  // Placeholder text shown instead of the rows (nothing scanned yet, scanning, no results)
   lv_obj_t * placeholder = lv_label_create(list_container);
-  lv_label_set_text(placeholder, "Devices will appear here");
   lv_obj_set_width(placeholder, 200);
-  lv_obj_set_style_text_color(placeholder, lv_color_white(), LV_PART_MAIN);
-  lv_obj_set_style_text_font(placeholder, &lv_font_montserrat_12, LV_PART_MAIN);
-  lv_obj_set_style_text_align(placeholder, LV_TEXT_ALIGN_CENTER, LV_PART_MAIN);
-  lv_obj_set_style_bg_color(placeholder, lv_color_black(), LV_PART_MAIN); // CHANGED to BLACK background
-  lv_obj_set_style_bg_opa(placeholder, LV_OPA_COVER, LV_PART_MAIN);
-  lv_obj_set_style_pad_all(placeholder, 5, LV_PART_MAIN);
+  lv_obj_add_style(placeholder, &themeListText, LV_PART_MAIN);
+  lv_obj_set_y(placeholder, DEVICE_LIST_HEADER_H);
+  btUi.scanPlaceholderLabel = placeholder;
+  deviceListSetPlaceholder(btView.placeholder);
   
   // Store the container as deviceList for later use
-  deviceList = list_container;
+  btUi.deviceList = list_container;
+  deviceListCreateRows();
+  deviceListRefresh();  // Rebind any devices found before the screen was (re)built
   
-  // Scan button - Blue style - MOVE DOWN
-  lv_obj_t * btnScan = create_blue_button("Scan", event_handler_btnScan, LV_ALIGN_TOP_RIGHT, -5, 50); // CHANGED from 5 to 50
+  // Scan button
+  lv_obj_t * btnScan = create_blue_button(bluetooth_screen, isScanning ? "Stop" : "Scan", event_handler_btnScan, LV_ALIGN_TOP_RIGHT, -5, 50);
+  btUi.scanButtonLabel = lv_obj_get_child(btnScan, 0);
   
-  // Target1 Store button - Blue style - MOVE DOWN
-  lv_obj_t * btnTarget1 = create_blue_button("Target1", event_handler_btnTarget1, LV_ALIGN_TOP_RIGHT, -5, 95); // CHANGED from 50 to 95
-  
-  // Target2 Store button - Blue style - MOVE DOWN
-  lv_obj_t * btnTarget2 = create_blue_button("Target2", event_handler_btnTarget2, LV_ALIGN_TOP_RIGHT, -5, 140); // CHANGED from 95 to 140
+  // Add the selected device to, or remove it from, the stored peers
+  create_blue_button(bluetooth_screen, "Store", event_handler_btnStore, LV_ALIGN_TOP_RIGHT, -5, 95);
+  create_blue_button(bluetooth_screen, "Forget", event_handler_btnForget, LV_ALIGN_TOP_RIGHT, -5, 140);
   
   // Selected device label
-  selectedDeviceLabel = lv_label_create(bluetooth_screen);
-  lv_label_set_text(selectedDeviceLabel, "Selected: None");
-  lv_obj_set_width(selectedDeviceLabel, 250);
-  lv_obj_align(selectedDeviceLabel, LV_ALIGN_BOTTOM_MID, -30, -35);
-  lv_obj_set_style_text_align(selectedDeviceLabel, LV_TEXT_ALIGN_CENTER, 0);
-  lv_obj_set_style_text_font(selectedDeviceLabel, &lv_font_montserrat_12, LV_PART_MAIN);
-  lv_obj_set_style_text_color(selectedDeviceLabel, lv_color_white(), LV_PART_MAIN);
+  btUi.selectedDeviceLabel = lv_label_create(bluetooth_screen);
+  lv_label_set_text(btUi.selectedDeviceLabel, btView.selected.c_str());
+  lv_obj_set_width(btUi.selectedDeviceLabel, 250);
+  lv_obj_align(btUi.selectedDeviceLabel, LV_ALIGN_BOTTOM_MID, -30, -35);
+  lv_obj_add_style(btUi.selectedDeviceLabel, &themeCaption, LV_PART_MAIN);
   
   // Connection status
-  connectionStatusLabel = lv_label_create(bluetooth_screen);
-  lv_label_set_text(connectionStatusLabel, "Status: Disconnected");
-  lv_obj_set_width(connectionStatusLabel, 250);
-  lv_obj_align(connectionStatusLabel, LV_ALIGN_BOTTOM_MID, -30, -10);
-  lv_obj_set_style_text_font(connectionStatusLabel, &lv_font_montserrat_12, LV_PART_MAIN);
-  lv_obj_set_style_text_align(connectionStatusLabel, LV_TEXT_ALIGN_CENTER, 0);
-  lv_obj_set_style_text_color(connectionStatusLabel, lv_color_white(), LV_PART_MAIN);
-  
-  // ADDED: Auto-connect checkbox and label
-  // Container for checkbox and label
+  btUi.connectionStatusLabel = lv_label_create(bluetooth_screen);
+  lv_label_set_text(btUi.connectionStatusLabel, btView.status.c_str());
+  lv_obj_set_width(btUi.connectionStatusLabel, 250);
+  lv_obj_align(btUi.connectionStatusLabel, LV_ALIGN_BOTTOM_MID, -30, -10);
+  lv_obj_add_style(btUi.connectionStatusLabel, &themeCaption, LV_PART_MAIN);
+  
+  // Auto-connect checkbox in a layout-only container
   lv_obj_t * autoConnectContainer = lv_obj_create(bluetooth_screen);
   lv_obj_set_size(autoConnectContainer, 220, 35);
-  lv_obj_align(autoConnectContainer, LV_ALIGN_TOP_LEFT, 0, 175); // CHANGED from 165 to 175 (moved down)
-  lv_obj_set_style_border_width(autoConnectContainer, 0, LV_PART_MAIN);
-  lv_obj_set_style_bg_opa(autoConnectContainer, LV_OPA_TRANSP, LV_PART_MAIN);
-  lv_obj_set_style_pad_all(autoConnectContainer, 0, LV_PART_MAIN);
+  lv_obj_align(autoConnectContainer, LV_ALIGN_TOP_LEFT, 0, 175);
+  lv_obj_add_style(autoConnectContainer, &themeTransparent, LV_PART_MAIN);
   
-  // Checkbox
   lv_obj_t * autoConnectCheckbox = lv_checkbox_create(autoConnectContainer);
   lv_checkbox_set_text(autoConnectCheckbox, "Auto-connect");
   lv_obj_add_event_cb(autoConnectCheckbox, event_handler_autoConnectCheckbox, LV_EVENT_VALUE_CHANGED, NULL);
   lv_obj_align(autoConnectCheckbox, LV_ALIGN_LEFT_MID, 0, 0);
-  
-  // Set checkbox text color to white
-  lv_obj_set_style_text_color(autoConnectCheckbox, lv_color_white(), LV_PART_MAIN);
+  lv_obj_add_style(autoConnectCheckbox, &themeHeading, LV_PART_MAIN);
   
   // Set initial state from NVS
   if (autoConnectEnabled) {
@@ -1444,112 +4032,128 @@ void create_bluetooth_screen() {
   }
 }
 
-// Screen creation - Main Screen
+// Screen deleted (teardown): forget its widgets so updates only touch the view model
+static void event_handler_screenDeleted(lv_event_t * e) {
+  lv_obj_t * screen = (lv_obj_t *)lv_event_get_target(e);
+  if (screen == bluetooth_screen) {
+    bluetooth_screen = nullptr;
+    btUi = BluetoothScreenWidgets();
+  } else if (screen == stored_devices_screen) {
+    stored_devices_screen = nullptr;
+    storedUi = StoredScreenWidgets();
+  } else if (screen == calibration_screen) {
+    calibration_screen = nullptr;
+    calibrationUi = CalibrationScreenWidgets();
+  }
+}
+
+// Load a screen; the screen being left is deleted unless it is the main screen
+void uiLoadScreen(lv_obj_t * target) {
+  lv_obj_t * previous = lv_screen_active();
+  if (previous == target) return;
+  
+  lv_screen_load(target);
+#if LAZY_SCREEN_TEARDOWN
+  if (previous != main_screen) {
+    lv_obj_delete_async(previous);
+  }
+#endif
+}
+
+// Build the Bluetooth screen on first use (or after teardown) and show it
+void show_bluetooth_screen() {
+  if (!bluetooth_screen) {
+    uint32_t start = micros();
+    create_bluetooth_screen();
+    Serial.printf("Bluetooth screen built in %lu us\n", (unsigned long)(micros() - start));
+    PERF_LVGL_MEMORY("after building the Bluetooth screen");
+  }
+  uiLoadScreen(bluetooth_screen);
+}
+
+void show_stored_devices_screen() {
+  if (!stored_devices_screen) {
+    uint32_t start = micros();
+    create_stored_devices_screen();
+    Serial.printf("Stored devices screen built in %lu us\n", (unsigned long)(micros() - start));
+    PERF_LVGL_MEMORY("after building the stored devices screen");
+  }
+  uiLoadScreen(stored_devices_screen);
+}
+
+// Build the calibration screen if needed and start at its first target
+void show_touch_calibration_screen() {
+  if (!calibration_screen) {
+    create_touch_calibration_screen();
+  }
+  calibrationUi.step = 0;
+  calibrationShowTarget("");
+  uiLoadScreen(calibration_screen);
+}
+
 // Screen creation - Main Screen
 void create_main_screen() {
   main_screen = lv_screen_active();
+  lv_obj_add_style(main_screen, &themeScreen, LV_PART_MAIN);
   
-  // Set main screen background color to BLACK
-  lv_obj_set_style_bg_color(main_screen, lv_color_black(), LV_PART_MAIN);
-  lv_obj_set_style_bg_opa(main_screen, LV_OPA_COVER, LV_PART_MAIN);
-  
-  // ADDED: Status indicator circle (20px diameter) at top right
+  // Status indicator circle (20px diameter) at top right, see updateStatusIndicator()
   status_indicator = lv_obj_create(main_screen);
-  lv_obj_set_size(status_indicator, 20, 20);  // 20px diameter
-  
-  // IMPORTANT: First set position, then apply styles
-  lv_obj_align(status_indicator, LV_ALIGN_TOP_RIGHT, -10, 10);  // 10px from top and right edges
-  
-  // Apply circle styling
-  lv_obj_set_style_radius(status_indicator, 10, LV_PART_MAIN);  // Half of 20px for perfect circle
-  lv_obj_set_style_bg_color(status_indicator, lv_color_hex(0xFF0000), LV_PART_MAIN); // RED when not connected
-  lv_obj_set_style_bg_opa(status_indicator, LV_OPA_COVER, LV_PART_MAIN);
-  lv_obj_set_style_border_width(status_indicator, 2, LV_PART_MAIN);
-  lv_obj_set_style_border_color(status_indicator, lv_color_white(), LV_PART_MAIN);
-  lv_obj_set_style_border_opa(status_indicator, LV_OPA_COVER, LV_PART_MAIN);
-  
-  // Remove any padding or default spacing
-  lv_obj_set_style_pad_all(status_indicator, 0, LV_PART_MAIN);
+  lv_obj_set_size(status_indicator, 20, 20);
+  lv_obj_align(status_indicator, LV_ALIGN_TOP_RIGHT, -10, 10);
+  lv_obj_add_style(status_indicator, &themeStatusDot, LV_PART_MAIN);
+  lv_obj_add_style(status_indicator, &themeStatusDotOn, LV_PART_MAIN | LV_STATE_CHECKED);
   
-  // Settings button - moved down slightly to make room for status indicator
+  // Settings button (red title button); a long press calibrates the touchscreen
   lv_obj_t * btnSet = lv_button_create(main_screen);
   lv_obj_add_event_cb(btnSet, event_handler_btnSet, LV_EVENT_CLICKED, NULL);
-  lv_obj_align(btnSet, LV_ALIGN_TOP_MID, 0, 15);  // Changed from 10 to 15
+  lv_obj_add_event_cb(btnSet, event_handler_btnSet, LV_EVENT_LONG_PRESSED, NULL);
+  lv_obj_align(btnSet, LV_ALIGN_TOP_MID, 0, 15);
   lv_obj_set_size(btnSet, 200, 40);
-  // Set the text color to white
-  lv_obj_set_style_text_color(btnSet, lv_color_white(), LV_PART_MAIN);
-  // Set the background color to RED (0x00FF00 on your display)
-  lv_obj_set_style_bg_opa(btnSet, LV_OPA_COVER, LV_PART_MAIN);
-  lv_obj_set_style_bg_color(btnSet, lv_color_hex(0x00FF00), LV_PART_MAIN | LV_STATE_DEFAULT);
-  
-  // Add border to the title button (2px white border)
-  lv_obj_set_style_border_width(btnSet, 2, LV_PART_MAIN);
-  lv_obj_set_style_border_color(btnSet, lv_color_white(), LV_PART_MAIN);
-  lv_obj_set_style_border_opa(btnSet, LV_OPA_COVER, LV_PART_MAIN);
+  lv_obj_add_style(btnSet, &themeButton, LV_PART_MAIN);
+  lv_obj_add_style(btnSet, &themeAccentButton, LV_PART_MAIN);
   
   lv_obj_t * lblSet = lv_label_create(btnSet);
   lv_label_set_text(lblSet, "POV BLE Controller");
-  // Set font size 16 for the title button
-  lv_obj_set_style_text_font(lblSet, &lv_font_montserrat_16, LV_PART_MAIN);
+  lv_obj_add_style(lblSet, &themeTitle, LV_PART_MAIN);
   lv_obj_center(lblSet);
   
-  // Calculate button dimensions for 3 columns
+  // Calculate button dimensions for RELAY_COLUMNS columns
   const int btnWidth = 90;  // Smaller width for 3 columns
   const int btnHeight = 70; // Same height as before
   const int horizontalSpacing = 10; // Space between buttons
   const int verticalSpacing = 15;   // Space between rows
-  const int totalWidth = (btnWidth * 3) + (horizontalSpacing * 2); // Total width of button row
-  
-  // Calculate starting X position to center the row
-  const int startX = -(totalWidth / 2) + (btnWidth / 2);
   
-  // Helper function to create relay buttons with consistent styling
-  auto create_relay_button = [&](const char* label, lv_event_cb_t event_cb, int column, int row) -> lv_obj_t* {
+  // Helper function to create relay buttons: blue when OFF, green when ON (checked)
+  auto create_relay_button = [&](int relay, int column, int row, int rowLength) -> lv_obj_t* {
     lv_obj_t * btn = lv_button_create(main_screen);
-    lv_obj_add_event_cb(btn, event_cb, LV_EVENT_VALUE_CHANGED, NULL);
+    lv_obj_add_event_cb(btn, event_handler_relay, LV_EVENT_VALUE_CHANGED, (void*)(uintptr_t)relay);
     
-    // Calculate position based on column and row
-    int xPos = startX + (column * (btnWidth + horizontalSpacing));
+    // Calculate position based on column and row, each row centred on its own
+    int rowWidth = (btnWidth * rowLength) + (horizontalSpacing * (rowLength - 1));
+    int xPos = -(rowWidth / 2) + (column * (btnWidth + horizontalSpacing));
     int yPos = 70 + (row * (btnHeight + verticalSpacing)); // Start below title button
     
     lv_obj_set_pos(btn, SCREEN_WIDTH/2 + xPos, yPos);
     lv_obj_set_size(btn, btnWidth, btnHeight);
     lv_obj_add_flag(btn, LV_OBJ_FLAG_CHECKABLE);
+    lv_obj_add_style(btn, &themeButton, LV_PART_MAIN);
+    lv_obj_add_style(btn, &themeRelayOn, LV_PART_MAIN | LV_STATE_CHECKED);
     
-    // Set blue background when OFF (0xFF0000 on your display)
-    lv_obj_set_style_bg_color(btn, lv_color_hex(0xFF0000), LV_PART_MAIN);
-    lv_obj_set_style_bg_opa(btn, LV_OPA_COVER, LV_PART_MAIN);
-    
-    // Set green background when ON (0x0000FF on your display = Green)
-    lv_obj_set_style_bg_color(btn, lv_color_hex(0x0000FF), LV_PART_MAIN | LV_STATE_CHECKED);
-    
-    // Set white text
-    lv_obj_set_style_text_color(btn, lv_color_white(), LV_PART_MAIN);
-    
-    // Add border for better visibility
-    lv_obj_set_style_border_width(btn, 2, LV_PART_MAIN);
-    lv_obj_set_style_border_color(btn, lv_color_white(), LV_PART_MAIN);
-    lv_obj_set_style_border_opa(btn, LV_OPA_COVER, LV_PART_MAIN);
-    
-    // Create label with larger font for bolder appearance
+    // Label in the larger 16 px font for a bolder appearance
     lv_obj_t * lbl = lv_label_create(btn);
-    lv_label_set_text(lbl, label);
-    // Use larger font size 16 for bolder appearance
-    lv_obj_set_style_text_font(lbl, &lv_font_montserrat_16, LV_PART_MAIN);
+    lv_label_set_text(lbl, relayConfig.relays[relay].label);
+    lv_obj_add_style(lbl, &themeTitle, LV_PART_MAIN);
     lv_obj_center(lbl);
     
     return btn;
   };
   
-  // Top row buttons (row 0)
-  lv_obj_t * btn1 = create_relay_button("Relay1", event_handler_btn1, 0, 0);  // Column 0, Row 0
-  lv_obj_t * btn2 = create_relay_button("Relay2", event_handler_btn2, 1, 0);  // Column 1, Row 0
-  lv_obj_t * btn3 = create_relay_button("Relay3", event_handler_btn3, 2, 0);  // Column 2, Row 0
-  
-  // Bottom row buttons (row 1)
-  lv_obj_t * btn4 = create_relay_button("Relay4", event_handler_btn4, 0, 1);  // Column 0, Row 1
-  lv_obj_t * btn5 = create_relay_button("Relay5", event_handler_btn5, 1, 1);  // Column 1, Row 1
-  lv_obj_t * btn6 = create_relay_button("Relay6", event_handler_btn6, 2, 1);  // Column 2, Row 1
+  // One button per configured relay, RELAY_COLUMNS to a row
+  for (int relay = 0; relay < relayConfig.count; relay++) {
+    int row = relay / RELAY_COLUMNS;
+    int rowLength = min(RELAY_COLUMNS, relayConfig.count - row * RELAY_COLUMNS);
+    relayButtons[relay] = create_relay_button(relay, relay % RELAY_COLUMNS, row, rowLength);
+  }
 }
 
 void setup() {
@@ -1558,36 +4162,27 @@ void setup() {
   Serial.println("       POV BLE CONTROLLER STARTING");
   Serial.println("==========================================");
   
-  // Load stored MACs from NVS - CORRECT PLACE
-  loadStoredMACs();
+  // Load the settings (auto-connect, relay table, stored peers) from NVS - CORRECT PLACE
+  loadSettings();
   
-  // Load auto-connect state from NVS
-  loadAutoConnectState();
-  
-  // Initialize stored devices
-  initStoredDevices();
-  
-  // Initialize BLE
-  Serial.println("Initializing BLE Client...");
-  BLEDevice::init("POV_BLE_Controller");
-  
-  // Create BLE scan
-  pBLEScan = BLEDevice::getScan();
-  pBLEScan->setAdvertisedDeviceCallbacks(new MyAdvertisedDeviceCallbacks());
-  pBLEScan->setActiveScan(true);
-  pBLEScan->setInterval(100);
-  pBLEScan->setWindow(99);
+  // Initialize BLE on the other core while the display comes up here
+  // The queues and loop handle must exist before the BLE callbacks can fire
+  scanResultQueue = xQueueCreate(SCAN_QUEUE_LENGTH, sizeof(ScanResultMsg));
+  linkEventQueue = xQueueCreate(LINK_EVENT_QUEUE_LENGTH, sizeof(BleLinkEvent));
+  bleCommandQueue = xQueueCreate(BLE_COMMAND_QUEUE_LENGTH, sizeof(BleCommand));
+  bleWriteQueue = xQueueCreate(BLE_WRITE_QUEUE_LENGTH, sizeof(BleCommand));
+  loopTaskHandle = xTaskGetCurrentTaskHandle();
+  bootMark("settings loaded");
+  xTaskCreatePinnedToCore(bleWorkerTask, "ble_worker", 4096, NULL, 1, &bleWorkerHandle, BLE_CORE);
   
-  Serial.println("BLE initialized successfully");
   Serial.println("Device Name: POV_BLE_Controller");
-  Serial.println("Stored Target1 MAC: " + storedTarget1MAC);
-  Serial.println("Stored Target2 MAC: " + storedTarget2MAC);
   Serial.println("Auto-connect enabled: " + String(autoConnectEnabled ? "YES" : "NO"));
   Serial.println("Service UUID: " + String(SERVICE_UUID));
   Serial.println("Characteristic UUID: " + String(CHARACTERISTIC_UUID));
   
   // Initialize LVGL
   lv_init();
+  lv_tick_set_cb(lv_tick_millis);
   lv_log_register_print_cb(log_print);
   
   // Initialize touchscreen
@@ -1596,32 +4191,51 @@ void setup() {
   touchscreen.setRotation(2);
   
   // Initialize display
+#if DISPLAY_DMA_FLUSH
+  lv_display_t * disp = tft_dma_display_create();
+#else
   lv_display_t * disp = lv_tft_espi_create(SCREEN_WIDTH, SCREEN_HEIGHT, draw_buf, sizeof(draw_buf));
+#endif
   lv_display_set_rotation(disp, LV_DISPLAY_ROTATION_270);
+  PERF_WATCH_DISPLAY(disp);
+  bootMark("display ready");
   
   // Initialize input device
-  lv_indev_t * indev = lv_indev_create();
-  lv_indev_set_type(indev, LV_INDEV_TYPE_POINTER);
-  lv_indev_set_read_cb(indev, touchscreen_read);
+  // Event mode: LVGL reads only when the sampler task has queued points
+  touchIndev = lv_indev_create();
+  lv_indev_set_type(touchIndev, LV_INDEV_TYPE_POINTER);
+  lv_indev_set_read_cb(touchIndev, touchscreen_read);
+  lv_indev_set_mode(touchIndev, LV_INDEV_MODE_EVENT);
+  touchThrowTimer = lv_timer_create(touchThrowRead, TOUCH_THROW_READ_MS, NULL);
+  lv_timer_pause(touchThrowTimer);
+  
+  xTaskCreate(touchTask, "touch", 3072, NULL, 2, &touchTaskHandle);
+  pinMode(XPT2046_IRQ, INPUT);
+  attachInterrupt(digitalPinToInterrupt(XPT2046_IRQ), touchIrqHandler, FALLING);
   
   // Create screens
+  // Only the main screen is built at boot, the others on first visit (show_bluetooth_screen())
+  theme_init();
   create_main_screen();
-  create_bluetooth_screen();
-  create_stored_devices_screen();  // ADDED: Create stored devices screen
+  PERF_LVGL_MEMORY("after UI construction");
   
-  // NEW: Try to auto-connect to target device (after UI is created)
-  delay(1000); // Give BLE stack time to initialize
-  if (autoConnectEnabled && storedTarget1MAC != "00:00:00:00:00:00") {
-    bleAutoConnectDirect();
-  }
+  // Periodic work runs on LVGL timers so loop() can sleep between them
+  lv_timer_create(bleLinkPollTimer, LINK_POLL_PERIOD_MS, NULL);
+  settingsTimer = lv_timer_create(settingsCommitTimer, SETTINGS_COMMIT_DELAY_MS, NULL);
+  lv_timer_pause(settingsTimer);
+  esp_register_shutdown_handler(settingsCommit);
+  
+  // Auto-connect runs from loop() once bleWorkerTask() reports the stack ready
+  bootAutoConnectPending = true;
+  bootMark("UI interactive");
   
   Serial.println("\nSetup Complete!");
   Serial.println("Instructions:");
   Serial.println("1. Go to Bluetooth screen (tap 'POV BLE Controller')");
   Serial.println("2. Tap 'Scan' to find BLE devices");
   Serial.println("3. Tap a device in the list to select it");
-  Serial.println("4. Tap 'Target1' to store it as Target1 (for auto-connect)");
-  Serial.println("5. Tap 'Target2' to store it as Target2");
+  Serial.println("4. Tap 'Store' to add it to the stored devices (Target1 auto-connects)");
+  Serial.println("5. Tap 'Forget' to remove a stored device");
   Serial.println("6. Use 'Auto-connect' checkbox to enable/disable auto-connect at boot");
   Serial.println("7. Tap 'Stored' to view and manage stored devices");
   Serial.println("8. Return to main screen and toggle relays");
@@ -1629,19 +4243,36 @@ void setup() {
 }
 
 void loop() {
-  lv_task_handler();
-  lv_tick_inc(5);
+  PERF_LOOP_TICK();
   
-  // Check BLE connection periodically
-  static unsigned long lastCheck = 0;
-  if (millis() - lastCheck > 2000) {
-    lastCheck = millis();
-    
-    if (isConnected && pClient && !pClient->isConnected()) {
-      Serial.println("BLE connection lost!");
-      bleDisconnect();
-    }
+  // Feed queued touch points to LVGL
+  if (touchPointsPending()) {
+    lv_indev_read(touchIndev);
   }
   
-  delay(5);
+  // Run due LVGL timers (refresh, link poll); returns ms until the next one
+  uint32_t sleepMs = lv_timer_handler();
+  
+  // Boot auto-connect, once the BLE stack is ready
+  bootProcess();
+  
+  // Stream scan results into the device list
+  bleProcessScanResults();
+  
+  // Advance the connection state machine
+  bleProcessLinkEvents();
+  bleProcessReconnects();
+  
+  // Flush coalesced relay commands
+  bleProcessRelayQueues();
+  
+  // Sleep until the next deadline, or until a BLE task posts work
+  sleepMs = min(sleepMs, bleNextDeadlineMs());
+  if (sleepMs > 0) {
+    if (ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(sleepMs)) > 0) {
+      loopEventWakeups++;
+    } else {
+      loopTimerWakeups++;
+    }
+  }
 }
\ No newline at end of file
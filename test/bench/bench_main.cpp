@@ -0,0 +1,343 @@
+// Host benchmark: runs the whole controller (setup() and loop() from main.cpp)
+// against the stand-ins in test/native, with the real LVGL, and reports
+//   - boot phases: UI interactive, first frame, BLE stack ready and relay
+//     board ready, with the BLE bring-up overlapping the display's,
+//   - LVGL memory at boot, with the Bluetooth screen built and after it is
+//     torn down,
+//   - loop() iteration time,
+//   - scan result to device list latency and the longest loop() gap in a scan,
+//   - relay tap to write latency,
+//   - relay frame encoding against the old hex-string parsing,
+//   - loop() wakeups per second on an idle screen,
+//   - LVGL memory and frame time of the relay buttons, with per-object
+//     local styles as the UI used to set them and with the shared theme,
+// over a boot, a list scan among many advertisers, a scan while loop() is
+// stuck, a run of relay taps played on the touchscreen and an idle spell
+// with the relay board connected. Host-time limits
+// fail the run. Build and run with `pio run -e native -t exec`.
+
+#include "../../src/main.cpp"
+
+#include <native_ui.h>
+
+#define BENCH_ADVERTISERS 150
+#define BENCH_SCAN_SECOND_MS 400   // One second of scan duration in host time
+#define BENCH_RELAY_TAPS 40
+#define BENCH_BLE_INIT_MS 300      // BLEDevice::init() bring-up time
+#define BENCH_SCAN_MAX_GAP_MS 100  // Longest loop() gap allowed while a scan streams in
+#define BENCH_STALL_MS 400         // loop() stuck this long while a scan runs
+#define BENCH_ENCODE_ROUNDS 200000
+#define BENCH_IDLE_MS 3000
+#define BENCH_LEGACY_WAKEUPS_PER_S 200  // The old loop(): lv_task_handler(), delay(5)
+#define BENCH_STYLE_FRAMES 20
+
+// The firmware prints and resets its statistics every PERF_REPORT_INTERVAL_MS;
+// these keep the totals over the whole run
+struct BenchStat {
+  uint32_t count;
+  uint64_t totalUs;
+  uint32_t maxUs;
+};
+
+struct BenchWatch {
+  PerfStat* stat;
+  BenchStat total;
+  PerfStat before;
+};
+
+BenchWatch benchWatches[] = {
+  { &perfLoop }, { &perfScanToList }, { &perfListBind }, { &perfTapToWrite },
+  { &perfRelayConfirm }, { &perfFrame }, { &perfFlushWait },
+};
+
+BenchStat benchTapToPeer;  // Pen down to the write reaching the relay board
+
+// One loop() pass, with whatever it added to the firmware statistics kept.
+// A report in this pass resets them: only the samples after it are still there.
+void benchLoop() {
+  for (BenchWatch& watch : benchWatches) watch.before = *watch.stat;
+  loop();
+  for (BenchWatch& watch : benchWatches) {
+    const PerfStat& now = *watch.stat;
+    bool reset = now.count < watch.before.count;
+    watch.total.count += reset ? now.count : now.count - watch.before.count;
+    watch.total.totalUs += reset ? now.totalUs : now.totalUs - watch.before.totalUs;
+    if (now.maxUs > watch.total.maxUs) watch.total.maxUs = now.maxUs;
+  }
+}
+
+template <typename Done>
+bool benchLoopUntil(Done done, uint32_t timeoutMs) {
+  auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeoutMs);
+  while (!done()) {
+    if (std::chrono::steady_clock::now() >= deadline) return false;
+    benchLoop();
+  }
+  return true;
+}
+
+void benchRecord(BenchStat& stat, uint32_t us) {
+  stat.count++;
+  stat.totalUs += us;
+  if (us > stat.maxUs) stat.maxUs = us;
+}
+
+void benchPrint(const char* name, const BenchStat& stat) {
+  if (!stat.count) {
+    printf("  %-24s no samples\n", name);
+    return;
+  }
+  printf("  %-24s n=%-6lu avg=%6lu us  max=%6lu us\n", name, (unsigned long)stat.count,
+         (unsigned long)(stat.totalUs / stat.count), (unsigned long)stat.maxUs);
+}
+
+[[noreturn]] void benchFail(const char* what) {
+  printf("bench: %s\n", what);
+  fflush(stdout);
+  std::_Exit(1);
+}
+
+// bleSendHexString()'s conversion before the frame table: a heap buffer and a
+// substring and strtoul() per byte
+size_t benchLegacyHexToBytes(const String& hexString, uint8_t*& bytes) {
+  int byteCount = hexString.length() / 2;
+  bytes = new uint8_t[byteCount];
+  for (int i = 0; i < byteCount; i++) {
+    String byteString = hexString.substring(i * 2, i * 2 + 2);
+    bytes[i] = strtoul(byteString.c_str(), NULL, 16);
+  }
+  return byteCount;
+}
+
+// Per-frame cost of the encoder and of the old parsing, in ns
+void benchRelayEncoding(double& legacyNs, double& tableNs) {
+  static const char* const commands[4][2] = {
+    { "A00100A1", "A00101A2" }, { "A00200A2", "A00201A3" },
+    { "A00300A3", "A00301A4" }, { "A00400A4", "A00401A5" },
+  };
+  volatile uint32_t sink = 0;
+  
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < BENCH_ENCODE_ROUNDS; i++) {
+    uint8_t* bytes;
+    benchLegacyHexToBytes(commands[i & 3][(i >> 2) & 1], bytes);
+    sink = sink + bytes[3];
+    delete[] bytes;
+  }
+  legacyNs = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / BENCH_ENCODE_ROUNDS;
+  
+  start = std::chrono::steady_clock::now();
+  for (int i = 0; i < BENCH_ENCODE_ROUNDS; i++) {
+    const RelayDescriptor& d = relayConfig.relays[i & 3];
+    RelayFrame frame = makeRelayFrame(d.channel, (i >> 2) & 1, d.header);
+    sink = sink + frame[3];
+  }
+  tableNs = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / BENCH_ENCODE_ROUNDS;
+}
+
+// LVGL heap in use
+uint32_t benchLvglUsed() {
+  lv_mem_monitor_t mon;
+  lv_mem_monitor(&mon);
+  return mon.total_size - mon.free_size;
+}
+
+struct BenchStyleCost {
+  uint32_t bytes;   // LVGL memory the buttons hold
+  double frameUs;   // Full redraw of a screen holding only them
+};
+
+// The relay buttons on a screen of their own, styled with local properties
+// one call at a time as create_main_screen() did before the theme, or with
+// the shared theme styles
+BenchStyleCost benchRelayButtonStyles(bool localStyles) {
+  lv_obj_t * previous = lv_screen_active();
+  uint32_t usedBefore = benchLvglUsed();
+  lv_obj_t * screen = lv_obj_create(NULL);
+  lv_obj_add_style(screen, &themeScreen, LV_PART_MAIN);
+  for (int relay = 0; relay < relayConfig.count; relay++) {
+    lv_obj_t * btn = lv_button_create(screen);
+    lv_obj_set_pos(btn, 10 + (relay % RELAY_COLUMNS) * 100, 70 + (relay / RELAY_COLUMNS) * 85);
+    lv_obj_set_size(btn, 90, 70);
+    lv_obj_add_flag(btn, LV_OBJ_FLAG_CHECKABLE);
+    lv_obj_t * lbl = lv_label_create(btn);
+    lv_label_set_text(lbl, relayConfig.relays[relay].label);
+    if (localStyles) {
+      lv_obj_set_style_bg_color(btn, lv_color_hex(0xFF0000), LV_PART_MAIN);
+      lv_obj_set_style_bg_opa(btn, LV_OPA_COVER, LV_PART_MAIN);
+      lv_obj_set_style_bg_color(btn, lv_color_hex(0x0000FF), LV_PART_MAIN | LV_STATE_CHECKED);
+      lv_obj_set_style_text_color(btn, lv_color_white(), LV_PART_MAIN);
+      lv_obj_set_style_border_width(btn, 2, LV_PART_MAIN);
+      lv_obj_set_style_border_color(btn, lv_color_white(), LV_PART_MAIN);
+      lv_obj_set_style_border_opa(btn, LV_OPA_COVER, LV_PART_MAIN);
+      lv_obj_set_style_text_font(lbl, &lv_font_montserrat_16, LV_PART_MAIN);
+    } else {
+      lv_obj_add_style(btn, &themeButton, LV_PART_MAIN);
+      lv_obj_add_style(btn, &themeRelayOn, LV_PART_MAIN | LV_STATE_CHECKED);
+      lv_obj_add_style(lbl, &themeTitle, LV_PART_MAIN);
+    }
+    lv_obj_center(lbl);
+  }
+  BenchStyleCost cost;
+  cost.bytes = benchLvglUsed() - usedBefore;
+  
+  lv_screen_load(screen);
+  lv_refr_now(NULL);
+  auto start = std::chrono::steady_clock::now();
+  for (int frame = 0; frame < BENCH_STYLE_FRAMES; frame++) {
+    lv_obj_invalidate(screen);
+    lv_refr_now(NULL);
+  }
+  cost.frameUs = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count() / BENCH_STYLE_FRAMES;
+  
+  lv_screen_load(previous);
+  lv_obj_delete(screen);
+  return cost;
+}
+
+int main() {
+  Serial.echo = false;
+  NativeNvs::flash().path = "";  // Factory-fresh settings: Target1 is the default relay board
+
+  NativeBle::Peer& board = NativeBle::addPeer(DEFAULT_TARGET1_MAC.packed(), "RELAY_BOARD");
+  board.reportsStatus = true;
+  for (int i = 0; i < BENCH_ADVERTISERS; i++) {
+    char name[20];
+    snprintf(name, sizeof(name), "Sensor-%03d", i);
+    NativeBle::Peer& peer = NativeBle::addPeer(0xC0FFEE000000ull + i, name);
+    peer.rssi = -40 - i % 50;
+    peer.advertIntervalMs = 100 + (i % 7) * 20;
+  }
+  NativeBle::radio().scanSecondMs = BENCH_SCAN_SECOND_MS;
+  NativeBle::radio().initMs = BENCH_BLE_INIT_MS;
+
+  // Boot: auto-connect to Target1
+  auto bootStart = std::chrono::steady_clock::now();
+  auto sinceBoot = [bootStart]() {
+    return (long long)std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - bootStart).count();
+  };
+  setup();
+  long long interactiveMs = sinceBoot();
+  uint32_t bootLvglUsed = benchLvglUsed();
+  // The BLE stack comes up on the worker while setup() builds the display
+  if (bleStackReady) {
+    benchFail("BLE bring-up finished before setup() returned");
+  }
+  long long firstFrameMs = -1, stackReadyMs = -1;
+  if (!benchLoopUntil([&]() {
+        if (firstFrameMs < 0 && perfFirstFrameLogged) firstFrameMs = sinceBoot();
+        if (stackReadyMs < 0 && bleStackReady) stackReadyMs = sinceBoot();
+        return activePeer >= 0;
+      }, 5000)) {
+    benchFail("Target1 did not connect");
+  }
+  long long bootMs = sinceBoot();
+  if (firstFrameMs < 0) {
+    benchFail("no frame reached the panel");
+  }
+
+  // List scan on the Bluetooth screen
+  show_bluetooth_screen();
+  uint32_t bluetoothLvglUsed = benchLvglUsed();
+  bleStartScan();
+  benchLoopUntil([]() { return listScanRunning; }, 1000);
+  if (!benchLoopUntil([]() { return !listScanRunning && !uxQueueMessagesWaiting(scanResultQueue); },
+                      SCAN_DURATION_S * BENCH_SCAN_SECOND_MS + 2000)) {
+    benchFail("list scan did not finish");
+  }
+  int listed = advertiserCount;
+  unsigned long scanGapMs = scanMaxLoopGapMs;
+  if (scanGapMs > BENCH_SCAN_MAX_GAP_MS) {
+    benchFail("loop() stalled while the scan streamed in");
+  }
+  
+  // A scan while loop() is stuck: the queue fills, onResult() drops the rest
+  // instead of blocking the BLE stack, and the repeats are listed afterwards
+  benchLoopUntil([]() { return !isScanning; }, 1000);
+  bleStartScan();
+  if (!isScanning) {
+    benchFail("scan did not start");
+  }
+  delay(BENCH_STALL_MS);
+  int stalledQueued = uxQueueMessagesWaiting(scanResultQueue);
+  uint32_t stalledDropped = scanDroppedResults;
+  if (stalledQueued != SCAN_QUEUE_LENGTH || stalledDropped == 0) {
+    benchFail("scan queue did not fill while loop() was stuck");
+  }
+  if (!benchLoopUntil([]() { return !listScanRunning && !uxQueueMessagesWaiting(scanResultQueue); },
+                      SCAN_DURATION_S * BENCH_SCAN_SECOND_MS + 2000)) {
+    benchFail("scan after the stall did not finish");
+  }
+  int stalledListed = advertiserCount;
+
+  // Relay taps on the main screen, each waiting for its write to reach the board
+  uiLoadScreen(main_screen);
+  benchLoopUntil([]() { return false; }, 100);
+  for (int tap = 0; tap < BENCH_RELAY_TAPS; tap++) {
+    int relay = tap % relayConfig.count;
+    size_t writes = NativeBle::writesTo(board).size();
+    uint64_t penDown = micros();
+    nativeTap(relayButtons[relay]);
+    if (!benchLoopUntil([&]() { return NativeBle::writesTo(board).size() > writes; }, 2000)) {
+      benchFail("relay tap was not written");
+    }
+    benchRecord(benchTapToPeer, NativeBle::writesTo(board)[writes].micros - penDown);
+    benchLoopUntil([]() { return !touchscreen.remaining() && !touchPointsPending(); }, 500);
+    benchLoopUntil([]() { return false; }, 20);
+  }
+  // Left for the main screen before the taps: the Bluetooth screen is gone
+  uint32_t teardownLvglUsed = benchLvglUsed();
+
+  // Idle on the main screen: every loop() pass ends in one sleep, woken by a
+  // deadline or by a BLE or touch task
+  uint32_t idleTimer = 0, idleEvent = 0, idlePasses = 0;
+  auto idleEnd = std::chrono::steady_clock::now() + std::chrono::milliseconds(BENCH_IDLE_MS);
+  while (std::chrono::steady_clock::now() < idleEnd) {
+    uint32_t timerBefore = loopTimerWakeups, eventBefore = loopEventWakeups;
+    benchLoop();
+    idlePasses++;
+    // The firmware's periodic report zeroes the counters before the sleep
+    if (loopTimerWakeups < timerBefore || loopEventWakeups < eventBefore) timerBefore = eventBefore = 0;
+    idleTimer += loopTimerWakeups - timerBefore;
+    idleEvent += loopEventWakeups - eventBefore;
+  }
+  double idleWakeupsPerS = idlePasses * 1000.0 / BENCH_IDLE_MS;
+  if (idleWakeupsPerS >= BENCH_LEGACY_WAKEUPS_PER_S) {
+    benchFail("idle loop() wakes as often as the fixed 5 ms delay");
+  }
+
+  BenchStyleCost localStyles = benchRelayButtonStyles(true);
+  BenchStyleCost themeStyles = benchRelayButtonStyles(false);
+  if (themeStyles.bytes > localStyles.bytes) {
+    benchFail("theme styles take more LVGL memory than local styles");
+  }
+
+  double legacyNs, tableNs;
+  benchRelayEncoding(legacyNs, tableNs);
+  if (tableNs >= legacyNs) {
+    benchFail("relay frame encoder is not faster than hex parsing");
+  }
+  
+  printf("=== Native benchmark ===\n");
+  printf("  boot: UI interactive %lld ms, first frame %lld ms, BLE stack ready %lld ms (init %d ms), relay board ready %lld ms\n",
+         interactiveMs, firstFrameMs, stackReadyMs, BENCH_BLE_INIT_MS, bootMs);
+  printf("  LVGL memory: %u bytes at boot, %u with the Bluetooth screen, %u after leaving it\n",
+         (unsigned int)bootLvglUsed, (unsigned int)bluetoothLvglUsed, (unsigned int)teardownLvglUsed);
+  // The connected relay board does not advertise
+  printf("  list scan: %d of %d advertisers listed, longest loop() gap %lu ms\n", listed, BENCH_ADVERTISERS, scanGapMs);
+  printf("  loop() stuck %d ms in a scan: %d queued, %u dropped, %d listed after\n",
+         BENCH_STALL_MS, stalledQueued, (unsigned int)stalledDropped, stalledListed);
+  for (const BenchWatch& watch : benchWatches) benchPrint(watch.stat->name, watch.total);
+  benchPrint("pen down to board write", benchTapToPeer);
+  printf("  relay board received %u writes\n", (unsigned int)NativeBle::writesTo(board).size());
+  printf("  idle %d ms: %.1f wakeups/s (%u timer, %u event), fixed 5 ms delay: %d/s\n", BENCH_IDLE_MS,
+         idleWakeupsPerS, (unsigned int)idleTimer, (unsigned int)idleEvent, BENCH_LEGACY_WAKEUPS_PER_S);
+  printf("  %d relay buttons, local styles: %u LVGL bytes, %.0f us/frame; theme: %u bytes, %.0f us/frame\n",
+         relayConfig.count, (unsigned int)localStyles.bytes, localStyles.frameUs,
+         (unsigned int)themeStyles.bytes, themeStyles.frameUs);
+  printf("  relay frame: hex parsing %.1f ns, encoder %.1f ns\n", legacyNs, tableNs);
+  fflush(stdout);
+
+  // The BLE, touch and timeline threads never return
+  std::_Exit(0);
+}
@@ -0,0 +1,313 @@
+// Native stand-in for the parts of the ESP32 Arduino core main.cpp uses.
+// Header only, so the benchmark harness and every unit test build it into
+// their own program. Tasks are threads and the clock is the host's, unless a
+// test freezes it (nativeClockFreeze()).
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "esp_err.h"
+
+using std::min;
+using std::max;
+
+#define IRAM_ATTR
+#define ARDUINO_RUNNING_CORE 1
+
+#define INPUT 0x01
+#define OUTPUT 0x03
+#define INPUT_PULLUP 0x05
+#define LOW 0x0
+#define HIGH 0x1
+#define RISING 0x01
+#define FALLING 0x02
+#define CHANGE 0x03
+
+#define constrain(amt, low, high) ((amt) < (low) ? (low) : ((amt) > (high) ? (high) : (amt)))
+
+inline long map(long x, long in_min, long in_max, long out_min, long out_max) {
+  return (x - in_min) * (out_max - out_min) / (in_max - in_min) + out_min;
+}
+
+// Clock: host time since start, or a frozen clock that only moves when a test
+// advances it. Frozen time is for single-threaded tests; tasks still sleep in real time.
+struct NativeClock {
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  std::atomic<int64_t> offsetMicros{0};  // Time a test stepped forward while frozen
+  std::atomic<bool> frozen{false};
+  std::atomic<uint64_t> frozenMicros{0};
+};
+
+inline NativeClock& nativeClock() {
+  static NativeClock* clock = new NativeClock();
+  return *clock;
+}
+
+// Start at 1 s: main.cpp uses 0 as "never" for some timestamps
+inline uint64_t nativeRunningMicros64() {
+  NativeClock& clock = nativeClock();
+  return 1000000 + clock.offsetMicros + std::chrono::duration_cast<std::chrono::microseconds>(
+                                           std::chrono::steady_clock::now() - clock.start).count();
+}
+
+inline uint64_t nativeMicros64() {
+  NativeClock& clock = nativeClock();
+  return clock.frozen ? clock.frozenMicros.load() : nativeRunningMicros64();
+}
+
+// Native only: stop the clock where it is; nativeClockAdvance() then moves it
+// by hand, so a test can step past a timeout without waiting for it
+inline void nativeClockFreeze() {
+  nativeClock().frozenMicros = nativeMicros64();
+  nativeClock().frozen = true;
+}
+
+inline void nativeClockAdvance(uint32_t ms) {
+  nativeClock().frozenMicros += (uint64_t)ms * 1000;
+}
+
+// Run again from the frozen time, so the clock never goes back
+inline void nativeClockRelease() {
+  NativeClock& clock = nativeClock();
+  if (!clock.frozen) return;
+  clock.offsetMicros += (int64_t)(clock.frozenMicros - nativeRunningMicros64());
+  clock.frozen = false;
+}
+
+inline unsigned long millis() { return (unsigned long)(nativeMicros64() / 1000); }
+inline unsigned long micros() { return (unsigned long)nativeMicros64(); }
+inline void delay(uint32_t ms) { std::this_thread::sleep_for(std::chrono::milliseconds(ms)); }
+inline void delayMicroseconds(uint32_t us) { std::this_thread::sleep_for(std::chrono::microseconds(us)); }
+
+// Arduino String, on std::string
+class String {
+public:
+  String(const char* text = "") : s(text ? text : "") {}
+  String(const std::string& text) : s(text) {}
+  explicit String(char c) : s(1, c) {}
+  explicit String(int value) : s(std::to_string(value)) {}
+  explicit String(unsigned int value) : s(std::to_string(value)) {}
+  explicit String(long value) : s(std::to_string(value)) {}
+  explicit String(unsigned long value) : s(std::to_string(value)) {}
+
+  const char* c_str() const { return s.c_str(); }
+  unsigned int length() const { return s.length(); }
+  bool isEmpty() const { return s.empty(); }
+  char operator[](unsigned int index) const { return index < s.length() ? s[index] : 0; }
+  String substring(unsigned int left, unsigned int right) const {
+    return left < s.length() ? String(s.substr(left, right > left ? right - left : 0)) : String();
+  }
+
+  String& operator+=(const String& other) { s += other.s; return *this; }
+  String& operator+=(const char* other) { s += other; return *this; }
+  String& operator+=(char c) { s += c; return *this; }
+  String& operator+=(int value) { s += std::to_string(value); return *this; }
+  String& operator+=(unsigned int value) { s += std::to_string(value); return *this; }
+  String& operator+=(long value) { s += std::to_string(value); return *this; }
+  String& operator+=(unsigned long value) { s += std::to_string(value); return *this; }
+
+  bool operator==(const String& other) const { return s == other.s; }
+  bool operator==(const char* other) const { return s == other; }
+  bool operator!=(const String& other) const { return s != other.s; }
+  bool operator!=(const char* other) const { return s != other; }
+
+private:
+  std::string s;
+};
+
+template <typename T>
+inline String operator+(String lhs, const T& rhs) { return lhs += rhs; }
+inline String operator+(const char* lhs, const String& rhs) { return String(lhs) += rhs; }
+
+// Serial: printed to stdout. Benchmarks and tests set echo = false to keep
+// their own output readable.
+class HardwareSerial {
+public:
+  bool echo = true;
+
+  void begin(unsigned long baud) {}
+  void flush() { if (echo) fflush(stdout); }
+
+  size_t print(const char* text) { return echo ? fputs(text, stdout), strlen(text) : 0; }
+  size_t print(const String& text) { return print(text.c_str()); }
+  size_t print(int value) { return printf("%d", value); }
+  size_t print(unsigned long value) { return printf("%lu", value); }
+  size_t println() { return print("\n"); }
+  size_t println(const char* text) { return print(text) + println(); }
+  size_t println(const String& text) { return println(text.c_str()); }
+  size_t println(int value) { return print(value) + println(); }
+
+  size_t printf(const char* format, ...) __attribute__((format(printf, 2, 3))) {
+    if (!echo) return 0;
+    va_list args;
+    va_start(args, format);
+    int written = vprintf(format, args);
+    va_end(args);
+    return written > 0 ? written : 0;
+  }
+};
+
+inline HardwareSerial Serial;
+
+// GPIO: input levels are set by the stand-ins that drive them (the touch
+// controller's PENIRQ); a falling edge runs the attached handler on the
+// thread that made it, as an interrupt would run between two instructions.
+struct NativeGpio {
+  std::mutex mutex;
+  uint8_t level[64];
+  void (*handler[64])(void) = {};
+  int mode[64] = {};
+
+  NativeGpio() { memset(level, HIGH, sizeof(level)); }
+};
+
+inline NativeGpio& nativeGpio() {
+  static NativeGpio* gpio = new NativeGpio();
+  return *gpio;
+}
+
+inline void pinMode(uint8_t pin, uint8_t mode) {}
+
+inline int digitalRead(uint8_t pin) {
+  return nativeGpio().level[pin];
+}
+
+inline int digitalPinToInterrupt(int pin) { return pin; }
+
+inline void attachInterrupt(uint8_t pin, void (*handler)(void), int mode) {
+  std::lock_guard<std::mutex> lock(nativeGpio().mutex);
+  nativeGpio().handler[pin] = handler;
+  nativeGpio().mode[pin] = mode;
+}
+
+inline void detachInterrupt(uint8_t pin) {
+  std::lock_guard<std::mutex> lock(nativeGpio().mutex);
+  nativeGpio().handler[pin] = nullptr;
+}
+
+// Native only: drive an input pin, running its interrupt handler on a matching edge
+inline void nativePinWrite(uint8_t pin, uint8_t level) {
+  NativeGpio& gpio = nativeGpio();
+  void (*handler)(void) = nullptr;
+  {
+    std::lock_guard<std::mutex> lock(gpio.mutex);
+    uint8_t old = gpio.level[pin];
+    gpio.level[pin] = level;
+    bool falling = old == HIGH && level == LOW;
+    bool rising = old == LOW && level == HIGH;
+    int mode = gpio.mode[pin];
+    if ((falling && (mode == FALLING || mode == CHANGE)) || (rising && (mode == RISING || mode == CHANGE))) {
+      handler = gpio.handler[pin];
+    }
+  }
+  if (handler) handler();
+}
+
+// Native only: a falling edge on a pin that stays low, as the XPT2046 makes while it samples
+inline void nativePinPulse(uint8_t pin) {
+  NativeGpio& gpio = nativeGpio();
+  void (*handler)(void) = nullptr;
+  {
+    std::lock_guard<std::mutex> lock(gpio.mutex);
+    if (gpio.mode[pin] == FALLING || gpio.mode[pin] == CHANGE) handler = gpio.handler[pin];
+  }
+  if (handler) handler();
+}
+
+// Seeded, so a test run is repeatable. Shared by every thread, hence the lock.
+struct NativeRandom {
+  std::mutex mutex;
+  std::mt19937 engine{1};
+};
+
+inline NativeRandom& nativeRandom() {
+  static NativeRandom* random = new NativeRandom();
+  return *random;
+}
+
+inline void randomSeed(unsigned long seed) {
+  std::lock_guard<std::mutex> lock(nativeRandom().mutex);
+  nativeRandom().engine.seed(seed);
+}
+
+inline long random(long howbig) {
+  if (howbig <= 0) return 0;
+  std::lock_guard<std::mutex> lock(nativeRandom().mutex);
+  return std::uniform_int_distribution<long>(0, howbig - 1)(nativeRandom().engine);
+}
+
+inline long random(long howsmall, long howbig) {
+  if (howsmall >= howbig) return howsmall;
+  return howsmall + random(howbig - howsmall);
+}
+
+inline uint32_t esp_random() {
+  std::lock_guard<std::mutex> lock(nativeRandom().mutex);
+  return (uint32_t)nativeRandom().engine();
+}
+
+#if !defined(__GLIBC__) || __GLIBC__ < 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ < 38)
+inline size_t strlcpy(char* dst, const char* src, size_t size) {
+  size_t length = strlen(src);
+  if (size) {
+    size_t n = length < size - 1 ? length : size - 1;
+    memcpy(dst, src, n);
+    dst[n] = '\0';
+  }
+  return length;
+}
+#endif
+
+// SPI: the touch controller stand-in does not talk to it
+#define VSPI 3
+#define HSPI 2
+
+class SPIClass {
+public:
+  explicit SPIClass(uint8_t bus = HSPI) {}
+  void begin(int8_t sck = -1, int8_t miso = -1, int8_t mosi = -1, int8_t ss = -1) {}
+};
+
+// Heap figures have no host equivalent; report a fixed ESP32 figure
+class EspClass {
+public:
+  uint32_t getFreeHeap() { return 200000; }
+  uint32_t getMinFreeHeap() { return 180000; }
+  uint32_t getMaxAllocHeap() { return 110000; }
+};
+
+inline EspClass ESP;
+
+// esp_system.h: handlers run by esp_restart(), here by nativeRunShutdownHandlers()
+typedef void (*shutdown_handler_t)(void);
+
+inline std::vector<shutdown_handler_t>& nativeShutdownHandlers() {
+  static std::vector<shutdown_handler_t>* handlers = new std::vector<shutdown_handler_t>();
+  return *handlers;
+}
+
+inline esp_err_t esp_register_shutdown_handler(shutdown_handler_t handler) {
+  nativeShutdownHandlers().push_back(handler);
+  return ESP_OK;
+}
+
+inline void nativeRunShutdownHandlers() {
+  for (shutdown_handler_t handler : nativeShutdownHandlers()) handler();
+}
@@ -0,0 +1,4 @@
+// Native stand-in: the BLE library and stack API are all in native_ble.h
+#pragma once
+
+#include "native_ble.h"
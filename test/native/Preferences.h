@@ -0,0 +1,238 @@
+// Native stand-in for the ESP32 Preferences library, backed by a file so
+// settings survive a restart of the program the way NVS survives a reboot.
+// The file is read on the first begin() and rewritten by end() after a change.
+//
+// Entries are typed as in NVS: a key written as a blob does not read back as
+// an integer. The limits main.cpp depends on are kept: 15-character keys and
+// namespaces, no writes in a read-only session, getBytes() failing (0) when
+// the buffer is too small.
+#pragma once
+
+#include <Arduino.h>
+
+#include <map>
+#include <string>
+#include <vector>
+
+namespace NativeNvs {
+
+enum Type : uint8_t { U8, U16, U32, BOOL, STR, BLOB };
+
+struct Entry {
+  Type type;
+  std::vector<uint8_t> value;
+};
+
+typedef std::map<std::string, std::map<std::string, Entry>> Store;
+
+struct Flash {
+  std::mutex mutex;
+  std::string path = "native_nvs.bin";  // Empty: memory only
+  Store store;
+  bool loaded = false;
+  uint32_t commits = 0;                 // end() calls that wrote the file
+  uint32_t writes = 0;                  // Successful put and remove calls
+  uint32_t sessions = 0;                // begin() calls
+  uint32_t reads = 0;                   // Key lookups by get and isKey calls
+  uint32_t bytesRead = 0;               // Bytes copied out by getBytes()
+};
+
+inline Flash& flash() {
+  static Flash* f = new Flash();
+  return *f;
+}
+
+// Called with the flash locked
+inline void load() {
+  Flash& f = flash();
+  f.loaded = true;
+  f.store.clear();
+  if (f.path.empty()) return;
+  FILE* file = fopen(f.path.c_str(), "rb");
+  if (!file) return;
+
+  auto readString = [file](std::string& s) {
+    uint8_t length;
+    if (fread(&length, 1, 1, file) != 1) return false;
+    s.resize(length);
+    return fread(&s[0], 1, length, file) == length;
+  };
+  std::string ns, key;
+  while (readString(ns) && readString(key)) {
+    Entry entry;
+    uint32_t length;
+    if (fread(&entry.type, 1, 1, file) != 1 || fread(&length, sizeof(length), 1, file) != 1) break;
+    entry.value.resize(length);
+    if (fread(entry.value.data(), 1, length, file) != length) break;
+    f.store[ns][key] = entry;
+  }
+  fclose(file);
+}
+
+// Called with the flash locked
+inline void save() {
+  Flash& f = flash();
+  f.commits++;
+  if (f.path.empty()) return;
+  FILE* file = fopen(f.path.c_str(), "wb");
+  if (!file) return;
+  auto writeString = [file](const std::string& s) {
+    uint8_t length = s.size();
+    fwrite(&length, 1, 1, file);
+    fwrite(s.data(), 1, length, file);
+  };
+  for (const auto& ns : f.store) {
+    for (const auto& item : ns.second) {
+      uint32_t length = item.second.value.size();
+      writeString(ns.first);
+      writeString(item.first);
+      fwrite(&item.second.type, 1, 1, file);
+      fwrite(&length, sizeof(length), 1, file);
+      fwrite(item.second.value.data(), 1, length, file);
+    }
+  }
+  fclose(file);
+}
+
+// Erase the whole partition, file included
+inline void eraseAll() {
+  Flash& f = flash();
+  std::lock_guard<std::mutex> lock(f.mutex);
+  f.store.clear();
+  f.loaded = true;
+  f.commits = 0;
+  f.writes = 0;
+  if (!f.path.empty()) remove(f.path.c_str());
+}
+
+// Forget the in-memory copy, so the next begin() reads the file as after a reboot
+inline void reboot() {
+  std::lock_guard<std::mutex> lock(flash().mutex);
+  flash().loaded = false;
+}
+
+}  // namespace NativeNvs
+
+class Preferences {
+public:
+  bool begin(const char* name, bool readOnly = false, const char* partition_label = nullptr) {
+    if (started || !name || strlen(name) > 15) return false;
+    NativeNvs::Flash& f = NativeNvs::flash();
+    std::lock_guard<std::mutex> lock(f.mutex);
+    if (!f.loaded) NativeNvs::load();
+    f.sessions++;
+    ns = name;
+    this->readOnly = readOnly;
+    started = true;
+    dirty = false;
+    return true;
+  }
+
+  void end() {
+    if (!started) return;
+    NativeNvs::Flash& f = NativeNvs::flash();
+    std::lock_guard<std::mutex> lock(f.mutex);
+    if (dirty) NativeNvs::save();
+    started = false;
+  }
+
+  bool clear() {
+    if (!writable()) return false;
+    std::lock_guard<std::mutex> lock(NativeNvs::flash().mutex);
+    NativeNvs::flash().store.erase(ns);
+    changed();
+    return true;
+  }
+
+  bool remove(const char* key) {
+    if (!writable() || !validKey(key)) return false;
+    std::lock_guard<std::mutex> lock(NativeNvs::flash().mutex);
+    if (NativeNvs::flash().store[ns].erase(key) == 0) return false;
+    changed();
+    return true;
+  }
+
+  bool isKey(const char* key) { return find(key) != nullptr; }
+
+  size_t putUChar(const char* key, uint8_t value) { return put(key, NativeNvs::U8, &value, sizeof(value)); }
+  size_t putUShort(const char* key, uint16_t value) { return put(key, NativeNvs::U16, &value, sizeof(value)); }
+  size_t putUInt(const char* key, uint32_t value) { return put(key, NativeNvs::U32, &value, sizeof(value)); }
+  size_t putBool(const char* key, bool value) {
+    uint8_t byte = value;
+    return put(key, NativeNvs::BOOL, &byte, sizeof(byte));
+  }
+  size_t putString(const char* key, const char* value) { return put(key, NativeNvs::STR, value, strlen(value)); }
+  size_t putString(const char* key, String value) { return putString(key, value.c_str()); }
+  size_t putBytes(const char* key, const void* value, size_t len) {
+    if (!value || !len) return 0;
+    return put(key, NativeNvs::BLOB, value, len);
+  }
+
+  uint8_t getUChar(const char* key, uint8_t defaultValue = 0) { return get(key, NativeNvs::U8, defaultValue); }
+  uint16_t getUShort(const char* key, uint16_t defaultValue = 0) { return get(key, NativeNvs::U16, defaultValue); }
+  uint32_t getUInt(const char* key, uint32_t defaultValue = 0) { return get(key, NativeNvs::U32, defaultValue); }
+  bool getBool(const char* key, bool defaultValue = false) { return get<uint8_t>(key, NativeNvs::BOOL, defaultValue); }
+
+  String getString(const char* key, String defaultValue = String()) {
+    const NativeNvs::Entry* entry = find(key);
+    if (!entry || entry->type != NativeNvs::STR) return defaultValue;
+    return String(std::string(entry->value.begin(), entry->value.end()));
+  }
+
+  size_t getBytesLength(const char* key) {
+    const NativeNvs::Entry* entry = find(key);
+    return entry && entry->type == NativeNvs::BLOB ? entry->value.size() : 0;
+  }
+
+  size_t getBytes(const char* key, void* buf, size_t maxLen) {
+    const NativeNvs::Entry* entry = find(key);
+    if (!entry || entry->type != NativeNvs::BLOB || !buf) return 0;
+    if (entry->value.size() > maxLen) return 0;
+    memcpy(buf, entry->value.data(), entry->value.size());
+    NativeNvs::flash().bytesRead += entry->value.size();
+    return entry->value.size();
+  }
+
+private:
+  std::string ns;
+  bool started = false;
+  bool readOnly = false;
+  bool dirty = false;
+
+  static bool validKey(const char* key) { return key && strlen(key) <= 15; }
+  bool writable() const { return started && !readOnly; }
+
+  void changed() {
+    dirty = true;
+    NativeNvs::flash().writes++;
+  }
+
+  // Only a session's own put/remove/clear change its namespace, so the entry
+  // stays valid for the caller after the lock is released
+  const NativeNvs::Entry* find(const char* key) {
+    if (!started || !validKey(key)) return nullptr;
+    std::lock_guard<std::mutex> lock(NativeNvs::flash().mutex);
+    NativeNvs::flash().reads++;
+    auto& entries = NativeNvs::flash().store[ns];
+    auto it = entries.find(key);
+    return it == entries.end() ? nullptr : &it->second;
+  }
+
+  size_t put(const char* key, NativeNvs::Type type, const void* value, size_t len) {
+    if (!writable() || !validKey(key)) return 0;
+    std::lock_guard<std::mutex> lock(NativeNvs::flash().mutex);
+    const uint8_t* bytes = (const uint8_t*)value;
+    NativeNvs::flash().store[ns][key] = NativeNvs::Entry{ type, std::vector<uint8_t>(bytes, bytes + len) };
+    changed();
+    return len;
+  }
+
+  template <typename T>
+  T get(const char* key, NativeNvs::Type type, T defaultValue) {
+    const NativeNvs::Entry* entry = find(key);
+    if (!entry || entry->type != type || entry->value.size() != sizeof(T)) return defaultValue;
+    T value;
+    memcpy(&value, entry->value.data(), sizeof(T));
+    return value;
+  }
+};
@@ -0,0 +1,126 @@
+// Native stand-in for TFT_eSPI on the ILI9341: a framebuffer in place of the
+// panel. DMA transfers take the time the SPI clock would and read the source
+// buffer when they finish, so a buffer reused before dmaWait() shows up as
+// wrong pixels, as it would on the panel.
+//
+// The framebuffer holds the RGB565 words as sent (big-endian on the wire) and
+// is kept in the current rotation's coordinates; readPixel() returns native RGB565.
+#pragma once
+
+#include <Arduino.h>
+
+#include <chrono>
+#include <vector>
+
+#define TFT_BLACK 0x0000
+#define TFT_WHITE 0xFFFF
+
+class TFT_eSPI {
+public:
+  uint32_t spiHz = 55000000;    // SPI_FREQUENCY of the CYD build
+
+  // Counters for tests and the benchmark
+  uint32_t pushes = 0;
+  uint64_t pixelsPushed = 0;
+  uint32_t pushesOutsideWrite = 0;  // pushImageDMA() without startWrite()
+  uint64_t dmaWaitMicros = 0;       // Time callers spent blocked in dmaWait()
+
+  TFT_eSPI(int16_t w = 240, int16_t h = 320) : panelWidth(w), panelHeight(h) {
+    frame.assign((size_t)w * h, 0);
+  }
+
+  void begin() { init(); }
+  void init() { rotation = 0; }
+
+  void setRotation(uint8_t r) {
+    dmaWait();
+    if ((r & 1) != (rotation & 1)) frame.assign(frame.size(), 0);
+    rotation = r & 3;
+  }
+
+  uint8_t getRotation() const { return rotation; }
+  int16_t width() const { return rotation & 1 ? panelHeight : panelWidth; }
+  int16_t height() const { return rotation & 1 ? panelWidth : panelHeight; }
+
+  bool initDMA(bool ctrl_cs = false) { return dmaReady = true; }
+  void deInitDMA() { dmaReady = false; }
+
+  void startWrite() { writeDepth++; }
+  void endWrite() { if (writeDepth > 0) writeDepth--; }
+  bool inWrite() const { return writeDepth > 0; }
+
+  void setSwapBytes(bool swap) { swapBytes = swap; }
+  bool getSwapBytes() const { return swapBytes; }
+
+  void fillScreen(uint32_t color) {
+    dmaWait();
+    uint16_t wire = (uint16_t)((color >> 8) | (color << 8));
+    frame.assign(frame.size(), wire);
+  }
+
+  // Starts the transfer and returns; the previous one is waited for first
+  void pushImageDMA(int32_t x, int32_t y, int32_t w, int32_t h, uint16_t* data, uint16_t* buffer = nullptr) {
+    dmaWait();
+    if (!inWrite()) pushesOutsideWrite++;
+    pushes++;
+    pixelsPushed += (uint64_t)w * h;
+    transfer = { x, y, w, h, data, true };
+    busyUntil = std::chrono::steady_clock::now() +
+                std::chrono::nanoseconds((uint64_t)w * h * 16 * 1000000000ull / spiHz);
+  }
+
+  bool dmaBusy() {
+    if (transfer.active && std::chrono::steady_clock::now() >= busyUntil) complete();
+    return transfer.active;
+  }
+
+  void dmaWait() {
+    if (!transfer.active) return;
+    auto start = std::chrono::steady_clock::now();
+    std::this_thread::sleep_until(busyUntil);
+    dmaWaitMicros += std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - start).count();
+    complete();
+  }
+
+  // Native only: the pixel at (x, y) in the current rotation, as RGB565
+  uint16_t readPixel(int32_t x, int32_t y) {
+    dmaBusy();
+    if (x < 0 || y < 0 || x >= width() || y >= height()) return 0;
+    uint16_t wire = frame[(size_t)y * width() + x];
+    return (uint16_t)((wire >> 8) | (wire << 8));
+  }
+
+private:
+  struct Transfer {
+    int32_t x, y, w, h;
+    const uint16_t* data;
+    bool active;
+  };
+
+  int16_t panelWidth;
+  int16_t panelHeight;
+  uint8_t rotation = 0;
+  bool dmaReady = false;
+  bool swapBytes = false;
+  int writeDepth = 0;
+  std::vector<uint16_t> frame;
+  Transfer transfer = {};
+  std::chrono::steady_clock::time_point busyUntil;
+
+  // The transfer lands: copy the source as it is now, clipped to the panel
+  void complete() {
+    const Transfer& t = transfer;
+    for (int32_t row = 0; row < t.h; row++) {
+      int32_t py = t.y + row;
+      if (py < 0 || py >= height()) continue;
+      for (int32_t col = 0; col < t.w; col++) {
+        int32_t px = t.x + col;
+        if (px < 0 || px >= width()) continue;
+        uint16_t pixel = t.data[(size_t)row * t.w + col];
+        frame[(size_t)py * width() + px] = swapBytes ? (uint16_t)((pixel >> 8) | (pixel << 8)) : pixel;
+      }
+    }
+    transfer.active = false;
+  }
+};
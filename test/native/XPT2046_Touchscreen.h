@@ -0,0 +1,89 @@
+// Native stand-in for the XPT2046_Touchscreen library, played from a script.
+// Each getPoint() returns the next scripted sample (raw coordinates after the
+// library's rotation) and sets PENIRQ (GPIO36 on the CYD, whether or not the
+// library is given the pin) to that sample's pen state; reading while
+// the pen is down raises the spurious PENIRQ edges the real controller makes
+// during a conversion. With the script used up the pen is up: z = 0, PENIRQ high.
+#pragma once
+
+#include <Arduino.h>
+
+#include <deque>
+#include <vector>
+
+class TS_Point {
+public:
+  TS_Point() : x(0), y(0), z(0) {}
+  TS_Point(int16_t x, int16_t y, int16_t z) : x(x), y(y), z(z) {}
+  bool operator==(TS_Point p) const { return x == p.x && y == p.y && z == p.z; }
+  bool operator!=(TS_Point p) const { return !(*this == p); }
+  int16_t x, y, z;
+};
+
+struct TouchSample {
+  int16_t x;
+  int16_t y;
+  int16_t z;
+  bool penDown;     // PENIRQ low while this sample is the current one
+};
+
+class XPT2046_Touchscreen {
+public:
+  XPT2046_Touchscreen(uint8_t cs, uint8_t tirq = 255) : tirq(tirq) {
+    if (tirq != 255) penIrqPin = tirq;
+  }
+
+  bool begin(SPIClass& spi) { return true; }
+  void setRotation(uint8_t r) { rotation = r % 4; }
+
+  TS_Point getPoint() {
+    TouchSample sample = { 0, 0, 0, false };
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      reads++;
+      if (!script.empty()) {
+        sample = script.front();
+        script.pop_front();
+      }
+    }
+    setPen(sample.penDown);
+    if (sample.penDown) nativePinPulse(penIrqPin);
+    return TS_Point(sample.x, sample.y, sample.z);
+  }
+
+  bool tirqTouched() { return tirq != 255 && digitalRead(tirq) == LOW; }
+  bool touched() { return getPoint().z >= 300; }
+
+  // Native only: queue samples; a script that starts with the pen down pulls
+  // PENIRQ low now, which is the edge that wakes the sampler
+  void play(const std::vector<TouchSample>& samples) {
+    if (samples.empty()) return;
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      script.insert(script.end(), samples.begin(), samples.end());
+    }
+    if (samples.front().penDown) setPen(true);
+  }
+
+  size_t remaining() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return script.size();
+  }
+
+  uint32_t readCount() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return reads;
+  }
+
+private:
+  uint8_t tirq;
+  uint8_t penIrqPin = 36;
+  uint8_t rotation = 0;
+  std::mutex mutex;
+  std::deque<TouchSample> script;
+  uint32_t reads = 0;
+
+  void setPen(bool down) {
+    nativePinWrite(penIrqPin, down ? LOW : HIGH);
+  }
+};
@@ -0,0 +1,45 @@
+// Native stand-in for the FreeRTOS kernel as the ESP32 Arduino core ships it.
+// Tasks are host threads; one tick is one millisecond (CONFIG_FREERTOS_HZ=1000).
+#pragma once
+
+#include <stdint.h>
+#include <mutex>
+
+typedef uint32_t TickType_t;
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+
+#define pdTRUE 1
+#define pdFALSE 0
+#define pdPASS pdTRUE
+#define pdFAIL pdFALSE
+#define errQUEUE_FULL 0
+#define portMAX_DELAY (TickType_t)0xffffffffUL
+#define portTICK_PERIOD_MS 1
+#define pdMS_TO_TICKS(ms) ((TickType_t)(ms))
+#define configMAX_PRIORITIES 25
+#define tskNO_AFFINITY 0x7FFFFFFF
+
+#define portYIELD_FROM_ISR(...) ((void)0)
+
+// Critical sections: one lock shared by every spinlock, recursive like the
+// ESP-IDF ones are per core. Interrupts here are handlers run on the caller's
+// thread, so the ISR variants take the same lock.
+typedef struct {
+  uint32_t owner;
+  uint32_t count;
+} portMUX_TYPE;
+
+#define portMUX_INITIALIZER_UNLOCKED {0, 0}
+
+inline std::recursive_mutex& nativeCriticalLock() {
+  static std::recursive_mutex* lock = new std::recursive_mutex();
+  return *lock;
+}
+
+inline void portENTER_CRITICAL(portMUX_TYPE* mux) { nativeCriticalLock().lock(); }
+inline void portEXIT_CRITICAL(portMUX_TYPE* mux) { nativeCriticalLock().unlock(); }
+inline void portENTER_CRITICAL_ISR(portMUX_TYPE* mux) { nativeCriticalLock().lock(); }
+inline void portEXIT_CRITICAL_ISR(portMUX_TYPE* mux) { nativeCriticalLock().unlock(); }
+
+inline BaseType_t xPortGetCoreID() { return 1; }
@@ -0,0 +1,95 @@
+// Native stand-in for FreeRTOS queues: fixed-size items copied in and out
+// under a lock, with blocking sends and receives.
+#pragma once
+
+#include "FreeRTOS.h"
+
+#include <string.h>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <vector>
+
+struct QueueDefinition {
+  std::mutex mutex;
+  std::condition_variable notEmpty;
+  std::condition_variable notFull;
+  UBaseType_t length = 0;
+  UBaseType_t itemSize = 0;
+  std::deque<std::vector<uint8_t>> items;
+};
+
+typedef QueueDefinition* QueueHandle_t;
+
+// Waits on cv until ready() holds or the ticks run out; true if ready
+template <typename Ready>
+inline bool nativeQueueWait(std::unique_lock<std::mutex>& lock, std::condition_variable& cv,
+                            TickType_t ticksToWait, Ready ready) {
+  if (ticksToWait == portMAX_DELAY) {
+    cv.wait(lock, ready);
+    return true;
+  }
+  return cv.wait_for(lock, std::chrono::milliseconds(ticksToWait), ready);
+}
+
+inline QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t itemSize) {
+  QueueHandle_t queue = new QueueDefinition();
+  queue->length = length;
+  queue->itemSize = itemSize;
+  return queue;
+}
+
+inline BaseType_t xQueueSend(QueueHandle_t queue, const void* item, TickType_t ticksToWait) {
+  std::unique_lock<std::mutex> lock(queue->mutex);
+  if (!nativeQueueWait(lock, queue->notFull, ticksToWait,
+                       [queue]() { return queue->items.size() < queue->length; })) {
+    return errQUEUE_FULL;
+  }
+  const uint8_t* bytes = (const uint8_t*)item;
+  queue->items.emplace_back(bytes, bytes + queue->itemSize);
+  lock.unlock();
+  queue->notEmpty.notify_one();
+  return pdTRUE;
+}
+
+inline BaseType_t xQueueSendToBack(QueueHandle_t queue, const void* item, TickType_t ticksToWait) {
+  return xQueueSend(queue, item, ticksToWait);
+}
+
+inline BaseType_t xQueueSendFromISR(QueueHandle_t queue, const void* item, BaseType_t* higherPriorityTaskWoken) {
+  if (higherPriorityTaskWoken) *higherPriorityTaskWoken = pdFALSE;
+  return xQueueSend(queue, item, 0);
+}
+
+inline BaseType_t xQueueReceive(QueueHandle_t queue, void* buffer, TickType_t ticksToWait) {
+  std::unique_lock<std::mutex> lock(queue->mutex);
+  if (!nativeQueueWait(lock, queue->notEmpty, ticksToWait,
+                       [queue]() { return !queue->items.empty(); })) {
+    return pdFALSE;
+  }
+  memcpy(buffer, queue->items.front().data(), queue->itemSize);
+  queue->items.pop_front();
+  lock.unlock();
+  queue->notFull.notify_one();
+  return pdTRUE;
+}
+
+inline UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue) {
+  std::lock_guard<std::mutex> lock(queue->mutex);
+  return queue->items.size();
+}
+
+inline UBaseType_t uxQueueSpacesAvailable(QueueHandle_t queue) {
+  std::lock_guard<std::mutex> lock(queue->mutex);
+  return queue->length - queue->items.size();
+}
+
+inline BaseType_t xQueueReset(QueueHandle_t queue) {
+  {
+    std::lock_guard<std::mutex> lock(queue->mutex);
+    queue->items.clear();
+  }
+  queue->notFull.notify_all();
+  return pdPASS;
+}
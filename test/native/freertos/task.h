@@ -0,0 +1,99 @@
+// Native stand-in for FreeRTOS tasks and direct-to-task notifications.
+// A task is a detached thread that runs until the process exits.
+#pragma once
+
+#include "FreeRTOS.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+
+typedef void (*TaskFunction_t)(void*);
+
+struct tskTaskControlBlock {
+  std::string name;
+  std::mutex mutex;
+  std::condition_variable notified;
+  uint32_t notifyValue = 0;
+};
+
+typedef tskTaskControlBlock* TaskHandle_t;
+
+// The calling thread's task; the first call on a thread that was not started
+// by xTaskCreate() (main(), as the Arduino loop task) makes one for it
+inline TaskHandle_t& nativeCurrentTask() {
+  static thread_local TaskHandle_t current = nullptr;
+  return current;
+}
+
+inline TaskHandle_t xTaskGetCurrentTaskHandle() {
+  TaskHandle_t& current = nativeCurrentTask();
+  if (current == nullptr) {
+    current = new tskTaskControlBlock();
+    current->name = "loopTask";
+  }
+  return current;
+}
+
+// Control blocks are never freed: tasks live for the whole program
+inline BaseType_t xTaskCreatePinnedToCore(TaskFunction_t code, const char* name, uint32_t stackDepth,
+                                          void* parameters, UBaseType_t priority,
+                                          TaskHandle_t* createdTask, BaseType_t coreId) {
+  TaskHandle_t task = new tskTaskControlBlock();
+  task->name = name ? name : "";
+  // The handle is stored before the task runs, as the kernel does for a lower
+  // priority task: code that notifies through it may start immediately
+  if (createdTask) *createdTask = task;
+  std::thread([task, code, parameters]() {
+    nativeCurrentTask() = task;
+    code(parameters);
+  }).detach();
+  return pdPASS;
+}
+
+inline BaseType_t xTaskCreate(TaskFunction_t code, const char* name, uint32_t stackDepth,
+                              void* parameters, UBaseType_t priority, TaskHandle_t* createdTask) {
+  return xTaskCreatePinnedToCore(code, name, stackDepth, parameters, priority, createdTask, tskNO_AFFINITY);
+}
+
+inline void vTaskDelay(TickType_t ticks) {
+  std::this_thread::sleep_for(std::chrono::milliseconds(ticks));
+}
+
+inline TickType_t xTaskGetTickCount() {
+  static const auto start = std::chrono::steady_clock::now();
+  return (TickType_t)std::chrono::duration_cast<std::chrono::milliseconds>(
+      std::chrono::steady_clock::now() - start).count();
+}
+
+inline uint32_t ulTaskNotifyTake(BaseType_t clearCountOnExit, TickType_t ticksToWait) {
+  TaskHandle_t task = xTaskGetCurrentTaskHandle();
+  std::unique_lock<std::mutex> lock(task->mutex);
+  if (ticksToWait == portMAX_DELAY) {
+    task->notified.wait(lock, [task]() { return task->notifyValue > 0; });
+  } else if (ticksToWait > 0) {
+    task->notified.wait_for(lock, std::chrono::milliseconds(ticksToWait),
+                            [task]() { return task->notifyValue > 0; });
+  }
+  uint32_t value = task->notifyValue;
+  if (value > 0) {
+    task->notifyValue = clearCountOnExit ? 0 : value - 1;
+  }
+  return value;
+}
+
+inline BaseType_t xTaskNotifyGive(TaskHandle_t task) {
+  {
+    std::lock_guard<std::mutex> lock(task->mutex);
+    task->notifyValue++;
+  }
+  task->notified.notify_all();
+  return pdPASS;
+}
+
+inline void vTaskNotifyGiveFromISR(TaskHandle_t task, BaseType_t* higherPriorityTaskWoken) {
+  xTaskNotifyGive(task);
+  if (higherPriorityTaskWoken) *higherPriorityTaskWoken = pdTRUE;
+}
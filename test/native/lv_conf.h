@@ -0,0 +1,28 @@
+/**
+ * LVGL configuration for the native build (env:native). Only what differs
+ * from LVGL's defaults, or what main.cpp depends on, is set here.
+ */
+#ifndef LV_CONF_H
+#define LV_CONF_H
+
+#define LV_COLOR_DEPTH 16
+
+#define LV_USE_STDLIB_MALLOC LV_STDLIB_BUILTIN
+#define LV_MEM_SIZE (64 * 1024U)
+
+/* loop() drives LVGL from one thread, as on the ESP32 */
+#define LV_USE_OS LV_OS_NONE
+
+#define LV_USE_LOG 1
+#define LV_LOG_LEVEL LV_LOG_LEVEL_WARN
+#define LV_LOG_PRINTF 0
+
+#define LV_FONT_MONTSERRAT_12 1
+#define LV_FONT_MONTSERRAT_14 1
+#define LV_FONT_MONTSERRAT_16 1
+#define LV_FONT_DEFAULT &lv_font_montserrat_14
+
+/* The display is main.cpp's own DMA flush on the TFT_eSPI stand-in */
+#define LV_USE_TFT_ESPI 0
+
+#endif /* LV_CONF_H */
@@ -0,0 +1,44 @@
+// Native only: a replacement global operator new that counts the allocations
+// made by each thread, for the tests that check a path allocates nothing.
+// Defines the replacement functions, so include it in one translation unit
+// per program (each test and the benchmark are a single one). They are kept
+// out of line: inlined, GCC would pair the free() with the operator new call.
+#pragma once
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#include <new>
+
+inline thread_local uint32_t nativeThreadAllocations = 0;
+
+// Allocations made by the calling thread since it started
+inline uint32_t nativeAllocations() {
+  return nativeThreadAllocations;
+}
+
+__attribute__((noinline)) void* operator new(size_t size) {
+  nativeThreadAllocations++;
+  if (void* p = malloc(size ? size : 1)) return p;
+  throw std::bad_alloc();
+}
+
+__attribute__((noinline)) void* operator new[](size_t size) {
+  return operator new(size);
+}
+
+__attribute__((noinline)) void operator delete(void* p) noexcept {
+  free(p);
+}
+
+__attribute__((noinline)) void operator delete[](void* p) noexcept {
+  free(p);
+}
+
+__attribute__((noinline)) void operator delete(void* p, size_t) noexcept {
+  free(p);
+}
+
+__attribute__((noinline)) void operator delete[](void* p, size_t) noexcept {
+  free(p);
+}
@@ -0,0 +1,928 @@
+// Native stand-in for the ESP32 Arduino BLE library and the Bluedroid GAP and
+// GATT client APIs main.cpp calls, over a simulated radio.
+//
+// The radio holds a list of peers (NativeBle::addPeer()). Stack events are
+// delivered on a BTC timeline thread, through the custom GAP/GATTC handlers
+// first and the library's own handling second, as BLEDevice does. Blocking
+// library calls (BLEClient::connect(), getService()) block their caller for
+// the peer's configured latency, as they block the worker on the device.
+//
+// A peer with reportsStatus behaves as the relay board: it applies the relay
+// frames written to its characteristic and, once the CCCD is written, notifies
+// the resulting state.
+#pragma once
+
+#include <Arduino.h>
+
+#include <deque>
+#include <functional>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "native_timeline.h"
+
+// esp_bt_defs.h, esp_gap_ble_api.h, esp_gattc_api.h: the parts main.cpp uses
+
+#define ESP_BD_ADDR_LEN 6
+typedef uint8_t esp_bd_addr_t[ESP_BD_ADDR_LEN];
+
+typedef enum { BLE_ADDR_TYPE_PUBLIC = 0, BLE_ADDR_TYPE_RANDOM = 1 } esp_ble_addr_type_t;
+typedef enum { BLE_WL_ADDR_TYPE_PUBLIC = 0, BLE_WL_ADDR_TYPE_RANDOM = 1 } esp_ble_wl_addr_type_t;
+typedef enum { ESP_BT_STATUS_SUCCESS = 0, ESP_BT_STATUS_FAIL = 1 } esp_bt_status_t;
+
+typedef uint8_t esp_gatt_if_t;
+
+typedef enum {
+  ESP_GATT_OK = 0x00,
+  ESP_GATT_INVALID_HANDLE = 0x01,
+  ESP_GATT_ERROR = 0x85,
+  ESP_GATT_NOT_FOUND = 0x0a,
+} esp_gatt_status_t;
+
+typedef enum { ESP_GATT_WRITE_TYPE_NO_RSP = 1, ESP_GATT_WRITE_TYPE_RSP = 2 } esp_gatt_write_type_t;
+typedef enum { ESP_GATT_AUTH_REQ_NONE = 0 } esp_gatt_auth_req_t;
+
+#define ESP_GATT_CHAR_PROP_BIT_READ (1 << 1)
+#define ESP_GATT_CHAR_PROP_BIT_WRITE_NR (1 << 2)
+#define ESP_GATT_CHAR_PROP_BIT_WRITE (1 << 3)
+#define ESP_GATT_CHAR_PROP_BIT_NOTIFY (1 << 4)
+
+#define ESP_UUID_LEN_16 2
+#define ESP_UUID_LEN_128 16
+#define ESP_GATT_UUID_CHAR_CLIENT_CONFIG 0x2902
+
+typedef struct {
+  uint16_t len;
+  union {
+    uint16_t uuid16;
+    uint32_t uuid32;
+    uint8_t uuid128[ESP_UUID_LEN_128];
+  } uuid;
+} esp_bt_uuid_t;
+
+typedef struct {
+  uint16_t handle;
+  esp_bt_uuid_t uuid;
+} esp_gattc_descr_elem_t;
+
+typedef enum {
+  ESP_GATTC_WRITE_CHAR_EVT = 4,
+  ESP_GATTC_WRITE_DESCR_EVT = 8,
+  ESP_GATTC_NOTIFY_EVT = 10,
+  ESP_GATTC_CFG_MTU_EVT = 18,
+  ESP_GATTC_DISCONNECT_EVT = 41,
+  ESP_GATTC_CONGEST_EVT = 44,
+} esp_gattc_cb_event_t;
+
+typedef union {
+  struct {
+    esp_gatt_status_t status;
+    uint16_t conn_id;
+    uint16_t handle;
+    uint16_t offset;
+  } write;
+  struct {
+    uint16_t conn_id;
+    esp_bd_addr_t remote_bda;
+    uint16_t handle;
+    uint16_t value_len;
+    uint8_t* value;
+    bool is_notify;
+  } notify;
+  struct {
+    int reason;
+    uint16_t conn_id;
+    esp_bd_addr_t remote_bda;
+  } disconnect;
+  struct {
+    esp_gatt_status_t status;
+    uint16_t conn_id;
+    uint16_t mtu;
+  } cfg_mtu;
+  struct {
+    uint16_t conn_id;
+    bool congested;
+  } congest;
+} esp_ble_gattc_cb_param_t;
+
+typedef enum {
+  ESP_GAP_BLE_SCAN_PARAM_SET_COMPLETE_EVT = 2,
+  ESP_GAP_BLE_SCAN_RESULT_EVT = 3,
+  ESP_GAP_BLE_SCAN_START_COMPLETE_EVT = 7,
+  ESP_GAP_BLE_SCAN_STOP_COMPLETE_EVT = 18,
+} esp_gap_ble_cb_event_t;
+
+typedef enum { ESP_GAP_SEARCH_INQ_RES_EVT = 0, ESP_GAP_SEARCH_INQ_CMPL_EVT = 1 } esp_gap_search_evt_t;
+
+#define ESP_BLE_ADV_DATA_LEN_MAX 31
+#define ESP_BLE_SCAN_RSP_DATA_LEN_MAX 31
+#define ESP_BLE_AD_TYPE_NAME_CMPL 0x09
+
+typedef union {
+  struct {
+    esp_gap_search_evt_t search_evt;
+    esp_bd_addr_t bda;
+    esp_ble_addr_type_t ble_addr_type;
+    int rssi;
+    uint8_t ble_adv[ESP_BLE_ADV_DATA_LEN_MAX + ESP_BLE_SCAN_RSP_DATA_LEN_MAX];
+    uint8_t adv_data_len;
+    uint8_t scan_rsp_len;
+    int num_resps;
+  } scan_rst;
+  struct {
+    esp_bt_status_t status;
+  } scan_start_cmpl;
+  struct {
+    esp_bt_status_t status;
+  } scan_stop_cmpl;
+} esp_ble_gap_cb_param_t;
+
+typedef enum { BLE_SCAN_TYPE_PASSIVE = 0, BLE_SCAN_TYPE_ACTIVE = 1 } esp_ble_scan_type_t;
+typedef enum { BLE_SCAN_FILTER_ALLOW_ALL = 0, BLE_SCAN_FILTER_ALLOW_ONLY_WLST = 1 } esp_ble_scan_filter_t;
+typedef enum { BLE_SCAN_DUPLICATE_DISABLE = 0, BLE_SCAN_DUPLICATE_ENABLE = 1 } esp_ble_scan_duplicate_t;
+
+typedef struct {
+  esp_ble_scan_type_t scan_type;
+  esp_ble_addr_type_t own_addr_type;
+  esp_ble_scan_filter_t scan_filter_policy;
+  uint16_t scan_interval;
+  uint16_t scan_window;
+  esp_ble_scan_duplicate_t scan_duplicate;
+} esp_ble_scan_params_t;
+
+typedef void (*gattc_event_handler)(esp_gattc_cb_event_t event, esp_gatt_if_t gattc_if, esp_ble_gattc_cb_param_t* param);
+typedef void (*gap_event_handler)(esp_gap_ble_cb_event_t event, esp_ble_gap_cb_param_t* param);
+
+class BLEClient;
+class BLEScan;
+
+// Simulated radio
+
+namespace NativeBle {
+
+constexpr esp_gatt_if_t GATTC_IF = 3;
+
+// One write as the peer received it
+struct Write {
+  uint64_t micros;            // micros() when the worker handed it to the stack
+  uint16_t handle;
+  bool response;
+  std::vector<uint8_t> data;
+};
+
+struct Peer {
+  // Advertising
+  uint8_t address[ESP_BD_ADDR_LEN] = {};
+  std::string name;
+  int rssi = -60;
+  bool advertising = true;          // Also connectable while set
+  uint32_t advertIntervalMs = 100;
+
+  // GATT server: FFE0 with FFE1 and its CCCD
+  bool hasService = true;
+  bool hasCharacteristic = true;
+  uint16_t charHandle = 0x002A;
+  uint8_t charProperties = ESP_GATT_CHAR_PROP_BIT_WRITE | ESP_GATT_CHAR_PROP_BIT_WRITE_NR | ESP_GATT_CHAR_PROP_BIT_NOTIFY;
+  uint16_t cccdHandle = 0x002B;     // 0: no CCCD
+  uint16_t mtu = 23;
+
+  // Latencies
+  uint32_t connectMs = 30;          // BLEClient::connect()
+  uint32_t discoveryMs = 60;        // BLEClient::getService()
+  uint32_t writeAckMs = 8;          // Write to ESP_GATTC_WRITE_CHAR_EVT, one at a time
+
+  // Relay board
+  bool reportsStatus = false;
+  uint8_t relayOn = 0;              // Bit n-1 = channel n
+
+  // Link state, owned by the radio
+  BLEClient* client = nullptr;
+  uint16_t connId = 0;
+  bool connected = false;
+  bool registered = false;          // esp_ble_gattc_register_for_notify()
+  bool notifying = false;           // CCCD written with notifications on
+  std::chrono::steady_clock::time_point ackDue;
+  uint32_t connects = 0;
+  std::vector<Write> writes;
+};
+
+struct Radio {
+  std::recursive_mutex mutex;
+  NativeTimeline btc{"BTC_TASK"};
+  std::deque<Peer> peers;
+  std::set<BLEClient*> clients;
+  std::set<uint64_t> whitelist;
+
+  gattc_event_handler customGattcHandler = nullptr;
+  gap_event_handler customGapHandler = nullptr;
+  BLEScan* scan = nullptr;
+  bool initialized = false;
+  uint16_t localMtu = 23;
+  uint16_t nextConnId = 0;
+
+  esp_ble_scan_params_t params = {};
+  esp_ble_scan_params_t activeParams = {};
+  bool scanning = false;
+  uint32_t scanGeneration = 0;
+  std::set<uint64_t> scanReported;  // BLE_SCAN_DUPLICATE_ENABLE filter
+
+  // Settings
+  uint32_t initMs = 0;              // BLEDevice::init() bring-up time
+  uint32_t scanSecondMs = 1000;     // Length of one second of scan duration, to compress scans
+  uint32_t failedConnectMs = 0;     // Time a connect to an absent peer takes; 0 = the caller's timeout
+};
+
+inline Radio& radio() {
+  static Radio* r = new Radio();
+  return *r;
+}
+
+inline uint64_t packAddress(const uint8_t* address) {
+  uint64_t packed = 0;
+  for (int i = 0; i < ESP_BD_ADDR_LEN; i++) packed = (packed << 8) | address[i];
+  return packed;
+}
+
+// Add a peer in range of the radio. The reference stays valid until reset().
+inline Peer& addPeer(uint64_t address, const char* name) {
+  std::lock_guard<std::recursive_mutex> lock(radio().mutex);
+  radio().peers.emplace_back();
+  Peer& peer = radio().peers.back();
+  for (int i = ESP_BD_ADDR_LEN - 1; i >= 0; i--, address >>= 8) peer.address[i] = address & 0xFF;
+  peer.name = name;
+  return peer;
+}
+
+inline Peer* findPeer(const uint8_t* address) {
+  for (Peer& peer : radio().peers) {
+    if (memcmp(peer.address, address, ESP_BD_ADDR_LEN) == 0) return &peer;
+  }
+  return nullptr;
+}
+
+inline Peer* findConnection(uint16_t connId) {
+  for (Peer& peer : radio().peers) {
+    if (peer.connected && peer.connId == connId) return &peer;
+  }
+  return nullptr;
+}
+
+// Copy of the writes a peer received, safe to read while the worker runs
+inline std::vector<Write> writesTo(const Peer& peer) {
+  std::lock_guard<std::recursive_mutex> lock(radio().mutex);
+  return peer.writes;
+}
+
+// Wait for every queued stack event to be delivered
+inline bool waitIdle(uint32_t timeoutMs = 10000) {
+  return radio().btc.waitIdle(timeoutMs);
+}
+
+inline void deliverGap(esp_gap_ble_cb_event_t event, esp_ble_gap_cb_param_t* param);
+inline void deliverGattc(esp_gattc_cb_event_t event, esp_ble_gattc_cb_param_t* param);
+inline void linkDown(Peer& peer, int reason);
+
+// Peer-side link loss (supervision timeout): the disconnect event and the
+// client's onDisconnect() follow on the BTC thread
+inline void dropLink(Peer& peer, int reason = 0x08) {
+  std::lock_guard<std::recursive_mutex> lock(radio().mutex);
+  if (peer.connected) linkDown(peer, reason);
+}
+
+// Controller-side flow control, as ESP_GATTC_CONGEST_EVT reports it
+inline void congest(Peer& peer, bool congested) {
+  std::lock_guard<std::recursive_mutex> lock(radio().mutex);
+  if (!peer.connected) return;
+  uint16_t connId = peer.connId;
+  radio().btc.post([connId, congested]() {
+    esp_ble_gattc_cb_param_t param = {};
+    param.congest.conn_id = connId;
+    param.congest.congested = congested;
+    deliverGattc(ESP_GATTC_CONGEST_EVT, &param);
+  });
+}
+
+// Forget every peer and scan; clients still held by the application keep
+// working as disconnected clients
+inline void reset() {
+  Radio& r = radio();
+  r.btc.clear();
+  r.btc.waitIdle();
+  std::lock_guard<std::recursive_mutex> lock(r.mutex);
+  for (Peer& peer : r.peers) {
+    peer.connected = false;
+  }
+  r.peers.clear();
+  r.whitelist.clear();
+  r.scanning = false;
+  r.scanGeneration++;
+  r.scanReported.clear();
+}
+
+}  // namespace NativeBle
+
+// GAP API
+
+inline esp_err_t esp_ble_gap_set_scan_params(esp_ble_scan_params_t* params) {
+  NativeBle::Radio& r = NativeBle::radio();
+  std::lock_guard<std::recursive_mutex> lock(r.mutex);
+  if (r.scanning) return ESP_FAIL;
+  r.params = *params;
+  r.btc.post([]() {
+    esp_ble_gap_cb_param_t param = {};
+    NativeBle::deliverGap(ESP_GAP_BLE_SCAN_PARAM_SET_COMPLETE_EVT, &param);
+  });
+  return ESP_OK;
+}
+
+namespace NativeBle {
+
+// Advertisement from one peer during scan 'generation', then the next one
+// advertIntervalMs later while the scan lasts
+inline void scheduleAdvert(uint32_t generation, size_t peerIndex, std::chrono::steady_clock::time_point due,
+                           std::chrono::steady_clock::time_point scanEnd) {
+  if (due >= scanEnd) return;
+  radio().btc.at(due, [generation, peerIndex, due, scanEnd]() {
+    Radio& r = radio();
+    esp_ble_gap_cb_param_t param = {};
+    {
+      std::lock_guard<std::recursive_mutex> lock(r.mutex);
+      if (generation != r.scanGeneration || peerIndex >= r.peers.size()) return;
+      Peer& peer = r.peers[peerIndex];
+      // Advertising events are spread by up to 10 ms, as the spec requires
+      scheduleAdvert(generation, peerIndex,
+                     due + std::chrono::milliseconds(peer.advertIntervalMs + random(0, 11)), scanEnd);
+
+      uint64_t address = packAddress(peer.address);
+      if (!peer.advertising || peer.connected) return;
+      if (r.activeParams.scan_filter_policy == BLE_SCAN_FILTER_ALLOW_ONLY_WLST && !r.whitelist.count(address)) return;
+      if (r.activeParams.scan_duplicate == BLE_SCAN_DUPLICATE_ENABLE && !r.scanReported.insert(address).second) return;
+
+      param.scan_rst.search_evt = ESP_GAP_SEARCH_INQ_RES_EVT;
+      memcpy(param.scan_rst.bda, peer.address, ESP_BD_ADDR_LEN);
+      param.scan_rst.rssi = peer.rssi + (int)random(-3, 4);
+      param.scan_rst.num_resps = 1;
+      // Name in the scan response, as an active scan gets it
+      size_t nameLength = min(peer.name.size(), (size_t)ESP_BLE_SCAN_RSP_DATA_LEN_MAX - 2);
+      if (nameLength) {
+        param.scan_rst.ble_adv[0] = nameLength + 1;
+        param.scan_rst.ble_adv[1] = ESP_BLE_AD_TYPE_NAME_CMPL;
+        memcpy(param.scan_rst.ble_adv + 2, peer.name.data(), nameLength);
+        param.scan_rst.scan_rsp_len = nameLength + 2;
+      }
+    }
+    deliverGap(ESP_GAP_BLE_SCAN_RESULT_EVT, &param);
+  });
+}
+
+}  // namespace NativeBle
+
+inline esp_err_t esp_ble_gap_start_scanning(uint32_t duration) {
+  NativeBle::Radio& r = NativeBle::radio();
+  std::lock_guard<std::recursive_mutex> lock(r.mutex);
+  if (r.scanning) return ESP_FAIL;
+  r.scanning = true;
+  r.activeParams = r.params;
+  r.scanReported.clear();
+  uint32_t generation = ++r.scanGeneration;
+
+  auto start = std::chrono::steady_clock::now();
+  auto end = start + std::chrono::milliseconds((uint64_t)duration * r.scanSecondMs);
+  r.btc.post([]() {
+    esp_ble_gap_cb_param_t param = {};
+    param.scan_start_cmpl.status = ESP_BT_STATUS_SUCCESS;
+    NativeBle::deliverGap(ESP_GAP_BLE_SCAN_START_COMPLETE_EVT, &param);
+  });
+  for (size_t i = 0; i < r.peers.size(); i++) {
+    // The first advertisement falls anywhere in the peer's interval
+    uint32_t phaseMs = random(0, r.peers[i].advertIntervalMs);
+    NativeBle::scheduleAdvert(generation, i, start + std::chrono::milliseconds(phaseMs), end);
+  }
+  r.btc.at(end, [generation]() {
+    NativeBle::Radio& r = NativeBle::radio();
+    {
+      std::lock_guard<std::recursive_mutex> lock(r.mutex);
+      if (generation != r.scanGeneration) return;
+      r.scanning = false;
+    }
+    esp_ble_gap_cb_param_t param = {};
+    param.scan_rst.search_evt = ESP_GAP_SEARCH_INQ_CMPL_EVT;
+    NativeBle::deliverGap(ESP_GAP_BLE_SCAN_RESULT_EVT, &param);
+  });
+  return ESP_OK;
+}
+
+// Stopping does not complete the inquiry: only STOP_COMPLETE follows
+inline esp_err_t esp_ble_gap_stop_scanning(void) {
+  NativeBle::Radio& r = NativeBle::radio();
+  std::lock_guard<std::recursive_mutex> lock(r.mutex);
+  if (!r.scanning) return ESP_OK;
+  r.scanning = false;
+  r.scanGeneration++;
+  r.btc.post([]() {
+    esp_ble_gap_cb_param_t param = {};
+    param.scan_stop_cmpl.status = ESP_BT_STATUS_SUCCESS;
+    NativeBle::deliverGap(ESP_GAP_BLE_SCAN_STOP_COMPLETE_EVT, &param);
+  });
+  return ESP_OK;
+}
+
+inline esp_err_t esp_ble_gap_update_whitelist(bool add_remove, esp_bd_addr_t remote_bda, esp_ble_wl_addr_type_t wl_addr_type) {
+  NativeBle::Radio& r = NativeBle::radio();
+  std::lock_guard<std::recursive_mutex> lock(r.mutex);
+  if (r.scanning) return ESP_FAIL;  // The controller refuses whitelist changes while it uses the list
+  uint64_t address = NativeBle::packAddress(remote_bda);
+  if (add_remove) {
+    r.whitelist.insert(address);
+  } else {
+    r.whitelist.erase(address);
+  }
+  return ESP_OK;
+}
+
+inline esp_err_t esp_ble_gap_clear_whitelist(void) {
+  std::lock_guard<std::recursive_mutex> lock(NativeBle::radio().mutex);
+  NativeBle::radio().whitelist.clear();
+  return ESP_OK;
+}
+
+// Arduino BLE library
+
+class BLEUUID {
+public:
+  BLEUUID() {}
+  BLEUUID(std::string text) : text(text) {}
+  BLEUUID(const char* text) : text(text) {}
+  BLEUUID(uint16_t uuid16) : uuid16(uuid16) {}
+
+  bool equals(const BLEUUID& other) const { return text == other.text && uuid16 == other.uuid16; }
+  std::string toString() const { return text.empty() ? std::to_string(uuid16) : text; }
+  uint16_t getUuid16() const { return uuid16; }
+
+private:
+  std::string text;
+  uint16_t uuid16 = 0;
+};
+
+class BLEAddress {
+public:
+  BLEAddress(esp_bd_addr_t address) { memcpy(native, address, ESP_BD_ADDR_LEN); }
+
+  BLEAddress(std::string text) {
+    unsigned int b[ESP_BD_ADDR_LEN] = {};
+    sscanf(text.c_str(), "%x:%x:%x:%x:%x:%x", &b[0], &b[1], &b[2], &b[3], &b[4], &b[5]);
+    for (int i = 0; i < ESP_BD_ADDR_LEN; i++) native[i] = b[i];
+  }
+
+  bool equals(BLEAddress other) { return memcmp(native, other.native, ESP_BD_ADDR_LEN) == 0; }
+  esp_bd_addr_t* getNative() { return &native; }
+
+  std::string toString() {
+    char text[18];
+    snprintf(text, sizeof(text), "%02x:%02x:%02x:%02x:%02x:%02x",
+             native[0], native[1], native[2], native[3], native[4], native[5]);
+    return text;
+  }
+
+private:
+  esp_bd_addr_t native;
+};
+
+class BLEAdvertisedDevice {
+public:
+  BLEAdvertisedDevice(esp_bd_addr_t bda) : address(bda) {}
+
+  BLEAddress getAddress() { return address; }
+  std::string getName() { return name; }
+  int getRSSI() { return rssi; }
+  bool haveName() { return !name.empty(); }
+  bool haveRSSI() { return true; }
+  esp_ble_addr_type_t getAddressType() { return BLE_ADDR_TYPE_PUBLIC; }
+
+  // Library side of a scan result
+  void parse(const esp_ble_gap_cb_param_t* param) {
+    rssi = param->scan_rst.rssi;
+    int length = param->scan_rst.adv_data_len + param->scan_rst.scan_rsp_len;
+    const uint8_t* data = param->scan_rst.ble_adv;
+    for (int i = 0; i + 1 < length && data[i]; i += data[i] + 1) {
+      if (data[i + 1] == ESP_BLE_AD_TYPE_NAME_CMPL) name.assign((const char*)data + i + 2, data[i] - 1);
+    }
+  }
+
+private:
+  BLEAddress address;
+  std::string name;
+  int rssi = 0;
+};
+
+class BLEAdvertisedDeviceCallbacks {
+public:
+  virtual ~BLEAdvertisedDeviceCallbacks() {}
+  virtual void onResult(BLEAdvertisedDevice advertisedDevice) = 0;
+};
+
+class BLEScanResults {
+public:
+  int getCount() { return count; }
+  int count = 0;
+};
+
+class BLEScan {
+public:
+  void setActiveScan(bool active) { params.scan_type = active ? BLE_SCAN_TYPE_ACTIVE : BLE_SCAN_TYPE_PASSIVE; }
+  void setInterval(uint16_t intervalMs) { params.scan_interval = intervalMs / 0.625; }
+  void setWindow(uint16_t windowMs) { params.scan_window = windowMs / 0.625; }
+
+  void setAdvertisedDeviceCallbacks(BLEAdvertisedDeviceCallbacks* callbacks, bool wantDuplicates = false,
+                                    bool shouldParse = true) {
+    this->callbacks = callbacks;
+    this->wantDuplicates = wantDuplicates;
+  }
+
+  // Starts the scan and returns; scanCompleteCB runs on the BTC thread when the duration ends
+  bool start(uint32_t duration, void (*scanCompleteCB)(BLEScanResults), bool is_continue = false) {
+    std::lock_guard<std::recursive_mutex> lock(NativeBle::radio().mutex);
+    if (!is_continue) clearResults();
+    completeCB = scanCompleteCB;
+    stopped = false;
+    params.scan_filter_policy = BLE_SCAN_FILTER_ALLOW_ALL;
+    params.scan_duplicate = BLE_SCAN_DUPLICATE_DISABLE;
+    if (esp_ble_gap_set_scan_params(&params) != ESP_OK || esp_ble_gap_start_scanning(duration) != ESP_OK) {
+      stopped = true;
+      return false;
+    }
+    return true;
+  }
+
+  void stop() {
+    stopped = true;
+    esp_ble_gap_stop_scanning();
+  }
+
+  void clearResults() {
+    std::lock_guard<std::recursive_mutex> lock(NativeBle::radio().mutex);
+    seen.clear();
+    results.count = 0;
+  }
+
+  // BLEScan::handleGAPEvent(): results only while a scan this object started
+  // runs; the complete callback on any inquiry's end
+  void handleGAPEvent(esp_gap_ble_cb_event_t event, esp_ble_gap_cb_param_t* param) {
+    if (event != ESP_GAP_BLE_SCAN_RESULT_EVT) return;
+
+    if (param->scan_rst.search_evt == ESP_GAP_SEARCH_INQ_CMPL_EVT) {
+      stopped = true;
+      if (completeCB) completeCB(results);
+      return;
+    }
+    if (stopped) return;
+
+    bool found;
+    {
+      std::lock_guard<std::recursive_mutex> lock(NativeBle::radio().mutex);
+      found = !seen.insert(NativeBle::packAddress(param->scan_rst.bda)).second;
+      if (!found) results.count++;
+    }
+    if (found && !wantDuplicates) return;
+
+    BLEAdvertisedDevice device(param->scan_rst.bda);
+    device.parse(param);
+    if (callbacks) callbacks->onResult(device);
+  }
+
+private:
+  esp_ble_scan_params_t params = {};
+  BLEAdvertisedDeviceCallbacks* callbacks = nullptr;
+  bool wantDuplicates = false;
+  void (*completeCB)(BLEScanResults) = nullptr;
+  volatile bool stopped = true;
+  std::set<uint64_t> seen;
+  BLEScanResults results;
+};
+
+class BLERemoteDescriptor {
+public:
+  explicit BLERemoteDescriptor(uint16_t handle = 0) : handle(handle) {}
+  uint16_t getHandle() { return handle; }
+
+private:
+  uint16_t handle;
+};
+
+class BLERemoteCharacteristic {
+public:
+  uint16_t getHandle() { return handle; }
+  bool canRead() { return properties & ESP_GATT_CHAR_PROP_BIT_READ; }
+  bool canWrite() { return properties & ESP_GATT_CHAR_PROP_BIT_WRITE; }
+  bool canWriteNoResponse() { return properties & ESP_GATT_CHAR_PROP_BIT_WRITE_NR; }
+  bool canNotify() { return properties & ESP_GATT_CHAR_PROP_BIT_NOTIFY; }
+
+  // Only the CCCD is discovered
+  BLERemoteDescriptor* getDescriptor(BLEUUID uuid) {
+    if (cccd.getHandle() == 0 || uuid.getUuid16() != ESP_GATT_UUID_CHAR_CLIENT_CONFIG) return nullptr;
+    return &cccd;
+  }
+
+private:
+  friend class BLEClient;
+  uint16_t handle = 0;
+  uint8_t properties = 0;
+  BLERemoteDescriptor cccd;
+};
+
+class BLERemoteService {
+public:
+  BLERemoteCharacteristic* getCharacteristic(const char* uuid) { return present ? &characteristic : nullptr; }
+  BLERemoteCharacteristic* getCharacteristic(BLEUUID uuid) { return present ? &characteristic : nullptr; }
+
+private:
+  friend class BLEClient;
+  bool present = false;
+  BLERemoteCharacteristic characteristic;
+};
+
+class BLEClientCallbacks {
+public:
+  virtual ~BLEClientCallbacks() {}
+  virtual void onConnect(BLEClient* client) = 0;
+  virtual void onDisconnect(BLEClient* client) = 0;
+};
+
+class BLEClient {
+public:
+  BLEClient() {
+    std::lock_guard<std::recursive_mutex> lock(NativeBle::radio().mutex);
+    NativeBle::radio().clients.insert(this);
+  }
+
+  ~BLEClient() {
+    std::lock_guard<std::recursive_mutex> lock(NativeBle::radio().mutex);
+    if (peer && peer->client == this) {
+      peer->connected = false;
+      peer->client = nullptr;
+    }
+    NativeBle::radio().clients.erase(this);
+  }
+
+  // Blocks for the peer's connect latency, or the timeout if it is out of range
+  bool connect(BLEAddress address, esp_ble_addr_type_t type = BLE_ADDR_TYPE_PUBLIC, uint32_t timeoutMs = portMAX_DELAY) {
+    NativeBle::Radio& r = NativeBle::radio();
+    uint32_t waitMs;
+    {
+      std::lock_guard<std::recursive_mutex> lock(r.mutex);
+      NativeBle::Peer* target = NativeBle::findPeer(*address.getNative());
+      bool reachable = target && target->advertising && !target->connected;
+      waitMs = reachable ? target->connectMs : (r.failedConnectMs ? r.failedConnectMs : timeoutMs);
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(waitMs));
+
+    std::lock_guard<std::recursive_mutex> lock(r.mutex);
+    NativeBle::Peer* target = NativeBle::findPeer(*address.getNative());
+    if (!target || !target->advertising || target->connected) return false;
+
+    peer = target;
+    peer->client = this;
+    peer->connected = true;
+    peer->registered = false;
+    peer->notifying = false;
+    peer->connId = r.nextConnId++;
+    peer->connects++;
+    peer->ackDue = std::chrono::steady_clock::now();
+    connId = peer->connId;
+    mtu = min(r.localMtu, peer->mtu);
+    if (callbacks) callbacks->onConnect(this);
+    return true;
+  }
+
+  // Closes the link; ESP_GATTC_DISCONNECT_EVT and onDisconnect() follow on the BTC thread
+  void disconnect() {
+    std::lock_guard<std::recursive_mutex> lock(NativeBle::radio().mutex);
+    if (isConnected()) NativeBle::linkDown(*peer, 0x16);
+  }
+
+  bool isConnected() {
+    std::lock_guard<std::recursive_mutex> lock(NativeBle::radio().mutex);
+    return peer && peer->client == this && peer->connected;
+  }
+
+  // Blocks for the peer's discovery latency
+  BLERemoteService* getService(const char* uuid) { return getService(BLEUUID(uuid)); }
+
+  BLERemoteService* getService(BLEUUID uuid) {
+    uint32_t discoveryMs;
+    {
+      std::lock_guard<std::recursive_mutex> lock(NativeBle::radio().mutex);
+      if (!isConnected()) return nullptr;
+      discoveryMs = peer->discoveryMs;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(discoveryMs));
+
+    std::lock_guard<std::recursive_mutex> lock(NativeBle::radio().mutex);
+    if (!isConnected() || !peer->hasService) return nullptr;
+    service.present = peer->hasCharacteristic;
+    service.characteristic.handle = peer->charHandle;
+    service.characteristic.properties = peer->charProperties;
+    service.characteristic.cccd = BLERemoteDescriptor(peer->cccdHandle);
+    return &service;
+  }
+
+  uint16_t getConnId() { return connId; }
+  esp_gatt_if_t getGattcIf() { return NativeBle::GATTC_IF; }
+  uint16_t getMTU() { return mtu; }
+  void setClientCallbacks(BLEClientCallbacks* callbacks) { this->callbacks = callbacks; }
+  BLEClientCallbacks* getClientCallbacks() { return callbacks; }
+
+private:
+  NativeBle::Peer* peer = nullptr;
+  uint16_t connId = 0;
+  uint16_t mtu = 23;
+  BLEClientCallbacks* volatile callbacks = nullptr;
+  BLERemoteService service;
+};
+
+class BLEDevice {
+public:
+  static void init(std::string deviceName) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(NativeBle::radio().initMs));
+    NativeBle::radio().initialized = true;
+  }
+
+  static bool getInitialized() { return NativeBle::radio().initialized; }
+  static void setCustomGattcHandler(gattc_event_handler handler) { NativeBle::radio().customGattcHandler = handler; }
+  static void setCustomGapHandler(gap_event_handler handler) { NativeBle::radio().customGapHandler = handler; }
+
+  static BLEScan* getScan() {
+    NativeBle::Radio& r = NativeBle::radio();
+    if (r.scan == nullptr) r.scan = new BLEScan();
+    return r.scan;
+  }
+
+  static BLEClient* createClient() { return new BLEClient(); }
+
+  static esp_err_t setMTU(uint16_t mtu) {
+    NativeBle::radio().localMtu = mtu;
+    return ESP_OK;
+  }
+
+  static uint16_t getMTU() { return NativeBle::radio().localMtu; }
+};
+
+namespace NativeBle {
+
+// BLEDevice::gapEventHandler(): the application's hook, then the library's scan
+inline void deliverGap(esp_gap_ble_cb_event_t event, esp_ble_gap_cb_param_t* param) {
+  if (radio().customGapHandler) radio().customGapHandler(event, param);
+  if (radio().scan) radio().scan->handleGAPEvent(event, param);
+}
+
+inline void deliverGattc(esp_gattc_cb_event_t event, esp_ble_gattc_cb_param_t* param) {
+  if (radio().customGattcHandler) radio().customGattcHandler(event, GATTC_IF, param);
+}
+
+// Called with the radio locked
+inline void linkDown(Peer& peer, int reason) {
+  BLEClient* client = peer.client;
+  uint16_t connId = peer.connId;
+  uint8_t address[ESP_BD_ADDR_LEN];
+  memcpy(address, peer.address, sizeof(address));
+  peer.connected = false;
+  peer.client = nullptr;
+  peer.notifying = false;
+
+  radio().btc.post([client, connId, address, reason]() {
+    esp_ble_gattc_cb_param_t param = {};
+    param.disconnect.reason = reason;
+    param.disconnect.conn_id = connId;
+    memcpy(param.disconnect.remote_bda, address, ESP_BD_ADDR_LEN);
+    deliverGattc(ESP_GATTC_DISCONNECT_EVT, &param);
+
+    // The client may have been deleted since; callbacks are read now, as the library does
+    BLEClientCallbacks* callbacks = nullptr;
+    {
+      std::lock_guard<std::recursive_mutex> lock(radio().mutex);
+      if (radio().clients.count(client)) callbacks = client->getClientCallbacks();
+    }
+    if (callbacks) callbacks->onDisconnect(client);
+  });
+}
+
+// Relay board side of a write to FFE1: switch the relays the frames name and
+// answer with one notification carrying a frame per channel, or the full
+// report for a query. Frames with a bad checksum are ignored.
+inline std::vector<uint8_t> relayBoardApply(Peer& peer, const std::vector<uint8_t>& data) {
+  std::vector<uint8_t> report;
+  for (size_t i = 0; i + 4 <= data.size(); i += 4) {
+    const uint8_t* f = data.data() + i;
+    if ((uint8_t)(f[0] + f[1] + f[2]) != f[3]) continue;
+
+    uint8_t channel = f[1];
+    uint8_t state;
+    if (channel == 0xFF) {
+      state = peer.relayOn;
+    } else if (channel >= 1 && channel <= 8) {
+      uint8_t bit = 1 << (channel - 1);
+      peer.relayOn = f[2] ? (peer.relayOn | bit) : (peer.relayOn & ~bit);
+      state = f[2] ? 0x01 : 0x00;
+    } else {
+      continue;
+    }
+    uint8_t frame[4] = { 0xA0, channel, state, (uint8_t)(0xA0 + channel + state) };
+    report.insert(report.end(), frame, frame + 4);
+  }
+  return report;
+}
+
+}  // namespace NativeBle
+
+// GATT client API
+
+// Queues the write; the peer takes writes one at a time, writeAckMs each, and
+// ESP_GATTC_WRITE_CHAR_EVT reports each one, with or without response
+inline esp_err_t esp_ble_gattc_write_char(esp_gatt_if_t gattc_if, uint16_t conn_id, uint16_t handle,
+                                          uint16_t value_len, uint8_t* value,
+                                          esp_gatt_write_type_t write_type, esp_gatt_auth_req_t auth_req) {
+  NativeBle::Radio& r = NativeBle::radio();
+  std::lock_guard<std::recursive_mutex> lock(r.mutex);
+  NativeBle::Peer* peer = NativeBle::findConnection(conn_id);
+  if (peer == nullptr) return ESP_FAIL;
+
+  std::vector<uint8_t> data(value, value + value_len);
+  peer->writes.push_back({ (uint64_t)micros(), handle, write_type == ESP_GATT_WRITE_TYPE_RSP, data });
+
+  auto now = std::chrono::steady_clock::now();
+  peer->ackDue = max(peer->ackDue, now) + std::chrono::milliseconds(peer->writeAckMs);
+  size_t peerIndex = 0;
+  while (&r.peers[peerIndex] != peer) peerIndex++;
+  r.btc.at(peer->ackDue, [peerIndex, conn_id, handle, data]() {
+    NativeBle::Radio& r = NativeBle::radio();
+    esp_ble_gattc_cb_param_t param = {};
+    std::vector<uint8_t> report;
+    uint8_t address[ESP_BD_ADDR_LEN];
+    {
+      std::lock_guard<std::recursive_mutex> lock(r.mutex);
+      if (peerIndex >= r.peers.size()) return;
+      NativeBle::Peer& peer = r.peers[peerIndex];
+      if (!peer.connected || peer.connId != conn_id) return;
+
+      param.write.status = handle == peer.charHandle ? ESP_GATT_OK : ESP_GATT_INVALID_HANDLE;
+      if (param.write.status == ESP_GATT_OK && peer.reportsStatus) {
+        report = NativeBle::relayBoardApply(peer, data);
+        if (!peer.notifying) report.clear();
+      }
+      memcpy(address, peer.address, sizeof(address));
+    }
+    param.write.conn_id = conn_id;
+    param.write.handle = handle;
+    NativeBle::deliverGattc(ESP_GATTC_WRITE_CHAR_EVT, &param);
+
+    if (!report.empty()) {
+      esp_ble_gattc_cb_param_t notify = {};
+      notify.notify.conn_id = conn_id;
+      memcpy(notify.notify.remote_bda, address, ESP_BD_ADDR_LEN);
+      notify.notify.handle = handle;
+      notify.notify.value_len = report.size();
+      notify.notify.value = report.data();
+      notify.notify.is_notify = true;
+      NativeBle::deliverGattc(ESP_GATTC_NOTIFY_EVT, &notify);
+    }
+  });
+  return ESP_OK;
+}
+
+inline esp_err_t esp_ble_gattc_register_for_notify(esp_gatt_if_t gattc_if, esp_bd_addr_t server_bda, uint16_t handle) {
+  std::lock_guard<std::recursive_mutex> lock(NativeBle::radio().mutex);
+  NativeBle::Peer* peer = NativeBle::findPeer(server_bda);
+  if (peer == nullptr || !peer->connected) return ESP_FAIL;
+  peer->registered = handle == peer->charHandle;
+  return ESP_OK;
+}
+
+inline esp_err_t esp_ble_gattc_write_char_descr(esp_gatt_if_t gattc_if, uint16_t conn_id, uint16_t handle,
+                                                uint16_t value_len, uint8_t* value,
+                                                esp_gatt_write_type_t write_type, esp_gatt_auth_req_t auth_req) {
+  std::lock_guard<std::recursive_mutex> lock(NativeBle::radio().mutex);
+  NativeBle::Peer* peer = NativeBle::findConnection(conn_id);
+  if (peer == nullptr) return ESP_FAIL;
+  if (handle == peer->cccdHandle && handle != 0 && value_len >= 1) {
+    peer->notifying = peer->registered && (value[0] & 0x01);
+  }
+  return ESP_OK;
+}
+
+// From the attribute cache: FFE1's CCCD, if the peer has one
+inline esp_gatt_status_t esp_ble_gattc_get_descr_by_char_handle(esp_gatt_if_t gattc_if, uint16_t conn_id,
+                                                                uint16_t char_handle, esp_bt_uuid_t descr_uuid,
+                                                                esp_gattc_descr_elem_t* result, uint16_t* count) {
+  std::lock_guard<std::recursive_mutex> lock(NativeBle::radio().mutex);
+  NativeBle::Peer* peer = NativeBle::findConnection(conn_id);
+  if (peer == nullptr || char_handle != peer->charHandle || peer->cccdHandle == 0 ||
+      descr_uuid.len != ESP_UUID_LEN_16 || descr_uuid.uuid.uuid16 != ESP_GATT_UUID_CHAR_CLIENT_CONFIG) {
+    *count = 0;
+    return ESP_GATT_NOT_FOUND;
+  }
+  result[0].handle = peer->cccdHandle;
+  result[0].uuid = descr_uuid;
+  *count = 1;
+  return ESP_GATT_OK;
+}
@@ -0,0 +1,87 @@
+// Native only: runs callbacks at their due time on one thread, the way the
+// Bluedroid BTC task delivers stack events to the application. Due times are
+// host time, so a test that freezes millis() still gets its events.
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <thread>
+
+#include "freertos/task.h"
+
+class NativeTimeline {
+public:
+  typedef std::chrono::steady_clock Clock;
+
+  explicit NativeTimeline(const char* name) {
+    std::thread([this, name]() {
+      nativeCurrentTask() = new tskTaskControlBlock();
+      nativeCurrentTask()->name = name;
+      run();
+    }).detach();
+  }
+
+  // Run fn on the timeline thread delayUs from now. Callbacks due at the same
+  // time run in the order they were posted.
+  void after(uint32_t delayUs, std::function<void()> fn) {
+    at(Clock::now() + std::chrono::microseconds(delayUs), std::move(fn));
+  }
+
+  void at(Clock::time_point due, std::function<void()> fn) {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      pending.emplace(due, std::move(fn));
+    }
+    changed.notify_all();
+  }
+
+  void post(std::function<void()> fn) { after(0, std::move(fn)); }
+
+  // Wait until nothing is pending or running, up to timeoutMs; true if idle
+  bool waitIdle(uint32_t timeoutMs = 10000) {
+    std::unique_lock<std::mutex> lock(mutex);
+    return changed.wait_for(lock, std::chrono::milliseconds(timeoutMs),
+                            [this]() { return pending.empty() && !busy; });
+  }
+
+  // Drop everything not yet run
+  void clear() {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      pending.clear();
+    }
+    changed.notify_all();
+  }
+
+private:
+  std::mutex mutex;
+  std::condition_variable changed;
+  std::multimap<Clock::time_point, std::function<void()>> pending;
+  bool busy = false;
+
+  void run() {
+    std::unique_lock<std::mutex> lock(mutex);
+    for (;;) {
+      if (pending.empty()) {
+        changed.wait(lock);
+        continue;
+      }
+      auto next = pending.begin();
+      if (next->first > Clock::now()) {
+        changed.wait_until(lock, next->first);
+        continue;
+      }
+      std::function<void()> fn = std::move(next->second);
+      pending.erase(next);
+      busy = true;
+      lock.unlock();
+      fn();
+      lock.lock();
+      busy = false;
+      changed.notify_all();
+    }
+  }
+};
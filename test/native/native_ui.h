@@ -0,0 +1,100 @@
+// Helpers shared by the native tests and the benchmark: drive loop() and play
+// touches at on-screen objects. Include after main.cpp, whose calibration,
+// screen size and touchscreen they use.
+#pragma once
+
+#include <chrono>
+#include <cmath>
+#include <thread>
+#include <vector>
+
+// Run loop() until done() holds or timeoutMs of host time has passed.
+// Returns whether done() held.
+template <typename Done>
+bool nativeLoopUntil(Done done, uint32_t timeoutMs = 5000) {
+  auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeoutMs);
+  while (!done()) {
+    if (std::chrono::steady_clock::now() >= deadline) return false;
+    loop();
+  }
+  return true;
+}
+
+// Run loop() for a while, e.g. to let a refresh or a timer happen
+inline void nativeLoopFor(uint32_t ms) {
+  nativeLoopUntil([]() { return false; }, ms);
+}
+
+// Run loop() for `ms` and return on time: loop() sleeps until its next
+// deadline, so the caller's tap wakes it as the touch task would
+inline void nativeLoopUntilTap(uint32_t ms) {
+  auto due = std::chrono::steady_clock::now() + std::chrono::milliseconds(ms);
+  std::thread waker([due]() {
+    std::this_thread::sleep_until(due);
+    wakeMainLoop();
+  });
+  while (std::chrono::steady_clock::now() < due) loop();
+  waker.join();
+}
+
+// Boot the controller on factory settings kept in memory, as a first boot
+// would: Target1 is the default relay board address. Without autoConnect it
+// stays stored but is not connected. Returns once the BLE stack is up.
+inline bool nativeBoot(bool autoConnect = true) {
+  Serial.echo = false;
+  NativeNvs::flash().path = "";
+  NativeNvs::eraseAll();
+  if (!autoConnect) {
+    Preferences prefs;
+    prefs.begin(NVS_NAMESPACE, false);
+    prefs.putBool(AUTOCONNECT_ENABLED_KEY, false);
+    prefs.end();
+  }
+  setup();
+  return nativeLoopUntil([]() { return bleStackReady; });
+}
+
+// Raw XPT2046 reading for a point on the rotated (320x240) screen: undo LVGL's
+// ROTATION_270 indev transform, then the calibration (the one in use unless given)
+inline TouchSample nativeRawSample(int32_t lx, int32_t ly, bool penDown = true,
+                                   const TouchCalibration& cal = touchCalibration) {
+  float px = SCREEN_WIDTH - 1 - ly + 0.5f - cal.c;
+  float py = lx + 0.5f - cal.f;
+  float det = cal.a * cal.e - cal.b * cal.d;
+  TouchSample sample;
+  sample.x = (int16_t)lroundf((cal.e * px - cal.b * py) / det);
+  sample.y = (int16_t)lroundf((cal.a * py - cal.d * px) / det);
+  sample.z = penDown ? 1200 : 0;
+  sample.penDown = penDown;
+  return sample;
+}
+
+inline void nativeObjectCentre(lv_obj_t * obj, int32_t& x, int32_t& y) {
+  lv_obj_update_layout(obj);
+  lv_area_t area;
+  lv_obj_get_coords(obj, &area);
+  x = (area.x1 + area.x2) / 2;
+  y = (area.y1 + area.y2) / 2;
+}
+
+// A press of `samples` readings at a point, then the pen lifts
+inline std::vector<TouchSample> nativeTapScript(int32_t x, int32_t y, int samples = 6,
+                                                const TouchCalibration& cal = touchCalibration) {
+  std::vector<TouchSample> script(samples, nativeRawSample(x, y, true, cal));
+  script.push_back(nativeRawSample(x, y, false, cal));
+  return script;
+}
+
+// A vertical drag from (x, y0) to (x, y1) in `steps` readings, then the pen lifts
+inline std::vector<TouchSample> nativeDragScript(int32_t x, int32_t y0, int32_t y1, int steps = 12) {
+  std::vector<TouchSample> script;
+  for (int i = 0; i <= steps; i++) script.push_back(nativeRawSample(x, y0 + (y1 - y0) * i / steps));
+  script.push_back(nativeRawSample(x, y1, false));
+  return script;
+}
+
+inline void nativeTap(lv_obj_t * obj) {
+  int32_t x, y;
+  nativeObjectCentre(obj, x, y);
+  touchscreen.play(nativeTapScript(x, y));
+}
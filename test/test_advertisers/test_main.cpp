@@ -0,0 +1,230 @@
+// Advertiser table: lookups through the probe chains, in-place updates with a
+// smoothed RSSI, backward-shift removal that keeps colliding entries
+// reachable, age-out in discovery order, eviction from a full table, scan
+// results handled without heap allocations, and update cost against a
+// stream of 1k advertising reports per second.
+
+#include "../../src/main.cpp"
+
+#include <native_alloc.h>
+#include <native_ui.h>
+#include <unity.h>
+
+#include <chrono>
+#include <vector>
+
+#define BASE_ADDRESS 0x0A0B0C000000ull
+
+static void clearAdvertisers() {
+  for (Advertiser& slot : advertiserSlots) slot = Advertiser();
+  advertiserCount = 0;
+  advertiserEvictions = 0;
+  selectedDeviceIdx = -1;
+}
+
+// Every listed entry is where its list position says, and a lookup from its
+// home slot reaches it
+static void assertTableConsistent() {
+  int used = 0;
+  for (const Advertiser& slot : advertiserSlots) used += slot.address != 0;
+  TEST_ASSERT_EQUAL(advertiserCount, used);
+  for (int position = 0; position < advertiserCount; position++) {
+    int slot = advertiserList[position];
+    TEST_ASSERT_EQUAL(position, advertiserSlots[slot].position);
+    TEST_ASSERT_EQUAL(slot, advertiserProbe(advertiserSlots[slot].address));
+  }
+}
+
+// `count` addresses that share one home slot
+static std::vector<uint64_t> collidingAddresses(int count) {
+  std::vector<uint64_t> addresses;
+  uint32_t home = advertiserHash(BASE_ADDRESS);
+  for (uint64_t address = BASE_ADDRESS; (int)addresses.size() < count; address++) {
+    if (advertiserHash(address) == home) addresses.push_back(address);
+  }
+  return addresses;
+}
+
+void setUp(void) {
+  clearAdvertisers();
+  scanStartMillis = 1000;
+}
+
+void tearDown(void) {
+  clearAdvertisers();
+}
+
+void test_entries_are_listed_in_discovery_order(void) {
+  for (int i = 0; i < 100; i++) TEST_ASSERT_TRUE(advertiserUpdate(BASE_ADDRESS + i * 7919, "", -60, 1000));
+  TEST_ASSERT_EQUAL(100, advertiserCount);
+  for (int i = 0; i < 100; i++) TEST_ASSERT_EQUAL(BASE_ADDRESS + i * 7919, advertiserAt(i).address);
+  assertTableConsistent();
+}
+
+void test_repeat_report_updates_in_place(void) {
+  advertiserUpdate(BASE_ADDRESS, "", -80, 1000);
+  uint8_t revision = advertiserAt(0).revision;
+  TEST_ASSERT_EQUAL_STRING("Unknown Device", advertiserName(advertiserAt(0)));
+
+  // A quarter of the way to the new sample, which moves the shown dB value
+  advertiserUpdate(BASE_ADDRESS, "Sensor", -40, 1200);
+  TEST_ASSERT_EQUAL(1, advertiserCount);
+  TEST_ASSERT_EQUAL(-70 * 16, advertiserAt(0).rssiQ4);
+  TEST_ASSERT_EQUAL_STRING("Sensor", advertiserName(advertiserAt(0)));
+  TEST_ASSERT_EQUAL(1200, advertiserAt(0).lastSeenMillis);
+  TEST_ASSERT_EQUAL((uint8_t)(revision + 2), advertiserAt(0).revision);
+
+  // A report without a name keeps the one seen; one that changes nothing shown keeps the revision
+  revision = advertiserAt(0).revision;
+  advertiserUpdate(BASE_ADDRESS, "", -70, 1300);
+  TEST_ASSERT_EQUAL_STRING("Sensor", advertiserName(advertiserAt(0)));
+  TEST_ASSERT_EQUAL(revision, advertiserAt(0).revision);
+}
+
+void test_removal_keeps_colliding_entries_reachable(void) {
+  std::vector<uint64_t> chain = collidingAddresses(4);
+  for (uint64_t address : chain) advertiserUpdate(address, "", -60, 1000);
+  advertiserUpdate(BASE_ADDRESS + 1, "", -60, 1000);  // Possibly in the chain's way
+  assertTableConsistent();
+
+  // Dropping the head of the chain shifts the rest back; no tombstones
+  advertiserSlots[advertiserList[0]].lastSeenMillis = 0;
+  advertiserAgeOut(ADVERTISER_AGE_OUT_MS);
+  TEST_ASSERT_EQUAL(4, advertiserCount);
+  assertTableConsistent();
+  TEST_ASSERT_EQUAL(advertiserHash(chain[0]), advertiserList[0]);
+}
+
+void test_age_out_keeps_the_survivors_in_order(void) {
+  unsigned long now = ADVERTISER_AGE_OUT_MS + 5000;
+  for (int i = 0; i < 10; i++) advertiserUpdate(BASE_ADDRESS + i, "", -60, i % 3 == 0 ? 1000 : now);
+  advertiserAgeOut(now);
+  TEST_ASSERT_EQUAL(6, advertiserCount);
+  int position = 0;
+  for (int i = 0; i < 10; i++) {
+    if (i % 3 == 0) {
+      TEST_ASSERT_EQUAL(0, advertiserSlots[advertiserProbe(BASE_ADDRESS + i)].address);
+      continue;
+    }
+    TEST_ASSERT_EQUAL(BASE_ADDRESS + i, advertiserAt(position++).address);
+  }
+  assertTableConsistent();
+}
+
+void test_full_table_evicts_the_weakest_unheard_entry(void) {
+  // Heard before this scan, all at -60 dB but one at -95
+  for (int i = 0; i < ADVERTISER_MAX; i++) advertiserUpdate(BASE_ADDRESS + i, "", i == 200 ? -95 : -60, 500);
+  TEST_ASSERT_EQUAL(ADVERTISER_MAX, advertiserCount);
+  uint8_t revision = advertiserAt(200).revision;
+
+  TEST_ASSERT_TRUE(advertiserUpdate(BASE_ADDRESS + 1000, "", -50, 1500));
+  TEST_ASSERT_EQUAL(ADVERTISER_MAX, advertiserCount);
+  TEST_ASSERT_EQUAL(1, advertiserEvictions);
+  TEST_ASSERT_EQUAL(BASE_ADDRESS + 1000, advertiserAt(200).address);
+  TEST_ASSERT_EQUAL((uint8_t)(revision + 1), advertiserAt(200).revision);  // The row shows another device
+  assertTableConsistent();
+}
+
+void test_heard_entries_go_stalest_first(void) {
+  for (int i = 0; i < ADVERTISER_MAX; i++) advertiserUpdate(BASE_ADDRESS + i, "", -60, 2000 + (i == 17 ? 0 : 100));
+  TEST_ASSERT_TRUE(advertiserUpdate(BASE_ADDRESS + 1000, "", -60, 2500));
+  TEST_ASSERT_EQUAL(BASE_ADDRESS + 1000, advertiserAt(17).address);
+}
+
+void test_selected_and_stored_devices_are_never_evicted(void) {
+  uint64_t stored = peerRegistry.peers[0].address.packed();
+  TEST_ASSERT_TRUE(peerRegistry.peers[0].address.isSet());
+  advertiserUpdate(stored, "RELAY_BOARD", -99, 500);
+  advertiserUpdate(BASE_ADDRESS, "", -98, 500);
+  selectedDeviceIdx = 1;
+  for (int i = 1; i < ADVERTISER_MAX - 1; i++) advertiserUpdate(BASE_ADDRESS + i, "", -60, 500);
+
+  // Every other entry is heard again in this scan, so only those two would be
+  // unheard, and they are protected: the stalest heard entry goes
+  for (int i = 1; i < ADVERTISER_MAX - 1; i++) advertiserUpdate(BASE_ADDRESS + i, "", -60, 1500 + i);
+  TEST_ASSERT_TRUE(advertiserUpdate(BASE_ADDRESS + 1000, "", -60, 3000));
+  TEST_ASSERT_EQUAL(stored, advertiserAt(0).address);
+  TEST_ASSERT_EQUAL(BASE_ADDRESS, advertiserAt(1).address);
+  TEST_ASSERT_EQUAL(BASE_ADDRESS + 1000, advertiserAt(2).address);
+  assertTableConsistent();
+}
+
+// One second of reports at 1k per second from `devices` advertisers, round
+// robin; returns the mean cost of an update in nanoseconds
+static double streamReports(int devices, unsigned long now) {
+  const int reports = 1000;
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < reports; i++) {
+    advertiserUpdate(BASE_ADDRESS + (uint64_t)(i % devices) * 104729, (i & 7) ? "" : "Sensor", -60 - (i % 13), now + i);
+  }
+  return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / reports;
+}
+
+void test_bench_updates_at_1k_reports_per_second(void) {
+  const int populations[] = { 50, 200, ADVERTISER_MAX, 1000 };
+  for (int devices : populations) {
+    clearAdvertisers();
+    double firstNs = streamReports(devices, 2000);   // Mostly inserts
+    uint32_t evictions = advertiserEvictions;
+    double steadyNs = 0;
+    const int seconds = 20;
+    for (int s = 1; s <= seconds; s++) steadyNs += streamReports(devices, 2000 + s * 1000);
+    steadyNs /= seconds;
+    printf("%4d advertisers: first second %7.1f ns/update, then %7.1f ns/update (%4.2f%% of a 1 ms report interval), "
+           "%lu listed, %lu evictions\n",
+           devices, firstNs, steadyNs, steadyNs / 10000.0, (unsigned long)advertiserCount,
+           (unsigned long)(advertiserEvictions - evictions));
+    assertTableConsistent();
+    TEST_ASSERT_LESS_OR_EQUAL(ADVERTISER_MAX, advertiserCount);
+    TEST_ASSERT_LESS_THAN(1000000, (int)steadyNs);  // Keeps up with the stream
+  }
+}
+
+// loop()'s side of a scan result: the address stays a 6-byte value from the
+// queue message through the table update, the stored-peer match and the log text
+void test_scan_result_handling_does_not_allocate(void) {
+  const int reports = 1000;
+  volatile size_t sink = 0;
+  uint32_t before = nativeAllocations();
+  for (int i = 0; i < reports; i++) {
+    ScanResultMsg msg = {};
+    msg.address = MacAddress::fromPacked(BASE_ADDRESS + i % 100);
+    strlcpy(msg.name, "Sensor", sizeof(msg.name));
+    msg.rssi = -60 - i % 13;
+    TEST_ASSERT_TRUE(advertiserUpdate(msg.address.packed(), msg.name, msg.rssi, 2000 + i));
+    const Advertiser& entry = advertiserSlots[advertiserProbe(msg.address.packed())];
+    sink = sink + advertiserTarget(entry) + strlen(advertiserName(entry)) + strlen(msg.address.toString().c_str());
+  }
+  TEST_ASSERT_EQUAL(0, nativeAllocations() - before);
+  TEST_ASSERT_EQUAL(100, advertiserCount);
+
+  // The String addresses allocated on every report: the printed address
+  // compared against the stored targets' text
+  const String storedTarget1MAC = "b4:52:a9:b0:0f:bb";
+  before = nativeAllocations();
+  for (int i = 0; i < reports; i++) {
+    String address = MacAddress::fromPacked(BASE_ADDRESS + i % 100).toString().c_str();
+    sink = sink + (address == storedTarget1MAC);
+  }
+  TEST_ASSERT_GREATER_OR_EQUAL(reports, nativeAllocations() - before);
+}
+
+int main(int argc, char** argv) {
+  nativeBoot(false);
+
+  UNITY_BEGIN();
+  RUN_TEST(test_entries_are_listed_in_discovery_order);
+  RUN_TEST(test_repeat_report_updates_in_place);
+  RUN_TEST(test_removal_keeps_colliding_entries_reachable);
+  RUN_TEST(test_age_out_keeps_the_survivors_in_order);
+  RUN_TEST(test_full_table_evicts_the_weakest_unheard_entry);
+  RUN_TEST(test_heard_entries_go_stalest_first);
+  RUN_TEST(test_selected_and_stored_devices_are_never_evicted);
+  RUN_TEST(test_scan_result_handling_does_not_allocate);
+  RUN_TEST(test_bench_updates_at_1k_reports_per_second);
+  int failures = UNITY_END();
+
+  // The BLE worker, touch and radio threads never return
+  fflush(stdout);
+  std::_Exit(failures);
+}
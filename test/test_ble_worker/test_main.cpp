@@ -0,0 +1,192 @@
+// BLE worker: loop() only posts commands, writes to a ready peer go out ahead
+// of another peer's connect and discovery, a full command queue fails the post
+// instead of blocking the UI, and write latency and loop() pass times with and
+// without a connect running on the worker.
+
+#include "../../src/main.cpp"
+
+#include <native_ui.h>
+#include <unity.h>
+
+#include <string>
+#include <vector>
+
+NativeBle::Peer* board = nullptr;   // Stays connected
+NativeBle::Peer* sensor = nullptr;  // Connected and dropped by the tests
+
+static MacAddress addressOf(const NativeBle::Peer* peer) {
+  return MacAddress::fromPacked(NativeBle::packAddress(peer->address));
+}
+
+static int slotOf(const NativeBle::Peer* peer) {
+  return blePoolFind(addressOf(peer));
+}
+
+static bool readyPeer(const NativeBle::Peer* peer) {
+  int slot = slotOf(peer);
+  return slot >= 0 && peerLinks[slot].state == LINK_READY;
+}
+
+// micros() of the first write carrying `text` after the first `first` writes, 0 if none
+static uint64_t writeMicros(const NativeBle::Peer* peer, size_t first, const char* text) {
+  std::vector<NativeBle::Write> writes = NativeBle::writesTo(*peer);
+  for (size_t i = first; i < writes.size(); i++) {
+    if (std::string(writes[i].data.begin(), writes[i].data.end()) == text) return writes[i].micros;
+  }
+  return 0;
+}
+
+// Longest loop() pass until done() holds
+template <typename Done>
+static uint32_t longestLoopUntil(Done done, uint32_t timeoutMs = 3000) {
+  uint32_t longest = 0;
+  TEST_ASSERT_TRUE(nativeLoopUntil([&]() {
+    uint32_t start = micros();
+    loop();
+    longest = max<uint32_t>(longest, micros() - start);
+    return done();
+  }, timeoutMs));
+  return longest;
+}
+
+void setUp(void) {
+  sensor->connectMs = 30;
+  sensor->discoveryMs = 60;
+  saveCachedHandle(addressOf(sensor), 0, 0);
+  nativeLoopUntil([]() { return peerLinks[slotOf(board)].writesInFlight == 0; });
+}
+
+void tearDown(void) {
+  if (slotOf(sensor) >= 0) bleDisconnectPeer(slotOf(sensor));
+  nativeLoopUntil([]() { return !sensor->connected; });
+  NativeBle::waitIdle();
+  bleSetActivePeer(slotOf(board));
+}
+
+void test_connect_returns_while_the_worker_connects(void) {
+  sensor->connectMs = 300;
+  sensor->discoveryMs = 300;
+  uint32_t start = micros();
+  TEST_ASSERT_TRUE(bleConnect(addressOf(sensor), "SENSOR", "CONNECTED"));
+  TEST_ASSERT_LESS_THAN(20000, micros() - start);
+
+  // loop() keeps running passes of a few ms while the worker sits in connect and discovery
+  uint32_t longest = longestLoopUntil([]() { return readyPeer(sensor); });
+  TEST_ASSERT_LESS_THAN(50000, longest);
+}
+
+void test_write_goes_ahead_of_another_peers_discovery(void) {
+  sensor->connectMs = 100;
+  sensor->discoveryMs = 400;
+  TEST_ASSERT_TRUE(bleConnect(addressOf(sensor), "SENSOR", "CONNECTED"));
+
+  // Posted while the worker is in the sensor's connect; written as soon as it
+  // returns, not after the sensor's discovery
+  size_t first = NativeBle::writesTo(*board).size();
+  uint64_t posted = micros();
+  bleSendDataTo(slotOf(board), "PING");
+  TEST_ASSERT_TRUE(nativeLoopUntil([]() { return readyPeer(sensor); }));
+  uint64_t written = writeMicros(board, first, "PING");
+  TEST_ASSERT_NOT_EQUAL(0, written);
+  TEST_ASSERT_LESS_THAN(250000, written - posted);
+}
+
+void test_writes_keep_their_order(void) {
+  size_t first = NativeBle::writesTo(*board).size();
+  const char* texts[] = { "ONE", "TWO", "THREE", "FOUR" };
+  for (const char* text : texts) bleSendDataTo(slotOf(board), text);
+  TEST_ASSERT_TRUE(nativeLoopUntil([first]() { return NativeBle::writesTo(*board).size() >= first + 4; }));
+
+  std::vector<NativeBle::Write> writes = NativeBle::writesTo(*board);
+  for (int i = 0; i < 4; i++) {
+    TEST_ASSERT_EQUAL_STRING(texts[i], std::string(writes[first + i].data.begin(), writes[first + i].data.end()).c_str());
+  }
+}
+
+void test_full_command_queue_fails_the_post(void) {
+  sensor->connectMs = 300;
+  TEST_ASSERT_TRUE(bleConnect(addressOf(sensor), "SENSOR", "CONNECTED"));
+  TEST_ASSERT_TRUE(nativeLoopUntil([]() { return sensor->connects > 0 || uxQueueMessagesWaiting(bleCommandQueue) == 0; }));
+
+  // The worker is held in the connect; the queue fills and the next post returns at once
+  BleCommand cmd = {};
+  cmd.type = BLE_CMD_SCAN_CLEAR;
+  int posted = 0;
+  while (posted <= BLE_COMMAND_QUEUE_LENGTH && blePostCommand(cmd)) posted++;
+  uint32_t start = micros();
+  TEST_ASSERT_FALSE(blePostCommand(cmd));
+  TEST_ASSERT_LESS_THAN(5000, micros() - start);
+  TEST_ASSERT_EQUAL(BLE_COMMAND_QUEUE_LENGTH, posted);
+
+  // The worker catches up and the connect completes
+  TEST_ASSERT_TRUE(nativeLoopUntil([]() { return readyPeer(sensor); }));
+  TEST_ASSERT_TRUE(nativeLoopUntil([]() { return uxQueueMessagesWaiting(bleCommandQueue) == 0; }));
+}
+
+// Post-to-air time of writes to the board, every 25 ms, and the longest loop()
+// pass meanwhile; with `connecting` the sensor's connect runs on the worker
+static void measure(bool connecting) {
+  const int writes = 20;
+  if (connecting) {
+    sensor->connectMs = 150;
+    sensor->discoveryMs = 150;
+    TEST_ASSERT_TRUE(bleConnect(addressOf(sensor), "SENSOR", "CONNECTED"));
+  }
+
+  size_t first = NativeBle::writesTo(*board).size();
+  std::vector<uint64_t> posted;
+  uint32_t longest = 0;
+  for (int i = 0; i < writes; i++) {
+    char text[8];
+    snprintf(text, sizeof(text), "W%02d", i);
+    posted.push_back(micros());
+    bleSendDataTo(slotOf(board), text);
+    auto due = std::chrono::steady_clock::now() + std::chrono::milliseconds(25);
+    std::thread waker([due]() { std::this_thread::sleep_until(due); wakeMainLoop(); });
+    while (std::chrono::steady_clock::now() < due) {
+      uint32_t start = micros();
+      loop();
+      longest = max<uint32_t>(longest, micros() - start);
+    }
+    waker.join();
+  }
+  TEST_ASSERT_TRUE(nativeLoopUntil([first]() { return NativeBle::writesTo(*board).size() >= first + writes; }));
+
+  uint64_t totalUs = 0, worstUs = 0;
+  for (int i = 0; i < writes; i++) {
+    char text[8];
+    snprintf(text, sizeof(text), "W%02d", i);
+    uint64_t us = writeMicros(board, first, text) - posted[i];
+    totalUs += us;
+    worstUs = max(worstUs, us);
+  }
+  printf("%-22s post-to-air avg %6.2f ms, worst %6.2f ms; longest loop() pass %5.2f ms\n",
+         connecting ? "sensor connecting:" : "worker idle:", totalUs / 1000.0 / writes, worstUs / 1000.0, longest / 1000.0);
+  if (connecting) TEST_ASSERT_TRUE(nativeLoopUntil([]() { return readyPeer(sensor); }));
+}
+
+void test_bench_write_latency_during_a_connect(void) {
+  measure(false);
+  measure(true);
+}
+
+int main(int argc, char** argv) {
+  NativeBle::Peer& relayBoard = NativeBle::addPeer(DEFAULT_TARGET1_MAC.packed(), "RELAY_BOARD");
+  relayBoard.reportsStatus = true;
+  board = &relayBoard;
+  sensor = &NativeBle::addPeer(0x0A0B0C0D0E0Full, "SENSOR");
+  nativeBoot();
+  nativeLoopUntil([]() { return activePeer >= 0; });
+
+  UNITY_BEGIN();
+  RUN_TEST(test_connect_returns_while_the_worker_connects);
+  RUN_TEST(test_write_goes_ahead_of_another_peers_discovery);
+  RUN_TEST(test_writes_keep_their_order);
+  RUN_TEST(test_full_command_queue_fails_the_post);
+  RUN_TEST(test_bench_write_latency_during_a_connect);
+  int failures = UNITY_END();
+
+  // The BLE worker, touch and radio threads never return
+  fflush(stdout);
+  std::_Exit(failures);
+}
@@ -0,0 +1,171 @@
+// Virtualized device list: a fixed pool of rows bound to the advertiser
+// entries in view, moved and rebound as the list scrolls, and LVGL memory and
+// build time at 10, 100 and 500 devices.
+
+#include "../../src/main.cpp"
+
+#include <native_ui.h>
+#include <unity.h>
+
+static void clearAdvertisers() {
+  for (Advertiser& slot : advertiserSlots) slot = Advertiser();
+  advertiserCount = 0;
+  selectedDeviceIdx = -1;
+}
+
+static void deviceName(int i, char* name, size_t len) {
+  snprintf(name, len, "Dev-%03d", i);
+}
+
+// List `count` devices, as a scan would
+static void listDevices(int count) {
+  clearAdvertisers();
+  for (int i = 0; i < count; i++) {
+    char name[16];
+    deviceName(i, name, sizeof(name));
+    advertiserUpdate(0x0A0B0C000000ull + i, name, -60, millis());
+  }
+  deviceListClear();
+}
+
+// Every shown row sits at its entry's position and shows its name
+static void assertRowsBound() {
+  int first = max(0, (int)(lv_obj_get_scroll_y(btUi.deviceList) - DEVICE_LIST_HEADER_H) / DEVICE_LIST_ROW_PITCH);
+  for (int k = 0; k < DEVICE_LIST_POOL_ROWS; k++) {
+    lv_obj_t* row = btUi.deviceListRows[k];
+    int index = first + k;
+    if (index >= advertiserCount) {
+      TEST_ASSERT_TRUE(lv_obj_has_flag(row, LV_OBJ_FLAG_HIDDEN));
+      continue;
+    }
+    TEST_ASSERT_FALSE(lv_obj_has_flag(row, LV_OBJ_FLAG_HIDDEN));
+    TEST_ASSERT_EQUAL(index, btUi.deviceListRowIndex[k]);
+    TEST_ASSERT_EQUAL(DEVICE_LIST_HEADER_H + index * DEVICE_LIST_ROW_PITCH, lv_obj_get_y(row));
+    TEST_ASSERT_NOT_NULL(strstr(lv_label_get_text(lv_obj_get_child(row, 0)), advertiserName(advertiserAt(index))));
+  }
+}
+
+void setUp(void) {
+  show_bluetooth_screen();
+}
+
+void tearDown(void) {
+  clearAdvertisers();
+  deviceListClear();
+}
+
+void test_pool_rows_bind_the_first_entries(void) {
+  // Listing devices creates no objects, however long the list
+  uint32_t children = lv_obj_get_child_count(btUi.deviceList);
+  listDevices(40);
+  TEST_ASSERT_EQUAL(children, lv_obj_get_child_count(btUi.deviceList));
+  TEST_ASSERT_EQUAL(DEVICE_LIST_HEADER_H + 40 * DEVICE_LIST_ROW_PITCH, lv_obj_get_height(btUi.deviceListSpacer));
+  assertRowsBound();
+}
+
+void test_short_list_hides_the_spare_rows(void) {
+  listDevices(3);
+  assertRowsBound();
+  TEST_ASSERT_TRUE(lv_obj_has_flag(btUi.deviceListRows[3], LV_OBJ_FLAG_HIDDEN));
+}
+
+void test_scrolling_rebinds_the_same_rows(void) {
+  listDevices(40);
+  uint32_t children = lv_obj_get_child_count(btUi.deviceList);
+  lv_obj_t* rows[DEVICE_LIST_POOL_ROWS];
+  memcpy(rows, btUi.deviceListRows, sizeof(rows));
+
+  const int32_t positions[] = { 5, DEVICE_LIST_ROW_PITCH * 10 + 7, DEVICE_LIST_ROW_PITCH * 30, 0 };
+  for (int32_t y : positions) {
+    lv_obj_scroll_to_y(btUi.deviceList, y, LV_ANIM_OFF);
+    assertRowsBound();
+  }
+  TEST_ASSERT_EQUAL(0, memcmp(rows, btUi.deviceListRows, sizeof(rows)));
+  TEST_ASSERT_EQUAL(children, lv_obj_get_child_count(btUi.deviceList));
+}
+
+void test_drag_scroll_then_tap_selects_the_bound_entry(void) {
+  listDevices(40);
+  nativeLoopFor(50);
+
+  // Drag the list up by three rows
+  int32_t x, y;
+  nativeObjectCentre(btUi.deviceList, x, y);
+  touchscreen.play(nativeDragScript(x, y + 40, y + 40 - 3 * DEVICE_LIST_ROW_PITCH));
+  TEST_ASSERT_TRUE(nativeLoopUntil([]() { return touchscreen.remaining() == 0 && !touchPointsPending(); }, 2000));
+  nativeLoopFor(TOUCH_THROW_MAX_MS);
+  TEST_ASSERT_GREATER_THAN(DEVICE_LIST_ROW_PITCH, lv_obj_get_scroll_y(btUi.deviceList));
+  assertRowsBound();
+
+  // The row under the finger now stands for a later entry
+  int k = -1;
+  for (int i = 0; i < DEVICE_LIST_POOL_ROWS; i++) {
+    if (btUi.deviceListRowIndex[i] > 0 && !lv_obj_has_flag(btUi.deviceListRows[i], LV_OBJ_FLAG_HIDDEN)) {
+      lv_area_t area;
+      lv_obj_get_coords(btUi.deviceListRows[i], &area);
+      lv_area_t list;
+      lv_obj_get_coords(btUi.deviceList, &list);
+      if (area.y1 >= list.y1 && area.y2 <= list.y2) {
+        k = i;
+        break;
+      }
+    }
+  }
+  TEST_ASSERT_GREATER_OR_EQUAL(0, k);
+  int index = btUi.deviceListRowIndex[k];
+  nativeTap(btUi.deviceListRows[k]);
+  TEST_ASSERT_TRUE(nativeLoopUntil([index]() { return selectedDeviceIdx == index; }, 1000));
+}
+
+void test_changed_entry_updates_its_row(void) {
+  listDevices(10);
+  advertiserUpdate(0x0A0B0C000000ull + 2, "Renamed", -60, millis());
+  deviceListRefresh();
+  TEST_ASSERT_NOT_NULL(strstr(lv_label_get_text(lv_obj_get_child(btUi.deviceListRows[2], 0)), "Renamed"));
+}
+
+// LVGL heap in use and the time to build and scroll the list, by list length
+void test_bench_list_size(void) {
+  const int sizes[] = { 10, 100, 500 };
+  lv_mem_monitor_t mon;
+  uint32_t usedAt10 = 0;
+  for (int size : sizes) {
+    uint32_t start = micros();
+    listDevices(size);
+    uint32_t buildUs = micros() - start;
+
+    start = micros();
+    const int scrolls = 50;
+    for (int i = 0; i < scrolls; i++) {
+      lv_obj_scroll_to_y(btUi.deviceList, (i * 37 * DEVICE_LIST_ROW_PITCH / 10) % (advertiserCount * DEVICE_LIST_ROW_PITCH), LV_ANIM_OFF);
+    }
+    uint32_t scrollUs = micros() - start;
+
+    lv_mem_monitor(&mon);
+    uint32_t used = mon.total_size - mon.free_size;
+    if (size == 10) usedAt10 = used;
+    printf("device list of %3d (%3d listed): LVGL heap %6lu bytes, build %7.1f us, rebind per scroll %5.1f us\n",
+           size, advertiserCount, (unsigned long)used, (double)buildUs, (double)scrollUs / scrolls);
+    assertRowsBound();
+
+    // The row pool does not grow with the list
+    TEST_ASSERT_INT_WITHIN(1024, usedAt10, used);
+  }
+}
+
+int main(int argc, char** argv) {
+  nativeBoot(false);
+
+  UNITY_BEGIN();
+  RUN_TEST(test_pool_rows_bind_the_first_entries);
+  RUN_TEST(test_short_list_hides_the_spare_rows);
+  RUN_TEST(test_scrolling_rebinds_the_same_rows);
+  RUN_TEST(test_drag_scroll_then_tap_selects_the_bound_entry);
+  RUN_TEST(test_changed_entry_updates_its_row);
+  RUN_TEST(test_bench_list_size);
+  int failures = UNITY_END();
+
+  // The BLE worker, touch and radio threads never return
+  fflush(stdout);
+  std::_Exit(failures);
+}
@@ -0,0 +1,201 @@
+// Display flush: what LVGL renders reaches the panel framebuffer intact, in
+// byte-swapped RGB565 inside a write transaction, with each band's transfer
+// overlapping the next band's rendering; only the main screen built at boot,
+// the others built on a visit and deleted when left; and frame times for the
+// relay grid and a device list scroll with DMA double buffering against a
+// blocking flush.
+
+#include "../../src/main.cpp"
+
+#include <native_ui.h>
+#include <unity.h>
+
+#include <vector>
+
+// Copy of every band LVGL handed to the flush, in native RGB565, in the
+// rotated screen's coordinates
+std::vector<uint16_t> rendered;
+uint32_t bands = 0;
+uint32_t bandsOversized = 0;
+uint32_t flushesReturnedBusy = 0;
+
+static int32_t screenWidth() {
+  return lv_display_get_horizontal_resolution(lv_display_get_default());
+}
+
+static void recordBand(const lv_area_t * area, const uint8_t * px_map) {
+  uint32_t w = lv_area_get_width(area);
+  uint32_t h = lv_area_get_height(area);
+  const uint16_t* pixels = (const uint16_t*)px_map;
+  for (uint32_t row = 0; row < h; row++) {
+    memcpy(&rendered[(size_t)(area->y1 + row) * screenWidth() + area->x1], pixels + row * w, w * sizeof(uint16_t));
+  }
+  bands++;
+  if (w * h * sizeof(uint16_t) > sizeof(draw_buf)) bandsOversized++;
+}
+
+// The DMA flush, watched
+static void watchedDmaFlush(lv_display_t * disp, const lv_area_t * area, uint8_t * px_map) {
+  recordBand(area, px_map);
+  tft_flush_dma(disp, area, px_map);
+  if (tft.dmaBusy()) flushesReturnedBusy++;
+}
+
+// What a blocking driver does: swap, push and wait before LVGL may render on
+static void watchedBlockingFlush(lv_display_t * disp, const lv_area_t * area, uint8_t * px_map) {
+  recordBand(area, px_map);
+  lv_draw_sw_rgb565_swap(px_map, lv_area_get_width(area) * lv_area_get_height(area));
+  tft.startWrite();
+  tft.pushImageDMA(area->x1, area->y1, lv_area_get_width(area), lv_area_get_height(area), (uint16_t *)px_map);
+  tft.dmaWait();
+  tft.endWrite();
+  lv_display_flush_ready(disp);
+}
+
+// Draw with DMA and two buffers, or blocking with one, each of `bytes`
+static void useFlush(bool dma, uint32_t bytes) {
+  lv_display_t * disp = lv_display_get_default();
+  tft.dmaWait();
+  lv_display_set_flush_cb(disp, dma ? watchedDmaFlush : watchedBlockingFlush);
+  lv_display_set_flush_wait_cb(disp, dma ? tft_flush_wait : NULL);
+  lv_display_set_buffers(disp, draw_buf, dma ? draw_buf2 : NULL, bytes, LV_DISPLAY_RENDER_MODE_PARTIAL);
+}
+
+// Redraw the whole screen now; returns the frame time in microseconds
+static uint32_t redrawScreen() {
+  lv_obj_invalidate(lv_screen_active());
+  uint32_t start = micros();
+  lv_refr_now(lv_display_get_default());
+  return micros() - start;
+}
+
+static int mismatchedPixels() {
+  tft.dmaWait();
+  int mismatched = 0;
+  for (int32_t y = 0; y < lv_display_get_vertical_resolution(lv_display_get_default()); y++) {
+    for (int32_t x = 0; x < screenWidth(); x++) {
+      if (tft.readPixel(x, y) != rendered[(size_t)y * screenWidth() + x]) mismatched++;
+    }
+  }
+  return mismatched;
+}
+
+void setUp(void) {
+  useFlush(true, sizeof(draw_buf));
+  bands = 0;
+  bandsOversized = 0;
+  flushesReturnedBusy = 0;
+}
+
+void tearDown(void) {
+  useFlush(true, sizeof(draw_buf));
+  lv_display_set_flush_cb(lv_display_get_default(), tft_flush_dma);
+}
+
+void test_full_refresh_reaches_the_panel_intact(void) {
+  uiLoadScreen(main_screen);
+  uint64_t pixels = tft.pixelsPushed;
+  redrawScreen();
+
+  TEST_ASSERT_EQUAL(SCREEN_WIDTH * SCREEN_HEIGHT, tft.pixelsPushed - pixels);
+  TEST_ASSERT_GREATER_OR_EQUAL(DRAW_BUF_DIVISOR, bands);
+  TEST_ASSERT_EQUAL(0, bandsOversized);
+  TEST_ASSERT_EQUAL(0, tft.pushesOutsideWrite);
+  TEST_ASSERT_FALSE(tft.inWrite());
+  TEST_ASSERT_EQUAL(0, mismatchedPixels());
+}
+
+void test_transfers_overlap_rendering(void) {
+  uiLoadScreen(main_screen);
+  redrawScreen();
+
+  // Every flush returned with its transfer still running; LVGL went on to the next band
+  TEST_ASSERT_EQUAL(bands, flushesReturnedBusy);
+  TEST_ASSERT_EQUAL(0, mismatchedPixels());
+}
+
+void test_blocking_flush_draws_the_same_frame(void) {
+  uiLoadScreen(main_screen);
+  useFlush(false, sizeof(draw_buf));
+  redrawScreen();
+  TEST_ASSERT_EQUAL(0, mismatchedPixels());
+}
+
+// Frame times over `frames` redraws of what next() puts on screen
+template <typename Next>
+static void benchFrames(const char* scene, bool dma, int divisor, int frames, Next next) {
+  useFlush(dma, sizeof(draw_buf) * DRAW_BUF_DIVISOR / divisor);
+  uint64_t waited = tft.dmaWaitMicros;
+  uint32_t total = 0, worst = 0;
+  for (int i = 0; i < frames; i++) {
+    next(i);
+    uint32_t us = redrawScreen();
+    total += us;
+    worst = max(worst, us);
+  }
+  printf("%-12s %-8s 1/%-2d screen per buffer: frame avg %6.2f ms, worst %6.2f ms, %5.2f ms waiting on SPI\n",
+         scene, dma ? "DMA x2" : "blocking", divisor, total / 1000.0 / frames, worst / 1000.0,
+         (tft.dmaWaitMicros - waited) / 1000.0 / frames);
+  TEST_ASSERT_EQUAL(0, mismatchedPixels());
+}
+
+void test_screens_are_built_on_visit_and_deleted_when_left(void) {
+  TEST_ASSERT_NOT_NULL(main_screen);
+  TEST_ASSERT_NULL(bluetooth_screen);
+  TEST_ASSERT_NULL(stored_devices_screen);
+
+  show_bluetooth_screen();
+  TEST_ASSERT_NOT_NULL(bluetooth_screen);
+  TEST_ASSERT_TRUE(lv_screen_active() == bluetooth_screen);
+  uiSetStatus("Status: kept");
+
+  // Deleted on the next LVGL pass; the status survives in the view model
+  uiLoadScreen(main_screen);
+  TEST_ASSERT_TRUE(nativeLoopUntil([]() { return bluetooth_screen == nullptr; }, 500));
+  TEST_ASSERT_NULL(btUi.connectionStatusLabel);
+  show_bluetooth_screen();
+  TEST_ASSERT_EQUAL_STRING("Status: kept", lv_label_get_text(btUi.connectionStatusLabel));
+
+  uiLoadScreen(main_screen);
+  TEST_ASSERT_TRUE(nativeLoopUntil([]() { return bluetooth_screen == nullptr; }, 500));
+}
+
+void test_bench_frame_time_per_configuration(void) {
+  // Enough devices that the list scrolls
+  for (int i = 0; i < 60; i++) NativeBle::addPeer(0x0A0B0C000000ull + i, "Sensor");
+  NativeBle::radio().scanSecondMs = 100;
+  show_bluetooth_screen();
+  bleStartScan();
+  TEST_ASSERT_TRUE(nativeLoopUntil([]() { return !isScanning; }, 3000));
+
+  printf("SPI at %lu Hz: %.2f ms per full frame on the wire\n", (unsigned long)tft.spiHz,
+         SCREEN_WIDTH * SCREEN_HEIGHT * 16.0 * 1000.0 / tft.spiHz);
+  const int divisors[] = { DRAW_BUF_DIVISOR, DRAW_BUF_DIVISOR * 2 };
+  for (int divisor : divisors) {
+    for (int dma = 1; dma >= 0; dma--) {
+      uiLoadScreen(main_screen);
+      benchFrames("relay grid", dma, divisor, 20, [](int) {});
+      show_bluetooth_screen();
+      benchFrames("list scroll", dma, divisor, 20, [](int i) {
+        lv_obj_scroll_to_y(btUi.deviceList, (i % 10) * DEVICE_LIST_ROW_PITCH * 3, LV_ANIM_OFF);
+      });
+    }
+  }
+}
+
+int main(int argc, char** argv) {
+  nativeBoot(false);
+  rendered.assign(SCREEN_WIDTH * SCREEN_HEIGHT, 0);
+
+  UNITY_BEGIN();
+  RUN_TEST(test_full_refresh_reaches_the_panel_intact);
+  RUN_TEST(test_transfers_overlap_rendering);
+  RUN_TEST(test_blocking_flush_draws_the_same_frame);
+  RUN_TEST(test_screens_are_built_on_visit_and_deleted_when_left);
+  RUN_TEST(test_bench_frame_time_per_configuration);
+  int failures = UNITY_END();
+
+  // The BLE worker, touch and radio threads never return
+  fflush(stdout);
+  std::_Exit(failures);
+}
@@ -0,0 +1,164 @@
+// Link loss: a peer that drops mid-write is reported by onDisconnect() within
+// a loop() pass, updating the status line, the indicator and the stored-device
+// labels and failing the relay writes still queued; a loss that finds the
+// event queue full is parked for the poll timer; and drop-to-UI latency.
+
+#include "../../src/main.cpp"
+
+#include <native_ui.h>
+#include <unity.h>
+
+NativeBle::Peer* board = nullptr;
+
+static MacAddress boardAddress() {
+  return MacAddress::fromPacked(NativeBle::packAddress(board->address));
+}
+
+static int boardSlot() {
+  return blePoolFind(boardAddress());
+}
+
+static bool boardReady() {
+  int slot = boardSlot();
+  return slot >= 0 && peerLinks[slot].state == LINK_READY;
+}
+
+// Drop the link from the board's side; returns the microseconds until loop()
+// has freed the pool entry
+static uint32_t dropBoard() {
+  uint32_t start = micros();
+  NativeBle::dropLink(*board);
+  TEST_ASSERT_TRUE(nativeLoopUntil([]() { return boardSlot() < 0; }, 3000));
+  return micros() - start;
+}
+
+void setUp(void) {
+  board->writeAckMs = 8;
+  if (!boardReady()) {
+    TEST_ASSERT_TRUE(bleConnect(boardAddress(), "RELAY_BOARD", "CONNECTED"));
+    TEST_ASSERT_TRUE(nativeLoopUntil(boardReady));
+  }
+  nativeLoopUntil([]() { return peerLinks[boardSlot()].writesInFlight == 0; });
+  nativeLoopFor(RELAY_COALESCE_WINDOW_MS + 10);
+}
+
+void tearDown(void) {
+  // Reconnect on the test's terms, not the policy's
+  reconnectCancel(0);
+  NativeBle::waitIdle();
+}
+
+void test_drop_mid_write_is_reported_at_once(void) {
+  show_stored_devices_screen();
+  TEST_ASSERT_EQUAL_STRING("Status: CONNECTED (ACTIVE)", lv_label_get_text(storedUi.statusLabels[0]));
+  TEST_ASSERT_TRUE(lv_obj_has_state(storedUi.statusLabels[0], LV_STATE_CHECKED));  // Green
+  TEST_ASSERT_TRUE(lv_obj_has_state(status_indicator, LV_STATE_CHECKED));
+
+  // One write on the air and one frame queued behind it
+  board->writeAckMs = 300;
+  uint8_t relayOn = board->relayOn;
+  bleSendRelay(0, !(relayOn & 0x01));
+  bleSendRelay(1, !(relayOn & 0x02));
+  TEST_ASSERT_EQUAL(1, peerLinks[boardSlot()].writesInFlight);
+  TEST_ASSERT_EQUAL(1, peerLinks[boardSlot()].relayQueueLength);
+
+  uint32_t count = perfLinkLoss.count;
+  uint32_t us = dropBoard();
+  printf("drop mid-write to pool entry freed: %.2f ms\n", us / 1000.0);
+  TEST_ASSERT_LESS_THAN(50000, us);
+  TEST_ASSERT_EQUAL(count + 1, perfLinkLoss.count);
+
+  TEST_ASSERT_EQUAL(-1, activePeer);
+  TEST_ASSERT_EQUAL_STRING("Status: Connection lost", btView.status.c_str());
+  TEST_ASSERT_FALSE(lv_obj_has_state(status_indicator, LV_STATE_CHECKED));
+  TEST_ASSERT_EQUAL_STRING("Status: DISCONNECTED", lv_label_get_text(storedUi.statusLabels[0]));
+  TEST_ASSERT_FALSE(lv_obj_has_state(storedUi.statusLabels[0], LV_STATE_CHECKED));  // Red
+
+  // Neither the unacknowledged write nor the queued frame reached the board
+  nativeLoopFor(400);
+  TEST_ASSERT_EQUAL(relayOn, board->relayOn);
+  uiLoadScreen(main_screen);
+}
+
+void test_taps_after_the_drop_are_not_written(void) {
+  dropBoard();
+  size_t writes = NativeBle::writesTo(*board).size();
+  bleSendRelay(0, true);
+  nativeLoopFor(RELAY_COALESCE_WINDOW_MS + 10);
+  TEST_ASSERT_EQUAL(writes, NativeBle::writesTo(*board).size());
+}
+
+void test_full_event_queue_parks_the_loss_for_the_poll_timer(void) {
+  int slot = boardSlot();
+  uint32_t attempt = peerLinks[slot].attempt;
+
+  // Stale events fill the queue before loop() runs again
+  BleLinkEvent filler = bleMakeLinkEvent(LINK_EVT_WRITE_FAILED, slot, 0, nullptr, nullptr, 0, "");
+  while (xQueueSend(linkEventQueue, &filler, 0) == pdTRUE) {}
+  uint32_t dropped = linkEventsDropped;
+  NativeBle::dropLink(*board);
+  TEST_ASSERT_TRUE(NativeBle::waitIdle());
+  TEST_ASSERT_GREATER_THAN(dropped, linkEventsDropped);
+  TEST_ASSERT_EQUAL(attempt, bleLinkCallbacks[slot].lostAttempt);
+
+  // The queue drains, but the loss itself was never queued
+  nativeLoopFor(50);
+  TEST_ASSERT_EQUAL(slot, boardSlot());
+
+  bleLinkPollTimer(nullptr);
+  TEST_ASSERT_EQUAL(-1, boardSlot());
+  TEST_ASSERT_EQUAL(0, bleLinkCallbacks[slot].lostAttempt);
+  TEST_ASSERT_EQUAL(-1, activePeer);
+}
+
+void test_parked_loss_of_an_old_attempt_is_ignored(void) {
+  int slot = boardSlot();
+  bleLinkCallbacks[slot].lostAttempt = peerLinks[slot].attempt - 1;
+  bleLinkPollTimer(nullptr);
+  TEST_ASSERT_TRUE(boardReady());
+  TEST_ASSERT_EQUAL(0, bleLinkCallbacks[slot].lostAttempt);
+}
+
+// Drop to pool entry freed, idle and with writes in flight; the poll this
+// replaced noticed a loss up to 2000 ms late
+void test_bench_drop_to_ui_latency(void) {
+  const int drops = 10;
+  for (int busy = 0; busy <= 1; busy++) {
+    uint32_t total = 0, worst = 0;
+    for (int i = 0; i < drops; i++) {
+      setUp();
+      if (busy) {
+        board->writeAckMs = 100;
+        for (int relay = 0; relay < 4; relay++) bleSendRelay(relay, !(board->relayOn & (1 << relay)));
+      }
+      nativeLoopFor(i * 7 % 20);
+      uint32_t us = dropBoard();
+      total += us;
+      worst = max(worst, us);
+      reconnectCancel(0);
+    }
+    printf("drop to UI, %-18s avg %5.2f ms, worst %5.2f ms over %d drops\n",
+           busy ? "writes in flight:" : "idle link:", total / 1000.0 / drops, worst / 1000.0, drops);
+    TEST_ASSERT_LESS_THAN(50000, worst);
+  }
+}
+
+int main(int argc, char** argv) {
+  NativeBle::Peer& relayBoard = NativeBle::addPeer(DEFAULT_TARGET1_MAC.packed(), "RELAY_BOARD");
+  relayBoard.reportsStatus = true;
+  board = &relayBoard;
+  nativeBoot();
+  nativeLoopUntil([]() { return activePeer >= 0; });
+
+  UNITY_BEGIN();
+  RUN_TEST(test_drop_mid_write_is_reported_at_once);
+  RUN_TEST(test_taps_after_the_drop_are_not_written);
+  RUN_TEST(test_full_event_queue_parks_the_loss_for_the_poll_timer);
+  RUN_TEST(test_parked_loss_of_an_old_attempt_is_ignored);
+  RUN_TEST(test_bench_drop_to_ui_latency);
+  int failures = UNITY_END();
+
+  // The BLE worker, touch and radio threads never return
+  fflush(stdout);
+  std::_Exit(failures);
+}
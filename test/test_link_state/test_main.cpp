@@ -0,0 +1,269 @@
+// Connection state machine: the transition table, and a pool entry driven
+// through connect, discovery, timeouts and disconnects against the simulated
+// radio while loop() keeps running, with the address lookups of a connect
+// making no heap allocations. The bench case reports connect to first write
+// with and without a cached handle.
+
+#include "../../src/main.cpp"
+
+#include <native_alloc.h>
+#include <native_ui.h>
+#include <unity.h>
+
+#include <algorithm>
+#include <vector>
+
+NativeBle::Peer* board = nullptr;
+
+// States a pool entry passes through until done() holds, one entry per change,
+// and the longest loop() pass meanwhile
+struct StateTrace {
+  std::vector<BleLinkState> states;
+  uint32_t longestLoopUs = 0;
+};
+
+template <typename Done>
+StateTrace traceLink(const MacAddress& address, Done done, uint32_t timeoutMs = 3000) {
+  StateTrace trace;
+  auto record = [&]() {
+    int slot = blePoolFind(address);
+    BleLinkState state = slot >= 0 ? peerLinks[slot].state : LINK_IDLE;
+    if (trace.states.empty() || trace.states.back() != state) trace.states.push_back(state);
+  };
+  record();
+  nativeLoopUntil([&]() {
+    uint32_t start = micros();
+    loop();
+    trace.longestLoopUs = max<uint32_t>(trace.longestLoopUs, micros() - start);
+    record();
+    return done();
+  }, timeoutMs);
+  return trace;
+}
+
+static MacAddress boardAddress() {
+  return MacAddress::fromPacked(NativeBle::packAddress(board->address));
+}
+
+static bool boardReady() {
+  int slot = blePoolFind(boardAddress());
+  return slot >= 0 && peerLinks[slot].state == LINK_READY;
+}
+
+void setUp(void) {
+  board->advertising = true;
+  board->connectMs = 30;
+  board->discoveryMs = 60;
+  NativeBle::radio().failedConnectMs = 0;
+  saveCachedHandle(boardAddress(), 0, 0);
+}
+
+void tearDown(void) {
+  nativeClockRelease();
+  for (int slot = 0; slot < MAX_PEER_LINKS; slot++) bleDisconnectPeer(slot);
+  nativeLoopUntil([]() { return !board->connected; });
+}
+
+void test_transition_table(void) {
+  struct Step { BleLinkState from; BleLinkEventType event; BleLinkState to; };
+  const Step steps[] = {
+    { LINK_IDLE,          LINK_EVT_CONNECT_REQUESTED,    LINK_CONNECTING },
+    { LINK_CONNECTING,    LINK_EVT_LINK_UP,              LINK_DISCOVERING },
+    { LINK_CONNECTING,    LINK_EVT_READY,                LINK_READY },        // Cached handle, no discovery
+    { LINK_DISCOVERING,   LINK_EVT_READY,                LINK_READY },
+    { LINK_CONNECTING,    LINK_EVT_TIMEOUT,              LINK_IDLE },
+    { LINK_DISCOVERING,   LINK_EVT_TIMEOUT,              LINK_IDLE },
+    { LINK_CONNECTING,    LINK_EVT_FAILED,               LINK_IDLE },
+    { LINK_READY,         LINK_EVT_HANDLE_INVALID,       LINK_DISCOVERING },  // Rediscovery on the live link
+    { LINK_READY,         LINK_EVT_LINK_LOST,            LINK_DISCONNECTING },
+    { LINK_READY,         LINK_EVT_DISCONNECT_REQUESTED, LINK_DISCONNECTING },
+    { LINK_DISCONNECTING, LINK_EVT_DISCONNECTED,         LINK_IDLE },
+    // Events that do not apply leave the state alone
+    { LINK_IDLE,          LINK_EVT_READY,                LINK_IDLE },
+    { LINK_IDLE,          LINK_EVT_TIMEOUT,              LINK_IDLE },
+    { LINK_IDLE,          LINK_EVT_DISCONNECT_REQUESTED, LINK_IDLE },
+    { LINK_READY,         LINK_EVT_CONNECT_REQUESTED,    LINK_READY },
+    { LINK_READY,         LINK_EVT_TIMEOUT,              LINK_READY },
+    { LINK_READY,         LINK_EVT_LINK_UP,              LINK_READY },
+    { LINK_DISCOVERING,   LINK_EVT_LINK_UP,              LINK_DISCOVERING },
+  };
+  for (const Step& step : steps) {
+    TEST_ASSERT_EQUAL_STRING(bleLinkStateName(step.to), bleLinkStateName(bleLinkNextState(step.from, step.event)));
+  }
+
+  // Whatever the state, a disconnect ends in Idle and a status report changes nothing
+  for (int state = LINK_IDLE; state <= LINK_DISCONNECTING; state++) {
+    TEST_ASSERT_EQUAL(LINK_IDLE, bleLinkNextState((BleLinkState)state, LINK_EVT_DISCONNECTED));
+    TEST_ASSERT_EQUAL(state, bleLinkNextState((BleLinkState)state, LINK_EVT_RELAY_STATUS));
+    TEST_ASSERT_EQUAL(state, bleLinkNextState((BleLinkState)state, LINK_EVT_WRITE_FAILED));
+  }
+}
+
+void test_connect_runs_through_discovery_to_ready(void) {
+  uint32_t start = micros();
+  TEST_ASSERT_TRUE(bleConnect(boardAddress(), "RELAY_BOARD", "CONNECTED"));
+  TEST_ASSERT_LESS_THAN(20000, micros() - start);  // Returns at once; the worker connects
+
+  StateTrace trace = traceLink(boardAddress(), boardReady);
+  const BleLinkState expected[] = { LINK_CONNECTING, LINK_DISCOVERING, LINK_READY };
+  TEST_ASSERT_EQUAL(3, trace.states.size());
+  for (int i = 0; i < 3; i++) TEST_ASSERT_EQUAL(expected[i], trace.states[i]);
+  TEST_ASSERT_EQUAL(blePoolFind(boardAddress()), activePeer);
+
+  // The hello is written once the link is ready
+  TEST_ASSERT_TRUE(nativeLoopUntil([]() { return !NativeBle::writesTo(*board).empty(); }));
+  NativeBle::Write hello = NativeBle::writesTo(*board).back();
+  TEST_ASSERT_EQUAL_STRING("CONNECTED", std::string(hello.data.begin(), hello.data.end()).c_str());
+}
+
+void test_cached_handle_skips_discovery(void) {
+  TEST_ASSERT_TRUE(bleConnect(boardAddress(), "RELAY_BOARD", "CONNECTED"));
+  TEST_ASSERT_TRUE(nativeLoopUntil(boardReady));
+  bleDisconnectPeer(blePoolFind(boardAddress()));
+  TEST_ASSERT_TRUE(nativeLoopUntil([]() { return !board->connected; }));
+
+  TEST_ASSERT_TRUE(bleConnect(boardAddress(), "RELAY_BOARD", "CONNECTED"));
+  StateTrace trace = traceLink(boardAddress(), boardReady);
+  TEST_ASSERT_EQUAL(2, trace.states.size());
+  TEST_ASSERT_EQUAL(LINK_CONNECTING, trace.states[0]);
+  TEST_ASSERT_EQUAL(LINK_READY, trace.states[1]);
+  TEST_ASSERT_TRUE(peerLinks[blePoolFind(boardAddress())].handleFromCache);
+}
+
+void test_unreachable_peer_fails_without_blocking_the_ui(void) {
+  board->advertising = false;
+  NativeBle::radio().failedConnectMs = 400;
+
+  TEST_ASSERT_TRUE(bleConnect(boardAddress(), "RELAY_BOARD", "CONNECTED"));
+  StateTrace trace = traceLink(boardAddress(), []() { return blePoolFind(boardAddress()) < 0; });
+  TEST_ASSERT_EQUAL(LINK_CONNECTING, trace.states[0]);
+  TEST_ASSERT_EQUAL(LINK_IDLE, trace.states.back());
+  // A pass includes loop()'s sleep until the next LVGL timer; one that
+  // waited on the connect would take the whole failedConnectMs
+  TEST_ASSERT_LESS_THAN(NativeBle::radio().failedConnectMs * 1000 / 2, trace.longestLoopUs);
+  TEST_ASSERT_EQUAL(-1, activePeer);
+}
+
+void test_discovery_timeout_discards_the_late_result(void) {
+  board->discoveryMs = 600;
+  TEST_ASSERT_TRUE(bleConnect(boardAddress(), "RELAY_BOARD", "CONNECTED"));
+  int slot = blePoolFind(boardAddress());
+  TEST_ASSERT_TRUE(nativeLoopUntil([slot]() { return peerLinks[slot].state == LINK_DISCOVERING; }));
+  uint32_t attempt = peerLinks[slot].attempt;
+
+  // Step past the phase timeout: the attempt is abandoned and the slot freed
+  nativeClockFreeze();
+  nativeClockAdvance(DISCOVERY_TIMEOUT_MS + 1);
+  loop();
+  nativeClockRelease();
+  TEST_ASSERT_EQUAL(LINK_IDLE, peerLinks[slot].state);
+  TEST_ASSERT_FALSE(peerLinks[slot].inUse);
+  TEST_ASSERT_NOT_EQUAL(attempt, peerLinks[slot].attempt);
+
+  // Discovery still finishes on the worker; its result belongs to the old
+  // attempt, so the client is released and the link dropped, never made ready
+  StateTrace trace = traceLink(boardAddress(), []() { return board->connects > 0 && !board->connected; });
+  for (BleLinkState state : trace.states) TEST_ASSERT_NOT_EQUAL(LINK_READY, state);
+  TEST_ASSERT_FALSE(board->connected);
+  TEST_ASSERT_EQUAL(-1, activePeer);
+}
+
+void test_disconnect_says_goodbye_and_frees_the_slot(void) {
+  TEST_ASSERT_TRUE(bleConnect(boardAddress(), "RELAY_BOARD", "CONNECTED"));
+  TEST_ASSERT_TRUE(nativeLoopUntil(boardReady));
+  nativeLoopFor(50);
+
+  bleDisconnect();
+  TEST_ASSERT_EQUAL(-1, blePoolFind(boardAddress()));
+  TEST_ASSERT_EQUAL(-1, activePeer);
+  TEST_ASSERT_TRUE(nativeLoopUntil([]() { return !board->connected; }));
+  NativeBle::Write goodbye = NativeBle::writesTo(*board).back();
+  TEST_ASSERT_EQUAL_STRING("DISCONNECT", std::string(goodbye.data.begin(), goodbye.data.end()).c_str());
+}
+
+void test_link_loss_returns_to_idle(void) {
+  TEST_ASSERT_TRUE(bleConnect(boardAddress(), "RELAY_BOARD", "CONNECTED"));
+  TEST_ASSERT_TRUE(nativeLoopUntil(boardReady));
+
+  NativeBle::dropLink(*board);
+  TEST_ASSERT_TRUE(nativeLoopUntil([]() { return blePoolFind(boardAddress()) < 0; }));
+  TEST_ASSERT_EQUAL(-1, activePeer);
+  reconnectCancel(0);
+}
+
+// bleConnect() to the hello reaching the board, in ms, over `connects`
+// connects with the handle cache emptied first (miss) or kept (hit)
+static void benchConnectToFirstWrite(bool cached, int connects) {
+  uint64_t totalUs = 0, maxUs = 0;
+  for (int i = 0; i < connects; i++) {
+    if (!cached) saveCachedHandle(boardAddress(), 0, 0);
+    size_t writes = NativeBle::writesTo(*board).size();
+    uint32_t start = micros();
+    TEST_ASSERT_TRUE(bleConnect(boardAddress(), "RELAY_BOARD", "CONNECTED"));
+    StateTrace trace = traceLink(boardAddress(), []() { return boardReady() && peerLinks[activePeer].writesInFlight == 0; });
+    TEST_ASSERT_TRUE(nativeLoopUntil([writes]() { return NativeBle::writesTo(*board).size() > writes; }));
+    uint64_t us = NativeBle::writesTo(*board)[writes].micros - start;
+    totalUs += us;
+    maxUs = max(maxUs, us);
+
+    // Only a miss goes through discovery
+    bool discovered = std::find(trace.states.begin(), trace.states.end(), LINK_DISCOVERING) != trace.states.end();
+    TEST_ASSERT_EQUAL(!cached, discovered);
+    TEST_ASSERT_EQUAL(cached, peerLinks[blePoolFind(boardAddress())].handleFromCache);
+
+    bleDisconnectPeer(blePoolFind(boardAddress()));
+    TEST_ASSERT_TRUE(nativeLoopUntil([]() { return !board->connected; }));
+  }
+  printf("connect to first write, handle cache %s: avg %5.1f ms  max %5.1f ms  (connect %lu ms, discovery %lu ms)\n",
+         cached ? "hit " : "miss", totalUs / 1000.0 / connects, maxUs / 1000.0,
+         (unsigned long)board->connectMs, (unsigned long)board->discoveryMs);
+}
+
+// What bleConnect() and the worker do with the address: the list entry's
+// packed key to a MacAddress, the pool, registry and handle cache lookups,
+// the command and the esp_bd_addr_t for the stack
+void test_connect_address_handling_does_not_allocate(void) {
+  const int connects = 1000;
+  uint64_t packed = boardAddress().packed();
+  volatile uint32_t sink = 0;
+  uint32_t before = nativeAllocations();
+  for (int i = 0; i < connects; i++) {
+    MacAddress address = MacAddress::fromPacked(packed + i % 2);
+    uint8_t properties;
+    sink = sink + blePoolFind(address) + peerRegistryFind(address) + loadCachedHandle(address, properties);
+    BleCommand cmd = {};
+    cmd.address = address;
+    esp_bd_addr_t bda;
+    memcpy(bda, cmd.address.bytes, sizeof(bda));
+    sink = sink + bda[5] + strlen(cmd.address.toString().c_str());
+  }
+  TEST_ASSERT_EQUAL(0, nativeAllocations() - before);
+}
+
+void test_bench_connect_to_first_write_with_and_without_cache(void) {
+  benchConnectToFirstWrite(false, 5);
+  benchConnectToFirstWrite(true, 5);
+}
+
+int main(int argc, char** argv) {
+  NativeBle::Peer& relayBoard = NativeBle::addPeer(DEFAULT_TARGET1_MAC.packed(), "RELAY_BOARD");
+  relayBoard.reportsStatus = true;
+  board = &relayBoard;
+  nativeBoot(false);
+
+  UNITY_BEGIN();
+  RUN_TEST(test_transition_table);
+  RUN_TEST(test_connect_runs_through_discovery_to_ready);
+  RUN_TEST(test_cached_handle_skips_discovery);
+  RUN_TEST(test_unreachable_peer_fails_without_blocking_the_ui);
+  RUN_TEST(test_discovery_timeout_discards_the_late_result);
+  RUN_TEST(test_disconnect_says_goodbye_and_frees_the_slot);
+  RUN_TEST(test_link_loss_returns_to_idle);
+  RUN_TEST(test_connect_address_handling_does_not_allocate);
+  RUN_TEST(test_bench_connect_to_first_write_with_and_without_cache);
+  int failures = UNITY_END();
+
+  // The BLE worker, touch and radio threads never return
+  fflush(stdout);
+  std::_Exit(failures);
+}
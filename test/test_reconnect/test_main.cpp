@@ -0,0 +1,198 @@
+// Reconnect policy: backoff that doubles with up to 25% jitter and stops at
+// the cap, a lost board found by the targeted scan and reconnected, an absent
+// one probed without a connect attempt, probes held off by a list scan,
+// drop-to-reconnect time against a board that disappears for a while, and
+// the targeted scan's time to the target and radio duty among other
+// advertisers.
+
+#include "../../src/main.cpp"
+
+#include <native_ui.h>
+#include <unity.h>
+
+NativeBle::Peer* board = nullptr;
+
+static MacAddress boardAddress() {
+  return MacAddress::fromPacked(NativeBle::packAddress(board->address));
+}
+
+static bool boardReady() {
+  int slot = blePoolFind(boardAddress());
+  return slot >= 0 && peerLinks[slot].state == LINK_READY;
+}
+
+static ReconnectPolicy& policy() {
+  return reconnectPolicy[0];
+}
+
+void setUp(void) {
+  board->advertising = true;
+  autoConnectEnabled = true;
+  if (!boardReady()) {
+    reconnectCancel(0);
+    TEST_ASSERT_TRUE(bleConnectStoredTarget(0));
+    TEST_ASSERT_TRUE(nativeLoopUntil(boardReady));
+  }
+  nativeLoopUntil([]() { return policy().phase == RECONNECT_OFF; });
+}
+
+void tearDown(void) {
+  nativeClockRelease();
+  if (isScanning) bleStopScan();
+  NativeBle::waitIdle();
+}
+
+void test_backoff_doubles_with_jitter_up_to_the_cap(void) {
+  ReconnectPolicy saved = policy();
+  nativeClockFreeze();
+  policy().backoffMs = RECONNECT_BACKOFF_MIN_MS;
+  for (int i = 0; i < 10; i++) {
+    uint32_t backoff = policy().backoffMs;
+    reconnectSchedule(0);
+    uint32_t delayMs = policy().nextAttemptMillis - millis();
+    TEST_ASSERT_EQUAL(RECONNECT_WAITING, policy().phase);
+    TEST_ASSERT_GREATER_OR_EQUAL(backoff, delayMs);
+    TEST_ASSERT_LESS_OR_EQUAL(backoff + backoff / 4, delayMs);
+    TEST_ASSERT_EQUAL(min<uint32_t>(backoff * 2, RECONNECT_BACKOFF_MAX_MS), policy().backoffMs);
+  }
+  TEST_ASSERT_EQUAL(RECONNECT_BACKOFF_MAX_MS, policy().backoffMs);
+  policy() = saved;
+}
+
+void test_lost_board_is_probed_then_reconnected(void) {
+  uint32_t reconnects = policy().reconnects;
+  uint32_t connects = board->connects;
+  NativeBle::dropLink(*board);
+  TEST_ASSERT_TRUE(nativeLoopUntil([]() { return policy().phase == RECONNECT_WAITING; }));
+  TEST_ASSERT_EQUAL(RECONNECT_BACKOFF_MIN_MS * 2, policy().backoffMs);
+
+  TEST_ASSERT_TRUE(nativeLoopUntil([]() { return policy().phase == RECONNECT_PROBING; }, 2000));
+  TEST_ASSERT_TRUE(nativeLoopUntil(boardReady, 3000));
+  TEST_ASSERT_TRUE(nativeLoopUntil([]() { return policy().phase == RECONNECT_OFF; }));
+  TEST_ASSERT_EQUAL(reconnects + 1, policy().reconnects);
+  TEST_ASSERT_EQUAL(1, policy().attempts);
+  TEST_ASSERT_EQUAL(0, policy().probesAbsent);
+  TEST_ASSERT_EQUAL(connects + 1, board->connects);
+}
+
+void test_absent_board_costs_a_probe_not_a_connect(void) {
+  board->advertising = false;
+  uint32_t connects = board->connects;
+  NativeBle::dropLink(*board);
+  TEST_ASSERT_TRUE(nativeLoopUntil([]() { return policy().phase == RECONNECT_WAITING; }));
+
+  // The probe finds nothing and the backoff doubles again
+  policy().nextAttemptMillis = millis();
+  TEST_ASSERT_TRUE(nativeLoopUntil([]() { return policy().probesAbsent == 1 && policy().phase == RECONNECT_WAITING; }, 3000));
+  TEST_ASSERT_EQUAL(0, policy().attempts);
+  TEST_ASSERT_EQUAL(connects, board->connects);
+  TEST_ASSERT_EQUAL(RECONNECT_BACKOFF_MIN_MS * 4, policy().backoffMs);
+
+  // Back in range: the next probe sees it
+  board->advertising = true;
+  policy().nextAttemptMillis = millis();
+  TEST_ASSERT_TRUE(nativeLoopUntil(boardReady, 3000));
+  TEST_ASSERT_EQUAL(1, policy().attempts);
+}
+
+void test_list_scan_holds_off_the_probe(void) {
+  NativeBle::dropLink(*board);
+  TEST_ASSERT_TRUE(nativeLoopUntil([]() { return policy().phase == RECONNECT_WAITING; }));
+
+  show_bluetooth_screen();
+  bleStartScan();
+  TEST_ASSERT_TRUE(isScanning);
+  policy().nextAttemptMillis = millis();
+  nativeLoopFor(20);
+  TEST_ASSERT_EQUAL(RECONNECT_WAITING, policy().phase);
+  TEST_ASSERT_GREATER_THAN(millis(), policy().nextAttemptMillis);
+
+  bleStopScan();
+  uiLoadScreen(main_screen);
+  TEST_ASSERT_TRUE(nativeLoopUntil(boardReady, 3000));
+}
+
+void test_auto_connect_off_cancels_the_retry(void) {
+  NativeBle::dropLink(*board);
+  TEST_ASSERT_TRUE(nativeLoopUntil([]() { return policy().phase == RECONNECT_WAITING; }));
+  autoConnectEnabled = false;
+  nativeLoopFor(20);
+  TEST_ASSERT_EQUAL(RECONNECT_OFF, policy().phase);
+}
+
+// The board drops and stays out of range for `outageMs`; reconnect time,
+// connect attempts and probes that found nothing
+void test_bench_reconnect_after_an_outage(void) {
+  const uint32_t outages[] = { 0, 500, 2500 };
+  for (uint32_t outageMs : outages) {
+    setUp();
+    uint32_t connects = board->connects;
+    uint32_t start = millis();
+    board->advertising = outageMs == 0;
+    NativeBle::dropLink(*board);
+    TEST_ASSERT_TRUE(nativeLoopUntil([]() { return policy().phase != RECONNECT_OFF; }));
+    nativeLoopFor(outageMs);
+    board->advertising = true;
+    TEST_ASSERT_TRUE(nativeLoopUntil(boardReady, 15000));
+    TEST_ASSERT_TRUE(nativeLoopUntil([]() { return policy().phase == RECONNECT_OFF; }));
+    printf("outage %4lu ms: reconnected %5lu ms after the drop, %lu connect attempt(s), %lu probe(s) absent\n",
+           (unsigned long)outageMs, millis() - start, (unsigned long)policy().attempts,
+           (unsigned long)policy().probesAbsent);
+    TEST_ASSERT_EQUAL(connects + 1, board->connects);
+  }
+}
+
+// Probes for the lost board with `others` unrelated advertisers in range:
+// time to the target, scan length and what reached the host
+void test_bench_targeted_scan_among_other_advertisers(void) {
+  const int others = 40;
+  const int probes = 5;
+  for (int i = 0; i < others; i++) NativeBle::addPeer(0x0D0E0F000000ull + i, "Sensor");
+
+  unsigned long foundMs = 0, foundMaxMs = 0, scanMs = 0;
+  for (int probe = 0; probe < probes; probe++) {
+    setUp();
+    NativeBle::dropLink(*board);
+    TEST_ASSERT_TRUE(nativeLoopUntil([]() { return policy().phase == RECONNECT_WAITING; }));
+    policy().nextAttemptMillis = millis();
+    TEST_ASSERT_TRUE(nativeLoopUntil([]() { return policy().phase == RECONNECT_CONNECTING || boardReady(); }, 3000));
+    TEST_ASSERT_FALSE(targetScan.active);
+
+    // The whitelist passes only the board, and the duplicate filter one report of it
+    TEST_ASSERT_EQUAL(1, targetScan.foundMask);
+    TEST_ASSERT_EQUAL(1, targetScan.reports);
+    unsigned long found = targetScan.foundMillis[0] - targetScan.startMillis;
+    foundMs += found;
+    foundMaxMs = max(foundMaxMs, found);
+    scanMs += targetScan.endMillis - targetScan.startMillis;
+    TEST_ASSERT_TRUE(nativeLoopUntil(boardReady, 3000));
+  }
+  printf("targeted scan among %d advertisers: target found after avg %lu ms (max %lu), scan %lu ms of %lu, "
+         "%d%% radio duty (list scan 99%%), 1 report to the host\n",
+         others, foundMs / probes, foundMaxMs, scanMs / probes,
+         (unsigned long)(TARGET_SCAN_DURATION_S * NativeBle::radio().scanSecondMs),
+         TARGET_SCAN_WINDOW * 100 / TARGET_SCAN_INTERVAL);
+}
+
+int main(int argc, char** argv) {
+  NativeBle::Peer& relayBoard = NativeBle::addPeer(DEFAULT_TARGET1_MAC.packed(), "RELAY_BOARD");
+  relayBoard.reportsStatus = true;
+  board = &relayBoard;
+  NativeBle::radio().scanSecondMs = 200;
+  nativeBoot();
+  nativeLoopUntil([]() { return activePeer >= 0; });
+
+  UNITY_BEGIN();
+  RUN_TEST(test_backoff_doubles_with_jitter_up_to_the_cap);
+  RUN_TEST(test_lost_board_is_probed_then_reconnected);
+  RUN_TEST(test_absent_board_costs_a_probe_not_a_connect);
+  RUN_TEST(test_list_scan_holds_off_the_probe);
+  RUN_TEST(test_auto_connect_off_cancels_the_retry);
+  RUN_TEST(test_bench_reconnect_after_an_outage);
+  RUN_TEST(test_bench_targeted_scan_among_other_advertisers);
+  int failures = UNITY_END();
+
+  // The BLE worker, touch and radio threads never return
+  fflush(stdout);
+  std::_Exit(failures);
+}
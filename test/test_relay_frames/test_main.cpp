@@ -0,0 +1,127 @@
+// Relay frame encoder: the table-built frames against the hex literals the
+// relay handlers used to send, the bytes a tap puts on the air, and the heap
+// allocations per frame against the old parse-per-tap path. The timing of the
+// two paths is in the benchmark (test/bench).
+
+#include "../../src/main.cpp"
+
+#include <native_alloc.h>
+#include <native_ui.h>
+#include <unity.h>
+
+// The commands the relay handlers passed to bleSendHexString(), by relay and state
+const char* const LEGACY_COMMANDS[6][2] = {
+  { "A00100A1", "A00101A2" },
+  { "A00200A2", "A00201A3" },
+  { "A00300A3", "A00301A4" },
+  { "A00400A4", "A00401A5" },
+  { "A00100A1", "A00101A2" },  // Relay5 and Relay6 were placeholders for channel 1
+  { "A00100A1", "A00101A2" },
+};
+
+// bleSendHexString()'s conversion: a heap buffer and a substring and strtoul() per byte
+static size_t legacyHexToBytes(const String& hexString, uint8_t*& bytes) {
+  int byteCount = hexString.length() / 2;
+  bytes = new uint8_t[byteCount];
+  for (int i = 0; i < byteCount; i++) {
+    String byteString = hexString.substring(i * 2, i * 2 + 2);
+    bytes[i] = strtoul(byteString.c_str(), NULL, 16);
+  }
+  return byteCount;
+}
+
+NativeBle::Peer* board = nullptr;
+
+void setUp(void) {}
+void tearDown(void) {}
+
+void test_default_frames_match_the_legacy_commands(void) {
+  TEST_ASSERT_EQUAL(6, RELAY_DEFAULT_CONFIG.count);
+  for (int relay = 0; relay < RELAY_DEFAULT_CONFIG.count; relay++) {
+    for (int state = 0; state < 2; state++) {
+      const RelayDescriptor& d = RELAY_DEFAULT_CONFIG.relays[relay];
+      RelayFrame frame = makeRelayFrame(d.channel, state, d.header);
+      uint8_t* legacy;
+      TEST_ASSERT_EQUAL(frame.size(), legacyHexToBytes(LEGACY_COMMANDS[relay][state], legacy));
+      TEST_ASSERT_EQUAL_HEX8_ARRAY(legacy, frame.data(), frame.size());
+      delete[] legacy;
+    }
+  }
+}
+
+void test_checksum_is_the_low_byte_of_the_sum(void) {
+  for (int channel = 0; channel < 256; channel++) {
+    RelayFrame on = makeRelayFrame(channel, true);
+    RelayFrame off = makeRelayFrame(channel, false);
+    TEST_ASSERT_EQUAL_HEX8(RELAY_FRAME_HEADER, on[0]);
+    TEST_ASSERT_EQUAL_HEX8(channel, on[1]);
+    TEST_ASSERT_EQUAL_HEX8(0x01, on[2]);
+    TEST_ASSERT_EQUAL_HEX8(0x00, off[2]);
+    TEST_ASSERT_EQUAL_HEX8((RELAY_FRAME_HEADER + channel + 1) & 0xFF, on[3]);
+    TEST_ASSERT_EQUAL_HEX8((RELAY_FRAME_HEADER + channel) & 0xFF, off[3]);
+  }
+
+  // A table entry's own header takes part in the checksum
+  TEST_ASSERT_EQUAL_HEX32(0xB00501B6, relayFramePacked(makeRelayFrame(5, true, 0xB0)));
+  TEST_ASSERT_EQUAL_HEX32(0xA0FF009F, relayFramePacked(RELAY_QUERY_FRAME));
+}
+
+void test_tap_writes_the_frame_bytes(void) {
+  for (int relay = 0; relay < relayConfig.count; relay++) {
+    for (int state = 1; state >= 0; state--) {
+      size_t writes = NativeBle::writesTo(*board).size();
+      bleSendRelay(relay, state);
+      TEST_ASSERT_TRUE(nativeLoopUntil([&]() { return NativeBle::writesTo(*board).size() > writes; }, 1000));
+
+      NativeBle::Write write = NativeBle::writesTo(*board).back();
+      uint8_t* legacy;
+      size_t length = legacyHexToBytes(LEGACY_COMMANDS[relay][state], legacy);
+      TEST_ASSERT_EQUAL(length, write.data.size());
+      TEST_ASSERT_EQUAL_HEX8_ARRAY(legacy, write.data.data(), length);
+      delete[] legacy;
+    }
+  }
+}
+
+// The encoder builds frames on the stack; the old conversion allocated per frame
+void test_encoder_does_not_allocate(void) {
+  const int frames = 1000;
+  volatile uint32_t sink = 0;
+
+  uint32_t before = nativeAllocations();
+  for (int i = 0; i < frames; i++) {
+    uint8_t* bytes;
+    legacyHexToBytes(LEGACY_COMMANDS[i % 6][i & 1], bytes);
+    sink = sink + bytes[3];
+    delete[] bytes;
+  }
+  uint32_t legacyAllocations = nativeAllocations() - before;
+
+  before = nativeAllocations();
+  for (int i = 0; i < frames; i++) {
+    const RelayDescriptor& d = relayConfig.relays[i % relayConfig.count];
+    RelayFrame frame = makeRelayFrame(d.channel, i & 1, d.header);
+    sink = sink + frame[3];
+  }
+  TEST_ASSERT_EQUAL(0, nativeAllocations() - before);
+  TEST_ASSERT_GREATER_OR_EQUAL(frames, legacyAllocations);
+}
+
+int main(int argc, char** argv) {
+  NativeBle::Peer& relayBoard = NativeBle::addPeer(DEFAULT_TARGET1_MAC.packed(), "RELAY_BOARD");
+  relayBoard.reportsStatus = true;
+  board = &relayBoard;
+  nativeBoot();
+  nativeLoopUntil([]() { return activePeer >= 0; });
+
+  UNITY_BEGIN();
+  RUN_TEST(test_default_frames_match_the_legacy_commands);
+  RUN_TEST(test_checksum_is_the_low_byte_of_the_sum);
+  RUN_TEST(test_tap_writes_the_frame_bytes);
+  RUN_TEST(test_encoder_does_not_allocate);
+  int failures = UNITY_END();
+
+  // The BLE worker, touch and radio threads never return
+  fflush(stdout);
+  std::_Exit(failures);
+}
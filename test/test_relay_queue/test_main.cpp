@@ -0,0 +1,268 @@
+// Relay command queue: a burst on one relay collapses into its final state,
+// frames for several channels share a GATT write as far as the MTU allows, a
+// refused write puts the queued relays back to the board's state, and tap
+// sequences replayed against the board measure writes and tap-to-write time.
+
+#include "../../src/main.cpp"
+
+#include <native_ui.h>
+#include <unity.h>
+
+#include <vector>
+
+NativeBle::Peer* board = nullptr;
+
+static BlePeerLink& boardLink() {
+  return peerLinks[activePeer];
+}
+
+// Writes the board received after the first `first` ones
+static std::vector<NativeBle::Write> writesSince(size_t first) {
+  std::vector<NativeBle::Write> writes = NativeBle::writesTo(*board);
+  writes.erase(writes.begin(), writes.begin() + min(first, writes.size()));
+  return writes;
+}
+
+static void assertFrames(const NativeBle::Write& write, std::vector<RelayFrame> frames) {
+  TEST_ASSERT_EQUAL(frames.size() * sizeof(RelayFrame), write.data.size());
+  for (size_t i = 0; i < frames.size(); i++) {
+    TEST_ASSERT_EQUAL_HEX8_ARRAY(frames[i].data(), write.data.data() + i * sizeof(RelayFrame), sizeof(RelayFrame));
+  }
+}
+
+// Drop the link and connect again, e.g. to negotiate another MTU
+static void reconnectBoard() {
+  MacAddress address = MacAddress::fromPacked(NativeBle::packAddress(board->address));
+  bleDisconnectPeer(activePeer);
+  TEST_ASSERT_TRUE(nativeLoopUntil([]() { return !board->connected; }));
+  size_t first = NativeBle::writesTo(*board).size();
+  TEST_ASSERT_TRUE(bleConnect(address, "RELAY_BOARD", "CONNECTED"));
+  TEST_ASSERT_TRUE(nativeLoopUntil([first]() { return NativeBle::writesTo(*board).size() > first; }));  // The hello
+}
+
+void setUp(void) {
+  // Each test starts outside the coalescing window with nothing queued or in flight
+  nativeLoopUntil([]() { return boardLink().relayQueueLength == 0 && boardLink().writesInFlight == 0; });
+  nativeLoopFor(RELAY_COALESCE_WINDOW_MS + 10);
+}
+
+void tearDown(void) {}
+
+void test_burst_on_one_relay_collapses_into_its_final_state(void) {
+  BlePeerLink& link = boardLink();
+  size_t first = NativeBle::writesTo(*board).size();
+  uint32_t coalesced = link.relayFramesCoalesced;
+
+  bleSendRelay(0, true);   // First tap after a quiet period: written at once
+  bleSendRelay(0, false);  // Inside the window: queued
+  bleSendRelay(0, true);   // Replaces the queued OFF
+  TEST_ASSERT_EQUAL(1, link.relayQueueLength);
+  TEST_ASSERT_EQUAL(coalesced + 1, link.relayFramesCoalesced);
+
+  TEST_ASSERT_TRUE(nativeLoopUntil([&]() { return link.relayQueueLength == 0; }, 1000));
+  nativeLoopFor(RELAY_COALESCE_WINDOW_MS * 2);
+  std::vector<NativeBle::Write> writes = writesSince(first);
+  TEST_ASSERT_EQUAL(2, writes.size());
+  assertFrames(writes[0], { makeRelayFrame(1, true) });
+  assertFrames(writes[1], { makeRelayFrame(1, true) });
+  TEST_ASSERT_TRUE(nativeLoopUntil([]() { return board->relayOn & 0x01; }, 1000));
+}
+
+void test_taps_on_several_relays_share_one_write(void) {
+  BlePeerLink& link = boardLink();
+  size_t first = NativeBle::writesTo(*board).size();
+
+  bleSendRelay(0, false);
+  bleSendRelay(1, true);
+  bleSendRelay(2, true);
+  bleSendRelay(3, true);
+  TEST_ASSERT_EQUAL(3, link.relayQueueLength);
+
+  TEST_ASSERT_TRUE(nativeLoopUntil([&]() { return link.relayQueueLength == 0; }, 1000));
+  nativeLoopFor(RELAY_COALESCE_WINDOW_MS * 2);
+  std::vector<NativeBle::Write> writes = writesSince(first);
+  TEST_ASSERT_EQUAL(2, writes.size());
+  assertFrames(writes[0], { makeRelayFrame(1, false) });
+  assertFrames(writes[1], { makeRelayFrame(2, true), makeRelayFrame(3, true), makeRelayFrame(4, true) });
+
+  // FFE1 takes write-without-response, so relay frames go out unacknowledged
+  TEST_ASSERT_FALSE(writes[1].response);
+  TEST_ASSERT_TRUE(nativeLoopUntil([]() { return (board->relayOn & 0x0F) == 0x0E; }, 1000));
+}
+
+void test_mtu_limits_the_frames_per_write(void) {
+  std::vector<RelayFrame> frames;
+  for (int channel = 1; channel <= RELAY_MAX; channel++) frames.push_back(makeRelayFrame(channel, false));
+
+  // The default MTU of 23 leaves room for five frames
+  size_t first = NativeBle::writesTo(*board).size();
+  bleQueueRelayFrame(activePeer, makeRelayFrame(8, false));
+  for (const RelayFrame& frame : frames) bleQueueRelayFrame(activePeer, frame);
+  TEST_ASSERT_EQUAL(RELAY_MAX, boardLink().relayQueueLength);
+  TEST_ASSERT_TRUE(nativeLoopUntil([]() { return boardLink().relayQueueLength == 0; }, 1000));
+  std::vector<NativeBle::Write> writes = writesSince(first);
+  TEST_ASSERT_EQUAL(3, writes.size());
+  assertFrames(writes[1], std::vector<RelayFrame>(frames.begin(), frames.begin() + 5));
+  assertFrames(writes[2], std::vector<RelayFrame>(frames.begin() + 5, frames.end()));
+  TEST_ASSERT_TRUE(nativeLoopUntil([]() { return board->relayOn == 0; }, 1000));
+
+  // A larger MTU takes the whole queue in one write
+  BLEDevice::setMTU(185);
+  board->mtu = 185;
+  reconnectBoard();
+  TEST_ASSERT_EQUAL(185, boardLink().client->getMTU());
+  nativeLoopFor(RELAY_COALESCE_WINDOW_MS + 10);
+
+  first = NativeBle::writesTo(*board).size();
+  bleQueueRelayFrame(activePeer, makeRelayFrame(8, false));
+  for (const RelayFrame& frame : frames) bleQueueRelayFrame(activePeer, frame);
+  TEST_ASSERT_TRUE(nativeLoopUntil([]() { return boardLink().relayQueueLength == 0; }, 1000));
+  writes = writesSince(first);
+  TEST_ASSERT_EQUAL(2, writes.size());
+  assertFrames(writes[1], frames);
+  TEST_ASSERT_TRUE(nativeLoopUntil([]() { return board->relayOn == 0; }, 1000));
+
+  BLEDevice::setMTU(23);
+  board->mtu = 23;
+  reconnectBoard();
+}
+
+// Toggle a relay button as a released tap does, without waiting for the touch task
+static void clickRelay(int relay) {
+  lv_obj_t* button = relayButtons[relay];
+  lv_obj_set_state(button, LV_STATE_CHECKED, !lv_obj_has_state(button, LV_STATE_CHECKED));
+  lv_obj_send_event(button, LV_EVENT_VALUE_CHANGED, nullptr);
+}
+
+void test_refused_write_rolls_back_the_queued_relays(void) {
+  BlePeerLink& link = boardLink();
+  uint32_t dropped = link.relayFramesDropped;
+
+  // The clock stands still, so the second and third taps stay queued
+  nativeClockFreeze();
+  clickRelay(0);
+  TEST_ASSERT_TRUE(nativeLoopUntil([&]() { return link.writesInFlight == 0; }, 1000));
+  uint8_t boardBefore = board->relayOn;
+  clickRelay(1);
+  clickRelay(2);
+  TEST_ASSERT_EQUAL(2, link.relayQueueLength);
+  TEST_ASSERT_EQUAL_HEX8(0x06, link.relayPending & 0x06);
+
+  // The worker sleeps until something is posted, so filler written behind its
+  // back fills the write queue and the flush is refused
+  BleCommand filler = {};
+  filler.type = BLE_CMD_WRITE;
+  filler.slot = MAX_PEER_LINKS - 1;
+  while (xQueueSend(bleWriteQueue, &filler, 0) == pdTRUE) {}
+  nativeClockAdvance(RELAY_COALESCE_WINDOW_MS);
+  loop();
+  xQueueReset(bleWriteQueue);
+  nativeClockRelease();
+
+  TEST_ASSERT_EQUAL(0, link.relayQueueLength);
+  TEST_ASSERT_EQUAL(dropped + 2, link.relayFramesDropped);
+  TEST_ASSERT_EQUAL_HEX8(0, link.relayPending & 0x06);
+  for (int relay = 1; relay <= 2; relay++) {
+    bool boardOn = boardBefore & (1 << (bleRelayChannel(activePeer, relay) - 1));
+    TEST_ASSERT_EQUAL(boardOn, (bool)(link.relayDesired & (1 << relay)));
+    TEST_ASSERT_EQUAL(boardOn, lv_obj_has_state(relayButtons[relay], LV_STATE_CHECKED));
+  }
+  nativeLoopFor(RELAY_COALESCE_WINDOW_MS * 2);
+  TEST_ASSERT_EQUAL_HEX8(boardBefore, board->relayOn);
+}
+
+// Tap sequences as they come off the panel: relay button, and ms since the previous tap
+struct RecordedTap {
+  uint8_t relay;
+  uint16_t afterMs;
+};
+
+const RecordedTap HAMMERED_BUTTON[] = {  // One button, as fast as two fingers drum
+  { 0, 0 }, { 0, 24 }, { 0, 19 }, { 0, 31 }, { 0, 22 }, { 0, 17 }, { 0, 28 }, { 0, 21 },
+};
+const RecordedTap TWO_FINGERS[] = {      // Two buttons alternated
+  { 0, 0 }, { 1, 14 }, { 0, 36 }, { 1, 12 }, { 0, 41 }, { 1, 15 }, { 0, 39 }, { 1, 11 },
+};
+const RecordedTap SWEEP[] = {            // Down the column and back
+  { 0, 0 }, { 1, 95 }, { 2, 88 }, { 3, 102 }, { 3, 70 }, { 2, 81 }, { 1, 76 }, { 0, 90 },
+};
+
+// Replay a sequence, each tap toggling its relay, and report what went on the air
+static void replay(const char* name, const RecordedTap* taps, size_t count) {
+  BlePeerLink& link = boardLink();
+  size_t first = NativeBle::writesTo(*board).size();
+  uint32_t coalesced = link.relayFramesCoalesced;
+  std::vector<uint64_t> tapMicros;
+  std::vector<RelayFrame> tapFrames;
+
+  // The sequence starts on a quiet link, as the first tap after a pause would
+  nativeLoopFor(RELAY_COALESCE_WINDOW_MS + 10);
+  for (size_t i = 0; i < count; i++) {
+    nativeLoopUntilTap(taps[i].afterMs);
+    int relay = taps[i].relay;
+    bool on = !(link.relayDesired & (1 << relay));
+    tapMicros.push_back(micros());
+    tapFrames.push_back(makeRelayFrame(bleRelayChannel(activePeer, relay), on, relayConfig.relays[relay].header));
+    bleSendRelay(relay, on);
+  }
+
+  // Settled once the board's relays match the buttons
+  uint8_t expected = 0;
+  for (int relay = 0; relay < relayConfig.count; relay++) {
+    if (link.relayDesired & (1 << relay)) expected |= 1 << (bleRelayChannel(activePeer, relay) - 1);
+  }
+  uint64_t lastTap = tapMicros.back();
+  TEST_ASSERT_TRUE(nativeLoopUntil([&]() { return link.relayQueueLength == 0 && (board->relayOn & 0x0F) == expected; }, 2000));
+  uint64_t settledUs = micros() - lastTap;
+
+  // A tap is written by the first write carrying its frame or a later state of its channel
+  std::vector<NativeBle::Write> writes = writesSince(first);
+  size_t frames = 0;
+  uint64_t worstUs = 0, totalUs = 0;
+  for (const NativeBle::Write& write : writes) frames += write.data.size() / sizeof(RelayFrame);
+  for (size_t i = 0; i < tapMicros.size(); i++) {
+    for (const NativeBle::Write& write : writes) {
+      if (write.micros < tapMicros[i]) continue;
+      bool carries = false;
+      for (size_t f = 0; f + sizeof(RelayFrame) <= write.data.size(); f += sizeof(RelayFrame)) {
+        carries |= write.data[f + 1] == tapFrames[i][1];
+      }
+      if (!carries) continue;
+      worstUs = max<uint64_t>(worstUs, write.micros - tapMicros[i]);
+      totalUs += write.micros - tapMicros[i];
+      break;
+    }
+  }
+
+  printf("%-16s %zu taps, %zu writes, %zu frames, %lu coalesced; tap-to-write avg %.1f ms, worst %.1f ms; settled %.1f ms after the last tap\n",
+         name, count, writes.size(), frames, (unsigned long)(link.relayFramesCoalesced - coalesced),
+         totalUs / 1000.0 / count, worstUs / 1000.0, settledUs / 1000.0);
+  TEST_ASSERT_LESS_OR_EQUAL(count, writes.size());
+  TEST_ASSERT_LESS_OR_EQUAL((RELAY_COALESCE_WINDOW_MS + 20) * 1000, worstUs);
+}
+
+void test_bench_replayed_tap_sequences(void) {
+  replay("hammered button", HAMMERED_BUTTON, sizeof(HAMMERED_BUTTON) / sizeof(HAMMERED_BUTTON[0]));
+  replay("two fingers", TWO_FINGERS, sizeof(TWO_FINGERS) / sizeof(TWO_FINGERS[0]));
+  replay("sweep", SWEEP, sizeof(SWEEP) / sizeof(SWEEP[0]));
+}
+
+int main(int argc, char** argv) {
+  NativeBle::Peer& relayBoard = NativeBle::addPeer(DEFAULT_TARGET1_MAC.packed(), "RELAY_BOARD");
+  relayBoard.reportsStatus = true;
+  board = &relayBoard;
+  nativeBoot();
+  nativeLoopUntil([]() { return activePeer >= 0; });
+
+  UNITY_BEGIN();
+  RUN_TEST(test_burst_on_one_relay_collapses_into_its_final_state);
+  RUN_TEST(test_taps_on_several_relays_share_one_write);
+  RUN_TEST(test_mtu_limits_the_frames_per_write);
+  RUN_TEST(test_refused_write_rolls_back_the_queued_relays);
+  RUN_TEST(test_bench_replayed_tap_sequences);
+  int failures = UNITY_END();
+
+  // The BLE worker, touch and radio threads never return
+  fflush(stdout);
+  std::_Exit(failures);
+}
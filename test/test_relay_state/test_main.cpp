@@ -0,0 +1,309 @@
+// Relay state model: the status frame parser, the FFE1 subscription through a
+// discovered or a cached handle, taps confirmed by the board's echo, the
+// query sent for a tap the board never confirmed (and never to a board that
+// does not report), the query that re-syncs a reporting board after a
+// reconnect, reconciliation that touches only the buttons that changed, and a
+// full re-sync as one write against a write per relay.
+
+#include "../../src/main.cpp"
+
+#include <native_ui.h>
+#include <unity.h>
+
+#include <vector>
+
+NativeBle::Peer* board = nullptr;
+
+static BlePeerLink& boardLink() {
+  return peerLinks[activePeer];
+}
+
+static MacAddress boardAddress() {
+  return MacAddress::fromPacked(NativeBle::packAddress(board->address));
+}
+
+static bool boardReady() {
+  int slot = blePoolFind(boardAddress());
+  return slot >= 0 && peerLinks[slot].state == LINK_READY;
+}
+
+// Writes of RELAY_QUERY_FRAME after the first `first` writes
+static int queriesSince(size_t first) {
+  std::vector<NativeBle::Write> writes = NativeBle::writesTo(*board);
+  int queries = 0;
+  for (size_t i = first; i < writes.size(); i++) {
+    queries += writes[i].data == std::vector<uint8_t>(RELAY_QUERY_FRAME.begin(), RELAY_QUERY_FRAME.end());
+  }
+  return queries;
+}
+
+// Connect again from scratch; with `cached` false the handle is rediscovered
+static void reconnectBoard(bool cached) {
+  if (activePeer >= 0) bleDisconnectPeer(activePeer);
+  TEST_ASSERT_TRUE(nativeLoopUntil([]() { return !board->connected; }));
+  if (!cached) saveCachedHandle(boardAddress(), 0, 0);
+  size_t first = NativeBle::writesTo(*board).size();
+  TEST_ASSERT_TRUE(bleConnect(boardAddress(), "RELAY_BOARD", "CONNECTED"));
+  TEST_ASSERT_TRUE(nativeLoopUntil([first]() { return boardReady() && NativeBle::writesTo(*board).size() > first; }));
+  NativeBle::waitIdle();
+  nativeLoopFor(20);
+}
+
+// The buttons the board's current state should show
+static uint8_t boardShown() {
+  uint8_t shown = 0;
+  for (int relay = 0; relay < relayConfig.count; relay++) {
+    if (board->relayOn & (1 << (bleRelayChannel(activePeer, relay) - 1))) shown |= 1 << relay;
+  }
+  return shown;
+}
+
+// Tap a relay button and wait for the click
+static void tapRelay(int relay) {
+  bool shown = relayShown & (1 << relay);
+  nativeTap(relayButtons[relay]);
+  TEST_ASSERT_TRUE(nativeLoopUntil([relay, shown]() { return (bool)(relayShown & (1 << relay)) != shown; }, 1000));
+}
+
+// Tap a relay button and wait until the board confirms it
+static void tapAndConfirm(int relay) {
+  BlePeerLink& link = boardLink();
+  tapRelay(relay);
+  TEST_ASSERT_TRUE(nativeLoopUntil([&link]() { return link.relayPending == 0 && link.relayQueueLength == 0; }, 1000));
+}
+
+void setUp(void) {
+  board->reportsStatus = true;
+  board->cccdHandle = 0x002B;
+  board->writeAckMs = 8;
+  if (!boardReady()) reconnectBoard(true);
+  nativeLoopUntil([]() { return boardLink().writesInFlight == 0 && boardLink().relayPending == 0; });
+  nativeLoopFor(RELAY_COALESCE_WINDOW_MS + 10);
+}
+
+void tearDown(void) {
+  if (!board->notifying || !board->reportsStatus || board->cccdHandle == 0) {
+    board->reportsStatus = true;
+    board->cccdHandle = 0x002B;
+    reconnectBoard(false);
+  }
+}
+
+void test_parser_reads_reports_and_skips_bad_frames(void) {
+  uint8_t known, on;
+  const uint8_t full[] = { 0xA0, 0xFF, 0x24, 0xC3 };
+  TEST_ASSERT_EQUAL(1, relayParseStatus(full, sizeof(full), known, on));
+  TEST_ASSERT_EQUAL_HEX8(0xFF, known);
+  TEST_ASSERT_EQUAL_HEX8(0x24, on);
+
+  // Echoes of two channels and, between them, a bad checksum, an unknown
+  // channel and a wrong header; a trailing partial frame is ignored
+  const uint8_t batch[] = { 0xA0, 0x03, 0x01, 0xA4,
+                            0xA0, 0x05, 0x01, 0x00,
+                            0xA0, 0x09, 0x01, 0xAA,
+                            0xB0, 0x06, 0x01, 0xB7,
+                            0xA0, 0x06, 0x00, 0xA6,
+                            0xA0, 0x07 };
+  TEST_ASSERT_EQUAL(2, relayParseStatus(batch, sizeof(batch), known, on));
+  TEST_ASSERT_EQUAL_HEX8(0x24, known);
+  TEST_ASSERT_EQUAL_HEX8(0x04, on);
+
+  // A later frame in the same notification wins for its channel
+  const uint8_t flip[] = { 0xA0, 0x02, 0x01, 0xA3, 0xA0, 0x02, 0x00, 0xA2 };
+  TEST_ASSERT_EQUAL(2, relayParseStatus(flip, sizeof(flip), known, on));
+  TEST_ASSERT_EQUAL_HEX8(0x02, known);
+  TEST_ASSERT_EQUAL_HEX8(0x00, on);
+}
+
+void test_subscription_with_discovered_and_cached_handle(void) {
+  reconnectBoard(false);
+  TEST_ASSERT_NOT_NULL(boardLink().characteristic);
+  TEST_ASSERT_TRUE(board->notifying);
+
+  // No BLERemoteCharacteristic: the CCCD comes from the attribute cache
+  reconnectBoard(true);
+  TEST_ASSERT_NULL(boardLink().characteristic);
+  TEST_ASSERT_TRUE(board->notifying);
+}
+
+void test_echo_confirms_the_tap(void) {
+  BlePeerLink& link = boardLink();
+  uint32_t reports = link.relayStatusReports;
+  bool on = !(relayShown & 0x04);
+  tapRelay(2);
+  TEST_ASSERT_EQUAL(on, (bool)(link.relayDesired & 0x04));
+
+  TEST_ASSERT_TRUE(nativeLoopUntil([&link]() { return link.relayPending == 0; }, 1000));
+  TEST_ASSERT_GREATER_THAN(reports, link.relayStatusReports);
+  TEST_ASSERT_EQUAL(on, (bool)(link.relayConfirmed & (1 << (bleRelayChannel(activePeer, 2) - 1))));
+  TEST_ASSERT_EQUAL(on, (bool)(board->relayOn & (1 << (bleRelayChannel(activePeer, 2) - 1))));
+}
+
+void test_unconfirmed_tap_is_followed_by_one_query(void) {
+  tapAndConfirm(0);  // The board has reported, so it may be queried
+  BlePeerLink& link = boardLink();
+  uint32_t queries = link.relayQueries;
+  size_t first = NativeBle::writesTo(*board).size();
+
+  // Writes still arrive, but the echo does not
+  board->notifying = false;
+  tapRelay(1);
+  nativeLoopFor(RELAY_CONFIRM_TIMEOUT_MS / 2);
+  TEST_ASSERT_EQUAL(0, queriesSince(first));
+
+  TEST_ASSERT_TRUE(nativeLoopUntil([&]() { return link.relayQueries > queries; }, RELAY_CONFIRM_TIMEOUT_MS + 200));
+  nativeLoopFor(RELAY_CONFIRM_TIMEOUT_MS * 2);
+  TEST_ASSERT_EQUAL(1, queriesSince(first));
+  TEST_ASSERT_EQUAL(queries + 1, link.relayQueries);
+}
+
+void test_board_that_never_reports_is_not_queried(void) {
+  board->reportsStatus = false;
+  peerRegistry.peers[peerRegistryFind(boardAddress())].reportsStatus = false;  // As a board never seen before
+  reconnectBoard(true);
+  size_t first = NativeBle::writesTo(*board).size();
+
+  tapRelay(3);
+  nativeLoopFor(RELAY_CONFIRM_TIMEOUT_MS * 2);
+  TEST_ASSERT_EQUAL(0, queriesSince(first));
+  TEST_ASSERT_EQUAL(0, boardLink().relayStatusReports);
+  TEST_ASSERT_EQUAL(1, NativeBle::writesTo(*board).size() - first);
+}
+
+void test_reconnect_starts_with_a_query(void) {
+  tapAndConfirm(0);
+  TEST_ASSERT_TRUE(peerRegistry.peers[peerRegistryFind(boardAddress())].reportsStatus);
+
+  // The link drops and relay 2's channel switches at the board meanwhile
+  NativeBle::dropLink(*board);
+  TEST_ASSERT_TRUE(nativeLoopUntil([]() { return !boardReady(); }, 1000));
+  size_t first = NativeBle::writesTo(*board).size();
+  board->relayOn ^= 1 << (relayConfig.relays[1].channel - 1);
+
+  // The reconnect policy brings it back; its first relay write is the query
+  TEST_ASSERT_TRUE(nativeLoopUntil([]() { return boardReady() && activePeer >= 0; }, 10000));
+  TEST_ASSERT_TRUE(nativeLoopUntil([]() { return relayShown == boardShown(); }, 1000));
+  NativeBle::waitIdle();
+  nativeLoopFor(20);
+  TEST_ASSERT_EQUAL(1, queriesSince(first));
+  TEST_ASSERT_EQUAL_HEX8(boardShown(), relayShown);
+  TEST_ASSERT_EQUAL_HEX8(board->relayOn, boardLink().relayConfirmed);
+}
+
+void test_board_without_a_cccd_still_takes_taps(void) {
+  board->cccdHandle = 0;
+  reconnectBoard(false);
+  TEST_ASSERT_FALSE(board->notifying);
+
+  size_t first = NativeBle::writesTo(*board).size();
+  bool on = !(relayShown & 0x01);
+  tapRelay(0);
+  TEST_ASSERT_TRUE(nativeLoopUntil([]() { return boardLink().writesInFlight == 0; }));
+  TEST_ASSERT_EQUAL(1, NativeBle::writesTo(*board).size() - first);
+  TEST_ASSERT_EQUAL(on, (bool)(board->relayOn & (1 << (bleRelayChannel(activePeer, 0) - 1))));
+}
+
+void test_query_reconciles_only_the_changed_buttons(void) {
+  // In step with the board first, whatever earlier tests left behind
+  bleRelayQuery(activePeer);
+  TEST_ASSERT_TRUE(nativeLoopUntil([]() { return relayShown == boardShown(); }, 1000));
+  NativeBle::waitIdle();
+  nativeLoopFor(20);
+  BlePeerLink& link = boardLink();
+  uint8_t shown = relayShown;
+
+  // Relay 3's channel switched at the board, with no report
+  uint8_t channel = 1 << (bleRelayChannel(activePeer, 2) - 1);
+  board->relayOn ^= channel;
+  bleRelayQuery(activePeer);
+  TEST_ASSERT_TRUE(nativeLoopUntil([shown]() { return relayShown != shown; }, 1000));
+  nativeLoopFor(20);
+  TEST_ASSERT_EQUAL_HEX8(shown ^ 0x04, relayShown);
+  TEST_ASSERT_EQUAL_HEX8(boardShown(), relayShown);
+  TEST_ASSERT_EQUAL((bool)(board->relayOn & channel), lv_obj_has_state(relayButtons[2], LV_STATE_CHECKED));
+  for (int relay = 0; relay < relayConfig.count; relay++) {
+    TEST_ASSERT_EQUAL((bool)(relayShown & (1 << relay)), lv_obj_has_state(relayButtons[relay], LV_STATE_CHECKED));
+  }
+  TEST_ASSERT_EQUAL_HEX8(board->relayOn, link.relayConfirmed);
+}
+
+void test_full_report_after_the_query_settles_a_lost_tap(void) {
+  tapAndConfirm(1);
+  BlePeerLink& link = boardLink();
+  uint32_t missed = link.relayMissedWrites;
+  uint8_t channel = 1 << (bleRelayChannel(activePeer, 1) - 1);
+  bool reported = link.relayConfirmed & channel;
+
+  // A tap the board never saw: an echo of another channel leaves it pending,
+  // the full report answering a query with no tap since settles it
+  link.relayDesired ^= 0x02;
+  link.relayPending |= 0x02;
+  relayRefreshButtons();
+  bleRelayApplyStatus(activePeer, 0x01, link.relayConfirmed & 0x01);
+  TEST_ASSERT_EQUAL_HEX8(0x02, link.relayPending & 0x02);
+
+  link.relayTapSinceQuery = false;
+  bleRelayApplyStatus(activePeer, RELAY_STATUS_ALL, link.relayConfirmed);
+  TEST_ASSERT_EQUAL(0, link.relayPending & 0x02);
+  TEST_ASSERT_EQUAL(missed + 1, link.relayMissedWrites);
+  TEST_ASSERT_EQUAL(reported, (bool)(relayShown & 0x02));
+}
+
+// Re-sync after the board changed behind the panel: one query against a write
+// per relay, and tap-to-confirm time over a run of taps
+void test_bench_resync_and_confirm(void) {
+  BlePeerLink& link = boardLink();
+  const int rounds = 10;
+  uint64_t queryUs = 0;
+  for (int i = 0; i < rounds; i++) {
+    for (int relay = 0; relay < relayConfig.count; relay++) board->relayOn ^= 1 << (bleRelayChannel(activePeer, relay) - 1);
+    uint8_t expected = boardShown();
+    uint32_t start = micros();
+    bleRelayQuery(activePeer);
+    TEST_ASSERT_TRUE(nativeLoopUntil([expected]() { return relayShown == expected; }, 1000));
+    queryUs += micros() - start;
+    NativeBle::waitIdle();
+  }
+  printf("re-sync of %d relays: 1 write of %zu bytes, %.2f ms to the buttons (a write per relay: %d writes, %d bytes)\n",
+         relayConfig.count, sizeof(RelayFrame), queryUs / 1000.0 / rounds, relayConfig.count,
+         relayConfig.count * (int)sizeof(RelayFrame));
+
+  const int taps = 20;
+  uint64_t confirmUs = 0, worstUs = 0;
+  for (int i = 0; i < taps; i++) {
+    nativeLoopFor(RELAY_COALESCE_WINDOW_MS + 10);
+    uint32_t start = micros();
+    tapAndConfirm(i % relayConfig.count);
+    uint64_t us = micros() - start;
+    confirmUs += us;
+    worstUs = max(worstUs, us);
+  }
+  printf("pen down to board confirmation at %lu ms per write: avg %.2f ms, worst %.2f ms; %lu queries, %lu missed writes\n",
+         (unsigned long)board->writeAckMs, confirmUs / 1000.0 / taps, worstUs / 1000.0,
+         (unsigned long)link.relayQueries, (unsigned long)link.relayMissedWrites);
+}
+
+int main(int argc, char** argv) {
+  NativeBle::Peer& relayBoard = NativeBle::addPeer(DEFAULT_TARGET1_MAC.packed(), "RELAY_BOARD");
+  relayBoard.reportsStatus = true;
+  board = &relayBoard;
+  nativeBoot();
+  nativeLoopUntil([]() { return activePeer >= 0; });
+
+  UNITY_BEGIN();
+  RUN_TEST(test_parser_reads_reports_and_skips_bad_frames);
+  RUN_TEST(test_subscription_with_discovered_and_cached_handle);
+  RUN_TEST(test_echo_confirms_the_tap);
+  RUN_TEST(test_unconfirmed_tap_is_followed_by_one_query);
+  RUN_TEST(test_board_that_never_reports_is_not_queried);
+  RUN_TEST(test_reconnect_starts_with_a_query);
+  RUN_TEST(test_board_without_a_cccd_still_takes_taps);
+  RUN_TEST(test_query_reconciles_only_the_changed_buttons);
+  RUN_TEST(test_full_report_after_the_query_settles_a_lost_tap);
+  RUN_TEST(test_bench_resync_and_confirm);
+  int failures = UNITY_END();
+
+  // The BLE worker, touch and radio threads never return
+  fflush(stdout);
+  std::_Exit(failures);
+}
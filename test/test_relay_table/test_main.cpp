@@ -0,0 +1,173 @@
+// Relay table: the default table builds the original six buttons, each button's
+// handler writes its entry's frame, the Relay5/Relay6 placeholders follow
+// channel 1, and tables that cannot be sent are rejected when loaded.
+
+#include "../../src/main.cpp"
+
+#include <native_ui.h>
+#include <unity.h>
+
+NativeBle::Peer* board = nullptr;
+
+static BlePeerLink& boardLink() {
+  return peerLinks[activePeer];
+}
+
+// Tap a relay button on screen and wait for the frame it writes
+static NativeBle::Write tapRelay(int relay) {
+  size_t writes = NativeBle::writesTo(*board).size();
+  nativeTap(relayButtons[relay]);
+  TEST_ASSERT_TRUE(nativeLoopUntil([writes]() { return NativeBle::writesTo(*board).size() > writes; }, 1000));
+  return NativeBle::writesTo(*board).back();
+}
+
+// Wait until the board has confirmed every tap
+static void settle() {
+  TEST_ASSERT_TRUE(nativeLoopUntil([]() {
+    return boardLink().relayPending == 0 && boardLink().relayQueueLength == 0 && boardLink().writesInFlight == 0;
+  }, 1000));
+  nativeLoopFor(RELAY_COALESCE_WINDOW_MS + 10);
+}
+
+// A valid table other than the default
+static RelayConfig customRelays() {
+  RelayConfig config = {};
+  config.count = 2;
+  config.relays[0] = { "Pump", 5, RELAY_FRAME_HEADER, RELAY_ACTIVE_PEER };
+  config.relays[1] = { "Lamp", 6, 0xB0, 0 };
+  return config;
+}
+
+void setUp(void) {
+  settle();
+}
+
+void tearDown(void) {
+  relayConfig = RELAY_DEFAULT_CONFIG;
+}
+
+void test_default_table_builds_the_six_original_buttons(void) {
+  const char* const labels[] = { "Relay1", "Relay2", "Relay3", "Relay4", "Relay5", "Relay6" };
+  TEST_ASSERT_EQUAL(6, relayConfig.count);
+  for (int relay = 0; relay < 6; relay++) {
+    TEST_ASSERT_NOT_NULL(relayButtons[relay]);
+    TEST_ASSERT_EQUAL_STRING(labels[relay], lv_label_get_text(lv_obj_get_child(relayButtons[relay], 0)));
+    TEST_ASSERT_TRUE(lv_obj_has_flag(relayButtons[relay], LV_OBJ_FLAG_CHECKABLE));
+  }
+
+  // Two rows of RELAY_COLUMNS
+  for (int relay = 1; relay < 6; relay++) {
+    bool sameRow = relay % RELAY_COLUMNS != 0;
+    TEST_ASSERT_EQUAL(sameRow, lv_obj_get_y(relayButtons[relay]) == lv_obj_get_y(relayButtons[relay - 1]));
+  }
+}
+
+void test_each_button_writes_its_table_frame(void) {
+  for (int relay = 0; relay < relayConfig.count; relay++) {
+    for (int tap = 0; tap < 2; tap++) {
+      bool on = !lv_obj_has_state(relayButtons[relay], LV_STATE_CHECKED);
+      NativeBle::Write write = tapRelay(relay);
+      RelayFrame frame = makeRelayFrame(RELAY_DEFAULT_CONFIG.relays[relay].channel, on);
+      TEST_ASSERT_EQUAL(sizeof(RelayFrame), write.data.size());
+      TEST_ASSERT_EQUAL_HEX8_ARRAY(frame.data(), write.data.data(), sizeof(RelayFrame));
+      TEST_ASSERT_EQUAL(on, lv_obj_has_state(relayButtons[relay], LV_STATE_CHECKED));
+      settle();
+    }
+  }
+}
+
+void test_placeholders_follow_channel_1(void) {
+  // Relay5 switches channel 1; the board's echo puts Relay1 and Relay6 in step
+  bool on = !lv_obj_has_state(relayButtons[4], LV_STATE_CHECKED);
+  tapRelay(4);
+  settle();
+  TEST_ASSERT_EQUAL(on, (bool)(board->relayOn & 0x01));
+  for (int relay : { 0, 4, 5 }) {
+    TEST_ASSERT_EQUAL(on, lv_obj_has_state(relayButtons[relay], LV_STATE_CHECKED));
+  }
+  TEST_ASSERT_EQUAL_HEX8(0, boardLink().relayPending);
+}
+
+void test_validation_rejects_tables_that_cannot_be_sent(void) {
+  TEST_ASSERT_TRUE(relayConfigValid(RELAY_DEFAULT_CONFIG));
+  TEST_ASSERT_TRUE(relayConfigValid(customRelays()));
+  TEST_ASSERT_TRUE(relayConfigValid(RelayConfig{}));  // Empty: stands for the default
+
+  RelayConfig config = customRelays();
+  config.count = RELAY_MAX + 1;
+  TEST_ASSERT_FALSE(relayConfigValid(config));
+
+  config = customRelays();
+  config.relays[1].channel = 0;
+  TEST_ASSERT_FALSE(relayConfigValid(config));
+
+  config = customRelays();
+  memset(config.relays[0].label, 'x', sizeof(config.relays[0].label));  // No terminator
+  TEST_ASSERT_FALSE(relayConfigValid(config));
+
+  config = customRelays();
+  config.relays[1].target = STORED_PEER_MAX;
+  TEST_ASSERT_FALSE(relayConfigValid(config));
+  config.relays[1].target = -2;
+  TEST_ASSERT_FALSE(relayConfigValid(config));
+  config.relays[1].target = STORED_PEER_MAX - 1;
+  TEST_ASSERT_TRUE(relayConfigValid(config));
+
+  // Entries past count are not looked at
+  config = customRelays();
+  config.relays[RELAY_MAX - 1].channel = 0;
+  TEST_ASSERT_TRUE(relayConfigValid(config));
+}
+
+void test_loading_takes_a_valid_table_and_keeps_the_default_otherwise(void) {
+  RelayConfig custom = customRelays();
+  TEST_ASSERT_TRUE(loadRelayConfig(custom));
+  TEST_ASSERT_EQUAL_MEMORY(&custom, &relayConfig, sizeof(relayConfig));
+  TEST_ASSERT_FALSE(relayConfigIsDefault(relayConfig));
+
+  // An empty stored table is the compiled default
+  TEST_ASSERT_TRUE(loadRelayConfig(RelayConfig{}));
+  TEST_ASSERT_TRUE(relayConfigIsDefault(relayConfig));
+
+  RelayConfig invalid = customRelays();
+  invalid.relays[0].channel = 0;
+  TEST_ASSERT_FALSE(loadRelayConfig(invalid));
+  TEST_ASSERT_TRUE(relayConfigIsDefault(relayConfig));
+}
+
+void test_loaded_table_drives_the_frames(void) {
+  // Entry 0 drives channel 5 of the active peer
+  TEST_ASSERT_TRUE(loadRelayConfig(customRelays()));
+  bleSendRelay(0, true);
+  settle();
+  RelayFrame frame = makeRelayFrame(5, true);
+  NativeBle::Write write = NativeBle::writesTo(*board).back();
+  TEST_ASSERT_EQUAL(sizeof(RelayFrame), write.data.size());
+  TEST_ASSERT_EQUAL_HEX8_ARRAY(frame.data(), write.data.data(), sizeof(RelayFrame));
+  TEST_ASSERT_TRUE(board->relayOn & (1 << 4));
+
+  bleSendRelay(0, false);
+  settle();
+  TEST_ASSERT_FALSE(board->relayOn & (1 << 4));
+}
+
+int main(int argc, char** argv) {
+  NativeBle::Peer& relayBoard = NativeBle::addPeer(DEFAULT_TARGET1_MAC.packed(), "RELAY_BOARD");
+  relayBoard.reportsStatus = true;
+  board = &relayBoard;
+  nativeBoot();
+  nativeLoopUntil([]() { return activePeer >= 0; });
+
+  UNITY_BEGIN();
+  RUN_TEST(test_default_table_builds_the_six_original_buttons);
+  RUN_TEST(test_each_button_writes_its_table_frame);
+  RUN_TEST(test_placeholders_follow_channel_1);
+  RUN_TEST(test_validation_rejects_tables_that_cannot_be_sent);
+  RUN_TEST(test_loading_takes_a_valid_table_and_keeps_the_default_otherwise);
+  RUN_TEST(test_loaded_table_drives_the_frames);
+  int failures = UNITY_END();
+
+  // The BLE worker, touch and radio threads never return
+  fflush(stdout);
+  std::_Exit(failures);
+}
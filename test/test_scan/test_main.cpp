@@ -0,0 +1,147 @@
+// Asynchronous list scan: results stream into the advertiser table and the
+// device list while loop() keeps running, a full queue drops results instead
+// of blocking the BLE stack, and a cancelled scan keeps what it found. The
+// clock is frozen and stepped once per loop() pass, so the firmware's scan
+// timings come out as pass counts; the host-time limits are in the benchmark.
+
+#include "../../src/main.cpp"
+
+#include <native_ui.h>
+#include <unity.h>
+
+#include <thread>
+
+#define TEST_ADVERTISERS 40
+#define TEST_PASS_MS 7  // Frozen-clock time per loop() pass
+
+// Run loop() with the clock stepped TEST_PASS_MS before each pass, until done()
+// holds or timeoutMs of host time has passed. Counts the passes.
+template <typename Done>
+static bool passesUntil(Done done, int& passes, uint32_t timeoutMs) {
+  return nativeLoopUntil([&]() {
+    if (done()) return true;
+    nativeClockAdvance(TEST_PASS_MS);
+    passes++;
+    return false;
+  }, timeoutMs);
+}
+
+// Wait without running loop(), as if it were stuck
+template <typename Done>
+static bool waitWithoutLoop(Done done, uint32_t timeoutMs) {
+  auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeoutMs);
+  while (!done()) {
+    if (std::chrono::steady_clock::now() >= deadline) return false;
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  return true;
+}
+
+void setUp(void) {
+  NativeBle::reset();
+  for (int i = 0; i < TEST_ADVERTISERS; i++) {
+    char name[20];
+    snprintf(name, sizeof(name), "Node-%02d", i);
+    NativeBle::addPeer(0x0A0B0C000000ull + i, name);
+  }
+  NativeBle::radio().scanSecondMs = 200;  // A 5 s scan lasts 1 s
+  for (Advertiser& slot : advertiserSlots) slot = Advertiser();
+  advertiserCount = 0;
+  show_bluetooth_screen();
+  nativeClockFreeze();
+}
+
+void tearDown(void) {
+  nativeClockRelease();
+  bleStopScan();
+  nativeLoopUntil([]() { return !isScanning && !listScanRunning; });
+}
+
+void test_results_stream_in_while_the_scan_runs(void) {
+  bleStartScan();
+  int passes = 0;
+  TEST_ASSERT_TRUE(passesUntil([]() { return advertiserCount > 0; }, passes, 1000));
+
+  // loop() kept running: the first results are listed while the scan goes on,
+  // on the pass that drained them
+  TEST_ASSERT_TRUE(isScanning);
+  TEST_ASSERT_TRUE(listScanRunning);
+  TEST_ASSERT_EQUAL(passes * TEST_PASS_MS, scanFirstResultMillis - scanStartMillis);
+  TEST_ASSERT_NULL(btView.placeholder);
+  TEST_ASSERT_FALSE(lv_obj_has_flag(btUi.deviceListRows[0], LV_OBJ_FLAG_HIDDEN));
+
+  // Every pass drains: the longest gap the firmware saw is one pass
+  TEST_ASSERT_TRUE(passesUntil([]() { return !isScanning; }, passes, 3000));
+  TEST_ASSERT_EQUAL(TEST_ADVERTISERS, advertiserCount);
+  TEST_ASSERT_EQUAL(TEST_PASS_MS, scanMaxLoopGapMs);
+  TEST_ASSERT_EQUAL_STRING("Scan", lv_label_get_text(btUi.scanButtonLabel));
+}
+
+void test_full_queue_drops_results_without_blocking_the_stack(void) {
+  bleStartScan();
+
+  // Nothing drains the queue while loop() does not run; the stack goes on
+  // delivering and onResult() drops what does not fit
+  TEST_ASSERT_TRUE(waitWithoutLoop([]() { return scanDroppedResults > 0; }, 3000));
+  TEST_ASSERT_EQUAL(SCAN_QUEUE_LENGTH, uxQueueMessagesWaiting(scanResultQueue));
+  TEST_ASSERT_EQUAL(0, advertiserCount);
+
+  // Repeated advertisements bring the dropped devices back once loop() drains
+  TEST_ASSERT_TRUE(nativeLoopUntil([]() { return !isScanning; }, 3000));
+  TEST_ASSERT_EQUAL(TEST_ADVERTISERS, advertiserCount);
+}
+
+void test_cancelled_scan_keeps_its_results(void) {
+  bleStartScan();
+  TEST_ASSERT_TRUE(nativeLoopUntil([]() { return advertiserCount >= 5; }, 1000));
+  bleStopScan();
+  TEST_ASSERT_TRUE(nativeLoopUntil([]() { return !isScanning && !listScanRunning; }, 1000));
+
+  int found = advertiserCount;
+  TEST_ASSERT_GREATER_OR_EQUAL(5, found);
+  nativeLoopFor(300);
+  TEST_ASSERT_EQUAL(found, advertiserCount);
+  TEST_ASSERT_EQUAL_STRING("Scan", lv_label_get_text(btUi.scanButtonLabel));
+}
+
+void test_rescan_refreshes_listed_devices_in_place(void) {
+  bleStartScan();
+  TEST_ASSERT_TRUE(nativeLoopUntil([]() { return !isScanning; }, 3000));
+  TEST_ASSERT_EQUAL(TEST_ADVERTISERS, advertiserCount);
+
+  // Devices heard within ADVERTISER_AGE_OUT_MS stay listed and are not added twice
+  bleStartScan();
+  TEST_ASSERT_NULL(btView.placeholder);
+  TEST_ASSERT_TRUE(nativeLoopUntil([]() { return !isScanning; }, 3000));
+  TEST_ASSERT_EQUAL(TEST_ADVERTISERS, advertiserCount);
+}
+
+// Time to first result and the longest loop() gap during a scan of 150 advertisers
+void test_bench_scan_latency(void) {
+  nativeClockRelease();
+  for (int i = TEST_ADVERTISERS; i < 150; i++) {
+    NativeBle::addPeer(0x0A0B0C000000ull + i, "Node");
+  }
+  bleStartScan();
+  TEST_ASSERT_TRUE(nativeLoopUntil([]() { return !isScanning; }, 3000));
+
+  printf("scan of 150: first result after %lu ms, max loop gap %lu ms, %u results dropped\n",
+         scanFirstResultMillis - scanStartMillis, scanMaxLoopGapMs, (unsigned int)scanDroppedResults);
+  TEST_ASSERT_EQUAL(150, advertiserCount);
+}
+
+int main(int argc, char** argv) {
+  nativeBoot(false);
+
+  UNITY_BEGIN();
+  RUN_TEST(test_results_stream_in_while_the_scan_runs);
+  RUN_TEST(test_full_queue_drops_results_without_blocking_the_stack);
+  RUN_TEST(test_cancelled_scan_keeps_its_results);
+  RUN_TEST(test_rescan_refreshes_listed_devices_in_place);
+  RUN_TEST(test_bench_scan_latency);
+  int failures = UNITY_END();
+
+  // The BLE worker, touch and radio threads never return
+  fflush(stdout);
+  std::_Exit(failures);
+}
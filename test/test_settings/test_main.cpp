@@ -0,0 +1,380 @@
+// Settings store: migration of the original firmware's keys into the blob,
+// the default relay table stored empty, the touch calibration kept across a
+// reboot, the handle cache of peers that are not stored read from RAM and
+// replacing its oldest entry when full, the boot read cost the same for one
+// stored peer as for STORED_PEER_MAX, a burst of changes committed once by
+// the timer or the shutdown handler, and click-handler and commit cost against
+// a file-backed Preferences.
+
+#include "../../src/main.cpp"
+
+#include <native_ui.h>
+#include <unity.h>
+
+#include <chrono>
+
+constexpr MacAddress PEER_A = MacAddress::parse("11:22:33:44:55:66");
+constexpr MacAddress PEER_B = MacAddress::parse("AA:BB:CC:DD:EE:01");
+
+// A relay table other than the default
+static RelayConfig customRelays() {
+  RelayConfig config = {};
+  config.count = 2;
+  config.relays[0] = { "Pump", 5, RELAY_FRAME_HEADER, RELAY_ACTIVE_PEER };
+  config.relays[1] = { "Lamp", 6, RELAY_FRAME_HEADER, 0 };
+  return config;
+}
+
+// Registry with PEER_A as Target1
+static PeerRegistry storedRegistry() {
+  PeerRegistry registry;
+  registry.count = 1;
+  registry.peers[0].address = PEER_A;
+  strlcpy(registry.peers[0].name, "PUMP BOARD", sizeof(registry.peers[0].name));
+  registry.peers[0].charHandle = 0x002A;
+  registry.peers[0].charProperties = ESP_GATT_CHAR_PROP_BIT_WRITE;
+  return registry;
+}
+
+// Write raw entries as the original firmware left them
+template <typename Write>
+static void writeNvs(Write write) {
+  Preferences prefs;
+  prefs.begin(NVS_NAMESPACE, false);
+  write(prefs);
+  prefs.end();
+}
+
+static bool nvsHasKey(const char* key) {
+  Preferences prefs;
+  prefs.begin(NVS_NAMESPACE, true);
+  bool has = prefs.isKey(key);
+  prefs.end();
+  return has;
+}
+
+// The stored blob
+static SettingsRecord storedRecord() {
+  SettingsRecord record = {};
+  Preferences prefs;
+  prefs.begin(NVS_NAMESPACE, true);
+  size_t length = prefs.getBytes(SETTINGS_KEY, &record, sizeof(record));
+  prefs.end();
+  TEST_ASSERT_EQUAL(settingsRecordBytes(record.peers.count), length);
+  TEST_ASSERT_EQUAL(SETTINGS_VERSION, record.version);
+  return record;
+}
+
+// Load as after a reboot, from what the file holds
+static void reboot() {
+  autoConnectEnabled = true;
+  touchCalibration = TOUCH_DEFAULT_CALIBRATION;
+  relayConfig = RELAY_DEFAULT_CONFIG;
+  peerRegistry = PeerRegistry();
+  NativeNvs::reboot();
+  loadSettings();
+}
+
+void setUp(void) {
+  settingsCommit();
+  NativeNvs::eraseAll();
+  settingsDirty = false;
+  handleCacheCount = 0;
+  handleCacheDirty = false;
+}
+
+void tearDown(void) {
+  touchCalibration = TOUCH_DEFAULT_CALIBRATION;
+  relayConfig = RELAY_DEFAULT_CONFIG;
+}
+
+void test_original_keys_fold_into_the_blob(void) {
+  writeNvs([&](Preferences& prefs) {
+    prefs.putBool(AUTOCONNECT_ENABLED_KEY, false);
+    prefs.putString(TARGET1_MAC_KEY, PEER_A.toString().c_str());
+    prefs.putString(TARGET2_MAC_KEY, PEER_B.toString().c_str());
+  });
+  reboot();
+
+  TEST_ASSERT_FALSE(autoConnectEnabled);
+  TEST_ASSERT_EQUAL(2, peerRegistry.count);
+  TEST_ASSERT_TRUE(peerRegistry.peers[0].address == PEER_A);
+  TEST_ASSERT_TRUE(peerRegistry.peers[1].address == PEER_B);
+  TEST_ASSERT_TRUE(relayConfigIsDefault(relayConfig));
+
+  // Rewritten as one blob, the old keys gone
+  SettingsRecord record = storedRecord();
+  TEST_ASSERT_FALSE(record.autoConnect);
+  TEST_ASSERT_EQUAL(2, record.peers.count);
+  TEST_ASSERT_EQUAL_MEMORY(&TOUCH_DEFAULT_CALIBRATION, &record.touch, sizeof(record.touch));
+  const char* oldKeys[] = { AUTOCONNECT_ENABLED_KEY, TARGET1_MAC_KEY, TARGET2_MAC_KEY };
+  for (const char* key : oldKeys) TEST_ASSERT_FALSE(nvsHasKey(key));
+}
+
+void test_unset_target2_is_not_stored(void) {
+  // The original firmware stored an unused Target2 as all zeros
+  writeNvs([&](Preferences& prefs) {
+    prefs.putString(TARGET1_MAC_KEY, PEER_A.toString().c_str());
+    prefs.putString(TARGET2_MAC_KEY, "00:00:00:00:00:00");
+  });
+  reboot();
+
+  TEST_ASSERT_TRUE(autoConnectEnabled);
+  TEST_ASSERT_TRUE(peerRegistry.peers[0].address == PEER_A);
+  TEST_ASSERT_EQUAL(1, storedRecord().peers.count);
+}
+
+void test_no_settings_at_all_store_the_default_target(void) {
+  reboot();
+  TEST_ASSERT_TRUE(autoConnectEnabled);
+  TEST_ASSERT_TRUE(peerRegistry.peers[0].address == DEFAULT_TARGET1_MAC);
+  TEST_ASSERT_EQUAL(1, storedRecord().peers.count);
+}
+
+void test_current_blob_is_read_without_a_rewrite(void) {
+  peerRegistry = storedRegistry();
+  peerRegistry.peers[0].reportsStatus = true;
+  relayConfig = customRelays();
+  settingsMarkDirty();
+  settingsCommit();
+  uint32_t commits = NativeNvs::flash().commits;
+
+  reboot();
+  TEST_ASSERT_EQUAL(commits, NativeNvs::flash().commits);
+  RelayConfig expected = customRelays();
+  TEST_ASSERT_EQUAL_MEMORY(&expected, &relayConfig, sizeof(relayConfig));
+  TEST_ASSERT_TRUE(peerRegistry.peers[0].address == PEER_A);
+  TEST_ASSERT_TRUE(peerRegistry.peers[0].reportsStatus);
+}
+
+void test_default_relay_table_is_stored_empty(void) {
+  relayConfig = RELAY_DEFAULT_CONFIG;
+  settingsMarkDirty();
+  settingsCommit();
+  TEST_ASSERT_EQUAL(0, storedRecord().relays.count);
+
+  // Read back as the compiled default
+  reboot();
+  TEST_ASSERT_TRUE(relayConfigIsDefault(relayConfig));
+}
+
+void test_invalid_relay_table_falls_back_to_the_default(void) {
+  relayConfig = customRelays();
+  relayConfig.relays[1].channel = 0;
+  settingsMarkDirty();
+  settingsCommit();
+
+  reboot();
+  TEST_ASSERT_TRUE(relayConfigIsDefault(relayConfig));
+  TEST_ASSERT_EQUAL(0, storedRecord().relays.count);  // Rewritten
+}
+
+void test_touch_calibration_survives_a_reboot(void) {
+  const TouchCalibration cal = { 0.07f, 0.002f, -12.5f, -0.001f, 0.09f, -20.0f };
+  saveTouchCalibration(cal);
+  TEST_ASSERT_TRUE(settingsDirty);
+  settingsCommit();
+  SettingsRecord record = storedRecord();
+  TEST_ASSERT_EQUAL_MEMORY(&cal, &record.touch, sizeof(cal));
+
+  reboot();
+  TEST_ASSERT_EQUAL_MEMORY(&cal, &touchCalibration, sizeof(cal));
+}
+
+void test_invalid_touch_calibration_falls_back_to_the_default(void) {
+  touchCalibration = { 0.07f, 0.0f, 0.0f, 0.07f, 0.0f, 0.0f };  // Both axes follow raw x
+  settingsMarkDirty();
+  settingsCommit();
+
+  reboot();
+  TEST_ASSERT_EQUAL_MEMORY(&TOUCH_DEFAULT_CALIBRATION, &touchCalibration, sizeof(touchCalibration));
+  SettingsRecord record = storedRecord();  // Rewritten
+  TEST_ASSERT_EQUAL_MEMORY(&TOUCH_DEFAULT_CALIBRATION, &record.touch, sizeof(record.touch));
+}
+
+// A peer that is not stored, for the handle cache
+static MacAddress unstoredPeer(int i) {
+  MacAddress mac = PEER_B;
+  mac.bytes[5] = 0x10 + i;
+  return mac;
+}
+
+void test_handle_cache_is_read_from_ram(void) {
+  saveCachedHandle(PEER_B, 0x002A, ESP_GATT_CHAR_PROP_BIT_WRITE_NR);
+  settingsCommit();
+  reboot();
+  TEST_ASSERT_EQUAL(1, handleCacheCount);
+
+  // No Preferences session while connecting
+  uint32_t sessions = NativeNvs::flash().sessions;
+  uint8_t properties = 0;
+  TEST_ASSERT_EQUAL_HEX16(0x002A, loadCachedHandle(PEER_B, properties));
+  TEST_ASSERT_EQUAL_HEX8(ESP_GATT_CHAR_PROP_BIT_WRITE_NR, properties);
+  TEST_ASSERT_EQUAL_HEX16(0, loadCachedHandle(PEER_A, properties));
+  TEST_ASSERT_EQUAL(sessions, NativeNvs::flash().sessions);
+
+  // Forgetting the handle removes the entry, and the blob with it
+  saveCachedHandle(PEER_B, 0, 0);
+  TEST_ASSERT_EQUAL(0, handleCacheCount);
+  settingsCommit();
+  TEST_ASSERT_FALSE(nvsHasKey(HANDLE_CACHE_KEY));
+}
+
+void test_full_handle_cache_replaces_the_oldest_entry(void) {
+  settingsCommit();
+  uint32_t commits = NativeNvs::flash().commits;
+  for (int i = 0; i <= HANDLE_CACHE_MAX; i++) {
+    saveCachedHandle(unstoredPeer(i), 0x0100 + i, ESP_GATT_CHAR_PROP_BIT_WRITE);
+  }
+  TEST_ASSERT_EQUAL(commits, NativeNvs::flash().commits);  // Nothing written inline
+  TEST_ASSERT_EQUAL(HANDLE_CACHE_MAX, handleCacheCount);
+
+  uint8_t properties;
+  TEST_ASSERT_EQUAL_HEX16(0, loadCachedHandle(unstoredPeer(0), properties));
+  for (int i = 1; i <= HANDLE_CACHE_MAX; i++) {
+    TEST_ASSERT_EQUAL_HEX16(0x0100 + i, loadCachedHandle(unstoredPeer(i), properties));
+  }
+
+  // Saving an entry again makes it the newest: the next replacement takes another
+  saveCachedHandle(unstoredPeer(1), 0x0201, ESP_GATT_CHAR_PROP_BIT_WRITE);
+  saveCachedHandle(unstoredPeer(HANDLE_CACHE_MAX + 1), 0x0300, ESP_GATT_CHAR_PROP_BIT_WRITE);
+  TEST_ASSERT_EQUAL_HEX16(0x0201, loadCachedHandle(unstoredPeer(1), properties));
+  TEST_ASSERT_EQUAL_HEX16(0, loadCachedHandle(unstoredPeer(2), properties));
+
+  // One commit writes the whole cache, read back in the same order
+  settingsCommit();
+  TEST_ASSERT_EQUAL(commits + 1, NativeNvs::flash().commits);
+  HandleCacheEntry saved[HANDLE_CACHE_MAX];
+  memcpy(saved, handleCache, sizeof(saved));
+  reboot();
+  TEST_ASSERT_EQUAL(HANDLE_CACHE_MAX, handleCacheCount);
+  TEST_ASSERT_EQUAL_MEMORY(saved, handleCache, sizeof(saved));
+}
+
+// NVS sessions, key lookups and bytes read by a boot with `peers` stored
+struct BootReadCost {
+  uint32_t sessions;
+  uint32_t reads;
+  uint32_t bytes;
+};
+
+static BootReadCost bootReadCost(int peers) {
+  NativeNvs::eraseAll();
+  peerRegistry = PeerRegistry();
+  peerRegistry.count = peers;
+  for (int i = 0; i < peers; i++) {
+    peerRegistry.peers[i].address = MacAddress::fromPacked(PEER_B.packed() + i);
+    snprintf(peerRegistry.peers[i].name, sizeof(peerRegistry.peers[i].name), "BOARD %d", i + 1);
+    peerRegistry.peers[i].charHandle = 0x002A;
+  }
+  settingsMarkDirty();
+  settingsCommit();
+
+  NativeNvs::Flash& flash = NativeNvs::flash();
+  BootReadCost before = { flash.sessions, flash.reads, flash.bytesRead };
+  reboot();
+  TEST_ASSERT_EQUAL(peers, peerRegistry.count);
+  TEST_ASSERT_TRUE(peerRegistry.peers[peers - 1].address == MacAddress::fromPacked(PEER_B.packed() + peers - 1));
+  return { flash.sessions - before.sessions, flash.reads - before.reads, flash.bytesRead - before.bytes };
+}
+
+void test_boot_reads_the_same_keys_for_any_number_of_peers(void) {
+  BootReadCost one = bootReadCost(1);
+  for (int peers = 2; peers <= STORED_PEER_MAX; peers++) {
+    BootReadCost cost = bootReadCost(peers);
+    TEST_ASSERT_EQUAL(one.sessions, cost.sessions);
+    TEST_ASSERT_EQUAL(one.reads, cost.reads);
+    if (peers == STORED_PEER_MAX) {
+      printf("boot NVS reads: %lu session(s), %lu key lookup(s), %lu bytes with 1 peer, %lu bytes with %d\n",
+             (unsigned long)cost.sessions, (unsigned long)cost.reads, (unsigned long)one.bytes,
+             (unsigned long)cost.bytes, peers);
+    }
+  }
+  TEST_ASSERT_EQUAL(1, one.sessions);
+}
+
+void test_burst_of_changes_is_one_commit(void) {
+  settingsCommit();
+  nativeLoopFor(50);
+  uint32_t commits = NativeNvs::flash().commits;
+  for (int i = 0; i < 10; i++) {
+    saveAutoConnectState(i % 2 == 0);
+    nativeLoopFor(50);
+  }
+  TEST_ASSERT_EQUAL(commits, NativeNvs::flash().commits);
+
+  TEST_ASSERT_TRUE(nativeLoopUntil([commits]() { return NativeNvs::flash().commits > commits; }, SETTINGS_COMMIT_DELAY_MS + 500));
+  nativeLoopFor(100);
+  TEST_ASSERT_EQUAL(commits + 1, NativeNvs::flash().commits);
+  TEST_ASSERT_FALSE(storedRecord().autoConnect);
+}
+
+void test_shutdown_handler_commits_pending_changes(void) {
+  settingsCommit();
+  uint32_t commits = NativeNvs::flash().commits;
+  peerRegistryStore(PEER_B, "LAMP BOARD");
+  TEST_ASSERT_TRUE(settingsDirty);
+
+  nativeRunShutdownHandlers();
+  TEST_ASSERT_EQUAL(commits + 1, NativeNvs::flash().commits);
+  TEST_ASSERT_FALSE(settingsDirty);
+  reboot();
+  TEST_ASSERT_GREATER_OR_EQUAL(0, peerRegistryFind(PEER_B));
+}
+
+// Click-handler time with the mirror, against one Preferences session per
+// click as before; and the cost of the commit that follows a burst
+void test_bench_handler_latency_and_commits(void) {
+  settingsCommit();
+  const int clicks = 200;
+
+  uint32_t commits = NativeNvs::flash().commits;
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < clicks; i++) saveAutoConnectState(i % 2 == 0);
+  double mirrorUs = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count() / clicks;
+  uint32_t mirrorCommits = NativeNvs::flash().commits - commits;
+
+  start = std::chrono::steady_clock::now();
+  settingsCommit();
+  double commitUs = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+
+  commits = NativeNvs::flash().commits;
+  start = std::chrono::steady_clock::now();
+  for (int i = 0; i < clicks; i++) {
+    writeNvs([i](Preferences& prefs) { prefs.putBool(AUTOCONNECT_ENABLED_KEY, i % 2 == 0); });
+  }
+  double sessionUs = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count() / clicks;
+  uint32_t sessionCommits = NativeNvs::flash().commits - commits;
+
+  printf("%d clicks: mirror %.2f us/click and %lu commits, then one %.1f us commit; session per click %.1f us/click and %lu commits\n",
+         clicks, mirrorUs, (unsigned long)mirrorCommits, commitUs, sessionUs, (unsigned long)sessionCommits);
+  TEST_ASSERT_EQUAL(0, mirrorCommits);
+  TEST_ASSERT_EQUAL(clicks, sessionCommits);
+}
+
+int main(int argc, char** argv) {
+  nativeBoot(false);
+  NativeNvs::flash().path = "test_settings_nvs.bin";  // Survives NativeNvs::reboot()
+
+  UNITY_BEGIN();
+  RUN_TEST(test_original_keys_fold_into_the_blob);
+  RUN_TEST(test_unset_target2_is_not_stored);
+  RUN_TEST(test_no_settings_at_all_store_the_default_target);
+  RUN_TEST(test_current_blob_is_read_without_a_rewrite);
+  RUN_TEST(test_default_relay_table_is_stored_empty);
+  RUN_TEST(test_invalid_relay_table_falls_back_to_the_default);
+  RUN_TEST(test_touch_calibration_survives_a_reboot);
+  RUN_TEST(test_invalid_touch_calibration_falls_back_to_the_default);
+  RUN_TEST(test_handle_cache_is_read_from_ram);
+  RUN_TEST(test_full_handle_cache_replaces_the_oldest_entry);
+  RUN_TEST(test_boot_reads_the_same_keys_for_any_number_of_peers);
+  RUN_TEST(test_burst_of_changes_is_one_commit);
+  RUN_TEST(test_shutdown_handler_commits_pending_changes);
+  RUN_TEST(test_bench_handler_latency_and_commits);
+  int failures = UNITY_END();
+  NativeNvs::eraseAll();
+
+  // The BLE worker, touch and radio threads never return
+  fflush(stdout);
+  std::_Exit(failures);
+}
@@ -0,0 +1,306 @@
+// Touch pipeline: TouchFilter on sample traces of a press and a drag, and the
+// sampler task against the scripted XPT2046: no reads while the panel is idle,
+// Z jitter that does not split a press, a release after TOUCH_RELEASE_SAMPLES
+// light samples, and pen-down-to-click latency; the calibration screen solving
+// a panel that is off from the default calibration.
+
+#include "../../src/main.cpp"
+
+#include <native_ui.h>
+#include <unity.h>
+
+#include <chrono>
+#include <vector>
+
+// A finger held still near raw (2004, 1803), with the jitter the panel shows
+// and one spike on each axis
+const int16_t PRESS_X[] = { 2012, 1998, 2021, 2005, 1987, 2016, 2003, 2750, 1995, 2019,
+                            2008, 1991, 2014, 2001, 1996, 2022, 2007, 1989, 2011, 2004 };
+const int16_t PRESS_Y[] = { 1803, 1811, 1794, 1807, 1815, 1790, 1802, 1809, 1797, 1813,
+                            1805, 1793, 1808, 1150, 1812, 1801, 1795, 1806, 1810, 1798 };
+#define PRESS_SAMPLES (sizeof(PRESS_X) / sizeof(PRESS_X[0]))
+#define PRESS_CENTRE_X 2004
+#define PRESS_CENTRE_Y 1803
+
+// A vertical drag of 100 raw units per sample, then held at the end
+const int16_t DRAG_X[] = { 1503, 1496, 1508, 1499, 1494, 1506, 1501, 1497, 1509, 1502,
+                           1495, 1504, 1498, 1507, 1500, 1493, 1505, 1499, 1502, 1497 };
+const int16_t DRAG_Y[] = { 1004, 1097, 1206, 1295, 1408, 1502, 1593, 1711, 1798, 1903,
+                           2006, 2094, 2207, 2301, 2398, 2402, 2396, 2405, 2399, 2401 };
+#define DRAG_SAMPLES (sizeof(DRAG_X) / sizeof(DRAG_X[0]))
+#define DRAG_STEPS 15  // Samples until the finger stops
+
+// A panel that is off from the default calibration: a little rotated, scaled and shifted
+const TouchCalibration SKEWED_PANEL = { 0.066f, 0.003f, -8.0f, -0.002f, 0.093f, -17.0f };
+
+// Let the queued touch script play out
+static void touchSettle() {
+  nativeLoopUntil([]() { return touchscreen.remaining() == 0 && !touchPointsPending(); }, 2000);
+  nativeLoopFor(50);
+}
+
+// Both calibrations put any raw reading on the same panel pixel, give or take one
+static void assertSameMapping(const TouchCalibration& expected, const TouchCalibration& cal) {
+  for (int rx = 200; rx <= 3800; rx += 400) {
+    for (int ry = 200; ry <= 3800; ry += 400) {
+      TEST_ASSERT_FLOAT_WITHIN(1.0f, expected.a * rx + expected.b * ry + expected.c, cal.a * rx + cal.b * ry + cal.c);
+      TEST_ASSERT_FLOAT_WITHIN(1.0f, expected.d * rx + expected.e * ry + expected.f, cal.d * rx + cal.e * ry + cal.f);
+    }
+  }
+}
+
+void setUp(void) {
+  uiLoadScreen(main_screen);
+  touchSettle();
+}
+
+void tearDown(void) {
+  uiLoadScreen(main_screen);
+  touchCalibration = TOUCH_DEFAULT_CALIBRATION;
+}
+
+void test_filter_seeds_on_the_first_sample(void) {
+  TouchFilter filter;
+  int16_t x, y;
+  filter.update(PRESS_X[0], PRESS_Y[0], x, y);
+  TEST_ASSERT_EQUAL(PRESS_X[0], x);
+  TEST_ASSERT_EQUAL(PRESS_Y[0], y);
+
+  // A new press does not drift from where the last one ended
+  filter.reset();
+  filter.update(DRAG_X[0], DRAG_Y[0], x, y);
+  TEST_ASSERT_EQUAL(DRAG_X[0], x);
+  TEST_ASSERT_EQUAL(DRAG_Y[0], y);
+}
+
+void test_filter_rejects_single_sample_spikes(void) {
+  TouchFilter filter;
+  for (size_t i = 0; i < PRESS_SAMPLES; i++) {
+    int16_t x, y;
+    filter.update(PRESS_X[i], PRESS_Y[i], x, y);
+    TEST_ASSERT_INT_WITHIN(25, PRESS_CENTRE_X, x);
+    TEST_ASSERT_INT_WITHIN(25, PRESS_CENTRE_Y, y);
+  }
+}
+
+void test_filter_reduces_jitter(void) {
+  TouchFilter filter;
+  int16_t rawMin = INT16_MAX, rawMax = INT16_MIN, outMin = INT16_MAX, outMax = INT16_MIN;
+  for (size_t i = 0; i < PRESS_SAMPLES; i++) {
+    int16_t x, y;
+    filter.update(PRESS_X[i], PRESS_Y[i], x, y);
+    if (i < 3 || PRESS_X[i] > 2500) continue;  // Settled samples; the spike is not jitter
+    rawMin = min(rawMin, PRESS_X[i]);
+    rawMax = max(rawMax, PRESS_X[i]);
+    outMin = min(outMin, x);
+    outMax = max(outMax, x);
+  }
+  printf("press trace: raw x spread %d, filtered %d\n", rawMax - rawMin, outMax - outMin);
+  TEST_ASSERT_LESS_OR_EQUAL((rawMax - rawMin) / 2, outMax - outMin);
+}
+
+void test_filter_follows_a_drag(void) {
+  TouchFilter filter;
+  int16_t x, y;
+  for (size_t i = 0; i < DRAG_SAMPLES; i++) {
+    filter.update(DRAG_X[i], DRAG_Y[i], x, y);
+    if (i < DRAG_STEPS) TEST_ASSERT_INT_WITHIN(300, DRAG_Y[i], y);  // At most three samples behind
+  }
+  TEST_ASSERT_INT_WITHIN(10, 2400, y);
+  TEST_ASSERT_INT_WITHIN(10, 1500, x);
+}
+
+void test_idle_panel_is_not_read(void) {
+  uint32_t reads = touchscreen.readCount();
+  nativeLoopFor(200);
+  TEST_ASSERT_EQUAL(reads, touchscreen.readCount());
+}
+
+// A press on relay 1's button, pressure[i] replacing the Z of the
+// i-th reading (0 keeps it); returns the number of times the button toggled
+static int pressRelayButton(std::vector<int16_t> pressure) {
+  int32_t x, y;
+  nativeObjectCentre(relayButtons[0], x, y);
+  std::vector<TouchSample> script;
+  for (int16_t z : pressure) {
+    TouchSample sample = nativeRawSample(x, y);
+    if (z) sample.z = z;
+    script.push_back(sample);
+  }
+  script.push_back(nativeRawSample(x, y, false));
+
+  int toggles = 0;
+  bool shown = relayShown & 0x01;
+  touchscreen.play(script);
+  nativeLoopUntil([&]() {
+    if ((bool)(relayShown & 0x01) != shown) {
+      shown = !shown;
+      toggles++;
+    }
+    return touchscreen.remaining() == 0 && !touchPointsPending();
+  }, 2000);
+  nativeLoopFor(50);
+  if ((bool)(relayShown & 0x01) != shown) toggles++;
+  return toggles;
+}
+
+void test_tap_toggles_once(void) {
+  uint32_t reads = touchscreen.readCount();
+  TEST_ASSERT_EQUAL(1, pressRelayButton({ 0, 0, 0, 0, 0, 0 }));
+
+  // The panel is read only while pressed, plus the samples that end the press
+  TEST_ASSERT_LESS_OR_EQUAL(10, touchscreen.readCount() - reads);
+}
+
+void test_z_jitter_does_not_split_a_press(void) {
+  const int16_t light = TOUCH_MIN_PRESSURE / 2;
+  std::vector<int16_t> pressure = { 0, 0, 0, 0 };
+  for (int i = 0; i < TOUCH_RELEASE_SAMPLES - 1; i++) pressure.push_back(light);
+  pressure.insert(pressure.end(), { 0, 0, 0, 0 });
+  TEST_ASSERT_EQUAL(1, pressRelayButton(pressure));
+}
+
+void test_light_first_contact_waits_for_pressure(void) {
+  const int16_t light = TOUCH_MIN_PRESSURE / 2;
+  TEST_ASSERT_EQUAL(1, pressRelayButton({ light, light, light, light, 0, 0, 0, 0 }));
+}
+
+void test_light_samples_end_a_press_while_penirq_stays_low(void) {
+  const int16_t light = TOUCH_MIN_PRESSURE / 2;
+  int32_t x, y;
+  nativeObjectCentre(relayButtons[0], x, y);
+  std::vector<TouchSample> script(5, nativeRawSample(x, y));
+  TouchSample lifted = nativeRawSample(x, y);
+  lifted.z = light;
+  script.insert(script.end(), TOUCH_RELEASE_SAMPLES + 10, lifted);
+  script.push_back(nativeRawSample(x, y, false));
+
+  // The click (on release) comes while light samples with the pen down are still queued
+  bool shown = relayShown & 0x01;
+  touchscreen.play(script);
+  TEST_ASSERT_TRUE(nativeLoopUntil([shown]() { return (bool)(relayShown & 0x01) != shown; }, 1000));
+  TEST_ASSERT_GREATER_OR_EQUAL(3, touchscreen.remaining());
+}
+
+void test_calibration_solve_recovers_the_panel(void) {
+  int16_t rawX[CALIBRATION_POINTS], rawY[CALIBRATION_POINTS], panelX[CALIBRATION_POINTS], panelY[CALIBRATION_POINTS];
+  for (int i = 0; i < CALIBRATION_POINTS; i++) {
+    TouchSample sample = nativeRawSample(CALIBRATION_TARGETS[i].x, CALIBRATION_TARGETS[i].y, true, SKEWED_PANEL);
+    rawX[i] = sample.x;
+    rawY[i] = sample.y;
+    panelX[i] = SCREEN_WIDTH - 1 - CALIBRATION_TARGETS[i].y;
+    panelY[i] = CALIBRATION_TARGETS[i].x;
+  }
+  TouchCalibration cal;
+  TEST_ASSERT_TRUE(touchCalibrationSolve(rawX, rawY, panelX, panelY, cal));
+  assertSameMapping(SKEWED_PANEL, cal);
+
+  // Three readings on one line leave the matrix undetermined
+  rawX[2] = rawX[0] + 2 * (rawX[1] - rawX[0]);
+  rawY[2] = rawY[0] + 2 * (rawY[1] - rawY[0]);
+  TEST_ASSERT_FALSE(touchCalibrationSolve(rawX, rawY, panelX, panelY, cal));
+}
+
+void test_long_press_on_the_title_calibrates_the_panel(void) {
+  // The title button is the main screen's second child, after the status dot
+  lv_obj_t * title = lv_obj_get_child(main_screen, 1);
+  lv_obj_send_event(title, LV_EVENT_LONG_PRESSED, NULL);
+  TEST_ASSERT_TRUE(lv_screen_active() == calibration_screen);
+  lv_obj_send_event(title, LV_EVENT_CLICKED, NULL);  // Ends the long press: stays
+  TEST_ASSERT_TRUE(lv_screen_active() == calibration_screen);
+
+  // Tap each target as the skewed panel reads it
+  for (int i = 0; i < CALIBRATION_POINTS; i++) {
+    TEST_ASSERT_EQUAL(i, calibrationUi.step);
+    touchscreen.play(nativeTapScript(CALIBRATION_TARGETS[i].x, CALIBRATION_TARGETS[i].y, 6, SKEWED_PANEL));
+    touchSettle();
+  }
+  TEST_ASSERT_TRUE(lv_screen_active() == main_screen);
+  assertSameMapping(SKEWED_PANEL, touchCalibration);
+  TEST_ASSERT_TRUE(settingsDirty);
+
+  // The sampler uses it from the next press: a tap where the panel reads a relay button hits it
+  int32_t x, y;
+  nativeObjectCentre(relayButtons[0], x, y);
+  bool shown = relayShown & 0x01;
+  touchscreen.play(nativeTapScript(x, y, 6, SKEWED_PANEL));
+  TEST_ASSERT_TRUE(nativeLoopUntil([shown]() { return (bool)(relayShown & 0x01) != shown; }, 1000));
+  touchSettle();
+  TEST_ASSERT_INT_WITHIN(1, SCREEN_WIDTH - 1 - y, touchLast.x);
+  TEST_ASSERT_INT_WITHIN(1, x, touchLast.y);
+
+  // Stored with the settings
+  settingsCommit();
+  SettingsRecord record = {};
+  Preferences prefs;
+  prefs.begin(NVS_NAMESPACE, true);
+  prefs.getBytes(SETTINGS_KEY, &record, sizeof(record));
+  prefs.end();
+  TEST_ASSERT_EQUAL_MEMORY(&touchCalibration, &record.touch, sizeof(record.touch));
+}
+
+void test_taps_on_one_spot_start_the_calibration_over(void) {
+  show_touch_calibration_screen();
+  for (int i = 0; i < CALIBRATION_POINTS; i++) {
+    touchscreen.play(nativeTapScript(CALIBRATION_TARGETS[0].x, CALIBRATION_TARGETS[0].y));
+    touchSettle();
+  }
+  TEST_ASSERT_TRUE(lv_screen_active() == calibration_screen);
+  TEST_ASSERT_EQUAL(0, calibrationUi.step);
+  TEST_ASSERT_EQUAL_MEMORY(&TOUCH_DEFAULT_CALIBRATION, &touchCalibration, sizeof(touchCalibration));
+}
+
+// Filter cost per sample, and pen down to the button's click through the task,
+// the ring and LVGL
+void test_bench_touch_latency(void) {
+  const int rounds = 200000;
+  TouchFilter filter;
+  volatile int16_t sink = 0;
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < rounds; i++) {
+    int16_t x, y;
+    if (i % PRESS_SAMPLES == 0) filter.reset();
+    filter.update(PRESS_X[i % PRESS_SAMPLES], PRESS_Y[i % PRESS_SAMPLES], x, y);
+    sink = sink + x;
+  }
+  auto filterNs = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+
+  const int taps = 20;
+  uint32_t total = 0, worst = 0;
+  for (int i = 0; i < taps; i++) {
+    nativeLoopFor(50);
+    bool shown = relayShown & 0x01;
+    uint32_t pressed = micros();
+    nativeTap(relayButtons[0]);
+    TEST_ASSERT_TRUE(nativeLoopUntil([shown]() { return (bool)(relayShown & 0x01) != shown; }, 1000));
+    uint32_t us = micros() - pressed;
+    total += us;
+    worst = max(worst, us);
+  }
+  printf("touch: filter %.1f ns per sample; pen down to click avg %.1f ms, worst %.1f ms (6-sample taps)\n",
+         (double)filterNs / rounds, total / 1000.0 / taps, worst / 1000.0);
+}
+
+int main(int argc, char** argv) {
+  nativeBoot(false);
+
+  UNITY_BEGIN();
+  RUN_TEST(test_filter_seeds_on_the_first_sample);
+  RUN_TEST(test_filter_rejects_single_sample_spikes);
+  RUN_TEST(test_filter_reduces_jitter);
+  RUN_TEST(test_filter_follows_a_drag);
+  RUN_TEST(test_idle_panel_is_not_read);
+  RUN_TEST(test_tap_toggles_once);
+  RUN_TEST(test_z_jitter_does_not_split_a_press);
+  RUN_TEST(test_light_first_contact_waits_for_pressure);
+  RUN_TEST(test_light_samples_end_a_press_while_penirq_stays_low);
+  RUN_TEST(test_calibration_solve_recovers_the_panel);
+  RUN_TEST(test_long_press_on_the_title_calibrates_the_panel);
+  RUN_TEST(test_taps_on_one_spot_start_the_calibration_over);
+  RUN_TEST(test_bench_touch_latency);
+  int failures = UNITY_END();
+
+  // The BLE worker, touch and radio threads never return
+  fflush(stdout);
+  std::_Exit(failures);
+}
@@ -0,0 +1,222 @@
+// Relay write transport: the write type follows FFE1's properties, the credit
+// window bounds unacknowledged writes in flight, congestion and lost
+// completions do not stall the link for good, and throughput and latency
+// against a board with configurable link delay.
+
+#include "../../src/main.cpp"
+
+#include <native_ui.h>
+#include <unity.h>
+
+#include <vector>
+
+NativeBle::Peer* board = nullptr;
+
+static BlePeerLink& boardLink() {
+  return peerLinks[activePeer];
+}
+
+static std::vector<NativeBle::Write> writesSince(size_t first) {
+  std::vector<NativeBle::Write> writes = NativeBle::writesTo(*board);
+  writes.erase(writes.begin(), writes.begin() + min(first, writes.size()));
+  return writes;
+}
+
+// (Re)connect with FFE1 advertising `properties`. The cached handle is
+// dropped so discovery reads them.
+static void connectBoard(uint8_t properties) {
+  MacAddress address = MacAddress::fromPacked(NativeBle::packAddress(board->address));
+  if (activePeer >= 0) bleDisconnectPeer(activePeer);
+  TEST_ASSERT_TRUE(nativeLoopUntil([]() { return !board->connected; }));
+  saveCachedHandle(address, 0, 0);
+  board->charProperties = properties | ESP_GATT_CHAR_PROP_BIT_NOTIFY;
+
+  size_t first = NativeBle::writesTo(*board).size();
+  TEST_ASSERT_TRUE(bleConnect(address, "RELAY_BOARD", "CONNECTED"));
+  TEST_ASSERT_TRUE(nativeLoopUntil([first]() { return NativeBle::writesTo(*board).size() > first; }));  // The hello
+}
+
+void setUp(void) {
+  board->writeAckMs = 8;
+  nativeLoopUntil([]() { return boardLink().relayQueueLength == 0 && boardLink().writesInFlight == 0; });
+  nativeLoopFor(RELAY_COALESCE_WINDOW_MS + 10);
+}
+
+void tearDown(void) {
+  nativeClockRelease();
+  if (activePeer >= 0 && boardLink().charProperties != (ESP_GATT_CHAR_PROP_BIT_WRITE | ESP_GATT_CHAR_PROP_BIT_WRITE_NR)) {
+    connectBoard(ESP_GATT_CHAR_PROP_BIT_WRITE | ESP_GATT_CHAR_PROP_BIT_WRITE_NR);
+  }
+}
+
+void test_write_type_follows_the_characteristic(void) {
+  // Factory board: FFE1 takes both; the hello is acknowledged, relay frames are not
+  TEST_ASSERT_TRUE(bleRelayWriteNoResponse(activePeer));
+  size_t first = NativeBle::writesTo(*board).size();
+  bleSendRelay(0, true);
+  bleSendDataTo(activePeer, "PING");
+  TEST_ASSERT_TRUE(nativeLoopUntil([first]() { return writesSince(first).size() >= 2; }));
+  std::vector<NativeBle::Write> writes = writesSince(first);
+  TEST_ASSERT_FALSE(writes[0].response);
+  TEST_ASSERT_TRUE(writes[1].response);
+
+  // Acknowledged writes only: relay frames fall back to them
+  connectBoard(ESP_GATT_CHAR_PROP_BIT_WRITE);
+  TEST_ASSERT_FALSE(bleRelayWriteNoResponse(activePeer));
+  nativeLoopFor(RELAY_COALESCE_WINDOW_MS + 10);
+  first = NativeBle::writesTo(*board).size();
+  bleSendRelay(0, false);
+  TEST_ASSERT_TRUE(nativeLoopUntil([first]() { return writesSince(first).size() >= 1; }));
+  TEST_ASSERT_TRUE(writesSince(first)[0].response);
+}
+
+void test_credit_window_bounds_writes_in_flight(void) {
+  board->writeAckMs = 100;
+  BlePeerLink& link = boardLink();
+  uint32_t stalls = link.creditStalls;
+  size_t first = NativeBle::writesTo(*board).size();
+
+  // One write per flush until the credits run out; the rest stays queued
+  for (int channel = 1; channel <= 6; channel++) {
+    bleQueueRelayFrame(activePeer, makeRelayFrame(channel, true));
+    bleFlushRelayQueue(activePeer);
+  }
+  TEST_ASSERT_EQUAL(RELAY_WRITE_CREDITS, link.writesInFlight);
+  TEST_ASSERT_EQUAL(0, bleWriteCreditsAvailable(activePeer));
+  TEST_ASSERT_EQUAL(6 - RELAY_WRITE_CREDITS, link.relayQueueLength);
+  TEST_ASSERT_EQUAL(stalls + 2, link.creditStalls);
+
+  // Completions return credits and the remainder goes out in one write
+  TEST_ASSERT_TRUE(nativeLoopUntil([&]() { return link.relayQueueLength == 0; }));
+  std::vector<NativeBle::Write> writes = writesSince(first);
+  TEST_ASSERT_EQUAL(RELAY_WRITE_CREDITS + 1, writes.size());
+  TEST_ASSERT_EQUAL(2 * sizeof(RelayFrame), writes.back().data.size());
+  TEST_ASSERT_TRUE(nativeLoopUntil([]() { return (board->relayOn & 0x3F) == 0x3F; }));
+}
+
+void test_acknowledged_writes_go_one_at_a_time(void) {
+  connectBoard(ESP_GATT_CHAR_PROP_BIT_WRITE);
+  nativeLoopFor(RELAY_COALESCE_WINDOW_MS + 10);
+  board->writeAckMs = 100;
+  BlePeerLink& link = boardLink();
+
+  bleQueueRelayFrame(activePeer, makeRelayFrame(1, false));
+  bleQueueRelayFrame(activePeer, makeRelayFrame(2, false));
+  bleFlushRelayQueue(activePeer);
+  TEST_ASSERT_EQUAL(1, link.writesInFlight);
+  TEST_ASSERT_EQUAL(1, link.relayQueueLength);
+  TEST_ASSERT_TRUE(nativeLoopUntil([&]() { return link.relayQueueLength == 0; }));
+  TEST_ASSERT_TRUE(nativeLoopUntil([]() { return (board->relayOn & 0x03) == 0; }));
+}
+
+void test_congestion_holds_frames_until_it_clears(void) {
+  BlePeerLink& link = boardLink();
+  NativeBle::congest(*board, true);
+  TEST_ASSERT_TRUE(nativeLoopUntil([&]() { return link.congested; }));
+
+  size_t first = NativeBle::writesTo(*board).size();
+  uint32_t stalls = link.creditStalls;
+  bleSendRelay(0, true);
+  nativeLoopFor(100);
+  TEST_ASSERT_EQUAL(1, link.relayQueueLength);
+  TEST_ASSERT_GREATER_THAN(stalls, link.creditStalls);
+  TEST_ASSERT_EQUAL(0, writesSince(first).size());
+
+  NativeBle::congest(*board, false);
+  TEST_ASSERT_TRUE(nativeLoopUntil([first]() { return writesSince(first).size() == 1; }));
+  TEST_ASSERT_EQUAL(0, link.relayQueueLength);
+}
+
+void test_missing_completions_are_reclaimed(void) {
+  board->writeAckMs = 1000;  // The completion arrives long after the credit timeout
+  BlePeerLink& link = boardLink();
+  bleSendRelay(1, true);
+  TEST_ASSERT_EQUAL(1, link.writesInFlight);
+
+  nativeClockFreeze();
+  TEST_ASSERT_EQUAL(RELAY_WRITE_CREDITS - 1, bleWriteCreditsAvailable(activePeer));
+  nativeClockAdvance(WRITE_CREDIT_TIMEOUT_MS + 1);
+  TEST_ASSERT_EQUAL(RELAY_WRITE_CREDITS, bleWriteCreditsAvailable(activePeer));
+  TEST_ASSERT_EQUAL(0, link.writesInFlight);
+  nativeClockRelease();
+
+  // The late completions (the tap's, and the query sent when it went
+  // unconfirmed) do not take the count below zero
+  TEST_ASSERT_TRUE(nativeLoopUntil([]() { return board->relayOn & 0x02; }, 2000));
+  TEST_ASSERT_TRUE(NativeBle::waitIdle(3000));
+  nativeLoopFor(20);
+  TEST_ASSERT_EQUAL(0, link.writesInFlight);
+}
+
+// Taps every 15 ms across the four relays, against a board taking ackMs per write
+static void measure(const char* mode, uint32_t ackMs) {
+  const int taps = 24;
+  board->writeAckMs = ackMs;
+  nativeLoopFor(RELAY_COALESCE_WINDOW_MS + 10);
+
+  BlePeerLink& link = boardLink();
+  size_t first = NativeBle::writesTo(*board).size();
+  uint32_t stalls = link.creditStalls;
+  std::vector<uint64_t> tapMicros;
+  std::vector<uint8_t> tapChannels;
+  for (int i = 0; i < taps; i++) {
+    if (i > 0) nativeLoopUntilTap(15);
+    int relay = i % 4;
+    tapMicros.push_back(micros());
+    tapChannels.push_back(bleRelayChannel(activePeer, relay));
+    bleSendRelay(relay, !(link.relayDesired & (1 << relay)));
+  }
+
+  uint8_t expected = 0;
+  for (int relay = 0; relay < 4; relay++) {
+    if (link.relayDesired & (1 << relay)) expected |= 1 << (bleRelayChannel(activePeer, relay) - 1);
+  }
+  TEST_ASSERT_TRUE(nativeLoopUntil([&]() { return link.relayQueueLength == 0 && (board->relayOn & 0x0F) == expected; }, 5000));
+  double elapsedMs = (micros() - tapMicros.front()) / 1000.0;
+
+  std::vector<NativeBle::Write> writes = writesSince(first);
+  uint64_t worstUs = 0, totalUs = 0;
+  for (int i = 0; i < taps; i++) {
+    for (const NativeBle::Write& write : writes) {
+      bool carries = false;
+      for (size_t f = 0; f + sizeof(RelayFrame) <= write.data.size(); f += sizeof(RelayFrame)) {
+        carries |= write.data[f + 1] == tapChannels[i];
+      }
+      if (write.micros < tapMicros[i] || !carries) continue;
+      worstUs = max<uint64_t>(worstUs, write.micros - tapMicros[i]);
+      totalUs += write.micros - tapMicros[i];
+      break;
+    }
+  }
+  printf("%-13s link %3lu ms: %d taps in %2zu writes, %3lu credit stalls, %5.1f taps/s; tap-to-write avg %5.1f ms, worst %5.1f ms\n",
+         mode, (unsigned long)ackMs, taps, writes.size(), (unsigned long)(link.creditStalls - stalls),
+         taps * 1000.0 / elapsedMs, totalUs / 1000.0 / taps, worstUs / 1000.0);
+}
+
+void test_bench_throughput_under_link_delay(void) {
+  const uint32_t delays[] = { 8, 30, 75 };
+  for (uint32_t ackMs : delays) measure("no response", ackMs);
+  connectBoard(ESP_GATT_CHAR_PROP_BIT_WRITE);
+  for (uint32_t ackMs : delays) measure("with response", ackMs);
+}
+
+int main(int argc, char** argv) {
+  NativeBle::Peer& relayBoard = NativeBle::addPeer(DEFAULT_TARGET1_MAC.packed(), "RELAY_BOARD");
+  relayBoard.reportsStatus = true;
+  board = &relayBoard;
+  nativeBoot();
+  nativeLoopUntil([]() { return activePeer >= 0; });
+
+  UNITY_BEGIN();
+  RUN_TEST(test_write_type_follows_the_characteristic);
+  RUN_TEST(test_credit_window_bounds_writes_in_flight);
+  RUN_TEST(test_acknowledged_writes_go_one_at_a_time);
+  RUN_TEST(test_congestion_holds_frames_until_it_clears);
+  RUN_TEST(test_missing_completions_are_reclaimed);
+  RUN_TEST(test_bench_throughput_under_link_delay);
+  int failures = UNITY_END();
+
+  // The BLE worker, touch and radio threads never return
+  fflush(stdout);
+  std::_Exit(failures);
+}